@@ -0,0 +1,299 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <bvh.h>
+#include <job_system.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+Headless test of the bounding volume hierarchy (bvh.h). No window or OpenGL context is created: trees are built over
+synthetic boxes, on one thread and on the job system, and every frustum, sphere and ray query is compared with a brute
+force pass over all the boxes. The scenes include an empty one, a single box, boxes that all share a center, a scene
+large enough for the parallel build, and a chain of boxes spaced further and further apart, whose tree comes out
+several times deeper than the others; every tree has to stay shallow enough for the traversal stack. Every scene is
+checked again after the boxes move and Refit() updates the tree.
+usage: BVHTest [boxes] [queries] [seed]
+*/
+
+// same slab test as the tree: entry distance of the ray into the box, false when it misses within maxDistance
+bool bruteRayBox(const AABB& box, const Ray& ray, float maxDistance, float& entry)
+{
+    glm::vec3 inverse = glm::vec3(1.0f) / ray.Direction;
+    float tNear = 0.0f, tFar = maxDistance;
+    for (int a = 0; a < 3; a++)
+    {
+        float t0 = (box.Min[a] - ray.Origin[a]) * inverse[a];
+        float t1 = (box.Max[a] - ray.Origin[a]) * inverse[a];
+        tNear = std::max(tNear, std::min(t0, t1));
+        tFar = std::min(tFar, std::max(t0, t1));
+    }
+    entry = tNear;
+    return tNear <= tFar;
+}
+
+bool bruteSphere(const AABB& box, const BoundingSphere& sphere)
+{
+    glm::vec3 closest = glm::max(box.Min, glm::min(sphere.Center, box.Max));
+    glm::vec3 d = closest - sphere.Center;
+    return glm::dot(d, d) <= sphere.Radius * sphere.Radius;
+}
+
+// how far inside the frustum the box reaches: negative when some plane has it wholly outside
+float frustumMargin(const Frustum& frustum, const AABB& box)
+{
+    glm::vec3 center = box.Center(), extent = box.Extent();
+    float margin = FLT_MAX;
+    for (int i = 0; i < 6; i++)
+    {
+        const glm::vec4& p = frustum.Planes[i];
+        float distance = p.x * center.x + p.y * center.y + p.z * center.z + p.w;
+        float radius = std::abs(p.x) * extent.x + std::abs(p.y) * extent.y + std::abs(p.z) * extent.z;
+        margin = std::min(margin, distance + radius);
+    }
+    return margin;
+}
+
+bool contains(const glm::vec3& min, const glm::vec3& max, const AABB& box)
+{
+    for (int a = 0; a < 3; a++)
+        if (box.Min[a] < min[a] || box.Max[a] > max[a])
+            return false;
+    return true;
+}
+
+// levels of inner nodes below the root of the 4-wide tree
+int treeDepth(const BVH& bvh, int node)
+{
+    int depth = 0;
+    for (int k = 0; k < 4; k++)
+        if (bvh.Nodes[node].Child[k] >= 0 && bvh.Nodes[node].Count[k] == 0)
+            depth = std::max(depth, 1 + treeDepth(bvh, bvh.Nodes[node].Child[k]));
+    return depth;
+}
+
+// checks the layout of a built tree: every object in exactly one leaf, every slot box around what is under it
+int checkTree(const BVH& bvh, const std::string& name)
+{
+    int failures = 0;
+    std::vector<unsigned int> seen(bvh.Bounds.size(), 0);
+    unsigned int loose = 0;
+    for (const BVH::Node& node : bvh.Nodes)
+        for (int k = 0; k < 4; k++)
+        {
+            if (node.Child[k] < 0)
+                continue;
+            glm::vec3 slotMin(node.MinX[k], node.MinY[k], node.MinZ[k]), slotMax(node.MaxX[k], node.MaxY[k], node.MaxZ[k]);
+            std::vector<unsigned int> under;
+            if (node.Count[k] > 0)
+                for (unsigned int i = 0; i < node.Count[k]; i++)
+                {
+                    seen[bvh.Objects[node.Child[k] + i]]++;
+                    under.push_back(bvh.Objects[node.Child[k] + i]);
+                }
+            else
+            {
+                const BVH::Node& child = bvh.Nodes[node.Child[k]];
+                for (int c = 0; c < 4; c++)
+                    if (child.Child[c] >= 0)
+                    {
+                        AABB box(glm::vec3(child.MinX[c], child.MinY[c], child.MinZ[c]), glm::vec3(child.MaxX[c], child.MaxY[c], child.MaxZ[c]));
+                        if (!contains(slotMin, slotMax, box))
+                            loose++;
+                    }
+            }
+            for (unsigned int object : under)
+                if (!contains(slotMin, slotMax, bvh.Bounds[object]))
+                    loose++;
+        }
+    unsigned int wrong = 0;
+    for (unsigned int count : seen)
+        wrong += count == 1 ? 0 : 1;
+    if (wrong > 0 || loose > 0)
+    {
+        std::cout << name << ": " << wrong << " objects not in exactly one leaf, " << loose << " boxes outside their slot" << std::endl;
+        failures++;
+    }
+    if (!bvh.Nodes.empty() && 3 * treeDepth(bvh, 0) + 1 > BVH::STACK_SIZE)
+    {
+        std::cout << name << ": " << treeDepth(bvh, 0) << " levels, more than a " << BVH::STACK_SIZE << " entry traversal stack holds" << std::endl;
+        failures++;
+    }
+    return failures;
+}
+
+// runs the queries against the brute force answers; returns the failures
+int checkQueries(const BVH& bvh, const AABB& scene, unsigned int queries, std::mt19937& rng, const std::string& name)
+{
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const std::vector<AABB>& boxes = bvh.Bounds;
+    glm::vec3 sceneSize = scene.Max - scene.Min;
+    float sceneScale = std::max(sceneSize.x, std::max(sceneSize.y, sceneSize.z)) + 1.0f;
+    auto randomPoint = [&](float margin) { return scene.Min - glm::vec3(margin) + glm::vec3(unit(rng), unit(rng), unit(rng)) * (sceneSize + glm::vec3(2.0f * margin)); };
+    unsigned int frustumMisses = 0, sphereMisses = 0, rayMisses = 0;
+
+    for (unsigned int q = 0; q < queries; q++)
+    {
+        // frustum from a random point looking at another; boxes within a hair of a plane may go either way
+        glm::vec3 eye = randomPoint(sceneScale * 0.2f), target = randomPoint(0.0f);
+        if (glm::length(target - eye) < 1e-3f * sceneScale)
+            target = eye + glm::vec3(0.0f, 0.0f, -1.0f);
+        glm::vec3 up = std::abs(glm::normalize(target - eye).y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 projection = glm::perspective(glm::radians(20.0f + unit(rng) * 70.0f), 0.5f + unit(rng) * 1.5f, sceneScale * 0.01f, sceneScale * (0.1f + unit(rng)));
+        Frustum frustum(projection * glm::lookAt(eye, target, up));
+        std::vector<unsigned int> result;
+        bvh.Query(frustum, result);
+        std::vector<unsigned int> hits(boxes.size(), 0);
+        for (unsigned int object : result)
+            hits[object]++;
+        for (unsigned int i = 0; i < boxes.size(); i++)
+        {
+            float margin = frustumMargin(frustum, boxes[i]);
+            bool inside = frustum.Intersects(boxes[i]);
+            if (hits[i] > 1 || (hits[i] == 1 && !inside) || (hits[i] == 0 && inside && margin > 1e-5f * sceneScale))
+                frustumMisses++;
+        }
+
+        // sphere, exact: the tree tests the same closest point as the brute force
+        BoundingSphere sphere;
+        sphere.Center = randomPoint(sceneScale * 0.1f);
+        sphere.Radius = unit(rng) * unit(rng) * sceneScale * 0.5f;
+        result.clear();
+        bvh.Query(sphere, result);
+        std::fill(hits.begin(), hits.end(), 0);
+        for (unsigned int object : result)
+            hits[object]++;
+        for (unsigned int i = 0; i < boxes.size(); i++)
+            if (hits[i] != (bruteSphere(boxes[i], sphere) ? 1u : 0u))
+                sphereMisses++;
+
+        // ray, from outside or inside the boxes, some along an axis, some cut short: the nearest entry has to match
+        glm::vec3 direction;
+        if (q % 5 == 0)
+        {
+            direction = glm::vec3(0.0f);
+            direction[q / 5 % 3] = q % 2 ? 1.0f : -1.0f;
+        }
+        else
+            direction = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) * 2.0f - glm::vec3(1.0f));
+        Ray ray(randomPoint(sceneScale * 0.2f), direction);
+        if (q % 3 == 0)
+            ray.Direction = glm::normalize(randomPoint(0.0f) - ray.Origin);
+        float maxDistance = q % 4 == 0 ? unit(rng) * sceneScale : FLT_MAX;
+        RayHit hit = bvh.Raycast(ray, maxDistance);
+        int nearest = -1;
+        float nearestDistance = maxDistance, entry;
+        for (unsigned int i = 0; i < boxes.size(); i++)
+            if (bruteRayBox(boxes[i], ray, nearestDistance, entry) && (nearest < 0 || entry < nearestDistance))
+            {
+                nearest = (int)i;
+                nearestDistance = entry;
+            }
+        float tolerance = 1e-5f * sceneScale;
+        if ((hit.Object < 0) != (nearest < 0))
+            rayMisses++;
+        else if (nearest >= 0)
+        {
+            // ties may resolve to another box, but the reported box has to be entered at the reported distance
+            bool entered = bruteRayBox(boxes[hit.Object], ray, maxDistance, entry);
+            if (!entered || std::abs(entry - hit.Distance) > tolerance || std::abs(hit.Distance - nearestDistance) > tolerance)
+                rayMisses++;
+        }
+    }
+
+    if (frustumMisses > 0 || sphereMisses > 0 || rayMisses > 0)
+    {
+        std::cout << name << ": " << frustumMisses << " frustum, " << sphereMisses << " sphere and " << rayMisses << " ray results differ from brute force"
+                  << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+std::vector<AABB> makeBoxes(const std::string& kind, unsigned int count, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<AABB> boxes;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        glm::vec3 center, extent(0.05f + unit(rng), 0.05f + unit(rng), 0.05f + unit(rng));
+        if (kind == "coincident")
+            center = glm::vec3(3.0f, -2.0f, 1.0f);
+        else if (kind == "chain")
+        {
+            // each box 1.2 times further out than the last, so SAH keeps splitting off the few farthest ones
+            center = glm::vec3(std::pow(1.2f, (float)i), unit(rng), unit(rng));
+            extent = glm::vec3(0.5f);
+        }
+        else
+            center = glm::vec3(unit(rng), unit(rng), unit(rng)) * 100.0f - glm::vec3(50.0f);
+        boxes.push_back(AABB(center - extent, center + extent));
+    }
+    return boxes;
+}
+
+AABB sceneBounds(const std::vector<AABB>& boxes)
+{
+    if (boxes.empty())
+        return AABB(glm::vec3(-1.0f), glm::vec3(1.0f));
+    AABB scene = boxes[0];
+    for (const AABB& box : boxes)
+        scene = AABB(glm::min(scene.Min, box.Min), glm::max(scene.Max, box.Max));
+    return scene;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int boxCount = argc > 1 ? (unsigned int)std::atoi(argv[1]) : 2000;
+    unsigned int queries = argc > 2 ? (unsigned int)std::atoi(argv[2]) : 300;
+    std::mt19937 rng(argc > 3 ? (unsigned int)std::atoi(argv[3]) : 30);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    int failures = 0;
+
+    JobSystem jobs;
+    struct Scene
+    {
+        std::string Kind;
+        unsigned int Count;
+    };
+    // the chain stops before 1.2^i times the box count overflows the costs SAH compares
+    const Scene scenes[] = { { "random", 0 }, { "random", 1 }, { "random", 7 }, { "random", boxCount }, { "coincident", 50 }, { "chain", 440 },
+                             { "random", 10000 } };
+    for (const Scene& scene : scenes)
+    {
+        std::vector<AABB> boxes = makeBoxes(scene.Kind, scene.Count, rng);
+        std::string name = std::to_string(scene.Count) + " " + scene.Kind + " boxes";
+        for (bool parallel : { false, true })
+        {
+            std::string buildName = name + (parallel ? ", job system" : ", 1 thread");
+            BVH bvh;
+            bvh.Build(boxes, parallel ? &jobs : nullptr);
+            failures += checkTree(bvh, buildName);
+            failures += checkQueries(bvh, sceneBounds(boxes), queries, rng, buildName);
+
+            // every box moves a little and some a lot; the refitted tree has to answer like a fresh one
+            std::vector<AABB> moved = boxes;
+            glm::vec3 size = sceneBounds(boxes).Max - sceneBounds(boxes).Min;
+            for (unsigned int i = 0; i < moved.size(); i++)
+            {
+                glm::vec3 offset = (glm::vec3(unit(rng), unit(rng), unit(rng)) - glm::vec3(0.5f)) * size * (i % 10 == 0 ? 0.5f : 0.02f);
+                moved[i] = AABB(moved[i].Min + offset, moved[i].Max + offset);
+                bvh.SetBounds(i, moved[i]);
+            }
+            bvh.Refit();
+            failures += checkTree(bvh, buildName + ", refitted");
+            failures += checkQueries(bvh, sceneBounds(moved), queries, rng, buildName + ", refitted");
+        }
+        BVH bvh;
+        bvh.Build(boxes);
+        std::cout << name << ": " << bvh.Nodes.size() << " nodes, " << (bvh.Nodes.empty() ? 0 : treeDepth(bvh, 0)) << " levels" << std::endl;
+    }
+
+    std::cout << (failures == 0 ? "OK" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
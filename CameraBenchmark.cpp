@@ -0,0 +1,146 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <camera.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/*
+Camera (camera.h) microbenchmark. No window or OpenGL context is created: a frame asks the camera for what camera.cpp
+uses (view, projection, relative view, view-projection and frustum) and the cost per frame is timed with the camera idle,
+moving, turning and zooming, next to rebuilding all of it every frame from yaw and pitch with glm::lookAt the way the
+samples did before the matrices were cached. An idle camera has to rebuild nothing, the cached matrices have to match
+a fresh lookAt, and pitching has to work the same with other world up axes.
+usage: CameraBenchmark [frames]
+*/
+
+struct Frame
+{
+    glm::mat4 View, Projection, RelativeView, ViewProjection;
+    glm::vec4 Plane;
+};
+
+// what one frame of camera.cpp asks for
+inline Frame cachedFrame(Camera& camera)
+{
+    Frame frame;
+    frame.View = camera.GetViewMatrix();
+    frame.Projection = camera.GetProjectionMatrix();
+    frame.RelativeView = camera.GetRelativeViewMatrix();
+    frame.ViewProjection = camera.GetViewProjectionMatrix();
+    frame.Plane = camera.GetFrustum().Planes[0];
+    return frame;
+}
+
+// the same, recomputed from the angles every frame
+inline Frame uncachedFrame(float yaw, float pitch, float zoom, const glm::vec3& position)
+{
+    glm::vec3 front(std::cos(glm::radians(yaw)) * std::cos(glm::radians(pitch)), std::sin(glm::radians(pitch)),
+                    std::sin(glm::radians(yaw)) * std::cos(glm::radians(pitch)));
+    front = glm::normalize(front);
+    Frame frame;
+    frame.View = glm::lookAt(position, position + front, glm::vec3(0.0f, 1.0f, 0.0f));
+    frame.Projection = glm::perspective(glm::radians(zoom), 800.0f / 600.0f, 0.1f, 100.0f);
+    frame.RelativeView = glm::lookAt(glm::vec3(0.0f), front, glm::vec3(0.0f, 1.0f, 0.0f));
+    frame.ViewProjection = frame.Projection * frame.View;
+    frame.Plane = Frustum(frame.ViewProjection).Planes[0];
+    return frame;
+}
+
+bool near(const glm::mat4& a, const glm::mat4& b)
+{
+    for (int c = 0; c < 4; c++)
+        for (int r = 0; r < 4; r++)
+            if (std::fabs(a[c][r] - b[c][r]) > 1e-3f)
+                return false;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int frames = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    int failures = 0;
+    float sink = 0.0f;
+
+    const char* cases[] = { "idle", "moving", "turning", "zooming" };
+    for (const char* name : cases)
+    {
+        std::string mode = name;
+        Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+        camera.SetPerspective(800.0f / 600.0f, 0.1f, 100.0f);
+        cachedFrame(camera);
+        unsigned int viewUpdates = camera.ViewUpdates, projectionUpdates = camera.ProjectionUpdates;
+        auto start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++)
+        {
+            if (mode == "moving")
+                camera.ProcessKeyboard(f % 200 < 100 ? FORWARD : BACKWARD, 0.001f);
+            else if (mode == "turning")
+                camera.ProcessMouseMovement(f % 200 < 100 ? 1.0f : -1.0f, 0.5f * (f % 40 < 20 ? 1.0f : -1.0f));
+            else if (mode == "zooming")
+                camera.ProcessMouseScroll(f % 40 < 20 ? 0.5f : -0.5f);
+            Frame frame = cachedFrame(camera);
+            sink += frame.View[3][0] + frame.Projection[1][1] + frame.RelativeView[0][0] + frame.ViewProjection[2][2] + frame.Plane.w;
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / frames;
+        viewUpdates = camera.ViewUpdates - viewUpdates;
+        projectionUpdates = camera.ProjectionUpdates - projectionUpdates;
+        std::cout << name << ": " << ns << " ns/frame, view rebuilt " << viewUpdates << " times, projection " << projectionUpdates << " times in "
+                  << frames << " frames" << std::endl;
+        if (mode == "idle" && (viewUpdates != 0 || projectionUpdates != 0))
+        {
+            std::cout << "idle: the camera rebuilt its matrices" << std::endl;
+            failures++;
+        }
+
+        // what the cache holds has to be what a fresh lookAt gives
+        Frame cached = cachedFrame(camera);
+        Frame fresh = uncachedFrame(camera.Yaw, camera.Pitch, camera.Zoom, glm::vec3(camera.Position));
+        if (!near(cached.View, fresh.View) || !near(cached.Projection, fresh.Projection) || !near(cached.ViewProjection, fresh.ViewProjection))
+        {
+            std::cout << name << ": the cached matrices differ from lookAt and perspective" << std::endl;
+            failures++;
+        }
+    }
+
+    // with any world up the pitch has to be an elevation above the horizon and Right has to stay horizontal
+    const glm::vec3 ups[] = { glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f) };
+    for (const glm::vec3& up : ups)
+    {
+        Camera camera(glm::vec3(0.0f), up, 30.0f, 20.0f);
+        camera.GetViewMatrix();
+        float elevation = glm::degrees(std::asin(glm::dot(camera.Front, up)));
+        if (std::fabs(elevation - 20.0f) > 1e-2f || std::fabs(glm::dot(camera.Right, up)) > 1e-4f || glm::dot(camera.Up, up) <= 0.0f)
+        {
+            std::cout << "up (" << up.x << ", " << up.y << ", " << up.z << "): elevation " << elevation << ", right . up " << glm::dot(camera.Right, up)
+                      << std::endl;
+            failures++;
+        }
+        // and SetFront() has to give back the angles the front came from
+        glm::vec3 front = camera.Front;
+        camera.Yaw = camera.Pitch = 0.0f;
+        camera.SetFront(front);
+        if (std::fabs(camera.Yaw - 30.0f) > 1e-2f || std::fabs(camera.Pitch - 20.0f) > 1e-2f)
+        {
+            std::cout << "up (" << up.x << ", " << up.y << ", " << up.z << "): SetFront gave yaw " << camera.Yaw << ", pitch " << camera.Pitch << std::endl;
+            failures++;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++)
+    {
+        Frame frame = uncachedFrame(-90.0f + (float)(f % 100) * 0.01f, 0.0f, 45.0f, glm::vec3(0.0f, 0.0f, 3.0f));
+        sink += frame.View[3][0] + frame.Projection[1][1] + frame.RelativeView[0][0] + frame.ViewProjection[2][2] + frame.Plane.w;
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / frames;
+    std::cout << "recomputed every frame (lookAt): " << ns << " ns/frame" << std::endl;
+
+    // printed so the frames are not optimized away
+    std::cout << "(checksum " << sink << ")" << std::endl;
+    std::cout << (failures == 0 ? "OK" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <clustered_lights.h>
+#include <job_system.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+Headless test of the clustered light assignment. No window or OpenGL context is created: synthetic lights are binned by
+LightClusters::Assign() (clustered_lights.h), on one thread and on the job system, and every cluster's light list is
+compared with AssignReference(), the brute force version. The grids include sizes that are not multiples of the four
+clusters the SSE2 path tests at once, and the lights include the awkward ones: behind the camera, straddling the near
+and far planes, larger than the whole volume, sitting on slice boundaries, and fewer than the last frame had.
+usage: ClusterTest [random lights] [seed]
+*/
+
+struct Grid
+{
+    unsigned int X, Y, Z;
+};
+
+// view space depth of the boundary between slices z - 1 and z, as SetProjection() spaces them
+float sliceBoundary(unsigned int z, unsigned int gridZ, float nearPlane, float farPlane)
+{
+    return nearPlane * std::pow(farPlane / nearPlane, (float)z / gridZ);
+}
+
+// lights placed in view space (the camera looks down -z) and moved to world space with the inverse view
+std::vector<PointLight> makeLights(const std::string& kind, unsigned int count, const glm::mat4& view, const Grid& grid, float nearPlane, float farPlane,
+                                   std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    glm::mat4 toWorld = glm::inverse(view);
+    std::vector<PointLight> lights;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        PointLight light;
+        glm::vec3 p;
+        if (kind == "random")
+        {
+            // a box a little larger than the frustum, so some lights are outside it on every side
+            float depth = -1.0f + unit(rng) * (farPlane * 1.2f + 1.0f);
+            p = glm::vec3((unit(rng) * 2.0f - 1.0f) * (depth + 2.0f), (unit(rng) * 2.0f - 1.0f) * (depth + 2.0f), -depth);
+            light.Radius = 0.05f + unit(rng) * unit(rng) * farPlane * 0.3f;
+        }
+        else if (kind == "planes")
+        {
+            // straddling or just touching the near and far planes, and behind the camera
+            float depths[] = { nearPlane, nearPlane * 0.5f, -0.5f, farPlane, farPlane * 1.01f, farPlane + 3.0f };
+            float depth = depths[i % 6];
+            p = glm::vec3(unit(rng) * 2.0f - 1.0f, unit(rng) * 2.0f - 1.0f, -depth);
+            light.Radius = 0.01f + unit(rng) * 2.0f;
+        }
+        else if (kind == "boundaries")
+        {
+            // centers exactly on slice boundaries, radii from tiny to a slice wide
+            float depth = sliceBoundary(i % (grid.Z + 1), grid.Z, nearPlane, farPlane);
+            p = glm::vec3((unit(rng) * 2.0f - 1.0f) * depth * 0.5f, (unit(rng) * 2.0f - 1.0f) * depth * 0.5f, -depth);
+            light.Radius = (i % 3 == 0) ? 1e-4f : depth * 0.1f * unit(rng);
+        }
+        else // "huge": every light covers the whole clustered volume
+        {
+            p = glm::vec3(unit(rng) - 0.5f, unit(rng) - 0.5f, -farPlane * unit(rng));
+            light.Radius = farPlane * 4.0f;
+        }
+        light.Position = glm::vec3(toWorld * glm::vec4(p, 1.0f));
+        lights.push_back(light);
+    }
+    return lights;
+}
+
+// compares the last Assign() with the reference and checks the layout of the index list; returns the failures
+int check(const LightClusters& clusters, const std::vector<PointLight>& lights, const glm::mat4& view, const std::string& name)
+{
+    int failures = 0;
+    unsigned int mismatches = clusters.Validate(lights, view);
+    if (mismatches > 0)
+    {
+        std::cout << name << ": " << mismatches << " clusters differ from the brute force reference" << std::endl;
+        failures++;
+    }
+    // the ranges tile the index list in cluster order, and the stats count what is in it
+    unsigned int offset = 0;
+    for (unsigned int c = 0; c < clusters.ClusterCount(); c++)
+    {
+        if (clusters.Ranges[c * 2] != offset)
+        {
+            std::cout << name << ": cluster " << c << " starts at " << clusters.Ranges[c * 2] << ", expected " << offset << std::endl;
+            failures++;
+            break;
+        }
+        offset += clusters.Ranges[c * 2 + 1];
+    }
+    if (offset != clusters.Indices.size() || clusters.Stats().References != offset)
+    {
+        std::cout << name << ": " << offset << " references in the ranges, " << clusters.Indices.size() << " indices, stats "
+                  << clusters.Stats().References << std::endl;
+        failures++;
+    }
+    return failures;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int randomLights = argc > 1 ? (unsigned int)std::atoi(argv[1]) : 1000;
+    std::mt19937 rng(argc > 2 ? (unsigned int)std::atoi(argv[2]) : 43);
+    const float NEAR_PLANE = 0.1f, FAR_PLANE = 100.0f;
+    int failures = 0;
+    unsigned int runs = 0;
+
+    JobSystem jobs;
+    const Grid grids[] = { { 16, 9, 24 }, { 13, 7, 17 }, { 5, 3, 2 }, { 1, 1, 1 } };
+    // the identity, a camera looking down a diagonal and one rolled and pitched far from the origin
+    const glm::mat4 views[] = {
+        glm::mat4(1.0f),
+        glm::lookAt(glm::vec3(3.0f, 2.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+        glm::lookAt(glm::vec3(-250.0f, 40.0f, 900.0f), glm::vec3(-240.0f, 10.0f, 880.0f), glm::normalize(glm::vec3(0.3f, 1.0f, 0.1f))),
+    };
+    const std::string kinds[] = { "random", "planes", "boundaries", "huge" };
+
+    for (const Grid& grid : grids)
+    {
+        LightClusters clusters(grid.X, grid.Y, grid.Z);
+        clusters.SetProjection(glm::radians(45.0f), 16.0f / 9.0f, NEAR_PLANE, FAR_PLANE);
+        for (unsigned int v = 0; v < sizeof(views) / sizeof(views[0]); v++)
+            for (const std::string& kind : kinds)
+            {
+                unsigned int count = kind == "random" ? randomLights : kind == "huge" ? 9 : 61;
+                std::vector<PointLight> lights = makeLights(kind, count, views[v], grid, NEAR_PLANE, FAR_PLANE, rng);
+                std::string name = std::to_string(grid.X) + "x" + std::to_string(grid.Y) + "x" + std::to_string(grid.Z) + ", view " + std::to_string(v) + ", "
+                                   + kind + " lights";
+                clusters.Assign(lights, views[v]);
+                failures += check(clusters, lights, views[v], name + ", 1 thread");
+                clusters.Assign(lights, views[v], &jobs);
+                failures += check(clusters, lights, views[v], name + ", job system");
+
+                // fewer lights than last time (down to none) must not leave anything of the previous frame behind
+                for (unsigned int keep : { count / 3, 1u, 0u })
+                {
+                    std::vector<PointLight> fewer(lights.begin(), lights.begin() + std::min(keep, count));
+                    clusters.Assign(fewer, views[v], &jobs);
+                    failures += check(clusters, fewer, views[v], name + ", " + std::to_string(fewer.size()) + " kept");
+                }
+                runs += 5;
+            }
+    }
+
+    // a projection change rebuilds the boxes, and a differently shaped volume must still match
+    LightClusters clusters;
+    std::vector<PointLight> lights = makeLights("random", randomLights, views[1], { 16, 9, 24 }, 0.5f, 30.0f, rng);
+    clusters.SetProjection(glm::radians(45.0f), 16.0f / 9.0f, NEAR_PLANE, FAR_PLANE);
+    clusters.Assign(lights, views[1], &jobs);
+    clusters.SetProjection(glm::radians(90.0f), 1.0f, 0.5f, 30.0f);
+    clusters.Assign(lights, views[1], &jobs);
+    failures += check(clusters, lights, views[1], "after SetProjection()");
+    runs++;
+
+    std::cout << runs << " assignments checked" << std::endl;
+    std::cout << (failures == 0 ? "OK" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,186 @@
+#include <glm/glm.hpp>
+#include <depth_pyramid.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+Headless test of the depth pyramid reduction. No window or OpenGL context is created: synthetic depth buffers are reduced
+by DepthPyramid::Reduce() (depth_pyramid.h), the CPU reference Validate() holds the GPU's pyramid to, and every texel of
+every level is compared with the smallest and largest depth of the level 0 pixels p it has to cover, those with
+min(p >> L, size - 1) on the texel. The sizes include odd, non-power-of-two and one pixel wide buffers, where the last
+row and column of a level take in the extra ones. A background with an occluder on it is then reduced with standard
+and with reversed-z depth, to check that the channel occlusion tests read as the farthest depth (g, the largest, for
+standard depth; r, the smallest, for reversed-z) only shows the occluder where it covers a texel completely.
+usage: DepthPyramidTest [seed]
+*/
+
+struct Size
+{
+    unsigned int Width, Height;
+};
+
+std::string sizeName(const Size& size)
+{
+    return std::to_string(size.Width) + "x" + std::to_string(size.Height);
+}
+
+// the min, max pairs level L has to hold, straight from level 0: every pixel goes to texel min(p >> L, size - 1)
+std::vector<float> bruteForceLevel(const std::vector<float>& depth, const Size& size, unsigned int level, unsigned int levelWidth, unsigned int levelHeight,
+                                   std::vector<unsigned int>& covered)
+{
+    std::vector<float> texels((std::size_t)levelWidth * levelHeight * 2);
+    covered.assign((std::size_t)levelWidth * levelHeight, 0);
+    for (std::size_t t = 0; t < covered.size(); t++)
+    {
+        texels[t * 2] = 1e30f;
+        texels[t * 2 + 1] = -1e30f;
+    }
+    for (unsigned int y = 0; y < size.Height; y++)
+        for (unsigned int x = 0; x < size.Width; x++)
+        {
+            std::size_t t = (std::size_t)std::min(y >> level, levelHeight - 1) * levelWidth + std::min(x >> level, levelWidth - 1);
+            float d = depth[(std::size_t)y * size.Width + x];
+            texels[t * 2] = std::min(texels[t * 2], d);
+            texels[t * 2 + 1] = std::max(texels[t * 2 + 1], d);
+            covered[t]++;
+        }
+    return texels;
+}
+
+// checks the level sizes and every texel of a reduced pyramid; returns the failures
+int checkPyramid(const std::vector<float>& depth, const Size& size, const HiZPyramid& pyramid, const std::string& name)
+{
+    int failures = 0;
+    unsigned int expectedLevels = 1;
+    while ((std::max(size.Width, size.Height) >> expectedLevels) > 0)
+        expectedLevels++;
+    if (pyramid.Levels() != expectedLevels || pyramid.Widths.back() != 1 || pyramid.Heights.back() != 1 || pyramid.CpuLevels.size() != expectedLevels)
+    {
+        std::cout << name << ": " << pyramid.Levels() << " levels ending at " << pyramid.Widths.back() << "x" << pyramid.Heights.back() << ", expected "
+                  << expectedLevels << " ending at 1x1" << std::endl;
+        return 1;
+    }
+    for (unsigned int level = 0; level < pyramid.Levels(); level++)
+    {
+        unsigned int levelWidth = pyramid.Widths[level], levelHeight = pyramid.Heights[level];
+        unsigned int expectedWidth = std::max(size.Width >> level, 1u), expectedHeight = std::max(size.Height >> level, 1u);
+        if (levelWidth != expectedWidth || levelHeight != expectedHeight || pyramid.CpuLevels[level].size() != (std::size_t)levelWidth * levelHeight * 2)
+        {
+            std::cout << name << ", level " << level << ": " << levelWidth << "x" << levelHeight << ", expected " << expectedWidth << "x" << expectedHeight << std::endl;
+            failures++;
+            continue;
+        }
+        std::vector<unsigned int> covered;
+        std::vector<float> expected = bruteForceLevel(depth, size, level, levelWidth, levelHeight, covered);
+        unsigned int mismatches = 0, empty = 0;
+        for (std::size_t t = 0; t < covered.size(); t++)
+        {
+            empty += covered[t] == 0 ? 1 : 0;
+            if (pyramid.CpuLevels[level][t * 2] != expected[t * 2] || pyramid.CpuLevels[level][t * 2 + 1] != expected[t * 2 + 1])
+                mismatches++;
+        }
+        if (mismatches > 0 || empty > 0)
+        {
+            std::cout << name << ", level " << level << " (" << levelWidth << "x" << levelHeight << "): " << mismatches << " texels differ from the pixels under them, "
+                      << empty << " cover no pixel" << std::endl;
+            failures++;
+        }
+    }
+    return failures;
+}
+
+// a background at the far end of the depth range with a rectangle in front of it; checks what the farthest and nearest
+// channels of every texel show against which pixels the texel covers
+int checkOccluder(const Size& size, DepthConvention convention, std::mt19937& rng)
+{
+    bool reversed = convention == DEPTH_REVERSED_Z;
+    std::string name = sizeName(size) + (reversed ? ", reversed-z occluder" : ", standard occluder");
+    // cleared to the far plane: 1 for standard depth, 0 for reversed-z, where the occluder is nearer with larger values
+    const float background = reversed ? 0.0f : 1.0f, occluder = reversed ? 0.7f : 0.3f;
+    unsigned int x0 = rng() % size.Width, y0 = rng() % size.Height;
+    unsigned int x1 = x0 + rng() % (size.Width - x0), y1 = y0 + rng() % (size.Height - y0);
+    std::vector<float> depth((std::size_t)size.Width * size.Height, background);
+    for (unsigned int y = y0; y <= y1; y++)
+        for (unsigned int x = x0; x <= x1; x++)
+            depth[(std::size_t)y * size.Width + x] = occluder;
+
+    HiZPyramid pyramid;
+    pyramid.Depth = convention;
+    DepthPyramid::Reduce(depth, size.Width, size.Height, pyramid);
+    int failures = checkPyramid(depth, size, pyramid, name);
+
+    unsigned int mismatches = 0;
+    for (unsigned int level = 0; level < pyramid.Levels(); level++)
+    {
+        unsigned int levelWidth = pyramid.Widths[level], levelHeight = pyramid.Heights[level];
+        // how many pixels of the occluder and of the background every texel covers
+        std::vector<unsigned int> inside((std::size_t)levelWidth * levelHeight, 0), outside((std::size_t)levelWidth * levelHeight, 0);
+        for (unsigned int y = 0; y < size.Height; y++)
+            for (unsigned int x = 0; x < size.Width; x++)
+            {
+                std::size_t t = (std::size_t)std::min(y >> level, levelHeight - 1) * levelWidth + std::min(x >> level, levelWidth - 1);
+                if (x >= x0 && x <= x1 && y >= y0 && y <= y1)
+                    inside[t]++;
+                else
+                    outside[t]++;
+            }
+        for (std::size_t t = 0; t < inside.size(); t++)
+        {
+            const float* minMax = &pyramid.CpuLevels[level][t * 2];
+            float farthest = reversed ? minMax[0] : minMax[1], nearest = reversed ? minMax[1] : minMax[0];
+            // only a texel the occluder covers completely may hide what is behind it
+            float expectedFarthest = outside[t] > 0 ? background : occluder;
+            float expectedNearest = inside[t] > 0 ? occluder : background;
+            if (farthest != expectedFarthest || nearest != expectedNearest)
+                mismatches++;
+        }
+    }
+    if (mismatches > 0)
+    {
+        std::cout << name << " [" << x0 << ".." << x1 << "]x[" << y0 << ".." << y1 << "]: " << mismatches << " texels with the wrong farthest or nearest depth"
+                  << std::endl;
+        failures++;
+    }
+    return failures;
+}
+
+int main(int argc, char* argv[])
+{
+    std::mt19937 rng(argc > 1 ? (unsigned int)std::atoi(argv[1]) : 50);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    int failures = 0;
+
+    const Size sizes[] = { { 1, 1 }, { 2, 2 }, { 3, 3 }, { 1, 7 }, { 5, 1 }, { 7, 5 }, { 64, 64 }, { 65, 63 }, { 203, 117 }, { 257, 129 }, { 1023, 1 }, { 800, 600 } };
+    HiZPyramid reused;
+    for (const Size& size : sizes)
+    {
+        // random depth, with some pixels exactly at the ends of the range
+        std::vector<float> depth((std::size_t)size.Width * size.Height);
+        for (float& d : depth)
+        {
+            unsigned int pick = rng() % 20;
+            d = pick == 0 ? 0.0f : pick == 1 ? 1.0f : unit(rng);
+        }
+        HiZPyramid pyramid;
+        DepthPyramid::Reduce(depth, size.Width, size.Height, pyramid);
+        failures += checkPyramid(depth, size, pyramid, sizeName(size));
+        // the same pyramid reduced into again and again, the sizes going up and down, keeps nothing of the last one
+        DepthPyramid::Reduce(depth, size.Width, size.Height, reused);
+        failures += checkPyramid(depth, size, reused, sizeName(size) + ", reused");
+
+        for (int occluders = 0; occluders < 4; occluders++)
+        {
+            failures += checkOccluder(size, DEPTH_STANDARD, rng);
+            failures += checkOccluder(size, DEPTH_REVERSED_Z, rng);
+        }
+    }
+
+    std::cout << sizeof(sizes) / sizeof(sizes[0]) << " sizes checked" << std::endl;
+    std::cout << (failures == 0 ? "OK" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+#include <glm/glm.hpp>
+#include <ecs.h>
+#include <job_system.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+/*
+ECS (ecs.h) iteration benchmark. No window or OpenGL context is created: a world is filled with Transform + MeshRenderer
+entities (and some Transform-only ones the queries have to skip), and queries over both components are timed: one that
+only reads them and one that also writes both, on one thread through ForEach() and ForEachChunk(), then fanned out over the chunks on every
+core with JobSystem::ParallelFor() the way Lighting2 records its draws. The target is 1M entities in under a millisecond
+per core, i.e. the one-thread time times the entity count over 1M. A million entities are 56 MB of components, more
+than any cache, so at that count the passes are bounded by memory bandwidth; a smaller world shows what iterating costs
+when the chunks are in cache.
+usage: EcsBenchmark [entities] [passes]
+*/
+
+struct ChunkRange
+{
+    unsigned int Count;
+    ecs::Transform* Transforms;
+    ecs::MeshRenderer* Renderers;
+};
+
+// what the benchmark system does to one entity: a small move and a fade, so both arrays are read and written
+inline unsigned int touch(ecs::Transform& transform, ecs::MeshRenderer& renderer)
+{
+    transform.Position.y += 0.001f;
+    renderer.Fade = transform.Position.y > 0.0f ? 0.0f : 0.5f;
+    return renderer.Count > 0 ? 1u : 0u;
+}
+
+// runs pass `passes` times and returns the best time in milliseconds; every pass has to visit expected entities
+template<typename Pass>
+double best(int passes, unsigned int expected, int& failures, const char* name, Pass pass)
+{
+    double bestMs = 1e30, totalMs = 0.0;
+    for (int p = 0; p < passes; p++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        unsigned int visited = pass();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        bestMs = std::min(bestMs, ms);
+        totalMs += ms;
+        if (visited != expected)
+        {
+            std::cout << name << ": visited " << visited << " entities, expected " << expected << std::endl;
+            failures++;
+            break;
+        }
+    }
+    std::cout << name << ": " << bestMs << " ms best, " << (passes > 0 ? totalMs / passes : 0.0) << " ms average" << std::endl;
+    return bestMs;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int entities = argc > 1 ? (unsigned int)std::atoi(argv[1]) : 1000000;
+    int passes = argc > 2 ? std::atoi(argv[2]) : 50;
+
+    ecs::World world;
+    ecs::MeshRenderer renderer;
+    renderer.Count = 36;
+    for (unsigned int i = 0; i < entities; i++)
+    {
+        ecs::Transform transform;
+        transform.Position = glm::vec3((float)(i % 1000), 0.0f, (float)(i / 1000));
+        world.Create(transform, renderer);
+        // one entity in ten has no renderer, it lives in another archetype the query skips
+        if (i % 10 == 0)
+            world.Create(transform);
+    }
+    unsigned int chunkCount = 0;
+    for (const ecs::Archetype& archetype : world.Archetypes())
+        chunkCount += (unsigned int)archetype.Chunks.size();
+    std::cout << world.Size() << " entities in " << world.Archetypes().size() << " archetypes, " << chunkCount << " chunks of "
+              << ecs::CHUNK_SIZE / 1024 << " KB" << std::endl;
+
+    int failures = 0;
+    best(passes, entities, failures, "ForEach, 1 thread", [&]()
+    {
+        unsigned int visited = 0;
+        world.ForEach<ecs::Transform, ecs::MeshRenderer>([&](ecs::Entity, ecs::Transform& transform, ecs::MeshRenderer& renderer)
+        {
+            visited += touch(transform, renderer);
+        });
+        return visited;
+    });
+    // a query that only reads, like gathering draws: what iteration itself costs
+    double readMs = best(passes, entities, failures, "ForEachChunk read only, 1 thread", [&]()
+    {
+        unsigned int visited = 0;
+        world.ForEachChunk<ecs::Transform, ecs::MeshRenderer>([&](unsigned int count, const ecs::Entity*, ecs::Transform* transforms, ecs::MeshRenderer* renderers)
+        {
+            for (unsigned int i = 0; i < count; i++)
+                visited += transforms[i].Position.x >= 0.0f && renderers[i].Count > 0 ? 1u : 0u;
+        });
+        return visited;
+    });
+    double oneThreadMs = best(passes, entities, failures, "ForEachChunk, 1 thread", [&]()
+    {
+        unsigned int visited = 0;
+        world.ForEachChunk<ecs::Transform, ecs::MeshRenderer>([&](unsigned int count, const ecs::Entity*, ecs::Transform* transforms, ecs::MeshRenderer* renderers)
+        {
+            for (unsigned int i = 0; i < count; i++)
+                visited += touch(transforms[i], renderers[i]);
+        });
+        return visited;
+    });
+
+    JobSystem jobs;
+    std::vector<ChunkRange> chunks;
+    std::vector<unsigned int> visitedPerChunk;
+    std::string name = "ForEachChunk, " + std::to_string(jobs.ThreadCount()) + " threads";
+    best(passes, entities, failures, name.c_str(), [&]()
+    {
+        chunks.clear();
+        world.ForEachChunk<ecs::Transform, ecs::MeshRenderer>([&](unsigned int count, const ecs::Entity*, ecs::Transform* transforms, ecs::MeshRenderer* renderers)
+        {
+            chunks.push_back({ count, transforms, renderers });
+        });
+        visitedPerChunk.assign(chunks.size(), 0);
+        jobs.ParallelFor((unsigned int)chunks.size(), 4, [&](unsigned int begin, unsigned int end)
+        {
+            for (unsigned int c = begin; c < end; c++)
+                for (unsigned int i = 0; i < chunks[c].Count; i++)
+                    visitedPerChunk[c] += touch(chunks[c].Transforms[i], chunks[c].Renderers[i]);
+        });
+        unsigned int visited = 0;
+        for (unsigned int count : visitedPerChunk)
+            visited += count;
+        return visited;
+    });
+
+    double scale = entities > 0 ? 1000000.0 / entities : 0.0;
+    std::cout << "per 1M entities per core: " << readMs * scale << " ms read only, " << oneThreadMs * scale << " ms read and write, target 1 ms: "
+              << (readMs * scale < 1.0 ? "met" : "missed") << std::endl;
+    std::cout << (failures == 0 ? "OK" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
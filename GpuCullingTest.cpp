@@ -0,0 +1,353 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <gpu_culling.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+Headless test of GpuCuller's CPU reference (gpu_culling.h), the path culling takes without compute shaders and the one
+Validate() holds the compute passes to. No window or OpenGL context is created and nothing is uploaded: instances of a
+few meshes with LOD chains are scattered around a camera and culled with CullReference(), and the result is compared
+with a brute force loop over the instances: the sphere against the view volume worked out from the camera, the level
+from the screen space error of every level, and the indirect commands and instance lists packed draw after draw.
+Then a wall is ray cast into a depth buffer, reduced to a Hi-Z pyramid with DepthPyramid::Reduce(), and every instance
+the pyramid hides has to be hidden by the wall at every pixel its box covers, while spheres placed behind the wall must
+be hidden and ones in front of it or beside it must not. Both depth conventions are covered.
+usage: GpuCullingTest [instances] [seed]
+*/
+
+const float FOV_Y = glm::radians(60.0f), ASPECT = 4.0f / 3.0f, NEAR_PLANE = 0.1f, FAR_PLANE = 50.0f;
+const unsigned int VIEWPORT_WIDTH = 160, VIEWPORT_HEIGHT = 120;
+// the camera sits on +z looking down -z at the wall, a rectangle in the z = 0 plane
+const glm::vec3 EYE(0.0f, 0.0f, 12.0f);
+const glm::vec2 WALL_MIN(-6.0f, -5.0f), WALL_MAX(6.0f, 5.0f);
+
+struct TestMesh
+{
+    std::vector<LodLevel> Levels;
+    unsigned int FirstIndex;
+    int BaseVertex;
+    float Radius;
+};
+
+struct TestInstance
+{
+    unsigned int Mesh;
+    glm::vec3 Center;
+    float Scale;
+};
+
+glm::mat4 projectionFor(DepthConvention depth)
+{
+    if (depth == DEPTH_STANDARD)
+        return glm::perspective(FOV_Y, ASPECT, NEAR_PLANE, FAR_PLANE);
+    // camera.h's reversed-z projection with an infinite far plane
+    float f = 1.0f / std::tan(FOV_Y * 0.5f);
+    glm::mat4 projection(0.0f);
+    projection[0][0] = f / ASPECT;
+    projection[1][1] = f;
+    projection[2][3] = -1.0f;
+    projection[3][2] = NEAR_PLANE;
+    return projection;
+}
+
+// window depth of a world position, in the convention's 0..1 range
+float windowDepth(const glm::mat4& viewProjection, const glm::vec3& p, DepthConvention depth)
+{
+    glm::vec4 clip = viewProjection * glm::vec4(p, 1.0f);
+    return depth == DEPTH_REVERSED_Z ? clip.z / clip.w : clip.z / clip.w * 0.5f + 0.5f;
+}
+
+// how far inside the view volume the sphere is, from the camera's own description rather than the matrix: the
+// smallest signed distance of its center to the side, near and (standard depth only) far planes, plus its radius
+float frustumMargin(const glm::vec3& center, float radius, DepthConvention depth)
+{
+    glm::vec3 c = center - EYE;     // view space: the camera looks down -z with y up
+    float halfY = FOV_Y * 0.5f, halfX = std::atan(std::tan(halfY) * ASPECT);
+    float margin = -c.z - NEAR_PLANE;
+    margin = std::min(margin, glm::dot(glm::vec3(std::cos(halfX), 0.0f, -std::sin(halfX)), c));
+    margin = std::min(margin, glm::dot(glm::vec3(-std::cos(halfX), 0.0f, -std::sin(halfX)), c));
+    margin = std::min(margin, glm::dot(glm::vec3(0.0f, std::cos(halfY), -std::sin(halfY)), c));
+    margin = std::min(margin, glm::dot(glm::vec3(0.0f, -std::cos(halfY), -std::sin(halfY)), c));
+    if (depth == DEPTH_STANDARD)
+        margin = std::min(margin, FAR_PLANE + c.z);
+    return margin + radius;
+}
+
+// the level of a mesh an instance at this distance draws: every level whose error stays under the threshold in pixels
+// (the errors grow along the chain)
+unsigned int expectedLevel(const TestMesh& mesh, const TestInstance& instance, float radius, float threshold)
+{
+    float pixelsPerUnit = VIEWPORT_HEIGHT / (2.0f * std::tan(FOV_Y * 0.5f));
+    float nearest = std::max(glm::length(instance.Center - EYE) - radius, 0.01f);
+    float pixels = pixelsPerUnit * instance.Scale / nearest;
+    unsigned int level = 0;
+    for (unsigned int l = 1; l < mesh.Levels.size(); l++)
+        if (mesh.Levels[l].Error * pixels <= threshold)
+            level = l;
+    return level;
+}
+
+// the commands and lists of the given instances: one command per (mesh, level) with instances, in mesh and level
+// order, the instances of each in index order and the lists one after the other
+void expectedDraws(const std::vector<TestMesh>& meshes, const std::vector<TestInstance>& instances, const std::vector<bool>& drawn, float threshold,
+                   std::vector<DrawElementsIndirectCommand>& outCommands, std::vector<unsigned int>& outVisible)
+{
+    outCommands.clear();
+    outVisible.clear();
+    for (unsigned int m = 0; m < meshes.size(); m++)
+        for (unsigned int l = 0; l < meshes[m].Levels.size(); l++)
+        {
+            std::vector<unsigned int> list;
+            for (unsigned int i = 0; i < instances.size(); i++)
+                if (drawn[i] && instances[i].Mesh == m && expectedLevel(meshes[m], instances[i], meshes[m].Radius * instances[i].Scale, threshold) == l)
+                    list.push_back(i);
+            if (list.empty())
+                continue;
+            const LodLevel& level = meshes[m].Levels[l];
+            outCommands.push_back({ level.Count, (unsigned int)list.size(), meshes[m].FirstIndex + level.First, meshes[m].BaseVertex,
+                                    (unsigned int)outVisible.size() });
+            outVisible.insert(outVisible.end(), list.begin(), list.end());
+        }
+}
+
+int compareDraws(const std::vector<DrawElementsIndirectCommand>& commands, const std::vector<unsigned int>& visible,
+                 const std::vector<DrawElementsIndirectCommand>& expectedCommands, const std::vector<unsigned int>& expectedVisible, const std::string& name)
+{
+    bool same = commands.size() == expectedCommands.size() && visible == expectedVisible;
+    for (unsigned int c = 0; same && c < commands.size(); c++)
+        same = commands[c].Count == expectedCommands[c].Count && commands[c].InstanceCount == expectedCommands[c].InstanceCount
+            && commands[c].FirstIndex == expectedCommands[c].FirstIndex && commands[c].BaseVertex == expectedCommands[c].BaseVertex
+            && commands[c].BaseInstance == expectedCommands[c].BaseInstance;
+    if (same)
+        return 0;
+    std::cout << name << ": " << commands.size() << " commands and " << visible.size() << " instances, expected " << expectedCommands.size() << " and "
+              << expectedVisible.size() << std::endl;
+    return 1;
+}
+
+// the wall ray cast into a VIEWPORT_WIDTH x VIEWPORT_HEIGHT depth buffer (row 0 at the bottom), the rest at the far end
+std::vector<float> castWall(const glm::mat4& viewProjection, DepthConvention depth)
+{
+    std::vector<float> buffer((std::size_t)VIEWPORT_WIDTH * VIEWPORT_HEIGHT, depth == DEPTH_REVERSED_Z ? 0.0f : 1.0f);
+    float tanY = std::tan(FOV_Y * 0.5f);
+    for (unsigned int y = 0; y < VIEWPORT_HEIGHT; y++)
+        for (unsigned int x = 0; x < VIEWPORT_WIDTH; x++)
+        {
+            glm::vec2 ndc(((float)x + 0.5f) / VIEWPORT_WIDTH * 2.0f - 1.0f, ((float)y + 0.5f) / VIEWPORT_HEIGHT * 2.0f - 1.0f);
+            glm::vec3 direction(ndc.x * tanY * ASPECT, ndc.y * tanY, -1.0f);
+            glm::vec3 hit = EYE + direction * (EYE.z / -direction.z);
+            if (hit.x >= WALL_MIN.x && hit.x <= WALL_MAX.x && hit.y >= WALL_MIN.y && hit.y <= WALL_MAX.y)
+                buffer[(std::size_t)y * VIEWPORT_WIDTH + x] = windowDepth(viewProjection, hit, depth);
+        }
+    return buffer;
+}
+
+// whether the wall is in front of the sphere at every pixel its projected box touches, with no pyramid in between
+bool hiddenByWall(const std::vector<float>& buffer, const glm::mat4& viewProjection, const TestInstance& instance, float radius, DepthConvention depth)
+{
+    bool reversed = depth == DEPTH_REVERSED_Z;
+    glm::vec2 low(1e30f), high(-1e30f);
+    float nearest = reversed ? 0.0f : 1.0f;
+    for (int c = 0; c < 8; c++)
+    {
+        glm::vec3 corner = instance.Center + radius * glm::vec3(c & 1 ? 1.0f : -1.0f, c & 2 ? 1.0f : -1.0f, c & 4 ? 1.0f : -1.0f);
+        glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+        if (clip.w <= 1e-5f)
+            return false;
+        low = glm::min(low, glm::vec2(clip.x, clip.y) / clip.w);
+        high = glm::max(high, glm::vec2(clip.x, clip.y) / clip.w);
+        float d = windowDepth(viewProjection, corner, depth);
+        nearest = reversed ? std::max(nearest, d) : std::min(nearest, d);
+    }
+    if (low.x < -1.0f || low.y < -1.0f || high.x > 1.0f || high.y > 1.0f)
+        return false;
+    int x0 = std::min((int)((low.x * 0.5f + 0.5f) * VIEWPORT_WIDTH), (int)VIEWPORT_WIDTH - 1);
+    int x1 = std::min((int)((high.x * 0.5f + 0.5f) * VIEWPORT_WIDTH), (int)VIEWPORT_WIDTH - 1);
+    int y0 = std::min((int)((low.y * 0.5f + 0.5f) * VIEWPORT_HEIGHT), (int)VIEWPORT_HEIGHT - 1);
+    int y1 = std::min((int)((high.y * 0.5f + 0.5f) * VIEWPORT_HEIGHT), (int)VIEWPORT_HEIGHT - 1);
+    for (int y = y0; y <= y1; y++)
+        for (int x = x0; x <= x1; x++)
+        {
+            float d = buffer[(std::size_t)y * VIEWPORT_WIDTH + x];
+            if (reversed ? !(nearest < d) : !(nearest > d))
+                return false;
+        }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int instanceCount = argc > 1 ? (unsigned int)std::atoi(argv[1]) : 3000;
+    std::mt19937 rng(argc > 2 ? (unsigned int)std::atoi(argv[2]) : 49);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    int failures = 0;
+
+    // three meshes in the shared buffers: one without LODs, one with three levels, one with five
+    std::vector<TestMesh> meshes;
+    const unsigned int levelCounts[] = { 1, 3, 5 };
+    unsigned int nextIndex = 0;
+    int nextVertex = 0;
+    for (unsigned int levels : levelCounts)
+    {
+        TestMesh mesh;
+        mesh.FirstIndex = nextIndex;
+        mesh.BaseVertex = nextVertex;
+        mesh.Radius = 0.5f + (float)meshes.size() * 0.5f;
+        unsigned int first = 0;
+        for (unsigned int l = 0; l < levels; l++)
+        {
+            LodLevel level;
+            level.First = first;
+            level.Count = 3 * (240u >> l);
+            level.Error = l == 0 ? 0.0f : 0.002f * (float)(1u << (2 * l));
+            first += level.Count;
+            mesh.Levels.push_back(level);
+        }
+        nextIndex += first + 30;
+        nextVertex += 500;
+        meshes.push_back(mesh);
+    }
+
+    // instances all around the camera, some behind it and beyond the far plane, none right on a plane of the view
+    // volume where the two descriptions of it may round differently
+    std::vector<TestInstance> instances;
+    while (instances.size() < instanceCount)
+    {
+        TestInstance instance;
+        instance.Mesh = rng() % meshes.size();
+        instance.Center = glm::vec3(unit(rng) * 60.0f - 30.0f, unit(rng) * 40.0f - 20.0f, unit(rng) * 80.0f - 60.0f);
+        instance.Scale = 0.2f + unit(rng) * 2.8f;
+        float radius = meshes[instance.Mesh].Radius * instance.Scale;
+        if (std::fabs(frustumMargin(instance.Center, radius, DEPTH_STANDARD)) < 1e-3f || std::fabs(frustumMargin(instance.Center, radius, DEPTH_REVERSED_Z)) < 1e-3f)
+            continue;
+        instances.push_back(instance);
+    }
+    // and the ones whose occlusion is known: behind the middle of the wall, in front of it, and beside it
+    const unsigned int behind = (unsigned int)instances.size();
+    instances.push_back({ 1, glm::vec3(0.0f, 0.0f, -8.0f), 1.0f });
+    instances.push_back({ 0, glm::vec3(-2.0f, 1.5f, -20.0f), 2.0f });
+    const unsigned int inFront = (unsigned int)instances.size();
+    instances.push_back({ 1, glm::vec3(0.0f, 0.0f, 4.0f), 1.0f });
+    instances.push_back({ 0, glm::vec3(13.0f, 0.0f, -8.0f), 0.5f });
+
+    GpuCuller culler;
+    for (const TestMesh& mesh : meshes)
+        culler.AddMesh(mesh.Levels, mesh.FirstIndex, mesh.BaseVertex, mesh.Radius);
+    for (const TestInstance& instance : instances)
+    {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), instance.Center);
+        model = glm::rotate(model, instance.Center.x, glm::normalize(glm::vec3(0.3f, 1.0f, 0.2f)));
+        culler.Add(instance.Mesh, glm::scale(model, glm::vec3(instance.Scale)));
+    }
+
+    glm::mat4 view = glm::lookAt(EYE, EYE + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const DepthConvention conventions[] = { DEPTH_STANDARD, DEPTH_REVERSED_Z };
+    for (DepthConvention depth : conventions)
+    {
+        std::string convention = depth == DEPTH_REVERSED_Z ? "reversed-z" : "standard depth";
+        glm::mat4 viewProjection = projectionFor(depth) * view;
+        std::vector<bool> inside(instances.size());
+        for (unsigned int i = 0; i < instances.size(); i++)
+            inside[i] = frustumMargin(instances[i].Center, meshes[instances[i].Mesh].Radius * instances[i].Scale, depth) >= 0.0f;
+
+        // frustum, levels and packing, at two thresholds
+        std::vector<DrawElementsIndirectCommand> commands, expectedCommands;
+        std::vector<unsigned int> visible, expectedVisible;
+        for (float threshold : { 1.0f, 8.0f })
+        {
+            culler.LodThreshold = threshold;
+            GpuCullStats stats;
+            culler.CullReference(viewProjection, EYE, FOV_Y, (float)VIEWPORT_HEIGHT, commands, visible, nullptr, depth, &stats);
+            expectedDraws(meshes, instances, inside, threshold, expectedCommands, expectedVisible);
+            std::string name = convention + ", threshold " + std::to_string((int)threshold) + " pixels";
+            failures += compareDraws(commands, visible, expectedCommands, expectedVisible, name);
+            if (stats.Tested != instances.size() || stats.FrustumCulled + stats.Visible != stats.Tested || stats.Occluded != 0 || stats.Draws != commands.size())
+            {
+                std::cout << name << ": stats " << stats.Tested << " tested, " << stats.FrustumCulled << " outside, " << stats.Visible << " visible, "
+                          << stats.Draws << " draws" << std::endl;
+                failures++;
+            }
+        }
+        culler.LodThreshold = 1.0f;
+        culler.CullReference(viewProjection, EYE, FOV_Y, (float)VIEWPORT_HEIGHT, commands, visible, nullptr, depth);
+        std::vector<bool> unoccluded(instances.size(), false);
+        for (unsigned int i : visible)
+            unoccluded[i] = true;
+
+        // occlusion, with a CPU copy of every level and with one that starts a few levels up like a readback
+        std::vector<float> buffer = castWall(viewProjection, depth);
+        HiZPyramid pyramid;
+        DepthPyramid::Reduce(buffer, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, pyramid);
+        pyramid.ViewProjection = viewProjection;
+        pyramid.Depth = depth;
+        for (unsigned int firstLevel : { 0u, 3u })
+        {
+            HiZPyramid copy = pyramid;
+            copy.CpuFirstLevel = firstLevel;
+            copy.CpuLevels.erase(copy.CpuLevels.begin(), copy.CpuLevels.begin() + firstLevel);
+            std::string name = convention + ", Hi-Z from level " + std::to_string(firstLevel);
+            GpuCullStats stats;
+            culler.CullReference(viewProjection, EYE, FOV_Y, (float)VIEWPORT_HEIGHT, commands, visible, &copy, depth, &stats);
+            std::vector<bool> drawn(instances.size(), false);
+            for (unsigned int i : visible)
+                drawn[i] = true;
+            unsigned int wrong = 0, occluded = 0;
+            for (unsigned int i = 0; i < instances.size(); i++)
+            {
+                if (drawn[i] && !unoccluded[i])
+                    wrong++;    // culled by the frustum without the pyramid, drawn with it
+                if (unoccluded[i] && !drawn[i])
+                {
+                    occluded++;
+                    if (!hiddenByWall(buffer, viewProjection, instances[i], meshes[instances[i].Mesh].Radius * instances[i].Scale, depth))
+                        wrong++;    // hidden by the pyramid, but the wall does not cover it
+                }
+            }
+            if (wrong > 0 || occluded != stats.Occluded)
+            {
+                std::cout << name << ": " << wrong << " instances hidden or drawn wrongly, " << occluded << " occluded, stats " << stats.Occluded << std::endl;
+                failures++;
+            }
+            for (unsigned int i = behind; i < inFront; i++)
+                if (drawn[i] || !unoccluded[i])
+                {
+                    std::cout << name << ": instance " << i << " behind the wall is drawn" << std::endl;
+                    failures++;
+                }
+            for (unsigned int i = inFront; i < instances.size(); i++)
+                if (!drawn[i])
+                {
+                    std::cout << name << ": instance " << i << " in front of or beside the wall is hidden" << std::endl;
+                    failures++;
+                }
+            // what is left is packed like any other set of instances
+            expectedDraws(meshes, instances, drawn, 1.0f, expectedCommands, expectedVisible);
+            failures += compareDraws(commands, visible, expectedCommands, expectedVisible, name);
+            std::cout << name << ": " << visible.size() << " of " << instances.size() << " instances drawn in " << commands.size() << " draws, "
+                      << stats.FrustumCulled << " outside the view, " << occluded << " behind the wall" << std::endl;
+        }
+    }
+
+    // no instances at all: no draws
+    GpuCuller empty;
+    for (const TestMesh& mesh : meshes)
+        empty.AddMesh(mesh.Levels, mesh.FirstIndex, mesh.BaseVertex, mesh.Radius);
+    std::vector<DrawElementsIndirectCommand> commands(1);
+    std::vector<unsigned int> visible(1);
+    empty.CullReference(projectionFor(DEPTH_STANDARD) * view, EYE, FOV_Y, (float)VIEWPORT_HEIGHT, commands, visible);
+    if (!commands.empty() || !visible.empty())
+    {
+        std::cout << "no instances: " << commands.size() << " commands" << std::endl;
+        failures++;
+    }
+
+    std::cout << (failures == 0 ? "OK" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+#include <spsc_queue.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+/*
+SPSCQueue (spsc_queue.h) microbenchmark. No window or OpenGL context is created: events shaped like camera.cpp's input
+events are pushed and popped on one thread (the cost a callback and a simulation tick pay per event), then streamed from a
+producer thread to a consumer thread, and the same is done with a mutex guarded std::deque for comparison. The streamed
+events carry sequence numbers, so every run also checks that nothing is lost, duplicated or reordered.
+usage: InputQueueBenchmark [events]
+*/
+
+// the layout of camera.cpp's InputEvent
+struct Event
+{
+    int Type;
+    unsigned int Frame;
+    double X, Y;
+};
+
+// the baseline: what a queue between the callbacks and the simulation would be without the ring
+class LockedQueue
+{
+public:
+    bool TryPush(const Event& event)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(event);
+        return true;
+    }
+
+    bool TryPop(Event& event)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (events.empty())
+            return false;
+        event = events.front();
+        events.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    std::deque<Event> events;
+};
+
+// pushes a batch and drains it, as a frame's callbacks and the next tick do; ns per event pushed and popped
+template<typename Queue>
+double sameThread(Queue& queue, unsigned int events, int& failures, const char* name)
+{
+    const unsigned int BATCH = 256;
+    Event event = { 0, 0, 0.0, 0.0 };
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int sent = 0; sent < events; sent += BATCH)
+    {
+        for (unsigned int i = 0; i < BATCH; i++)
+        {
+            event.X = (double)(sent + i);
+            queue.TryPush(event);
+        }
+        for (unsigned int i = 0; i < BATCH; i++)
+        {
+            Event received;
+            if (!queue.TryPop(received) || received.X != (double)(sent + i))
+            {
+                std::cout << name << ": event " << sent + i << " missing or out of order" << std::endl;
+                failures++;
+                return 0.0;
+            }
+        }
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / events;
+}
+
+// one producer, one consumer, the consumer checking the sequence; ns per event end to end
+template<typename Queue>
+double twoThreads(Queue& queue, unsigned int events, int& failures, const char* name)
+{
+    unsigned int errors = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&]()
+    {
+        Event event;
+        for (unsigned int expected = 0; expected < events;)
+        {
+            if (!queue.TryPop(event))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            if (event.Frame != expected)
+                errors++;
+            expected++;
+        }
+    });
+    Event event = { 0, 0, 1.0, 2.0 };
+    for (unsigned int i = 0; i < events; i++)
+    {
+        event.Frame = i;
+        // a full ring drops the event in camera.cpp; here the producer waits so the sequence stays complete
+        while (!queue.TryPush(event))
+            std::this_thread::yield();
+    }
+    consumer.join();
+    if (errors > 0)
+    {
+        std::cout << name << ": " << errors << " events out of sequence" << std::endl;
+        failures++;
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / events;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int events = argc > 1 ? (unsigned int)std::atoi(argv[1]) : 10000000;
+    events = std::max(events / 256, 1u) * 256;
+    int failures = 0;
+    std::cout << events << " events of " << sizeof(Event) << " bytes, " << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+    SPSCQueue<Event> ring(1024);
+    LockedQueue locked;
+    std::cout << "same thread, push + pop: SPSCQueue " << sameThread(ring, events, failures, "SPSCQueue") << " ns/event, mutex + deque "
+              << sameThread(locked, events, failures, "mutex + deque") << " ns/event" << std::endl;
+    std::cout << "producer to consumer thread: SPSCQueue " << twoThreads(ring, events, failures, "SPSCQueue") << " ns/event, mutex + deque "
+              << twoThreads(locked, events, failures, "mutex + deque") << " ns/event" << std::endl;
+
+    std::cout << (failures == 0 ? "OK" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+#include <glm/glm.hpp>
+#include <job_system.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+/*
+JobSystem (job_system.h) scaling benchmark. No window or OpenGL context is created: the same frame-like work (transforming
+and sphere-culling a few million points) is split with ParallelFor() on job systems of 1 to N threads, and the time,
+speedup and efficiency of each are printed next to the cost of an empty job. Every run is checked against a sequential
+pass, and so is a worker of one job system waiting on the counters of another, smaller one.
+usage: JobSystemBenchmark [elements] [repetitions] [max threads]
+*/
+
+// the per-element work: transform a point and test it against a sphere, a few dozen flops like a culling job
+inline unsigned int work(unsigned int i)
+{
+    float angle = (float)i * 0.001f;
+    glm::vec3 p(std::cos(angle) * 10.0f, (float)(i % 100) * 0.1f, std::sin(angle) * 10.0f);
+    glm::vec3 q(p.x * 0.8f - p.z * 0.6f + 1.0f, p.y + 2.0f, p.x * 0.6f + p.z * 0.8f - 3.0f);
+    return glm::dot(q, q) < 100.0f ? 1u : 0u;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int elements = argc > 1 ? (unsigned int)std::atoi(argv[1]) : 4000000;
+    int repetitions = argc > 2 ? std::atoi(argv[2]) : 10;
+    unsigned int cores = std::thread::hardware_concurrency();
+    unsigned int maxThreads = argc > 3 ? (unsigned int)std::atoi(argv[3]) : (cores > 0 ? cores : 1);
+    const unsigned int GRAIN = 4096;
+    int failures = 0;
+
+    unsigned int expected = 0;
+    for (unsigned int i = 0; i < elements; i++)
+        expected += work(i);
+    std::cout << elements << " elements, grain " << GRAIN << ", " << cores << " cores" << std::endl;
+
+    double oneThreadMs = 0.0;
+    for (unsigned int threads = 1; threads <= maxThreads; threads++)
+    {
+        JobSystem jobs((int)threads - 1);
+        std::vector<unsigned int> partial((elements + GRAIN - 1) / GRAIN);
+        double bestMs = 1e30;
+        for (int r = 0; r < repetitions; r++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            jobs.ParallelFor(elements, GRAIN, [&](unsigned int begin, unsigned int end)
+            {
+                unsigned int count = 0;
+                for (unsigned int i = begin; i < end; i++)
+                    count += work(i);
+                partial[begin / GRAIN] = count;
+            });
+            bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            unsigned int total = 0;
+            for (unsigned int count : partial)
+                total += count;
+            if (total != expected)
+            {
+                std::cout << threads << " threads: " << total << " inside, expected " << expected << std::endl;
+                failures++;
+                break;
+            }
+        }
+
+        // the overhead of a job: many empty ones behind one counter
+        const unsigned int EMPTY_JOBS = 100000;
+        JobSystem::Counter counter;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int j = 0; j < EMPTY_JOBS; j++)
+            jobs.Run([]() {}, &counter);
+        jobs.Wait(counter);
+        double jobNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / EMPTY_JOBS;
+
+        if (threads == 1)
+            oneThreadMs = bestMs;
+        double speedup = oneThreadMs / bestMs;
+        std::cout << threads << " threads: " << bestMs << " ms, speedup " << speedup << ", efficiency " << speedup / threads * 100.0 << "%, "
+                  << jobNs << " ns per empty job" << std::endl;
+    }
+
+    // workers of a large job system waiting on a small one's counters: they must use the small one's shared queue
+    {
+        JobSystem large(7), small(1);
+        std::atomic<unsigned int> total{ 0 };
+        large.ParallelFor(512, 1, [&](unsigned int begin, unsigned int end)
+        {
+            for (unsigned int b = begin; b < end; b++)
+                small.ParallelFor(1000, 10, [&](unsigned int first, unsigned int last)
+                {
+                    total.fetch_add(last - first, std::memory_order_relaxed);
+                });
+        });
+        if (total.load() != 512 * 1000)
+        {
+            std::cout << "nested job systems: " << total.load() << " elements, expected " << 512 * 1000 << std::endl;
+            failures++;
+        }
+    }
+
+    std::cout << (failures == 0 ? "OK" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -7,6 +7,7 @@
 
 #include <shader_m.h>
 #include <camera.h>
+#include <input_log.h>
 
 #include <iostream>
 
@@ -32,8 +33,14 @@ float lastFrame = 0.0f;
 // lighting
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 
-int main()
+// input recording/replay: --record=<file>, --replay=<file> [--timestep=<seconds>]
+InputLog input;
+
+int main(int argc, char* argv[])
 {
+    if (!input.Open(argc, argv))
+        return -1;
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -56,8 +63,10 @@ int main()
     }
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+    // the callbacks go through the input log, which records them or, on replay, feeds them the logged events instead
+    glfwSetCursorPosCallback(window, [](GLFWwindow* w, double x, double y) { input.Cursor(w, x, y); });
+    glfwSetScrollCallback(window, [](GLFWwindow* w, double x, double y) { input.Scroll(w, x, y); });
+    input.SetCallbacks(mouse_callback, scroll_callback);
 
     // tell GLFW to capture our mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -152,12 +161,13 @@ int main()
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    double replayStart = glfwGetTime();
+    while (!glfwWindowShouldClose(window) && !input.Finished())
     {
         // per-frame time logic
         // --------------------
         float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
+        deltaTime = input.BeginFrame(currentFrame - lastFrame);
         lastFrame = currentFrame;
 
         // input
@@ -206,6 +216,15 @@ int main()
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+        input.EndFrame(window);
+    }
+
+    if (input.GetMode() == InputLog::MODE_REPLAY)
+    {
+        glFinish();
+        double seconds = glfwGetTime() - replayStart;
+        std::cout << "replayed " << input.Frame() << " frames in " << seconds << " s ("
+                  << (input.Frame() > 0 ? seconds * 1000.0 / input.Frame() : 0.0) << " ms/frame)" << std::endl;
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
@@ -224,15 +243,15 @@ int main()
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow* window)
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (input.GetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    if (input.GetKey(window, GLFW_KEY_W) == GLFW_PRESS)
         camera.ProcessKeyboard(FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    if (input.GetKey(window, GLFW_KEY_S) == GLFW_PRESS)
         camera.ProcessKeyboard(BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+    if (input.GetKey(window, GLFW_KEY_A) == GLFW_PRESS)
         camera.ProcessKeyboard(LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    if (input.GetKey(window, GLFW_KEY_D) == GLFW_PRESS)
         camera.ProcessKeyboard(RIGHT, deltaTime);
 }
 
@@ -7,13 +7,34 @@
 
 #include <shader_m.h>
 #include <camera.h>
+#include <ecs.h>
+#include <job_system.h>
+#include <gl_context.h>
+#include <frame_capture.h>
+#include <input_log.h>
+#include <clustered_lights.h>
+#include <deferred_renderer.h>
+#include <shadow_maps.h>
+#include <material_library.h>
+#include <mesh_lod.h>
+#include <meshlets.h>
+#include <depth_pyramid.h>
+#include <gpu_culling.h>
+#include <shader_program.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <random>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
+int runSample(GLContext& context, int argc, char* argv[]);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -32,43 +53,232 @@ float lastFrame = 0.0f;
 // lighting
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 
-int main()
+// input recording/replay: --record=<file>, --replay=<file> [--timestep=<seconds>]
+InputLog input;
+
+// shading: forward or deferred (--shading=forward|deferred, G switches while running)
+bool deferredShading = false;
+bool deferredAvailable = false;
+bool switchWasPressed = false;
+
+// clustered forward shading (--lights=N): the usual lighting vertex shader and a fragment shader that only loops over
+// the lights of the fragment's cluster, plus the shadowed sun and lamp of extraLighting() with --shadows=1
+const char* clusteredVertexSource = R"(#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+
+out vec3 FragPos;
+out vec3 Normal;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(model))) * aNormal;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
+)";
+const char* clusteredFragmentMain = R"(
+in vec3 FragPos;
+in vec3 Normal;
+
+out vec4 FragColor;
+
+uniform vec3 viewPos;
+
+void main()
+{
+    lodDither();
+    vec3 normal = normalize(Normal);
+    vec3 viewDir = normalize(viewPos - FragPos);
+    float viewDepth = 1.0 / gl_FragCoord.w;
+    float shininess = materialShininess();
+    vec3 light = vec3(0.05) + clusteredLighting(FragPos, normal, viewDir, shininess, viewDepth) + extraLighting(FragPos, normal, viewDir, shininess, viewDepth);
+    FragColor = vec4(light * materialColor(), 1.0);
+}
+)";
+
+// the rock field of --gpu-culling=1: the clustered lighting, with the model matrix of the instance GpuCuller draws
+const char* instancedVertexMain = R"(
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+
+out vec3 FragPos;
+out vec3 Normal;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    mat4 model = instanceModel();
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(model))) * aNormal;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
+)";
+
+// the shaders a material can be drawn with: the lighting shader lit by the single light, the unlit lamp shader and
+// the clustered shader (which also does the shadows)
+enum ShaderVariant { VARIANT_LIT, VARIANT_UNLIT, VARIANT_CLUSTERED };
+
+// moves a light around a circle, so that the clusters are rebuilt from scratch every frame
+struct LightOrbit
+{
+    glm::vec3 Center = glm::vec3(0.0f);
+    float Radius = 1.0f;
+    float Speed = 1.0f;
+    float Phase = 0.0f;
+};
+
+// what draws into the shadow maps: static casters are cached, dynamic ones drawn every frame
+struct ShadowCaster
+{
+    bool Static = true;
+    float Extent = 0.5f;    // half the size of the object space bounding box
+};
+
+// moves a dynamic caster up and down
+struct Bobbing
+{
+    glm::vec3 Base = glm::vec3(0.0f);
+    float Phase = 0.0f;
+};
+
+// a lumpy rock: a subdivided icosahedron pushed in and out by a few waves, with smooth normals
+LodMesh makeRock(unsigned int subdivisions, float seed)
+{
+    const float t = 1.6180340f;
+    std::vector<glm::vec3> positions = { glm::vec3(-1, t, 0), glm::vec3(1, t, 0), glm::vec3(-1, -t, 0), glm::vec3(1, -t, 0),
+                                         glm::vec3(0, -1, t), glm::vec3(0, 1, t), glm::vec3(0, -1, -t), glm::vec3(0, 1, -t),
+                                         glm::vec3(t, 0, -1), glm::vec3(t, 0, 1), glm::vec3(-t, 0, -1), glm::vec3(-t, 0, 1) };
+    for (glm::vec3& position : positions)
+        position = glm::normalize(position);
+    std::vector<unsigned int> indices = { 0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11, 1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+                                          3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9, 4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1 };
+    for (unsigned int s = 0; s < subdivisions; s++)
+    {
+        // every edge gets one midpoint, shared by the triangles on both sides
+        std::map<std::pair<unsigned int, unsigned int>, unsigned int> midpoints;
+        auto midpoint = [&](unsigned int a, unsigned int b)
+        {
+            std::pair<unsigned int, unsigned int> edge(std::min(a, b), std::max(a, b));
+            auto found = midpoints.find(edge);
+            if (found != midpoints.end())
+                return found->second;
+            positions.push_back(glm::normalize(positions[a] + positions[b]));
+            return midpoints[edge] = (unsigned int)positions.size() - 1;
+        };
+        std::vector<unsigned int> finer;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            unsigned int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            finer.insert(finer.end(), { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca });
+        }
+        indices.swap(finer);
+    }
+    for (glm::vec3& position : positions)
+        position *= 1.0f + 0.15f * std::sin(position.x * 5.0f + seed) * std::sin(position.y * 4.0f + seed * 2.0f) * std::sin(position.z * 6.0f)
+                  + 0.05f * std::sin(position.x * 17.0f + position.z * 13.0f + seed);
+    std::vector<glm::vec3> normals(positions.size(), glm::vec3(0.0f));
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        glm::vec3 normal = glm::cross(positions[indices[i + 1]] - positions[indices[i]], positions[indices[i + 2]] - positions[indices[i]]);
+        for (int k = 0; k < 3; k++)
+            normals[indices[i + k]] += normal;
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+    LodMesh mesh;
+    for (size_t v = 0; v < positions.size(); v++)
+    {
+        glm::vec3 normal = glm::normalize(normals[v]);
+        mesh.Vertices.insert(mesh.Vertices.end(), { positions[v].x, positions[v].y, positions[v].z, normal.x, normal.y, normal.z });
+    }
+    mesh.Indices = indices;
+    return mesh;
+}
 
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+int main(int argc, char* argv[])
+{
+    if (!input.Open(argc, argv))
+        return -1;
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    // context: a window by default, or headless (--context=egl|osmesa) drawing into an offscreen framebuffer
+    // -------------------------------------------------------------------------------------------------------
+    GLContext context;
+    if (!context.Create(GLContext::FromArgs(argc, argv), SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
     {
-        std::cout << "Failed to initialize GLAD" << std::endl;
+        context.Destroy();
         return -1;
     }
+    // every object that owns GL names lives in runSample(), so their destructors run before the context goes away
+    int result = runSample(context, argc, argv);
+
+    // glfw: terminate, clearing all previously allocated GLFW resources (or the headless context and its framebuffer).
+    // ------------------------------------------------------------------------------------------------------------------
+    context.Destroy();
+    return result;
+}
+
+// the sample itself, from the callbacks to the final statistics; returns when the window closes or the frames ran out
+int runSample(GLContext& context, int argc, char* argv[])
+{
+    GLFWwindow* window = context.Window;
+    if (window)
+    {
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        // the callbacks go through the input log, which records them or, on replay, feeds them the logged events instead
+        glfwSetCursorPosCallback(window, [](GLFWwindow* w, double x, double y) { input.Cursor(w, x, y); });
+        glfwSetScrollCallback(window, [](GLFWwindow* w, double x, double y) { input.Scroll(w, x, y); });
+
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
+    input.SetCallbacks(mouse_callback, scroll_callback);
+    // without a window nobody closes the sample, it renders a fixed number of frames (--frames=N)
+    int headlessFrames = GLContext::IntArg(argc, argv, "frames", 600);
+    // --capture=<directory> saves every frame (--capture-format=png|raw) without stalling the render loop
+    std::string captureDirectory = GLContext::StringArg(argc, argv, "capture", "");
+    FrameCapture::Format captureFormat = GLContext::StringArg(argc, argv, "capture-format", "png") == "raw" ? FrameCapture::FORMAT_RAW : FrameCapture::FORMAT_PNG;
+    // --lights=N switches to clustered forward shading with N moving point lights over a floor of cubes;
+    // --cluster-check=1 compares the light assignment with the brute force reference every frame
+    int pointLightCount = GLContext::IntArg(argc, argv, "lights", 0);
+    // --shading=deferred renders the same scene through a G-buffer instead, lit with light volumes or, with
+    // --deferred-lighting=clustered, a full-screen pass over the clusters
+    deferredShading = GLContext::StringArg(argc, argv, "shading", "forward") == "deferred";
+    DeferredRenderer::Lighting deferredLighting = GLContext::StringArg(argc, argv, "deferred-lighting", "volumes") == "clustered"
+        ? DeferredRenderer::LIGHTING_CLUSTERED : DeferredRenderer::LIGHTING_VOLUMES;
+    // --shadows=1 adds a sun with cascaded shadow maps and turns the lamp into a shadowed point light, over pillars and
+    // bobbing cubes; --sun-speed=<radians/second> turns the sun, which re-renders the cached static shadows
+    bool shadowed = GLContext::IntArg(argc, argv, "shadows", 0) != 0;
+    float sunSpeed = (float)std::atof(GLContext::StringArg(argc, argv, "sun-speed", "0").c_str());
+    // --lod=1 adds a field of rocks (20480 triangles at full detail) drawn from LOD chains simplified at startup,
+    // --lod-threshold=<pixels> sets the screen space error a level may have
+    bool lod = GLContext::IntArg(argc, argv, "lod", 0) != 0;
+    float lodThreshold = (float)std::atof(GLContext::StringArg(argc, argv, "lod-threshold", "1").c_str());
+    // --meshlets=1 (implies --lod=1) also culls the rocks' meshlets against the view and draws what is left from an
+    // index buffer compacted every frame
+    bool meshletCulling = GLContext::IntArg(argc, argv, "meshlets", 0) != 0;
+    // --gpu-culling=1 (implies --lod=1) keeps the rocks out of the ECS: they are culled and given their level by compute
+    // shaders and drawn from one vertex and element buffer with a single indirect draw, or by the CPU reference when the
+    // context has no compute shaders (or with --gpu-culling=cpu). They cast no shadows. --gpu-culling-check=1 compares
+    // the GPU's draws with the reference every frame
+    std::string gpuCullingMode = GLContext::StringArg(argc, argv, "gpu-culling", "0");
+    bool gpuCulling = gpuCullingMode != "0";
+    bool gpuCullingCheck = GLContext::IntArg(argc, argv, "gpu-culling-check", 0) != 0;
+    // --hiz=1 builds a min/max pyramid of every frame's depth; with --gpu-culling the rocks are also tested for
+    // occlusion against it, the compute passes against last frame's pyramid and the CPU reference against its readback,
+    // a frame older. --hiz-check=1 compares the pyramid with the CPU reference every frame
+    bool hiZ = GLContext::IntArg(argc, argv, "hiz", 0) != 0;
+    bool hiZCheck = GLContext::IntArg(argc, argv, "hiz-check", 0) != 0;
+    lod = lod || meshletCulling || gpuCulling;
+    bool clustered = pointLightCount > 0 || deferredShading || shadowed || lod;
+    bool clusterCheck = GLContext::IntArg(argc, argv, "cluster-check", 0) != 0;
+    // --material-edits=1 changes the cube's material every frame, which uploads only its slot
+    bool materialEdits = GLContext::IntArg(argc, argv, "material-edits", 0) != 0;
 
     // configure global opengl state
     // -----------------------------
@@ -78,6 +288,32 @@ int main()
     // ------------------------------------
     Shader lightingShader("C:\\Users\\maqui\\Documents\\OpenGL\\OpenGL\\Shaders\\vertColor.glsl", "C:\\Users\\maqui\\Documents\\OpenGL\\OpenGL\\Shaders\\fragColor.glsl");
     Shader lightCubeShader("C:\\Users\\maqui\\Documents\\OpenGL\\OpenGL\\Shaders\\lightVert.glsl", "C:\\Users\\maqui\\Documents\\OpenGL\\OpenGL\\Shaders\\lightFrag.glsl");
+    ShaderProgram clusteredShader, instancedShader;
+    DeferredRenderer deferred;
+    ShadowMaps shadows;
+    if (clustered)
+    {
+        const char* extraLighting = shadowed ? ShadowMaps::ShaderSource() : DeferredRenderer::NoExtraLightingSource();
+        clusteredShader.Build(clusteredVertexSource, std::string("#version 330 core\n") + ClusterBuffers::ShaderSource() + MaterialLibrary::ShaderSource()
+                              + LodSelector::ShaderSource() + extraLighting + clusteredFragmentMain);
+        MaterialLibrary::Attach(clusteredShader.ID);
+        if (gpuCulling)
+        {
+            instancedShader.Build(std::string("#version 330 core\n") + GpuCuller::ShaderSource() + instancedVertexMain, std::string("#version 330 core\n")
+                                  + ClusterBuffers::ShaderSource() + MaterialLibrary::ShaderSource() + LodSelector::ShaderSource() + extraLighting
+                                  + clusteredFragmentMain);
+            MaterialLibrary::Attach(instancedShader.ID);
+        }
+        deferredAvailable = deferred.Create(SCR_WIDTH, SCR_HEIGHT, extraLighting);
+    }
+    // the G-buffer and cluster units come first, see DeferredRenderer
+    const int shadowUnit = 6;
+    if (shadowed)
+    {
+        shadows.Create();
+        deferred.SetupLighting = [&](const ShaderProgram& program) { shadows.Bind(program, shadowUnit); };
+    }
+    deferredShading = deferredShading && deferredAvailable;
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -153,64 +389,714 @@ int main()
     glEnableVertexAttribArray(0);
 
 
+    // describe the scene as data: the lit cube, the lamp and the camera are entities
+    // -------------------------------------------------------------------------------
+    ecs::World world;
+
+    // every material's parameters live in one uniform buffer; the file based shaders can't read it and get the
+    // color from the library's copy instead
+    MaterialLibrary materials;
+    materials.Create();
+    unsigned int litVariant = clustered ? VARIANT_CLUSTERED : VARIANT_LIT; // lit by the single light, or clustered
+    MaterialParams cubeMaterial;
+    cubeMaterial.Color = glm::vec3(1.0f, 0.5f, 0.31f);
+    MaterialParams floorMaterial;
+    floorMaterial.Color = glm::vec3(0.8f);
+    floorMaterial.Shininess = 8.0f;
+    MaterialParams pillarMaterial;
+    pillarMaterial.Color = glm::vec3(0.6f, 0.65f, 0.7f);
+    pillarMaterial.Shininess = 16.0f;
+    MaterialParams rockMaterial;
+    rockMaterial.Color = glm::vec3(0.55f, 0.5f, 0.45f);
+    rockMaterial.Shininess = 4.0f;
+    MaterialParams bobbingMaterial;
+    bobbingMaterial.Color = glm::vec3(0.3f, 0.6f, 0.9f);
+    bobbingMaterial.Shininess = 64.0f;
+    unsigned int cubeMaterialID = materials.Add("cube", litVariant, cubeMaterial);
+    materials.Add("lamp", VARIANT_UNLIT, MaterialParams());
+    materials.Add("floor", litVariant, floorMaterial);
+    materials.Add("pillar", litVariant, pillarMaterial);
+    materials.Add("bobbing", litVariant, bobbingMaterial);
+    materials.Add("rock", litVariant, rockMaterial);
+
+    ecs::MeshRenderer cubeRenderer;
+    cubeRenderer.VAO = cubeVAO;
+    cubeRenderer.Count = 36;
+    cubeRenderer.Material = cubeMaterialID;
+    world.Create(ecs::Transform(), cubeRenderer, ShadowCaster());
+
+    ecs::Transform lampTransform;
+    lampTransform.Position = lightPos;
+    lampTransform.Scale = 0.2f; // a smaller cube
+    ecs::MeshRenderer lampRenderer;
+    lampRenderer.VAO = lightCubeVAO;
+    lampRenderer.Count = 36;
+    lampRenderer.Material = materials.Find("lamp");
+    ecs::Entity lamp = world.Create(lampTransform, lampRenderer, ecs::Light());
+
+    if (clustered)
+    {
+        // a floor of cubes for the lights to fall on, and the lights themselves, at random but the same every run
+        ecs::MeshRenderer floorRenderer = cubeRenderer;
+        floorRenderer.Material = materials.Find("floor");
+        for (int z = -20; z < 20; z++)
+            for (int x = -20; x < 20; x++)
+            {
+                ecs::Transform tile;
+                tile.Position = glm::vec3(x, -1.5f, z);
+                world.Create(tile, floorRenderer, ShadowCaster());
+            }
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (int i = 0; i < pointLightCount; i++)
+        {
+            LightOrbit orbit;
+            orbit.Center = glm::vec3(unit(random) * 40.0f - 20.0f, -1.0f + unit(random) * 1.5f, unit(random) * 40.0f - 20.0f);
+            orbit.Radius = 0.5f + unit(random) * 2.0f;
+            orbit.Speed = 0.5f + unit(random);
+            orbit.Phase = unit(random) * 6.2831853f;
+            ecs::Light light;
+            light.Color = glm::vec3(unit(random), unit(random), unit(random));
+            light.Intensity = 2.0f;
+            light.Radius = 1.0f + unit(random) * 2.0f;
+            ecs::Transform transform;
+            transform.Position = orbit.Center;
+            world.Create(transform, light, orbit);
+        }
+    }
+    if (shadowed)
+    {
+        // static pillars in rows, and dynamic cubes bobbing between them
+        ecs::MeshRenderer pillarRenderer = cubeRenderer;
+        pillarRenderer.Material = materials.Find("pillar");
+        ecs::MeshRenderer dynamicRenderer = cubeRenderer;
+        dynamicRenderer.Material = materials.Find("bobbing");
+        ShadowCaster dynamicCaster;
+        dynamicCaster.Static = false;
+        for (int z = -16; z <= 16; z += 4)
+            for (int x = -16; x <= 16; x += 4)
+            {
+                for (int level = 0; level < 3; level++)
+                {
+                    ecs::Transform pillar;
+                    pillar.Position = glm::vec3(x, -0.5f + level, z);
+                    world.Create(pillar, pillarRenderer, ShadowCaster());
+                }
+
+                Bobbing bobbing;
+                bobbing.Base = glm::vec3(x + 2.0f, 0.5f, z + 2.0f);
+                bobbing.Phase = 0.7f * x + 0.3f * z;
+                ecs::Transform cube;
+                cube.Position = bobbing.Base;
+                cube.Scale = 0.5f;
+                world.Create(cube, dynamicRenderer, dynamicCaster, bobbing);
+            }
+    }
+
+    // the rocks' LOD chains share one vertex and one element buffer per mesh
+    std::vector<LodMesh> lodMeshes;
+    std::vector<unsigned int> lodBuffers;
+    std::vector<unsigned int> lodVAOs;
+    // and per level, their meshlets; the compacted indices go to one buffer that every rock's meshlet VAO reads
+    std::vector<std::vector<MeshletMesh>> meshletLevels;
+    std::vector<unsigned int> meshletVAOs;
+    unsigned int meshletIndexBuffer = 0;
+    // and with --gpu-culling, all of the chains in one vertex and one element buffer
+    GpuCuller culler;
+    unsigned int rockBuffers[2] = {}, rockVAO = 0;
+    if (lod)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int variant = 0; variant < 3; variant++)
+        {
+            LodMesh mesh = makeRock(5, variant * 1.7f);
+            MeshSimplifier::BuildChain(mesh);
+            unsigned int buffers[2], vao;
+            glGenBuffers(2, buffers);
+            glGenVertexArrays(1, &vao);
+            glBindVertexArray(vao);
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+            glBufferData(GL_ARRAY_BUFFER, mesh.Vertices.size() * sizeof(float), mesh.Vertices.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.Indices.size() * sizeof(unsigned int), mesh.Indices.data(), GL_STATIC_DRAW);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+            glEnableVertexAttribArray(1);
+            glBindVertexArray(0);
+            lodBuffers.insert(lodBuffers.end(), buffers, buffers + 2);
+            lodVAOs.push_back(vao);
+            lodMeshes.push_back(mesh);
+        }
+        std::cout << "lod: " << lodMeshes.size() << " rocks simplified in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms, levels (triangles, error):";
+        for (const LodLevel& level : lodMeshes[0].Levels)
+            std::cout << " " << level.Count / 3 << " " << level.Error;
+        std::cout << std::endl;
+
+        if (meshletCulling)
+        {
+            glGenBuffers(1, &meshletIndexBuffer);
+            unsigned int meshlets = 0;
+            for (unsigned int m = 0; m < lodMeshes.size(); m++)
+            {
+                meshletLevels.push_back(std::vector<MeshletMesh>());
+                for (const LodLevel& level : lodMeshes[m].Levels)
+                {
+                    meshletLevels[m].push_back(MeshletBuilder::Build(lodMeshes[m], level.First, level.Count));
+                    meshlets += (unsigned int)meshletLevels[m].back().Meshlets.size();
+                }
+                unsigned int vao;
+                glGenVertexArrays(1, &vao);
+                glBindVertexArray(vao);
+                glBindBuffer(GL_ARRAY_BUFFER, lodBuffers[m * 2]);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshletIndexBuffer);
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+                glEnableVertexAttribArray(0);
+                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+                glEnableVertexAttribArray(1);
+                glBindVertexArray(0);
+                meshletVAOs.push_back(vao);
+            }
+            std::cout << "meshlets: " << meshlets << " over every level, at most " << MeshletMesh::MAX_VERTICES << " vertices and "
+                      << MeshletMesh::MAX_TRIANGLES << " triangles each" << std::endl;
+        }
+
+        if (gpuCulling)
+        {
+            culler.LodThreshold = lodThreshold;
+            culler.Create(gpuCullingMode != "cpu");
+            std::vector<float> rockVertices;
+            std::vector<unsigned int> rockIndices;
+            for (const LodMesh& mesh : lodMeshes)
+            {
+                culler.AddMesh(mesh.Levels, (unsigned int)rockIndices.size(), (int)(rockVertices.size() / LodMesh::STRIDE), mesh.Radius);
+                rockVertices.insert(rockVertices.end(), mesh.Vertices.begin(), mesh.Vertices.end());
+                rockIndices.insert(rockIndices.end(), mesh.Indices.begin(), mesh.Indices.end());
+            }
+            glGenBuffers(2, rockBuffers);
+            glGenVertexArrays(1, &rockVAO);
+            glBindVertexArray(rockVAO);
+            glBindBuffer(GL_ARRAY_BUFFER, rockBuffers[0]);
+            glBufferData(GL_ARRAY_BUFFER, rockVertices.size() * sizeof(float), rockVertices.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, rockBuffers[1]);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, rockIndices.size() * sizeof(unsigned int), rockIndices.data(), GL_STATIC_DRAW);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+            glEnableVertexAttribArray(1);
+            glBindVertexArray(0);
+            culler.Attach(rockVAO);
+            std::cout << "gpu culling: " << (culler.Gpu() ? "compute shaders" : "CPU reference") << std::endl;
+        }
+
+        ecs::MeshRenderer rockRenderer;
+        rockRenderer.Material = materials.Find("rock");
+        rockRenderer.Indexed = true;
+        ShadowCaster rockCaster;
+        rockCaster.Static = false; // its level changes, the cached shadows would go stale
+        std::mt19937 random(2);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (int z = -12; z < 12; z++)
+            for (int x = -12; x < 12; x++)
+            {
+                LodState state;
+                state.Mesh = (unsigned int)(random() % lodMeshes.size());
+                ecs::Transform transform;
+                transform.Scale = 0.4f + unit(random) * 0.6f;
+                transform.Position = glm::vec3(x * 5.0f + unit(random) * 3.0f, -1.0f + transform.Scale * 0.5f, z * 5.0f + unit(random) * 3.0f);
+                transform.Angle = unit(random) * 360.0f;
+                rockRenderer.VAO = lodVAOs[state.Mesh];
+                rockRenderer.Count = lodMeshes[state.Mesh].Levels[0].Count;
+                rockCaster.Extent = lodMeshes[state.Mesh].Radius;
+                if (gpuCulling)
+                    culler.Add(state.Mesh, transform.GetModelMatrix());
+                else
+                    world.Create(transform, rockRenderer, rockCaster, state);
+            }
+    }
+
+    ecs::Transform cameraTransform;
+    cameraTransform.Position = glm::vec3(camera.Position);
+    world.Create(cameraTransform, ecs::Camera());
+
+    // systems run in order once per frame
+    glm::mat4 projection, view;
+    ecs::Scheduler scheduler;
+    scheduler.Add("camera", [&](ecs::World& w, float dt)
+    {
+        // the fly camera is still driven by the GLFW callbacks, mirror it into the camera entity
+        w.ForEach<ecs::Transform, ecs::Camera>([&](ecs::Entity, ecs::Transform& transform, ecs::Camera& cam)
+        {
+            transform.Position = glm::vec3(camera.Position);
+            cam.Yaw = camera.Yaw;
+            cam.Pitch = camera.Pitch;
+            cam.Zoom = camera.Zoom;
+            projection = glm::perspective(glm::radians(cam.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, cam.Near, cam.Far);
+            lightingShader.use();
+            lightingShader.setVec3("viewPos", transform.Position);
+        });
+        view = camera.GetViewMatrix();
+    });
+    float lightTime = 0.0f;
+    int framebufferWidth = SCR_WIDTH, framebufferHeight = SCR_HEIGHT;
+    scheduler.Add("animate", [&](ecs::World& w, float dt)
+    {
+        // driven by deltaTime, so a replay moves the lights exactly like the recorded run did
+        lightTime += dt;
+        w.ForEach<ecs::Transform, LightOrbit>([&](ecs::Entity, ecs::Transform& transform, LightOrbit& orbit)
+        {
+            float angle = orbit.Phase + lightTime * orbit.Speed;
+            transform.Position = orbit.Center + glm::vec3(std::cos(angle), 0.0f, std::sin(angle)) * orbit.Radius;
+        });
+        w.ForEach<ecs::Transform, Bobbing>([&](ecs::Entity, ecs::Transform& transform, Bobbing& bobbing)
+        {
+            transform.Position = bobbing.Base + glm::vec3(0.0f, std::sin(bobbing.Phase + lightTime * 2.0f), 0.0f);
+        });
+    });
+    // LOD: every rock picks the level its size on screen needs and cross-fades into it
+    LodSelector lodSelector;
+    lodSelector.Threshold = lodThreshold;
+    scheduler.Add("lod", [&](ecs::World& w, float dt)
+    {
+        if (!lod)
+            return;
+        lodSelector.BeginFrame(glm::radians(camera.Zoom), (float)framebufferHeight, dt);
+        glm::vec3 eye = glm::vec3(camera.Position);
+        w.ForEach<ecs::Transform, ecs::MeshRenderer, LodState>([&](ecs::Entity, ecs::Transform& transform, ecs::MeshRenderer& renderer, LodState& state)
+        {
+            const LodMesh& mesh = lodMeshes[state.Mesh];
+            lodSelector.Select(state, mesh, glm::length(transform.Position - eye), transform.Scale);
+            renderer.First = mesh.Levels[state.Level].First;
+            renderer.Count = mesh.Levels[state.Level].Count;
+            renderer.VAO = lodVAOs[state.Mesh];
+            renderer.Fade = LodSelector::FadeIn(state);
+        });
+    });
+    // Hi-Z: the depth of the frame before, reduced to a pyramid the culling tests occlusion against
+    DepthPyramid depthPyramid;
+    if (hiZ && !depthPyramid.Create(SCR_WIDTH, SCR_HEIGHT))
+    {
+        std::cout << "hiz: could not create the depth pyramid" << std::endl;
+        hiZ = false;
+    }
+    // GPU culling: the rocks are culled and their draws built where they are drawn, the CPU only starts the passes
+    unsigned int cullMismatches = 0;
+    scheduler.Add("culling", [&](ecs::World& w, float dt)
+    {
+        if (!gpuCulling)
+            return;
+        const HiZPyramid* occluders = nullptr;
+        if (hiZ)
+            occluders = culler.Gpu() ? &depthPyramid.Current() : &depthPyramid.Readback();
+        culler.Cull(projection * view, glm::vec3(camera.Position), glm::radians(camera.Zoom), (float)framebufferHeight, occluders);
+        if (gpuCullingCheck)
+            cullMismatches += culler.Validate();
+    });
+    // clustered shading: the lights are gathered, binned into the view's clusters on the job system and uploaded
+    JobSystem jobs;
+    LightClusters clusters;
+    ClusterBuffers clusterBuffers;
+    std::vector<PointLight> pointLights;
+    double assignMs = 0.0;
+    unsigned int clusterMismatches = 0;
+    scheduler.Add("lights", [&](ecs::World& w, float dt)
+    {
+        if (clustered)
+        {
+            pointLights.clear();
+            w.ForEach<ecs::Transform, ecs::Light>([&](ecs::Entity entity, ecs::Transform& transform, ecs::Light& light)
+            {
+                // with shadows the lamp is the shadowed light of ShadowMaps instead
+                if (shadowed && entity == lamp)
+                    return;
+                PointLight point;
+                point.Position = transform.Position;
+                point.Radius = light.Radius;
+                point.Color = light.Color;
+                point.Intensity = light.Intensity;
+                pointLights.push_back(point);
+            });
+            if (window)
+                glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            w.ForEach<ecs::Camera>([&](ecs::Entity, ecs::Camera& cam)
+            {
+                clusters.SetProjection(glm::radians(cam.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, cam.Near, cam.Far);
+            });
+            clusters.Assign(pointLights, view, &jobs);
+            assignMs += clusters.Stats().AssignMs;
+            if (clusterCheck)
+                clusterMismatches += clusters.Validate(pointLights, view);
+            clusterBuffers.Upload(pointLights, clusters);
+            clusteredShader.use();
+            clusterBuffers.Bind(clusteredShader, clusters, framebufferWidth, framebufferHeight);
+            return;
+        }
+        lightingShader.use();
+        w.ForEach<ecs::Transform, ecs::Light>([&](ecs::Entity, ecs::Transform& transform, ecs::Light& light)
+        {
+            lightingShader.setVec3("lightColor", light.Color * light.Intensity);
+            lightingShader.setVec3("lightPos", transform.Position);
+        });
+    });
+    // meshes draw from their vertices, or from their element buffer (the LOD chains)
+    auto drawMesh = [](const ecs::MeshRenderer& renderer)
+    {
+        glBindVertexArray(renderer.VAO);
+        if (renderer.Indexed)
+            glDrawElements(GL_TRIANGLES, renderer.Count, GL_UNSIGNED_INT, (void*)(renderer.First * sizeof(unsigned int)));
+        else
+            glDrawArrays(GL_TRIANGLES, renderer.First, renderer.Count);
+    };
+    // shadows: the sun's cascades follow the camera, the lamp's cube follows the lamp; both only redraw their static
+    // casters when they have to
+    scheduler.Add("shadows", [&](ecs::World& w, float dt)
+    {
+        if (!shadowed)
+            return;
+        float sunAngle = 0.6f + lightTime * sunSpeed;
+        shadows.SetSun(glm::vec3(std::cos(sunAngle) * 0.5f, -1.0f, std::sin(sunAngle) * 0.5f), glm::vec3(0.6f, 0.55f, 0.5f));
+        const ecs::Light& lampLight = w.Get<ecs::Light>(lamp);
+        shadows.SetLamp(w.Get<ecs::Transform>(lamp).Position, lampLight.Color * lampLight.Intensity, 8.0f);
+        ShadowMaps::DrawCasters drawCasters = [&](const ShaderProgram& program, bool staticCasters, const Frustum& frustum)
+        {
+            unsigned int draws = 0;
+            w.ForEach<ecs::Transform, ecs::MeshRenderer, ShadowCaster>([&](ecs::Entity, ecs::Transform& transform, ecs::MeshRenderer& renderer, ShadowCaster& caster)
+            {
+                if (caster.Static != staticCasters)
+                    return;
+                glm::mat4 model = transform.GetModelMatrix();
+                if (!frustum.Intersects(AABB(glm::vec3(-caster.Extent), glm::vec3(caster.Extent)).Transform(model)))
+                    return;
+                program.setMat4("model", model);
+                drawMesh(renderer);
+                draws++;
+            });
+            return draws;
+        };
+        w.ForEach<ecs::Camera>([&](ecs::Entity, ecs::Camera& cam)
+        {
+            shadows.Render(view, glm::radians(cam.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, cam.Near, drawCasters);
+        });
+        glBindVertexArray(0);
+        clusteredShader.use();
+        shadows.Bind(clusteredShader, shadowUnit);
+    });
+    // meshlets: after the shadows, which need the whole level, each rock's level is culled down to the meshlets that
+    // face the camera inside the view, all of them compacted into one index buffer
+    MeshletCuller meshletCuller;
+    std::vector<unsigned int> meshletIndices;
+    scheduler.Add("meshlets", [&](ecs::World& w, float dt)
+    {
+        if (!meshletCulling)
+            return;
+        Frustum frustum(projection * view);
+        glm::vec3 eye = glm::vec3(camera.Position);
+        meshletIndices.clear();
+        w.ForEach<ecs::Transform, ecs::MeshRenderer, LodState>([&](ecs::Entity, ecs::Transform& transform, ecs::MeshRenderer& renderer, LodState& state)
+        {
+            renderer.First = (unsigned int)meshletIndices.size();
+            renderer.Count = meshletCuller.Cull(meshletLevels[state.Mesh][state.Level], transform.GetModelMatrix(), eye, frustum, meshletIndices);
+            renderer.VAO = meshletVAOs[state.Mesh];
+        });
+        // orphaned every frame, so the upload never waits for last frame's draws
+        glBindBuffer(GL_ARRAY_BUFFER, meshletIndexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, meshletIndices.size() * sizeof(unsigned int), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, meshletIndices.size() * sizeof(unsigned int), meshletIndices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    });
+    // material edits only mark their slot, the upload sends the changed slots before anything is drawn
+    scheduler.Add("materials", [&](ecs::World& w, float dt)
+    {
+        if (materialEdits)
+        {
+            MaterialParams params = materials.Params(cubeMaterialID);
+            params.Color = glm::vec3(1.0f, 0.5f, 0.31f) * (0.75f + 0.25f * std::sin(lightTime * 3.0f));
+            materials.Edit(cubeMaterialID, params);
+        }
+        materials.Upload();
+    });
+    // recording draw commands fans out over the job system, GL submission stays on this (the context) thread
+    struct DrawCommand
+    {
+        glm::mat4 Model;
+        ecs::MeshRenderer Renderer;
+        unsigned int Key;
+    };
+    struct ChunkRange
+    {
+        unsigned int Count, Offset;
+        ecs::Transform* Transforms;
+        ecs::MeshRenderer* Renderers;
+    };
+    std::vector<DrawCommand> commands;
+    std::vector<ChunkRange> chunks;
+    scheduler.Add("record", [&](ecs::World& w, float dt)
+    {
+        // gather the chunks first so that every job knows where its commands go
+        chunks.clear();
+        unsigned int total = 0;
+        w.ForEachChunk<ecs::Transform, ecs::MeshRenderer>([&](unsigned int count, const ecs::Entity*, ecs::Transform* transforms, ecs::MeshRenderer* renderers)
+        {
+            chunks.push_back({ count, total, transforms, renderers });
+            total += count;
+        });
+        commands.resize(total);
+        jobs.ParallelFor((unsigned int)chunks.size(), 1, [&](unsigned int begin, unsigned int end)
+        {
+            for (unsigned int c = begin; c < end; c++)
+            {
+                const ChunkRange& chunk = chunks[c];
+                for (unsigned int i = 0; i < chunk.Count; i++)
+                {
+                    commands[chunk.Offset + i].Model = chunk.Transforms[i].GetModelMatrix();
+                    commands[chunk.Offset + i].Renderer = chunk.Renderers[i];
+                    commands[chunk.Offset + i].Key = materials.SortKey(chunk.Renderers[i].Material);
+                }
+            }
+        });
+        // a LOD cross-fade also draws the level being faded out
+        w.ForEach<ecs::Transform, ecs::MeshRenderer, LodState>([&](ecs::Entity, ecs::Transform& transform, ecs::MeshRenderer& renderer, LodState& state)
+        {
+            if (state.Previous < 0)
+                return;
+            DrawCommand command;
+            command.Model = transform.GetModelMatrix();
+            command.Renderer = renderer;
+            command.Renderer.VAO = lodVAOs[state.Mesh];
+            command.Renderer.First = lodMeshes[state.Mesh].Levels[state.Previous].First;
+            command.Renderer.Count = lodMeshes[state.Mesh].Levels[state.Previous].Count;
+            command.Renderer.Fade = LodSelector::FadeOut(state);
+            command.Key = materials.SortKey(renderer.Material);
+            commands.push_back(command);
+        });
+        // batched by shader variant, then material
+        std::sort(commands.begin(), commands.end(), [](const DrawCommand& a, const DrawCommand& b) { return a.Key < b.Key; });
+    });
+    // GPU time of the render system, kept per shading mode so they can be compared on the same scene
+    GpuTimer forwardTimer, deferredTimer;
+    unsigned long long variantBatches = 0, materialBatches = 0;
+    scheduler.Add("render", [&](ecs::World& w, float dt)
+    {
+        GpuTimer& timer = deferredShading ? deferredTimer : forwardTimer;
+        if (clustered)
+            timer.Begin();
+        materials.Bind();
+        if (deferredShading)
+        {
+            // the lit meshes go into the G-buffer and are lit in one go, the lamp is still drawn forward below
+            const ShaderProgram& geometry = deferred.BeginGeometry(framebufferWidth, framebufferHeight, view, projection);
+            for (const DrawCommand& command : commands)
+            {
+                if (materials.Variant(command.Renderer.Material) != VARIANT_CLUSTERED)
+                    continue;
+                geometry.setInt("materialIndex", command.Renderer.Material);
+                geometry.setFloat("lodFade", command.Renderer.Fade);
+                geometry.setMat4("model", command.Model);
+                drawMesh(command.Renderer);
+            }
+            deferred.Light(deferredLighting, (unsigned int)pointLights.size(), clusterBuffers, clusters, glm::vec3(camera.Position));
+        }
+        // the commands are sorted, so a shader is set up once per variant and a material once per batch
+        unsigned int variant = ~0u, material = ~0u;
+        for (const DrawCommand& command : commands)
+        {
+            const ecs::MeshRenderer& renderer = command.Renderer;
+            unsigned int commandVariant = materials.Variant(renderer.Material);
+            if (commandVariant == VARIANT_CLUSTERED && deferredShading)
+                continue;
+            if (commandVariant != variant)
+            {
+                variant = commandVariant;
+                material = ~0u;
+                variantBatches++;
+                if (variant == VARIANT_CLUSTERED)
+                {
+                    clusteredShader.use();
+                    clusteredShader.setVec3("viewPos", glm::vec3(camera.Position));
+                    clusteredShader.setMat4("projection", projection);
+                    clusteredShader.setMat4("view", view);
+                }
+                else
+                {
+                    Shader& shader = variant == VARIANT_LIT ? lightingShader : lightCubeShader;
+                    shader.use();
+                    shader.setMat4("projection", projection);
+                    shader.setMat4("view", view);
+                }
+            }
+            if (renderer.Material != material)
+            {
+                material = renderer.Material;
+                materialBatches++;
+                if (variant == VARIANT_CLUSTERED)
+                    clusteredShader.setInt("materialIndex", material);
+                else if (variant == VARIANT_LIT)
+                    lightingShader.setVec3("objectColor", materials.Params(material).Color);
+            }
+            if (variant == VARIANT_CLUSTERED)
+            {
+                clusteredShader.setFloat("lodFade", renderer.Fade);
+                clusteredShader.setMat4("model", command.Model);
+            }
+            else
+                (variant == VARIANT_LIT ? lightingShader : lightCubeShader).setMat4("model", command.Model);
+
+            drawMesh(renderer);
+        }
+        // the rocks of --gpu-culling, one indirect draw however many there are
+        if (gpuCulling)
+        {
+            instancedShader.use();
+            instancedShader.setVec3("viewPos", glm::vec3(camera.Position));
+            instancedShader.setMat4("projection", projection);
+            instancedShader.setMat4("view", view);
+            clusterBuffers.Bind(instancedShader, clusters, framebufferWidth, framebufferHeight);
+            if (shadowed)
+                shadows.Bind(instancedShader, shadowUnit);
+            instancedShader.setInt("materialIndex", materials.Find("rock"));
+            instancedShader.setFloat("lodFade", 0.0f);
+            culler.Bind(instancedShader);
+            culler.Draw(rockVAO);
+        }
+        if (clustered)
+            timer.End();
+    });
+    // after everything opaque is drawn, so the next frame's culling sees this one's occluders
+    unsigned int hiZMismatches = 0;
+    scheduler.Add("hiz", [&](ecs::World& w, float dt)
+    {
+        if (!hiZ)
+            return;
+        depthPyramid.Build(framebufferWidth, framebufferHeight, projection * view);
+        if (hiZCheck)
+            hiZMismatches += depthPyramid.Validate();
+    });
+
+
+    // the capture size follows what is drawn into, which can differ from SCR_WIDTH x SCR_HEIGHT on high dpi screens
+    std::unique_ptr<FrameCapture> capture;
+    if (!captureDirectory.empty())
+    {
+        int captureWidth, captureHeight;
+        context.FramebufferSize(captureWidth, captureHeight);
+        capture.reset(new FrameCapture(captureWidth, captureHeight, captureDirectory, captureFormat));
+    }
+
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    int frame = 0;
+    double loopStart = context.Time();
+    for (; !context.ShouldClose() && (!context.Headless() || frame < headlessFrames) && !input.Finished(); frame++)
     {
         // per-frame time logic
         // --------------------
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
+        float currentFrame = (float)context.Time();
+        deltaTime = input.BeginFrame(currentFrame - lastFrame);
         lastFrame = currentFrame;
 
         // input
         // -----
-        processInput(window);
+        // a replay drives the camera even without a window
+        if (window || input.GetMode() == InputLog::MODE_REPLAY)
+            processInput(window);
 
         // render
         // ------
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // be sure to activate shader when setting uniforms/drawing objects
-        lightingShader.use();
-        lightingShader.setVec3("objectColor", 1.0f, 0.5f, 0.31f);
-        lightingShader.setVec3("lightColor", 1.0f, 1.0f, 1.0f);
-        lightingShader.setVec3("lightPos", lightPos);
-        lightingShader.setVec3("viewPos", camera.Position);
-
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", view);
-
-        // world transformation
-        glm::mat4 model = glm::mat4(1.0f);
-        lightingShader.setMat4("model", model);
-
-        // render the cube
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-
-        // also draw the lamp object
-        lightCubeShader.use();
-        lightCubeShader.setMat4("projection", projection);
-        lightCubeShader.setMat4("view", view);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, lightPos);
-        model = glm::scale(model, glm::vec3(0.2f)); // a smaller cube
-        lightCubeShader.setMat4("model", model);
-
-        glBindVertexArray(lightCubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        // camera, lights and meshes are all updated and drawn by the scheduled systems
+        scheduler.Run(world, deltaTime);
+        if (capture)
+            capture->Capture();
+
+
+        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.), or just submit the offscreen frame
+        // -----------------------------------------------------------------------------------------------------------------
+        context.Present();
+        input.EndFrame(window);
+    }
+    // throughput of the whole loop, including waiting for the last frames to finish
+    glFinish();
+    double loopTime = context.Time() - loopStart;
+    std::cout << GLContext::Name(context.Type) << ": " << frame << " frames in " << loopTime << " s, " << (loopTime > 0.0 ? frame / loopTime : 0.0) << " frames/second" << std::endl;
+    if (clustered)
+    {
+        ClusterStats stats = clusters.Stats();
+        std::cout << "clusters: " << pointLights.size() << " lights, " << stats.Lights << " in range, " << stats.Occupied << "/" << clusters.ClusterCount()
+                  << " clusters lit, " << stats.References << " references (max " << stats.MaxPerCluster << " per cluster), assignment "
+                  << (frame > 0 ? assignMs / frame : 0.0) << " ms/frame" << std::endl;
+        std::cout << "shading: forward " << forwardTimer.AverageMs() << " ms GPU/frame (" << forwardTimer.Samples << " frames), deferred ("
+                  << (deferredLighting == DeferredRenderer::LIGHTING_CLUSTERED ? "clustered" : "light volumes") << ") " << deferredTimer.AverageMs()
+                  << " ms GPU/frame (" << deferredTimer.Samples << " frames)" << std::endl;
+        if (shadowed)
+        {
+            ShadowStats stats = shadows.Stats();
+            std::cout << "shadows:";
+            for (int c = 0; c < ShadowStats::CASCADES; c++)
+                std::cout << " cascade " << c << " " << (stats.Frames ? (double)stats.CascadeDraws[c] / stats.Frames : 0.0) << " draws/frame, static re-rendered "
+                          << stats.CascadeStaticRenders[c] << "/" << stats.Frames << " frames;";
+            std::cout << " lamp cube " << (stats.Frames ? (double)stats.CubeDraws / stats.Frames : 0.0) << " draws/frame, static re-rendered "
+                      << stats.CubeStaticRenders << "/" << stats.Frames << " frames" << std::endl;
+        }
+        if (clusterCheck)
+            std::cout << "cluster check: " << clusterMismatches << " clusters differ from the brute force reference" << std::endl;
+    }
+    {
+        MaterialStats stats = materials.Stats();
+        std::cout << "materials: " << stats.Materials << ", " << (frame > 0 ? (double)variantBatches / frame : 0.0) << " shader variants and "
+                  << (frame > 0 ? (double)materialBatches / frame : 0.0) << " material batches per frame (" << commands.size() << " draws), " << stats.Edits
+                  << " edits, " << stats.Uploads << " uploads, " << stats.BytesUploaded << " bytes" << std::endl;
+    }
+    if (lod && !gpuCulling)
+    {
+        LodStats stats = lodSelector.Stats();
+        double submitted = frame > 0 ? (double)stats.Triangles / frame : 0.0, full = frame > 0 ? (double)stats.FullTriangles / frame : 0.0;
+        std::cout << "lod: " << submitted << " rock triangles/frame submitted, " << full << " at full detail (" << (full > 0.0 ? 100.0 * submitted / full : 0.0)
+                  << "%), " << stats.Switches << " level switches" << std::endl;
+    }
+    if (meshletCulling)
+    {
+        MeshletStats stats = meshletCuller.Stats();
+        double frames = frame > 0 ? (double)frame : 1.0;
+        std::cout << "meshlets: " << stats.Tested / frames << " tested/frame, " << stats.FrustumCulled / frames << " outside the frustum, "
+                  << stats.ConeCulled / frames << " facing away, " << stats.Visible / frames << " drawn; " << stats.Triangles / frames << " of "
+                  << stats.TrianglesTested / frames << " triangles/frame emitted" << std::endl;
+    }
+    if (gpuCulling)
+    {
+        GpuCullStats stats = culler.Stats();
+        double frames = frame > 0 ? (double)frame : 1.0;
+        std::cout << "gpu culling: " << culler.Size() << " rocks culled " << (culler.Gpu() ? "by compute shaders" : "on the CPU") << ", "
+                  << stats.CullMs / frames << " ms CPU/frame";
+        if (!culler.Gpu())
+            std::cout << ", " << stats.FrustumCulled / frames << " outside the frustum, " << stats.Occluded / frames << " occluded, " << stats.Visible / frames << " drawn in "
+                      << stats.Draws / frames << " draws/frame";
+        if (gpuCullingCheck)
+            std::cout << ", " << cullMismatches << " instances differ from the CPU reference";
+        std::cout << std::endl;
+    }
+    if (hiZ)
+    {
+        DepthPyramidStats stats = depthPyramid.Stats();
+        const HiZPyramid& pyramid = depthPyramid.Current();
+        unsigned int first = depthPyramid.Readback().CpuFirstLevel;
+        std::cout << "hiz: " << pyramid.Widths[0] << "x" << pyramid.Heights[0] << ", " << pyramid.Levels() << " levels, " << stats.Builds
+                  << " built, CPU copy from level " << first << " (" << pyramid.Widths[first] << "x" << pyramid.Heights[first] << ") "
+                  << stats.Readbacks << " read back, " << stats.Late << " late";
+        if (hiZCheck)
+            std::cout << ", " << hiZMismatches << " texels differ from the CPU reference";
+        std::cout << std::endl;
+    }
+    if (capture)
+    {
+        capture->Flush();
+        CaptureStats stats = capture->Stats();
+        std::cout << "capture: " << stats.Written << " written, " << stats.Dropped << " dropped, " << stats.Stalls << " stalls, latency " << stats.LatencyMs << " ms ("
+                  << stats.LatencyFrames << " frames), render thread " << stats.RenderThreadMs << " ms/frame, encode " << stats.EncodeMs << " ms/frame, "
+                  << stats.FramesPerSecond << " frames/second (" << stats.MegabytesPerSecond << " MB/s)" << std::endl;
+        capture.reset();
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
@@ -218,10 +1104,21 @@ int main()
     glDeleteVertexArrays(1, &cubeVAO);
     glDeleteVertexArrays(1, &lightCubeVAO);
     glDeleteBuffers(1, &VBO);
-
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    // ------------------------------------------------------------------
-    glfwTerminate();
+    if (!lodVAOs.empty())
+    {
+        glDeleteVertexArrays((GLsizei)lodVAOs.size(), lodVAOs.data());
+        glDeleteBuffers((GLsizei)lodBuffers.size(), lodBuffers.data());
+    }
+    if (rockVAO)
+    {
+        glDeleteVertexArrays(1, &rockVAO);
+        glDeleteBuffers(2, rockBuffers);
+    }
+    if (meshletIndexBuffer)
+    {
+        glDeleteVertexArrays((GLsizei)meshletVAOs.size(), meshletVAOs.data());
+        glDeleteBuffers(1, &meshletIndexBuffer);
+    }
     return 0;
 }
 
@@ -229,17 +1126,26 @@ int main()
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow* window)
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (window && input.GetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    if (input.GetKey(window, GLFW_KEY_W) == GLFW_PRESS)
         camera.ProcessKeyboard(FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    if (input.GetKey(window, GLFW_KEY_S) == GLFW_PRESS)
         camera.ProcessKeyboard(BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+    if (input.GetKey(window, GLFW_KEY_A) == GLFW_PRESS)
         camera.ProcessKeyboard(LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    if (input.GetKey(window, GLFW_KEY_D) == GLFW_PRESS)
         camera.ProcessKeyboard(RIGHT, deltaTime);
+
+    // G switches between forward and deferred shading (only with the clustered scene, see --lights)
+    bool switchPressed = input.GetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+    if (switchPressed && !switchWasPressed && deferredAvailable)
+    {
+        deferredShading = !deferredShading;
+        std::cout << (deferredShading ? "deferred" : "forward") << " shading" << std::endl;
+    }
+    switchWasPressed = switchPressed;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
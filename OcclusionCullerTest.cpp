@@ -0,0 +1,302 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <occlusion_culler.h>
+#include <job_system.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+Headless test of the software occlusion culler (occlusion_culler.h). No window or OpenGL context is created: a wall,
+a floor and a low wall that run from behind the camera through the near plane, and a scatter of triangles are rasterized by
+OcclusionCuller, and its depth buffer is compared pixel by pixel with a ray cast through every pixel center against the
+same triangles; pixels whose ray grazes an edge, where either answer is right, are left out. Tile maxima have to match
+the pixels, and the job system has to produce the same buffer as one thread. Boxes are then tested: any box with a
+point in front of the ray cast depth has to be visible, boxes behind the wall have to be hidden and boxes in front of
+or beside it visible, and Filter() has to agree with IsVisible(). Both depth conventions and a size that is not a
+whole number of tiles are covered.
+usage: OcclusionCullerTest [boxes] [seed]
+*/
+
+const float FOV_Y = glm::radians(60.0f), NEAR_PLANE = 0.5f, FAR_PLANE = 100.0f;
+const glm::vec3 EYE(0.0f, 1.5f, 8.0f), TARGET(0.0f, 0.5f, 0.0f);
+
+struct Scene
+{
+    std::vector<glm::vec3> Triangles;   // world space, three vertices per triangle
+};
+
+glm::mat4 projectionFor(DepthConvention depth, float aspect)
+{
+    if (depth == DEPTH_STANDARD)
+        return glm::perspective(FOV_Y, aspect, NEAR_PLANE, FAR_PLANE);
+    // camera.h's reversed-z projection with an infinite far plane
+    float f = 1.0f / std::tan(FOV_Y * 0.5f);
+    glm::mat4 projection(0.0f);
+    projection[0][0] = f / aspect;
+    projection[1][1] = f;
+    projection[2][3] = -1.0f;
+    projection[3][2] = NEAR_PLANE;
+    return projection;
+}
+
+// the culler's depth of a world position: 0 at the near plane, 1 at the far plane (or infinity) in both conventions
+float referenceDepth(const glm::mat4& viewProjection, const glm::vec3& p, DepthConvention depth)
+{
+    glm::vec4 clip = viewProjection * glm::vec4(p, 1.0f);
+    return depth == DEPTH_REVERSED_Z ? 1.0f - clip.z / clip.w : clip.z / clip.w * 0.5f + 0.5f;
+}
+
+// The occluders' depth at every pixel center, by casting a ray from the eye and keeping the nearest hit in front of
+// the near plane (Moller-Trumbore). ambiguous marks the pixels whose ray passes within a hair of a triangle's edge or
+// hits next to the near plane
+std::vector<float> castScene(const Scene& scene, const glm::mat4& viewProjection, DepthConvention depth, unsigned int width, unsigned int height,
+                             std::vector<bool>& ambiguous)
+{
+    glm::mat4 view = glm::lookAt(EYE, TARGET, glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::vec3 right(view[0][0], view[1][0], view[2][0]), up(view[0][1], view[1][1], view[2][1]), forward(-view[0][2], -view[1][2], -view[2][2]);
+    float tanY = std::tan(FOV_Y * 0.5f), aspect = (float)width / height;
+    std::vector<float> buffer((std::size_t)width * height, 1.0f);
+    ambiguous.assign(buffer.size(), false);
+    for (unsigned int y = 0; y < height; y++)
+        for (unsigned int x = 0; x < width; x++)
+        {
+            float nx = ((float)x + 0.5f) / width * 2.0f - 1.0f, ny = ((float)y + 0.5f) / height * 2.0f - 1.0f;
+            glm::vec3 direction = forward + right * (nx * tanY * aspect) + up * (ny * tanY);
+            std::size_t pixel = (std::size_t)y * width + x;
+            for (std::size_t t = 0; t < scene.Triangles.size(); t += 3)
+            {
+                const glm::vec3& a = scene.Triangles[t];
+                glm::vec3 e1 = scene.Triangles[t + 1] - a, e2 = scene.Triangles[t + 2] - a;
+                glm::vec3 p = glm::cross(direction, e2);
+                float determinant = glm::dot(e1, p);
+                if (std::fabs(determinant) < 1e-12f)
+                    continue;
+                glm::vec3 s = EYE - a;
+                float u = glm::dot(s, p) / determinant;
+                glm::vec3 q = glm::cross(s, e1);
+                float v = glm::dot(direction, q) / determinant;
+                float distance = glm::dot(e2, q) / determinant;   // along direction, whose forward component is 1
+                float edge = std::min(std::min(u, v), 1.0f - u - v);
+                if (edge < -1e-4f || distance <= 0.0f)
+                    continue;
+                if (edge < 1e-4f || std::fabs(distance - NEAR_PLANE) < 1e-3f)
+                {
+                    ambiguous[pixel] = true;
+                    continue;
+                }
+                if (distance < NEAR_PLANE)
+                    continue;
+                buffer[pixel] = std::min(buffer[pixel], referenceDepth(viewProjection, EYE + direction * distance, depth));
+            }
+        }
+    return buffer;
+}
+
+// a box is certainly visible when a point on its surface is in front of the cast depth at an unambiguous pixel
+bool certainlyVisible(const AABB& box, const std::vector<float>& buffer, const std::vector<bool>& ambiguous, const glm::mat4& viewProjection,
+                      DepthConvention depth, unsigned int width, unsigned int height)
+{
+    const int STEPS = 12;
+    for (int axis = 0; axis < 3; axis++)
+        for (int side = 0; side < 2; side++)
+            for (int i = 0; i <= STEPS; i++)
+                for (int j = 0; j <= STEPS; j++)
+                {
+                    glm::vec3 t;
+                    t[axis] = (float)side;
+                    t[(axis + 1) % 3] = (float)i / STEPS;
+                    t[(axis + 2) % 3] = (float)j / STEPS;
+                    glm::vec3 p = box.Min + (box.Max - box.Min) * t;
+                    glm::vec4 clip = viewProjection * glm::vec4(p, 1.0f);
+                    if (clip.w <= NEAR_PLANE)
+                        continue;
+                    float sx = (clip.x / clip.w * 0.5f + 0.5f) * width, sy = (clip.y / clip.w * 0.5f + 0.5f) * height;
+                    if (sx < 0.0f || sy < 0.0f || sx >= (float)width || sy >= (float)height)
+                        continue;
+                    std::size_t pixel = (std::size_t)sy * width + (std::size_t)sx;
+                    if (!ambiguous[pixel] && referenceDepth(viewProjection, p, depth) < buffer[pixel] - 1e-3f)
+                        return true;
+                }
+    return false;
+}
+
+// two triangles of a quad given as corner, edge and edge, in the local space of the occluder
+void addQuad(std::vector<float>& vertices, const glm::vec3& corner, const glm::vec3& u, const glm::vec3& v)
+{
+    const glm::vec3 points[] = { corner, corner + u, corner + u + v, corner, corner + u + v, corner + v };
+    for (const glm::vec3& p : points)
+        vertices.insert(vertices.end(), { p.x, p.y, p.z, 0.0f, 0.0f });
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int boxCount = argc > 1 ? (unsigned int)std::atoi(argv[1]) : 500;
+    std::mt19937 rng(argc > 2 ? (unsigned int)std::atoi(argv[2]) : 31);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    int failures = 0;
+
+    // occluders as a sample hands them over: positions followed by other attributes (stride 5), with a model matrix.
+    // The wall is a unit quad scaled into place; the floor and a low wall left of the camera run from behind the camera
+    // through the near plane, so both are clipped in view
+    std::vector<float> wall, floor, scatter;
+    addQuad(wall, glm::vec3(-0.5f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 wallModel = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.0f, 0.0f)), glm::vec3(8.0f, 4.0f, 1.0f));
+    addQuad(floor, glm::vec3(-10.0f, -1.0f, 12.0f), glm::vec3(20.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -40.0f));
+    addQuad(floor, glm::vec3(-0.4f, -1.0f, 9.0f), glm::vec3(0.0f, 0.0f, -5.0f), glm::vec3(0.0f, 2.0f, 0.0f));
+    for (int t = 0; t < 20; t++)
+    {
+        glm::vec3 center(unit(rng) * 30.0f - 15.0f, unit(rng) * 7.0f - 1.0f, -10.0f - unit(rng) * 20.0f);
+        for (int k = 0; k < 3; k++)
+        {
+            glm::vec3 p = center + glm::vec3(unit(rng) * 6.0f - 3.0f, unit(rng) * 6.0f - 3.0f, unit(rng) * 2.0f - 1.0f);
+            scatter.insert(scatter.end(), { p.x, p.y, p.z, 0.0f, 0.0f });
+        }
+    }
+    Scene scene;
+    for (std::size_t i = 0; i < wall.size(); i += 5)
+        scene.Triangles.push_back(glm::vec3(wallModel * glm::vec4(wall[i], wall[i + 1], wall[i + 2], 1.0f)));
+    for (const std::vector<float>* vertices : { &floor, &scatter })
+        for (std::size_t i = 0; i < vertices->size(); i += 5)
+            scene.Triangles.push_back(glm::vec3((*vertices)[i], (*vertices)[i + 1], (*vertices)[i + 2]));
+
+    // random boxes, and ones whose answer is known: behind the wall, in front of it, and beside it above the floor
+    std::vector<AABB> boxes;
+    for (unsigned int b = 0; b < boxCount; b++)
+    {
+        glm::vec3 center(unit(rng) * 30.0f - 15.0f, unit(rng) * 8.0f - 2.0f, unit(rng) * 40.0f - 32.0f);
+        glm::vec3 extent(0.05f + unit(rng) * 1.5f, 0.05f + unit(rng) * 1.5f, 0.05f + unit(rng) * 1.5f);
+        boxes.push_back(AABB(center - extent, center + extent));
+    }
+    const unsigned int hidden = (unsigned int)boxes.size();
+    boxes.push_back(AABB(glm::vec3(-0.5f, 0.5f, -5.5f), glm::vec3(0.5f, 1.5f, -4.5f)));
+    boxes.push_back(AABB(glm::vec3(-2.0f, -0.5f, -3.0f), glm::vec3(2.0f, 1.0f, -2.0f)));
+    const unsigned int shown = (unsigned int)boxes.size();
+    boxes.push_back(AABB(glm::vec3(-0.5f, 0.5f, 2.5f), glm::vec3(0.5f, 1.5f, 3.5f)));
+    boxes.push_back(AABB(glm::vec3(8.0f, 0.5f, -5.5f), glm::vec3(9.0f, 1.5f, -4.5f)));
+
+    JobSystem jobs;
+    glm::mat4 view = glm::lookAt(EYE, TARGET, glm::vec3(0.0f, 1.0f, 0.0f));
+    const unsigned int sizes[][2] = { { 256, 128 }, { 100, 61 } };
+    const DepthConvention conventions[] = { DEPTH_STANDARD, DEPTH_REVERSED_Z };
+    for (const auto& size : sizes)
+        for (DepthConvention depth : conventions)
+        {
+            OcclusionCuller culler(size[0], size[1]);
+            std::string name = std::to_string(size[0]) + "x" + std::to_string(size[1]) + (depth == DEPTH_REVERSED_Z ? ", reversed-z" : ", standard depth");
+            if (culler.Width % OcclusionCuller::TILE_SIZE != 0 || culler.Width < size[0] || culler.Width >= size[0] + OcclusionCuller::TILE_SIZE
+                || culler.Height % OcclusionCuller::TILE_SIZE != 0 || culler.Height < size[1] || culler.Height >= size[1] + OcclusionCuller::TILE_SIZE)
+            {
+                std::cout << name << ": buffer is " << culler.Width << "x" << culler.Height << std::endl;
+                failures++;
+            }
+            // the projection follows the buffer the culler actually has
+            glm::mat4 viewProjection = projectionFor(depth, (float)culler.Width / culler.Height) * view;
+
+            culler.BeginFrame(viewProjection, depth);
+            culler.AddOccluder(wall.data(), 5, (unsigned int)wall.size() / 5, wallModel);
+            culler.AddOccluder(floor.data(), 5, (unsigned int)floor.size() / 5, glm::mat4(1.0f));
+            culler.AddOccluder(scatter.data(), 5, (unsigned int)scatter.size() / 5, glm::mat4(1.0f));
+            culler.Rasterize();
+            std::vector<float> oneThread = culler.Depth;
+            std::vector<float> oneThreadTiles = culler.TileMax;
+
+            // the depth buffer against the ray cast
+            std::vector<bool> ambiguous;
+            std::vector<float> reference = castScene(scene, viewProjection, depth, culler.Width, culler.Height, ambiguous);
+            unsigned int mismatches = 0, skipped = 0;
+            for (std::size_t p = 0; p < reference.size(); p++)
+            {
+                if (ambiguous[p])
+                {
+                    skipped++;
+                    continue;
+                }
+                if (std::fabs(culler.Depth[p] - reference[p]) > 1e-4f)
+                    mismatches++;
+            }
+            if (mismatches > 0 || skipped * 10 > reference.size())
+            {
+                std::cout << name << ": " << mismatches << " pixels differ from the ray cast, " << skipped << " on edges" << std::endl;
+                failures++;
+            }
+            unsigned int badTiles = 0;
+            for (unsigned int ty = 0; ty < culler.TilesY; ty++)
+                for (unsigned int tx = 0; tx < culler.TilesX; tx++)
+                {
+                    float farthest = 0.0f;
+                    for (unsigned int y = ty * OcclusionCuller::TILE_SIZE; y < (ty + 1) * OcclusionCuller::TILE_SIZE; y++)
+                        for (unsigned int x = tx * OcclusionCuller::TILE_SIZE; x < (tx + 1) * OcclusionCuller::TILE_SIZE; x++)
+                            farthest = std::max(farthest, culler.Depth[y * culler.Width + x]);
+                    badTiles += culler.TileMax[ty * culler.TilesX + tx] != farthest ? 1 : 0;
+                }
+            if (badTiles > 0)
+            {
+                std::cout << name << ": " << badTiles << " tiles whose maximum is not their farthest pixel" << std::endl;
+                failures++;
+            }
+
+            // the same frame on the job system
+            culler.BeginFrame(viewProjection, depth);
+            culler.AddOccluder(wall.data(), 5, (unsigned int)wall.size() / 5, wallModel);
+            culler.AddOccluder(floor.data(), 5, (unsigned int)floor.size() / 5, glm::mat4(1.0f));
+            culler.AddOccluder(scatter.data(), 5, (unsigned int)scatter.size() / 5, glm::mat4(1.0f));
+            culler.Rasterize(&jobs);
+            if (culler.Depth != oneThread || culler.TileMax != oneThreadTiles)
+            {
+                std::cout << name << ": the job system rasterized a different buffer" << std::endl;
+                failures++;
+            }
+
+            // the boxes
+            unsigned int wrong = 0, culled = 0;
+            std::vector<unsigned int> expectedVisible;
+            for (unsigned int b = 0; b < boxes.size(); b++)
+            {
+                bool visible = culler.IsVisible(boxes[b]);
+                culled += visible ? 0 : 1;
+                if (visible)
+                    expectedVisible.push_back(b);
+                if (!visible && certainlyVisible(boxes[b], reference, ambiguous, viewProjection, depth, culler.Width, culler.Height))
+                    wrong++;
+            }
+            if (wrong > 0)
+            {
+                std::cout << name << ": " << wrong << " boxes with a point in front of the occluders are culled" << std::endl;
+                failures++;
+            }
+            for (unsigned int b = hidden; b < shown; b++)
+                if (culler.IsVisible(boxes[b]))
+                {
+                    std::cout << name << ": box " << b << " behind the wall is visible" << std::endl;
+                    failures++;
+                }
+            for (unsigned int b = shown; b < boxes.size(); b++)
+                if (!culler.IsVisible(boxes[b]))
+                {
+                    std::cout << name << ": box " << b << " in front of or beside the wall is culled" << std::endl;
+                    failures++;
+                }
+            for (JobSystem* filterJobs : { (JobSystem*)nullptr, &jobs })
+            {
+                std::vector<unsigned int> visible(boxes.size());
+                for (unsigned int b = 0; b < boxes.size(); b++)
+                    visible[b] = b;
+                unsigned int removed = culler.Filter(boxes, visible, filterJobs);
+                if (visible != expectedVisible || removed != culled)
+                {
+                    std::cout << name << ": Filter() kept " << visible.size() << " boxes, IsVisible() " << expectedVisible.size() << std::endl;
+                    failures++;
+                }
+            }
+            std::cout << name << ": " << culler.OccluderTriangles() << " occluder triangles, " << culled << " of " << boxes.size() << " boxes culled" << std::endl;
+        }
+
+    std::cout << (failures == 0 ? "OK" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
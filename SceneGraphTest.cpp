@@ -0,0 +1,155 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <scene_graph.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+/*
+SceneGraph (scene_graph.h) test and benchmark. No window or OpenGL context is created: a deep random hierarchy is built,
+a share of its nodes is animated every frame, and each Update() is checked against a naive recursive recompute of every
+world matrix. The number of matrices Update() rebuilds has to be exactly the size of the union of the dirty subtrees,
+and its time is printed for a few shares so it can be seen to follow the changes rather than the size of the graph.
+usage: SceneGraphTest [nodes] [frames]
+*/
+
+struct Hierarchy
+{
+    std::vector<int> Parent;
+    std::vector<std::vector<unsigned int>> Children;
+    std::vector<glm::mat4> Local;
+};
+
+// a random recursive tree (every node picks one of the nodes before it) with a chain of CHAIN_LENGTH nodes starting
+// at every 20000th node, so the graph is both wide and deep; returns the depth
+unsigned int buildHierarchy(Hierarchy& hierarchy, SceneGraph& scene, unsigned int nodes, std::mt19937& rng)
+{
+    const unsigned int CHAIN_LENGTH = 1000;
+    std::vector<unsigned int> depth;
+    for (unsigned int i = 0; i < nodes; i++)
+    {
+        int parent = -1;
+        if (i > 0)
+            parent = (i % 20000 < CHAIN_LENGTH && i >= 20000) ? (int)i - 1 : (int)(rng() % i);
+        glm::vec3 offset((float)(rng() % 200) * 0.01f - 1.0f, (float)(rng() % 200) * 0.01f - 1.0f, (float)(rng() % 200) * 0.01f - 1.0f);
+        glm::mat4 local = glm::translate(glm::mat4(1.0f), offset);
+        hierarchy.Parent.push_back(parent);
+        hierarchy.Children.push_back(std::vector<unsigned int>());
+        hierarchy.Local.push_back(local);
+        depth.push_back(parent < 0 ? 0 : depth[parent] + 1);
+        if (parent >= 0)
+            hierarchy.Children[parent].push_back(i);
+        scene.AddNode(parent, local);
+    }
+    unsigned int deepest = 0;
+    for (unsigned int d : depth)
+        deepest = d > deepest ? d : deepest;
+    return deepest;
+}
+
+void recompute(const Hierarchy& hierarchy, unsigned int node, const glm::mat4& parentWorld, std::vector<glm::mat4>& world)
+{
+    world[node] = parentWorld * hierarchy.Local[node];
+    for (unsigned int child : hierarchy.Children[node])
+        recompute(hierarchy, child, world[node], world);
+}
+
+// how many world matrices differ from the naive recompute
+unsigned int compareWorld(const Hierarchy& hierarchy, const SceneGraph& scene)
+{
+    unsigned int count = (unsigned int)hierarchy.Parent.size();
+    std::vector<glm::mat4> world(count);
+    for (unsigned int i = 0; i < count; i++)
+        if (hierarchy.Parent[i] < 0)
+            recompute(hierarchy, i, glm::mat4(1.0f), world);
+    unsigned int mismatches = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        const glm::mat4& expected = world[i];
+        const glm::mat4& actual = scene.GetWorld(i);
+        bool same = true;
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++)
+                same = same && std::fabs(expected[c][r] - actual[c][r]) <= 1e-4f * (1.0f + std::fabs(expected[c][r]));
+        mismatches += same ? 0 : 1;
+    }
+    return mismatches;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int nodes = argc > 1 ? (unsigned int)std::atoi(argv[1]) : 200000;
+    int frames = argc > 2 ? std::atoi(argv[2]) : 20;
+    std::mt19937 rng(26);
+    Hierarchy hierarchy;
+    SceneGraph scene;
+    unsigned int deepest = buildHierarchy(hierarchy, scene, nodes, rng);
+    std::cout << nodes << " nodes, " << deepest << " levels deep" << std::endl;
+
+    int failures = 0;
+    unsigned int first = scene.Update();
+    if (first != nodes)
+    {
+        std::cout << "first update rebuilt " << first << " matrices, expected " << nodes << std::endl;
+        failures++;
+    }
+    unsigned int mismatches = compareWorld(hierarchy, scene);
+    if (mismatches > 0)
+    {
+        std::cout << "first update: " << mismatches << " world matrices differ from the recompute" << std::endl;
+        failures++;
+    }
+
+    const float shares[] = { 1.0f, 0.01f, 0.001f, 0.0f };
+    for (float share : shares)
+    {
+        double totalMs = 0.0;
+        unsigned long long rebuilt = 0;
+        unsigned int animated = (unsigned int)(nodes * share);
+        for (int frame = 0; frame < frames; frame++)
+        {
+            // the expected count: a node is rebuilt when it or one of its ancestors is dirty (parents come first)
+            std::vector<char> dirty(nodes, 0);
+            for (unsigned int k = 0; k < animated; k++)
+            {
+                unsigned int node = share >= 1.0f ? k : (unsigned int)(rng() % nodes);
+                hierarchy.Local[node] = glm::rotate(hierarchy.Local[node], 0.01f, glm::vec3(0.0f, 1.0f, 0.0f));
+                scene.SetLocal(node, hierarchy.Local[node]);
+                dirty[node] = 1;
+            }
+            unsigned int expected = 0;
+            for (unsigned int i = 0; i < nodes; i++)
+            {
+                if (!dirty[i] && hierarchy.Parent[i] >= 0 && dirty[hierarchy.Parent[i]])
+                    dirty[i] = 1;
+                expected += dirty[i];
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            unsigned int updated = scene.Update();
+            totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            rebuilt += updated;
+            if (updated != expected)
+            {
+                std::cout << share * 100.0f << "% animated, frame " << frame << ": rebuilt " << updated << " matrices, expected " << expected << std::endl;
+                failures++;
+            }
+        }
+        mismatches = compareWorld(hierarchy, scene);
+        if (mismatches > 0)
+        {
+            std::cout << share * 100.0f << "% animated: " << mismatches << " world matrices differ from the recompute" << std::endl;
+            failures++;
+        }
+        double perFrame = frames > 0 ? totalMs / frames : 0.0;
+        std::cout << share * 100.0f << "% animated: " << (frames > 0 ? rebuilt / frames : 0) << " matrices rebuilt/frame, " << perFrame << " ms/frame ("
+                  << (rebuilt > 0 ? totalMs * 1e6 / rebuilt : 0.0) << " ns/matrix)" << std::endl;
+    }
+
+    std::cout << (failures == 0 ? "OK" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
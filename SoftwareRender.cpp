@@ -0,0 +1,666 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <job_system.h>
+#include <png_writer.h>
+#include <soft_rasterizer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/*
+Headless reference renders. No window or OpenGL context is created: the scenes of every sample from HelloTriangle to
+Lighting2 are drawn by SoftRasterizer (soft_rasterizer.h) with the vertex and fragment shaders written as C++ lambdas
+that do what the GLSL does. The textures are generated here, so the frames are the same on every machine; samples that
+animate are drawn at SAMPLE_TIME seconds. Every frame is saved as a PNG and compared with the golden image of the same
+name in golden/, a copy a quarter of the size on each axis: the frame is box filtered down to it and may differ by a
+few levels per channel on a few pixels, as much as another compiler's floating point moves edges and texel weights. A
+missing golden image is written from the frame instead, which is how new ones are made.
+usage: SoftwareRender [output directory] [benchmark frames] [golden directory]
+*/
+
+// settings
+const unsigned int SCR_WIDTH = 800;
+const unsigned int SCR_HEIGHT = 600;
+// stands in for glfwGetTime() in the samples that animate
+const float SAMPLE_TIME = 1.0f;
+
+// golden images: the frame box filtered by GOLDEN_SCALE on each axis, compared per channel
+const int GOLDEN_SCALE = 4;
+const int GOLDEN_CHANNEL_TOLERANCE = 4;         // out of 255
+const double GOLDEN_PIXEL_TOLERANCE = 0.002;    // share of the pixels that may be further off
+
+// integer hash for the texture noise, so the generated textures are the same bytes everywhere
+unsigned int hashTexel(unsigned int x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// stands in for container.jpg: planks behind a riveted steel frame with a diagonal brace. Textures are built with
+// row 0 at the bottom, as the samples load theirs with stbi_set_flip_vertically_on_load(true)
+SoftTexture makeContainer()
+{
+    const int size = 256, frame = 18, plank = 26;
+    std::vector<unsigned char> pixels(size * size * 3);
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+        {
+            unsigned char* p = &pixels[(y * size + x) * 3];
+            bool border = x < frame || y < frame || x >= size - frame || y >= size - frame;
+            bool brace = std::abs(x - y) < 10;
+            if (border || brace)
+            {
+                int shade = 140 + (int)(hashTexel(y * size + x) % 16);
+                // rivets along the frame
+                int rx = (x % 32) - 16, ry = (y < frame || y >= size - frame) ? (y % frame) - frame / 2 : (x < frame ? x : size - 1 - x) - frame / 2;
+                if (border && !brace && rx * rx + ry * ry < 12)
+                    shade -= 70;
+                p[0] = (unsigned char)shade; p[1] = (unsigned char)shade; p[2] = (unsigned char)(shade + 10);
+                continue;
+            }
+            int row = (y - frame) / plank;
+            int grain = (int)(hashTexel(row * 977 + (x + (int)(hashTexel(row) % 64)) / 4) % 24);
+            int tone = (int)(hashTexel(row + 7919) % 30) - grain;
+            if ((y - frame) % plank == 0)
+                tone -= 60;     // the seam between two planks
+            p[0] = (unsigned char)(170 + tone); p[1] = (unsigned char)(110 + tone * 3 / 4); p[2] = (unsigned char)(50 + tone / 2);
+        }
+    return SoftTexture(size, size, 3, pixels.data());
+}
+
+// stands in for awesomeface.png: a yellow face with its outline, eyes and smile on a transparent background
+SoftTexture makeFace()
+{
+    const int size = 256, center = 128;
+    std::vector<unsigned char> pixels(size * size * 4, 0);
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+        {
+            unsigned char* p = &pixels[(y * size + x) * 4];
+            int dx = x - center, dy = y - center;
+            int distance = dx * dx + dy * dy;
+            if (distance >= 112 * 112)
+                continue;
+            int leftEye = (x - 88) * (x - 88) + (y - 160) * (y - 160), rightEye = (x - 168) * (x - 168) + (y - 160) * (y - 160);
+            int mouth = dx * dx + (y - 116) * (y - 116);
+            bool dark = distance >= 100 * 100 || leftEye < 16 * 16 || rightEye < 16 * 16 || (y < 104 && mouth >= 54 * 54 && mouth < 66 * 66);
+            p[0] = dark ? 60 : 250; p[1] = dark ? 40 : 200; p[2] = dark ? 10 : 30; p[3] = 255;
+        }
+    return SoftTexture(size, size, 4, pixels.data());
+}
+
+// stands in for wall.jpg: rows of bricks, every other row offset by half a brick, in mortar
+SoftTexture makeWall()
+{
+    const int size = 256, brickWidth = 64, brickHeight = 32, mortar = 4;
+    std::vector<unsigned char> pixels(size * size * 3);
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+        {
+            unsigned char* p = &pixels[(y * size + x) * 3];
+            int row = y / brickHeight, shifted = x + (row % 2) * brickWidth / 2;
+            int column = (shifted / brickWidth) % (size / brickWidth);
+            int noise = (int)(hashTexel(y * size + x) % 20);
+            if (y % brickHeight < mortar || shifted % brickWidth < mortar)
+            {
+                p[0] = (unsigned char)(170 + noise); p[1] = (unsigned char)(165 + noise); p[2] = (unsigned char)(155 + noise);
+                continue;
+            }
+            int tone = (int)(hashTexel(row * 16 + column) % 40) + noise;
+            p[0] = (unsigned char)(140 + tone); p[1] = (unsigned char)(60 + tone / 2); p[2] = (unsigned char)(45 + tone / 2);
+        }
+    return SoftTexture(size, size, 3, pixels.data());
+}
+
+// texture(sampler, TexCoord) of a program with Derivatives set, whose first two varyings are TexCoord
+glm::vec4 sampleTexCoord(const SoftTexture& texture, const SoftFragment& fragment)
+{
+    glm::vec2 texCoord(fragment.Varyings[0], fragment.Varyings[1]);
+    glm::vec2 ddx(fragment.DDX[0], fragment.DDX[1]), ddy(fragment.DDY[0], fragment.DDY[1]);
+    return texture.Sample(texCoord, ddx, ddy);
+}
+
+// the cube of Coord2 and camera: positions and texture coordinates
+const float cubeVertices[] = {
+    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+     0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
+     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+     0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+     0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+     0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+
+    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+    -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+
+     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+     0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+     0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+     0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+
+    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+     0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
+     0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+     0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+
+    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
+    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
+};
+
+// the cube of Lighting1 and Lighting2: positions and normals
+const float litCubeVertices[] = {
+    -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+     0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+     0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+     0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+    -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+
+    -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+     0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+     0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+     0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+
+    -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+    -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+    -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+    -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+    -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+    -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+
+     0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+     0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+     0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+     0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+     0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+     0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+
+    -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+     0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+     0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+     0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+
+    -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+     0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+     0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+     0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+    -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f
+};
+
+// HelloTriangle: the orange rectangle drawn with an element buffer
+void renderHelloTriangle(SoftRasterizer& target)
+{
+    static const float vertices[] = {
+         0.5f,  0.5f, 0.0f,  // top right
+         0.5f, -0.5f, 0.0f,  // bottom right
+        -0.5f, -0.5f, 0.0f,  // bottom left
+        -0.5f,  0.5f, 0.0f   // top left
+    };
+    static const unsigned int indices[] = {
+        0, 1, 3,  // first triangle
+        1, 2, 3   // second triangle
+    };
+    SoftProgram program;
+    program.Vertex = [](const float* aPos, float*) { return glm::vec4(aPos[0], aPos[1], aPos[2], 1.0f); };
+    program.Fragment = [](const SoftFragment&) { return glm::vec4(1.0f, 0.5f, 0.2f, 1.0f); };
+
+    target.Clear(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+    target.DrawElements(program, vertices, 3, indices, 6);
+}
+
+// HTEjec1 and HTEjec2: two orange triangles next to each other (HTEjec1 draws the six vertices in one call, HTEjec2
+// keeps them in two buffers); HTEjec3 draws the second one yellow with a second program
+void renderTwoTriangles(SoftRasterizer& target, const glm::vec4& secondColor)
+{
+    static const float firstTriangle[] = {
+        -0.9f, -0.5f, 0.0f,  // left
+        -0.0f, -0.5f, 0.0f,  // right
+        -0.45f, 0.5f, 0.0f,  // top
+    };
+    static const float secondTriangle[] = {
+        0.0f, -0.5f, 0.0f,  // left
+        0.9f, -0.5f, 0.0f,  // right
+        0.45f, 0.5f, 0.0f   // top
+    };
+    SoftProgram orange, second;
+    orange.Vertex = second.Vertex = [](const float* aPos, float*) { return glm::vec4(aPos[0], aPos[1], aPos[2], 1.0f); };
+    orange.Fragment = [](const SoftFragment&) { return glm::vec4(1.0f, 0.5f, 0.2f, 1.0f); };
+    second.Fragment = [secondColor](const SoftFragment&) { return secondColor; };
+
+    target.Clear(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+    target.Draw(orange, firstTriangle, 3, 0, 3);
+    target.Draw(second, secondTriangle, 3, 0, 3);
+}
+
+// ShadersPart1: the triangle in the ourColor uniform, green going up and down with the time
+void renderUniformColor(SoftRasterizer& target)
+{
+    static const float vertices[] = {
+         0.5f, -0.5f, 0.0f,  // bottom right
+        -0.5f, -0.5f, 0.0f,  // bottom left
+         0.0f,  0.5f, 0.0f   // top
+    };
+    float greenValue = std::sin(SAMPLE_TIME) / 2.0f + 0.5f;
+    glm::vec4 ourColor(0.0f, greenValue, 0.0f, 1.0f);
+    SoftProgram program;
+    program.Vertex = [](const float* aPos, float*) { return glm::vec4(aPos[0], aPos[1], aPos[2], 1.0f); };
+    program.Fragment = [ourColor](const SoftFragment&) { return ourColor; };
+
+    target.Clear(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+    target.Draw(program, vertices, 3, 0, 3);
+}
+
+// ShadersPart2 and ShadersPart3 (which reads the same shaders from files): a color per vertex, interpolated
+void renderVertexColors(SoftRasterizer& target)
+{
+    static const float vertices[] = {
+        // positions         // colors
+         0.5f, -0.5f, 0.0f,  1.0f, 0.0f, 0.0f,  // bottom right
+        -0.5f, -0.5f, 0.0f,  0.0f, 1.0f, 0.0f,  // bottom left
+         0.0f,  0.5f, 0.0f,  0.0f, 0.0f, 1.0f   // top
+    };
+    SoftProgram program;
+    program.Varyings = 3;
+    program.Vertex = [](const float* vertex, float* ourColor)
+    {
+        ourColor[0] = vertex[3]; ourColor[1] = vertex[4]; ourColor[2] = vertex[5];
+        return glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f);
+    };
+    program.Fragment = [](const SoftFragment& fragment) { return glm::vec4(fragment.Varyings[0], fragment.Varyings[1], fragment.Varyings[2], 1.0f); };
+
+    target.Clear(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+    target.Draw(program, vertices, 6, 0, 3);
+}
+
+// the textured rectangle of texturepart1 and texturepart2: positions, colors and texture coordinates
+const float texturedQuad[] = {
+    // positions          // colors           // texture coords
+     0.5f,  0.5f, 0.0f,   1.0f, 0.0f, 0.0f,   1.0f, 1.0f, // top right
+     0.5f, -0.5f, 0.0f,   0.0f, 1.0f, 0.0f,   1.0f, 0.0f, // bottom right
+    -0.5f, -0.5f, 0.0f,   0.0f, 0.0f, 1.0f,   0.0f, 0.0f, // bottom left
+    -0.5f,  0.5f, 0.0f,   1.0f, 1.0f, 0.0f,   0.0f, 1.0f  // top left
+};
+const unsigned int quadIndices[] = {
+    0, 1, 3, // first triangle
+    1, 2, 3  // second triangle
+};
+
+// texturepart1: the wall texture on the rectangle. The sample itself never sets up its vertex attributes, so this is
+// the scene the chapter draws: FragColor = texture(ourTexture, TexCoord)
+void renderTexture(SoftRasterizer& target, const SoftTexture& wall)
+{
+    SoftProgram program;
+    program.Varyings = 2;
+    program.Derivatives = true;
+    program.Vertex = [](const float* vertex, float* texCoord)
+    {
+        texCoord[0] = vertex[6];
+        texCoord[1] = vertex[7];
+        return glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f);
+    };
+    program.Fragment = [&wall](const SoftFragment& fragment) { return sampleTexCoord(wall, fragment); };
+
+    target.Clear(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+    target.DrawElements(program, texturedQuad, 8, quadIndices, 6);
+}
+
+// texturepart2: the rectangle with both textures, mix(texture(texture0, texCoord), texture(texture1, texCoord), 0.2)
+void renderTextureMix(SoftRasterizer& target, const SoftTexture& texture1, const SoftTexture& texture2)
+{
+    SoftProgram program;
+    program.Varyings = 2;
+    program.Derivatives = true;
+    program.Vertex = [](const float* vertex, float* texCoord)
+    {
+        texCoord[0] = vertex[6];
+        texCoord[1] = vertex[7];
+        return glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f);
+    };
+    program.Fragment = [&texture1, &texture2](const SoftFragment& fragment)
+    {
+        return glm::mix(sampleTexCoord(texture1, fragment), sampleTexCoord(texture2, fragment), 0.2f);
+    };
+
+    target.Clear(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+    target.DrawElements(program, texturedQuad, 8, quadIndices, 6);
+}
+
+// Translation: the mixed textures on a rectangle moved to the bottom right and turned about z with the time
+void renderTransform(SoftRasterizer& target, const SoftTexture& texture1, const SoftTexture& texture2)
+{
+    static const float vertices[] = {
+        // positions          // texture coords
+         0.5f,  0.5f, 0.0f,   1.0f, 1.0f, // top right
+         0.5f, -0.5f, 0.0f,   1.0f, 0.0f, // bottom right
+        -0.5f, -0.5f, 0.0f,   0.0f, 0.0f, // bottom left
+        -0.5f,  0.5f, 0.0f,   0.0f, 1.0f  // top left
+    };
+    glm::mat4 transform = glm::mat4(1.0f);
+    transform = glm::translate(transform, glm::vec3(0.5f, -0.5f, 0.0f));
+    transform = glm::rotate(transform, SAMPLE_TIME, glm::vec3(0.0f, 0.0f, 1.0f));
+
+    // vertex shader: gl_Position = transform * vec4(aPos, 1.0f); TexCoord = aTexCoord;
+    SoftProgram program;
+    program.Varyings = 2;
+    program.Derivatives = true;
+    program.Vertex = [&transform](const float* vertex, float* texCoord)
+    {
+        texCoord[0] = vertex[3];
+        texCoord[1] = vertex[4];
+        return transform * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f);
+    };
+    program.Fragment = [&texture1, &texture2](const SoftFragment& fragment)
+    {
+        return glm::mix(sampleTexCoord(texture1, fragment), sampleTexCoord(texture2, fragment), 0.2f);
+    };
+
+    target.Clear(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+    target.DrawElements(program, vertices, 5, quadIndices, 6);
+}
+
+// Coord2: one textured cube turning about (0.5, 1, 0) with the time, three units in front of the camera
+void renderCoordinates(SoftRasterizer& target, const SoftTexture& texture1, const SoftTexture& texture2)
+{
+    glm::mat4 model = glm::rotate(glm::mat4(1.0f), SAMPLE_TIME, glm::vec3(0.5f, 1.0f, 0.0f));
+    glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -3.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 mvp = projection * view * model;
+
+    SoftProgram program;
+    program.Varyings = 2;
+    program.Derivatives = true;
+    program.Vertex = [&mvp](const float* vertex, float* texCoord)
+    {
+        texCoord[0] = vertex[3];
+        texCoord[1] = vertex[4];
+        return mvp * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f);
+    };
+    program.Fragment = [&texture1, &texture2](const SoftFragment& fragment)
+    {
+        return glm::mix(sampleTexCoord(texture1, fragment), sampleTexCoord(texture2, fragment), 0.2f);
+    };
+
+    target.Clear(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+    target.Draw(program, cubeVertices, 5, 0, 36);
+}
+
+// camera: ten textured boxes, texture1 and texture2 mixed 80/20
+void renderCamera(SoftRasterizer& target, const SoftTexture& texture1, const SoftTexture& texture2)
+{
+    static const glm::vec3 cubePositions[] = {
+        glm::vec3(0.0f,  0.0f,  0.0f),
+        glm::vec3(2.0f,  5.0f, -15.0f),
+        glm::vec3(-1.5f, -2.2f, -2.5f),
+        glm::vec3(-3.8f, -2.0f, -12.3f),
+        glm::vec3(2.4f, -0.4f, -3.5f),
+        glm::vec3(-1.7f,  3.0f, -7.5f),
+        glm::vec3(1.3f, -2.0f, -2.5f),
+        glm::vec3(1.5f,  2.0f, -2.5f),
+        glm::vec3(1.5f,  0.2f, -1.5f),
+        glm::vec3(-1.3f,  1.0f, -1.5f)
+    };
+    glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 3.0f);
+    glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
+    glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+
+    target.Clear(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+    for (unsigned int i = 0; i < 10; i++)
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, cubePositions[i]);
+        float angle = 20.0f * i;
+        model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+        glm::mat4 mvp = projection * view * model;
+
+        // vertex shader: gl_Position = projection * view * model * vec4(aPos, 1.0); TexCoord = aTexCoord;
+        SoftProgram program;
+        program.Varyings = 2;
+        program.Derivatives = true;
+        program.Vertex = [&mvp](const float* vertex, float* texCoord)
+        {
+            texCoord[0] = vertex[3];
+            texCoord[1] = vertex[4];
+            return mvp * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f);
+        };
+        // fragment shader: FragColor = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), 0.2);
+        program.Fragment = [&texture1, &texture2](const SoftFragment& fragment)
+        {
+            return glm::mix(sampleTexCoord(texture1, fragment), sampleTexCoord(texture2, fragment), 0.2f);
+        };
+        target.Draw(program, cubeVertices, 5, 0, 36);
+    }
+}
+
+// Lighting1: the cube in objectColor * lightColor next to the lamp cube, seen from the camera's starting point
+void renderColors(SoftRasterizer& target)
+{
+    glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
+    glm::vec3 objectColor(1.0f, 0.5f, 0.31f);
+    glm::vec3 lightColor(1.0f, 1.0f, 1.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 viewProjection = projection * view;
+
+    target.Clear(glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+
+    SoftProgram cube;
+    cube.Vertex = [&viewProjection](const float* vertex, float*) { return viewProjection * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f); };
+    cube.Fragment = [&](const SoftFragment&) { return glm::vec4(lightColor * objectColor, 1.0f); };
+    target.Draw(cube, litCubeVertices, 6, 0, 36);
+
+    glm::mat4 lampMVP = viewProjection * glm::scale(glm::translate(glm::mat4(1.0f), lightPos), glm::vec3(0.2f));
+    SoftProgram lamp;
+    lamp.Vertex = [&lampMVP](const float* vertex, float*) { return lampMVP * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f); };
+    lamp.Fragment = [](const SoftFragment&) { return glm::vec4(1.0f); };
+    target.Draw(lamp, litCubeVertices, 6, 0, 36);
+}
+
+// Lighting2: Phong lit cube next to the lamp cube
+void renderLighting(SoftRasterizer& target)
+{
+    glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
+    glm::vec3 viewPos(0.0f, 0.0f, 3.0f);
+    glm::vec3 objectColor(1.0f, 0.5f, 0.31f);
+    glm::vec3 lightColor(1.0f, 1.0f, 1.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(viewPos, viewPos + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    target.Clear(glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+
+    // lit cube: FragPos and Normal go to the fragment stage in world space
+    glm::mat4 model = glm::mat4(1.0f);
+    glm::mat4 viewProjection = projection * view;
+    glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(model)));
+    SoftProgram lighting;
+    lighting.Varyings = 6;
+    lighting.Vertex = [&](const float* vertex, float* out)
+    {
+        glm::vec3 fragPos = glm::vec3(model * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f));
+        glm::vec3 normal = normalMatrix * glm::vec3(vertex[3], vertex[4], vertex[5]);
+        out[0] = fragPos.x; out[1] = fragPos.y; out[2] = fragPos.z;
+        out[3] = normal.x; out[4] = normal.y; out[5] = normal.z;
+        return viewProjection * glm::vec4(fragPos, 1.0f);
+    };
+    lighting.Fragment = [&](const SoftFragment& fragment)
+    {
+        glm::vec3 fragPos(fragment.Varyings[0], fragment.Varyings[1], fragment.Varyings[2]);
+        glm::vec3 norm = glm::normalize(glm::vec3(fragment.Varyings[3], fragment.Varyings[4], fragment.Varyings[5]));
+        // ambient
+        float ambientStrength = 0.1f;
+        glm::vec3 ambient = ambientStrength * lightColor;
+        // diffuse
+        glm::vec3 lightDir = glm::normalize(lightPos - fragPos);
+        float diff = std::max(glm::dot(norm, lightDir), 0.0f);
+        glm::vec3 diffuse = diff * lightColor;
+        // specular
+        float specularStrength = 0.5f;
+        glm::vec3 viewDir = glm::normalize(viewPos - fragPos);
+        glm::vec3 reflectDir = glm::reflect(-lightDir, norm);
+        float spec = std::pow(std::max(glm::dot(viewDir, reflectDir), 0.0f), 32.0f);
+        glm::vec3 specular = specularStrength * spec * lightColor;
+        return glm::vec4((ambient + diffuse + specular) * objectColor, 1.0f);
+    };
+    target.Draw(lighting, litCubeVertices, 6, 0, 36);
+
+    // lamp: a small white cube at the light position
+    glm::mat4 lampModel = glm::mat4(1.0f);
+    lampModel = glm::translate(lampModel, lightPos);
+    lampModel = glm::scale(lampModel, glm::vec3(0.2f));
+    glm::mat4 lampMVP = viewProjection * lampModel;
+    SoftProgram lamp;
+    lamp.Vertex = [&lampMVP](const float* vertex, float*) { return lampMVP * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f); };
+    lamp.Fragment = [](const SoftFragment&) { return glm::vec4(1.0f); };
+    target.Draw(lamp, litCubeVertices, 6, 0, 36);
+}
+
+// the frame box filtered down by GOLDEN_SCALE, RGB with row 0 at the top
+std::vector<unsigned char> goldenPixels(const SoftRasterizer& target, int& width, int& height)
+{
+    width = target.Width / GOLDEN_SCALE;
+    height = target.Height / GOLDEN_SCALE;
+    std::vector<unsigned char> pixels((std::size_t)width * height * 3);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            for (int c = 0; c < 3; c++)
+            {
+                int sum = 0;
+                for (int sy = 0; sy < GOLDEN_SCALE; sy++)
+                    for (int sx = 0; sx < GOLDEN_SCALE; sx++)
+                        sum += target.Color[((std::size_t)(y * GOLDEN_SCALE + sy) * target.Width + x * GOLDEN_SCALE + sx) * 4 + c];
+                pixels[((std::size_t)y * width + x) * 3 + c] = (unsigned char)((sum + GOLDEN_SCALE * GOLDEN_SCALE / 2) / (GOLDEN_SCALE * GOLDEN_SCALE));
+            }
+    return pixels;
+}
+
+// compares the frame with its golden image, or writes the golden image when there is none; returns the failures
+int checkGolden(const SoftRasterizer& target, const std::string& path)
+{
+    int width, height;
+    std::vector<unsigned char> pixels = goldenPixels(target, width, height);
+    int goldenWidth, goldenHeight, channels;
+    std::vector<unsigned char> golden;
+    FILE* existing = std::fopen(path.c_str(), "rb");
+    if (!existing)
+    {
+        if (!PNGWriter::Write(path.c_str(), width, height, 3, pixels.data()))
+        {
+            std::cout << "Failed to write " << path << std::endl;
+            return 1;
+        }
+        std::cout << "no golden image, wrote " << path << std::endl;
+        return 0;
+    }
+    std::fclose(existing);
+    if (!PNGWriter::Read(path.c_str(), goldenWidth, goldenHeight, channels, golden) || channels != 3 || goldenWidth != width || goldenHeight != height)
+    {
+        std::cout << "Failed to read " << path << " as a " << width << "x" << height << " RGB image" << std::endl;
+        return 1;
+    }
+    int differing = 0, largest = 0;
+    for (std::size_t i = 0; i < pixels.size(); i += 3)
+    {
+        int difference = 0;
+        for (int c = 0; c < 3; c++)
+            difference = std::max(difference, std::abs((int)pixels[i + c] - (int)golden[i + c]));
+        largest = std::max(largest, difference);
+        if (difference > GOLDEN_CHANNEL_TOLERANCE)
+            differing++;
+    }
+    if (differing > GOLDEN_PIXEL_TOLERANCE * width * height)
+    {
+        std::cout << path << ": " << differing << " of " << width * height << " pixels differ by more than " << GOLDEN_CHANNEL_TOLERANCE
+                  << ", up to " << largest << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string directory = argc > 1 ? argv[1] : ".";
+    int frames = argc > 2 ? std::atoi(argv[2]) : 20;
+    std::string goldenDirectory = argc > 3 ? argv[3] : "golden";
+
+    JobSystem jobs;
+    SoftRasterizer target(SCR_WIDTH, SCR_HEIGHT, &jobs);
+    SoftTexture container = makeContainer(), face = makeFace(), wall = makeWall();
+
+    struct Sample
+    {
+        const char* Name;
+        std::function<void()> Render;
+    };
+    Sample samples[] = {
+        { "HelloTriangle", [&]() { renderHelloTriangle(target); } },
+        { "HTEjec1", [&]() { renderTwoTriangles(target, glm::vec4(1.0f, 0.5f, 0.2f, 1.0f)); } },
+        { "HTEjec2", [&]() { renderTwoTriangles(target, glm::vec4(1.0f, 0.5f, 0.2f, 1.0f)); } },
+        { "HTEjec3", [&]() { renderTwoTriangles(target, glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)); } },
+        { "ShadersPart1", [&]() { renderUniformColor(target); } },
+        { "ShadersPart2", [&]() { renderVertexColors(target); } },
+        { "ShadersPart3", [&]() { renderVertexColors(target); } },
+        { "texturepart1", [&]() { renderTexture(target, wall); } },
+        { "texturepart2", [&]() { renderTextureMix(target, container, face); } },
+        { "Translation", [&]() { renderTransform(target, container, face); } },
+        { "Coord2", [&]() { renderCoordinates(target, container, face); } },
+        { "camera", [&]() { renderCamera(target, container, face); } },
+        { "Lighting1", [&]() { renderColors(target); } },
+        { "Lighting2", [&]() { renderLighting(target); } }
+    };
+
+    std::cout << "rendering " << SCR_WIDTH << "x" << SCR_HEIGHT << " on " << jobs.ThreadCount() << " threads" << std::endl;
+    int failures = 0;
+    for (Sample& sample : samples)
+    {
+        sample.Render();
+        std::string path = directory + "/" + sample.Name + ".png";
+        if (!target.WritePNG(path.c_str()))
+        {
+            std::cout << "Failed to write " << path << std::endl;
+            failures++;
+        }
+        failures += checkGolden(target, goldenDirectory + "/" + sample.Name + ".png");
+
+        // frame time: every frame clears and redraws the whole scene
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < frames; i++)
+            sample.Render();
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << sample.Name << ": " << path << ", " << (frames > 0 ? elapsed / frames : 0.0) << " ms/frame" << std::endl;
+    }
+    std::cout << (failures == 0 ? "OK" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,544 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <frustum.h>
+#include <job_system.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BVH_SSE2
+#endif
+
+struct Ray
+{
+    glm::vec3 Origin = glm::vec3(0.0f);
+    glm::vec3 Direction = glm::vec3(0.0f, 0.0f, -1.0f);
+
+    Ray() {}
+    Ray(const glm::vec3& origin, const glm::vec3& direction) : Origin(origin), Direction(direction) {}
+
+    // world space ray through a window position (pixels, origin at the top left like GLFW's cursor position)
+    static Ray FromScreen(float x, float y, float width, float height, const glm::mat4& view, const glm::mat4& projection,
+                          DepthConvention depth = DEPTH_STANDARD)
+    {
+        glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+        float ndcX = 2.0f * x / width - 1.0f;
+        float ndcY = 1.0f - 2.0f * y / height;
+        // with reversed z the far plane may be at infinity, so the direction comes from a point halfway instead
+        float nearZ = depth == DEPTH_REVERSED_Z ? 1.0f : -1.0f;
+        float farZ = depth == DEPTH_REVERSED_Z ? 0.5f : 1.0f;
+        glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, nearZ, 1.0f);
+        glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, farZ, 1.0f);
+        glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+        glm::vec3 target = glm::vec3(farPoint) / farPoint.w;
+        return Ray(origin, glm::normalize(target - origin));
+    }
+};
+
+struct RayHit
+{
+    int Object = -1;
+    float Distance = FLT_MAX;
+};
+
+// Bounding volume hierarchy over object bounds. A binary tree is built top-down with binned SAH (subtrees are
+// built in parallel when a JobSystem is given) and then collapsed into a 4-wide tree whose nodes keep their
+// four child boxes as structure of arrays, so one SSE test checks every child of a node at once.
+// Refit() updates bounds in place for moving objects without rebuilding the topology.
+class BVH
+{
+public:
+    // a node slot is a leaf when Count > 0 (objects Objects[Child .. Child + Count)), an inner node when
+    // Count == 0 and Child >= 0, and empty when Child < 0; empty slots hold an inverted box
+    struct Node
+    {
+        float MinX[4], MinY[4], MinZ[4];
+        float MaxX[4], MaxY[4], MaxZ[4];
+        int Child[4];
+        unsigned int Count[4];
+    };
+
+    std::vector<Node> Nodes;
+    std::vector<unsigned int> Objects; // object indices referenced by the leaves
+    std::vector<AABB> Bounds;          // object bounds, indexed by object
+    AABB RootBounds;
+
+    static const unsigned int MAX_LEAF_SIZE = 4;
+    // entries of the traversal stack; every level of the 4-wide tree adds at most three, and Build() keeps the
+    // tree shallow enough for them
+    static const int STACK_SIZE = 256;
+
+    void Build(const std::vector<AABB>& bounds, JobSystem* jobs = nullptr)
+    {
+        Bounds = bounds;
+        Nodes.clear();
+        Objects.resize(bounds.size());
+        for (unsigned int i = 0; i < Objects.size(); i++)
+            Objects[i] = i;
+        if (bounds.empty())
+            return;
+
+        centroids.resize(bounds.size());
+        for (unsigned int i = 0; i < bounds.size(); i++)
+            centroids[i] = bounds[i].Center();
+
+        // a binary tree over n objects never has more than 2n - 1 nodes
+        buildNodes.resize(2 * bounds.size());
+        buildCount = 1;
+        buildNode(0, 0, (unsigned int)bounds.size(), 0, jobs);
+        RootBounds = buildNodes[0].Bounds;
+
+        Nodes.reserve(buildCount / 2 + 1);
+        Nodes.push_back(Node());
+        collapse(0, 0);
+        buildNodes.clear();
+        centroids.clear();
+    }
+
+    // moves object to new bounds; call Refit() once all objects of the frame are updated
+    void SetBounds(unsigned int object, const AABB& bounds)
+    {
+        Bounds[object] = bounds;
+    }
+
+    // recomputes every node box bottom-up, children always come after their parent in Nodes
+    void Refit()
+    {
+        for (int n = (int)Nodes.size() - 1; n >= 0; n--)
+        {
+            Node& node = Nodes[n];
+            for (int k = 0; k < 4; k++)
+            {
+                if (node.Child[k] < 0)
+                    continue;
+                AABB box = node.Count[k] > 0 ? leafBounds(node.Child[k], node.Count[k]) : nodeBounds(Nodes[node.Child[k]]);
+                setSlot(node, k, box);
+            }
+        }
+        if (!Nodes.empty())
+            RootBounds = nodeBounds(Nodes[0]);
+    }
+
+    // appends every object whose box intersects the frustum
+    void Query(const Frustum& frustum, std::vector<unsigned int>& result) const
+    {
+        if (Nodes.empty() || !frustum.Intersects(RootBounds))
+            return;
+        int stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Node& node = Nodes[stack[--top]];
+            unsigned int mask = frustumMask(node, frustum);
+            for (int k = 0; k < 4; k++)
+            {
+                if ((mask & (1u << k)) == 0)
+                    continue;
+                if (node.Count[k] > 0)
+                {
+                    for (unsigned int i = 0; i < node.Count[k]; i++)
+                    {
+                        unsigned int object = Objects[node.Child[k] + i];
+                        if (frustum.Intersects(Bounds[object]))
+                            result.push_back(object);
+                    }
+                }
+                else
+                {
+                    assert(top < STACK_SIZE);
+                    stack[top++] = node.Child[k];
+                }
+            }
+        }
+    }
+
+    // appends every object whose box overlaps the sphere
+    void Query(const BoundingSphere& sphere, std::vector<unsigned int>& result) const
+    {
+        if (Nodes.empty())
+            return;
+        int stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Node& node = Nodes[stack[--top]];
+            for (int k = 0; k < 4; k++)
+            {
+                if (node.Child[k] < 0 || !sphereOverlaps(sphere, slotBounds(node, k)))
+                    continue;
+                if (node.Count[k] > 0)
+                {
+                    for (unsigned int i = 0; i < node.Count[k]; i++)
+                    {
+                        unsigned int object = Objects[node.Child[k] + i];
+                        if (sphereOverlaps(sphere, Bounds[object]))
+                            result.push_back(object);
+                    }
+                }
+                else
+                {
+                    assert(top < STACK_SIZE);
+                    stack[top++] = node.Child[k];
+                }
+            }
+        }
+    }
+
+    // closest object whose box the ray enters within maxDistance
+    RayHit Raycast(const Ray& ray, float maxDistance = FLT_MAX) const
+    {
+        RayHit hit;
+        hit.Distance = maxDistance;
+        if (Nodes.empty())
+            return hit;
+        glm::vec3 inverse = glm::vec3(1.0f) / ray.Direction;
+        int stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Node& node = Nodes[stack[--top]];
+            unsigned int mask = rayMask(node, ray.Origin, inverse, hit.Distance);
+            for (int k = 0; k < 4; k++)
+            {
+                if ((mask & (1u << k)) == 0)
+                    continue;
+                if (node.Count[k] > 0)
+                {
+                    for (unsigned int i = 0; i < node.Count[k]; i++)
+                    {
+                        unsigned int object = Objects[node.Child[k] + i];
+                        float t;
+                        if (rayBox(Bounds[object], ray.Origin, inverse, hit.Distance, t))
+                        {
+                            hit.Object = (int)object;
+                            hit.Distance = t;
+                        }
+                    }
+                }
+                else
+                {
+                    assert(top < STACK_SIZE);
+                    stack[top++] = node.Child[k];
+                }
+            }
+        }
+        return hit;
+    }
+
+private:
+    static const int BIN_COUNT = 12;
+    static const unsigned int PARALLEL_THRESHOLD = 4096;
+    // SAH splits stop at this depth and median splits take over, which need at most 32 more levels
+    static const int MAX_SAH_DEPTH = 48;
+    static_assert(3 * (MAX_SAH_DEPTH + 32) + 1 <= STACK_SIZE, "a tree as deep as Build() allows overflows the traversal stack");
+
+    struct BuildNode
+    {
+        AABB Bounds;
+        unsigned int Left = 0, Right = 0; // children, 0 for a leaf (the root is never a child)
+        unsigned int First = 0, Count = 0;
+    };
+
+    std::vector<BuildNode> buildNodes;
+    std::atomic<unsigned int> buildCount{ 0 };
+    std::vector<glm::vec3> centroids;
+
+    static AABB merge(const AABB& a, const AABB& b)
+    {
+        return AABB(glm::min(a.Min, b.Min), glm::max(a.Max, b.Max));
+    }
+
+    static AABB emptyBox()
+    {
+        return AABB(glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX));
+    }
+
+    static float area(const AABB& box)
+    {
+        glm::vec3 d = box.Max - box.Min;
+        if (d.x < 0.0f || d.y < 0.0f || d.z < 0.0f)
+            return 0.0f;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    AABB leafBounds(int first, unsigned int count) const
+    {
+        AABB box = emptyBox();
+        for (unsigned int i = 0; i < count; i++)
+            box = merge(box, Bounds[Objects[first + i]]);
+        return box;
+    }
+
+    static AABB slotBounds(const Node& node, int k)
+    {
+        return AABB(glm::vec3(node.MinX[k], node.MinY[k], node.MinZ[k]), glm::vec3(node.MaxX[k], node.MaxY[k], node.MaxZ[k]));
+    }
+
+    static AABB nodeBounds(const Node& node)
+    {
+        AABB box = emptyBox();
+        for (int k = 0; k < 4; k++)
+            if (node.Child[k] >= 0)
+                box = merge(box, slotBounds(node, k));
+        return box;
+    }
+
+    static void setSlot(Node& node, int k, const AABB& box)
+    {
+        node.MinX[k] = box.Min.x; node.MinY[k] = box.Min.y; node.MinZ[k] = box.Min.z;
+        node.MaxX[k] = box.Max.x; node.MaxY[k] = box.Max.y; node.MaxZ[k] = box.Max.z;
+    }
+
+    // binned SAH split of Objects[first .. first + count) into node index, depth levels below the root
+    void buildNode(unsigned int index, unsigned int first, unsigned int count, int depth, JobSystem* jobs)
+    {
+        BuildNode& node = buildNodes[index];
+        node.First = first;
+        node.Count = count;
+        node.Left = node.Right = 0;
+        AABB bounds = emptyBox();
+        AABB centroidBounds = emptyBox();
+        for (unsigned int i = first; i < first + count; i++)
+        {
+            bounds = merge(bounds, Bounds[Objects[i]]);
+            centroidBounds = merge(centroidBounds, AABB(centroids[Objects[i]], centroids[Objects[i]]));
+        }
+        node.Bounds = bounds;
+        if (count <= MAX_LEAF_SIZE)
+            return;
+
+        // split along the widest centroid axis
+        glm::vec3 size = centroidBounds.Max - centroidBounds.Min;
+        int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+        float axisMin = centroidBounds.Min[axis];
+        float axisSize = size[axis];
+        unsigned int middle;
+        if (axisSize <= 0.0f)
+        {
+            // every centroid coincides, a median split keeps the tree balanced
+            middle = first + count / 2;
+        }
+        else if (depth >= MAX_SAH_DEPTH)
+        {
+            // skewed inputs make SAH peel off a few objects per level; halving from here on bounds the depth
+            unsigned int* begin = &Objects[first];
+            std::nth_element(begin, begin + count / 2, begin + count, [&](unsigned int a, unsigned int b)
+            {
+                return centroids[a][axis] < centroids[b][axis];
+            });
+            middle = first + count / 2;
+        }
+        else
+        {
+            AABB binBounds[BIN_COUNT];
+            unsigned int binCount[BIN_COUNT] = {};
+            for (int b = 0; b < BIN_COUNT; b++)
+                binBounds[b] = emptyBox();
+            float scale = BIN_COUNT / axisSize;
+            for (unsigned int i = first; i < first + count; i++)
+            {
+                int b = std::min(BIN_COUNT - 1, (int)((centroids[Objects[i]][axis] - axisMin) * scale));
+                binBounds[b] = merge(binBounds[b], Bounds[Objects[i]]);
+                binCount[b]++;
+            }
+            // sweep from the right to get suffix costs, then from the left to find the cheapest plane
+            float rightCost[BIN_COUNT];
+            AABB right = emptyBox();
+            unsigned int rightCount = 0;
+            for (int b = BIN_COUNT - 1; b > 0; b--)
+            {
+                right = merge(right, binBounds[b]);
+                rightCount += binCount[b];
+                rightCost[b] = area(right) * rightCount;
+            }
+            float bestCost = FLT_MAX;
+            int bestPlane = -1;
+            AABB left = emptyBox();
+            unsigned int leftCount = 0;
+            for (int b = 0; b < BIN_COUNT - 1; b++)
+            {
+                left = merge(left, binBounds[b]);
+                leftCount += binCount[b];
+                float cost = area(left) * leftCount + rightCost[b + 1];
+                if (leftCount > 0 && leftCount < count && cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestPlane = b;
+                }
+            }
+            if (bestPlane < 0 || bestCost >= area(bounds) * count)
+                return; // splitting does not beat testing every object
+            unsigned int* begin = &Objects[first];
+            unsigned int* split = std::partition(begin, begin + count, [&](unsigned int object)
+            {
+                return std::min(BIN_COUNT - 1, (int)((centroids[object][axis] - axisMin) * scale)) <= bestPlane;
+            });
+            middle = first + (unsigned int)(split - begin);
+        }
+
+        unsigned int left = buildCount.fetch_add(2);
+        node.Left = left;
+        node.Right = left + 1;
+        unsigned int leftCount = middle - first;
+        if (jobs && count >= PARALLEL_THRESHOLD)
+        {
+            JobSystem::Counter counter;
+            jobs->Run([this, left, first, leftCount, depth, jobs]() { buildNode(left, first, leftCount, depth + 1, jobs); }, &counter);
+            buildNode(left + 1, middle, count - leftCount, depth + 1, jobs);
+            jobs->Wait(counter);
+        }
+        else
+        {
+            buildNode(left, first, leftCount, depth + 1, jobs);
+            buildNode(left + 1, middle, count - leftCount, depth + 1, jobs);
+        }
+    }
+
+    // turns binary node build into the 4-wide node Nodes[target], pulling up the largest grandchildren
+    void collapse(unsigned int build, unsigned int target)
+    {
+        unsigned int children[4];
+        int childCount = 0;
+        const BuildNode& root = buildNodes[build];
+        if (root.Left == 0)
+            children[childCount++] = build;
+        else
+        {
+            children[childCount++] = root.Left;
+            children[childCount++] = root.Right;
+            while (childCount < 4)
+            {
+                int open = -1;
+                float openArea = -1.0f;
+                for (int c = 0; c < childCount; c++)
+                {
+                    const BuildNode& child = buildNodes[children[c]];
+                    if (child.Left != 0 && area(child.Bounds) > openArea)
+                    {
+                        open = c;
+                        openArea = area(child.Bounds);
+                    }
+                }
+                if (open < 0)
+                    break;
+                unsigned int opened = children[open];
+                children[open] = buildNodes[opened].Left;
+                children[childCount++] = buildNodes[opened].Right;
+            }
+        }
+
+        for (int k = 0; k < 4; k++)
+        {
+            if (k >= childCount)
+            {
+                setSlot(Nodes[target], k, emptyBox());
+                Nodes[target].Child[k] = -1;
+                Nodes[target].Count[k] = 0;
+                continue;
+            }
+            const BuildNode& child = buildNodes[children[k]];
+            setSlot(Nodes[target], k, child.Bounds);
+            if (child.Left == 0)
+            {
+                Nodes[target].Child[k] = (int)child.First;
+                Nodes[target].Count[k] = child.Count;
+            }
+            else
+            {
+                unsigned int index = (unsigned int)Nodes.size();
+                Nodes.push_back(Node());
+                Nodes[target].Child[k] = (int)index;
+                Nodes[target].Count[k] = 0;
+                collapse(children[k], index);
+            }
+        }
+    }
+
+    // bit k set when child box k is not fully outside one of the frustum planes
+    static unsigned int frustumMask(const Node& node, const Frustum& frustum)
+    {
+#ifdef BVH_SSE2
+        __m128 minX = _mm_loadu_ps(node.MinX), minY = _mm_loadu_ps(node.MinY), minZ = _mm_loadu_ps(node.MinZ);
+        __m128 maxX = _mm_loadu_ps(node.MaxX), maxY = _mm_loadu_ps(node.MaxY), maxZ = _mm_loadu_ps(node.MaxZ);
+        __m128 inside = _mm_cmple_ps(minX, maxX); // false for empty slots
+        for (int p = 0; p < 6; p++)
+        {
+            // the corner furthest along the plane normal decides
+            const glm::vec4& plane = frustum.Planes[p];
+            __m128 x = plane.x >= 0.0f ? maxX : minX;
+            __m128 y = plane.y >= 0.0f ? maxY : minY;
+            __m128 z = plane.z >= 0.0f ? maxZ : minZ;
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_mul_ps(_mm_set1_ps(plane.y), y)),
+                                         _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), z), _mm_set1_ps(plane.w)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+        }
+        return (unsigned int)_mm_movemask_ps(inside);
+#else
+        unsigned int mask = 0;
+        for (int k = 0; k < 4; k++)
+            if (node.Child[k] >= 0 && frustum.Intersects(slotBounds(node, k)))
+                mask |= 1u << k;
+        return mask;
+#endif
+    }
+
+    // bit k set when the ray enters child box k before maxDistance
+    static unsigned int rayMask(const Node& node, const glm::vec3& origin, const glm::vec3& inverse, float maxDistance)
+    {
+#ifdef BVH_SSE2
+        __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.MinX), _mm_set1_ps(origin.x)), _mm_set1_ps(inverse.x));
+        __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.MaxX), _mm_set1_ps(origin.x)), _mm_set1_ps(inverse.x));
+        __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.MinY), _mm_set1_ps(origin.y)), _mm_set1_ps(inverse.y));
+        __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.MaxY), _mm_set1_ps(origin.y)), _mm_set1_ps(inverse.y));
+        __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.MinZ), _mm_set1_ps(origin.z)), _mm_set1_ps(inverse.z));
+        __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.MaxZ), _mm_set1_ps(origin.z)), _mm_set1_ps(inverse.z));
+        __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+        __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(maxDistance)));
+        // empty slots have min > max, they are masked out explicitly since a negative direction flips their slab
+        __m128 valid = _mm_cmple_ps(_mm_loadu_ps(node.MinX), _mm_loadu_ps(node.MaxX));
+        return (unsigned int)_mm_movemask_ps(_mm_and_ps(valid, _mm_cmple_ps(tNear, tFar)));
+#else
+        unsigned int mask = 0;
+        float entry;
+        for (int k = 0; k < 4; k++)
+            if (node.Child[k] >= 0 && rayBox(slotBounds(node, k), origin, inverse, maxDistance, entry))
+                mask |= 1u << k;
+        return mask;
+#endif
+    }
+
+    static bool rayBox(const AABB& box, const glm::vec3& origin, const glm::vec3& inverse, float maxDistance, float& entry)
+    {
+        float tNear = 0.0f;
+        float tFar = maxDistance;
+        for (int a = 0; a < 3; a++)
+        {
+            float t0 = (box.Min[a] - origin[a]) * inverse[a];
+            float t1 = (box.Max[a] - origin[a]) * inverse[a];
+            tNear = std::max(tNear, std::min(t0, t1));
+            tFar = std::min(tFar, std::max(t0, t1));
+        }
+        entry = tNear;
+        return tNear <= tFar;
+    }
+
+    static bool sphereOverlaps(const BoundingSphere& sphere, const AABB& box)
+    {
+        glm::vec3 closest = glm::max(box.Min, glm::min(sphere.Center, box.Max));
+        glm::vec3 d = closest - sphere.Center;
+        return glm::dot(d, d) <= sphere.Radius * sphere.Radius;
+    }
+};
+#endif
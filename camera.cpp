@@ -6,7 +6,20 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <learnopengl/shader_m.h>
+#include <camera.h>
+#include <scene_graph.h>
+#include <frustum.h>
+#include <bvh.h>
+#include <occlusion_culler.h>
+#include <gl_context.h>
+#include <frame_capture.h>
+#include <frame_stream.h>
+#include <input_log.h>
+#include <fixed_timestep.h>
+#include <frame_pacer.h>
+#include <spsc_queue.h>
 #include <iostream>
+#include <memory>
 
 /*
 When we're talking about camera/view space we're talking about all the vertex coordinates as seen from the camera's perspective as the origin of the scene: the view matrix transforms all the world coordinates into view coordinates that are relative to the camera's position and direction.
@@ -138,65 +151,209 @@ glfwSetScrollCallback(window, scroll_callback);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void processInput(GLFWwindow* window);
+struct CameraInput;
+CameraInput processInput(GLFWwindow* window);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
-// camera
-glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 3.0f);
+// camera, as drawn this frame; the simulation owns the real state
+glm::dvec3 cameraPos = glm::dvec3(0.0, 0.0, 3.0);
 glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
 glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
+const float mouseSensitivity = 0.1f; // change this value to your liking
 
-bool firstMouse = true;
-float yaw = -90.0f;	// yaw is initialized to -90.0 degrees since a yaw of 0.0 results in a direction vector pointing to the right so we initially rotate a bit to the left.
-float pitch = 0.0f;
-float lastX = 800.0f / 2.0;
-float lastY = 600.0 / 2.0;
-float fov = 45.0f;
+// world positions are doubles; the scene graph sits at sceneOrigin and keeps its float matrices relative to it
+glm::dvec3 sceneOrigin = glm::dvec3(0.0);
+
+// raw events: the GLFW callbacks only push them, the main loop drains them after every poll and hands them on to the
+// simulation ticks, so the callbacks touch no camera state
+struct InputEvent
+{
+    enum Kind { EVENT_CURSOR, EVENT_SCROLL };
+    Kind Type;
+    unsigned int Frame; // first simulation update allowed to consume it
+    double X, Y;
+};
+SPSCQueue<InputEvent> callbackEvents(1024); // GLFW callbacks to the main loop
+SPSCQueue<InputEvent> inputEvents(1024);    // main loop to the simulation ticks, which may run on a worker thread
+unsigned int simulationFrame = 0;   // simulation updates started so far
+
+// the latest cursor position the main loop has passed on, for the late latch
+struct LatestCursor
+{
+    double X = 0.0, Y = 0.0;
+    bool Seen = false;
+};
+
+// moves the events the callbacks queued since the last poll on to the simulation, keeping the cursor position
+void forwardInput(LatestCursor& cursor)
+{
+    InputEvent event;
+    while (callbackEvents.TryPop(event))
+    {
+        if (event.Type == InputEvent::EVENT_CURSOR)
+        {
+            cursor.X = event.X;
+            cursor.Y = event.Y;
+            cursor.Seen = true;
+        }
+        inputEvents.TryPush(event);
+    }
+}
 
 // timing
-float deltaTime = 0.0f;	// time between current frame and last frame
-float lastFrame = 0.0f;
+double deltaTime = 0.0;	// time between current frame and last frame
+double lastFrame = 0.0;
+
+// the camera as the simulation ticks see it
+struct CameraState
+{
+    double Time;
+    glm::dvec3 Position;
+    glm::vec3 Front;
+    float Yaw, Pitch, Fov;
+    double CursorX, CursorY; // last cursor position the ticks consumed
+    bool CursorSeen;
+};
+struct CameraInput
+{
+    bool Forward, Backward, Left, Right;
+    bool Orbit;          // headless fly-through instead of keys
+    unsigned int Frame;  // simulation update the input was sampled for
+};
+
+// yaw and pitch after a cursor movement of dx, dy pixels
+void turnCamera(float& yaw, float& pitch, double dx, double dy)
+{
+    yaw += (float)dx * mouseSensitivity;
+    pitch += (float)-dy * mouseSensitivity; // reversed since y-coordinates go from bottom to top
+    // make sure that when pitch is out of bounds, screen doesn't get flipped
+    if (pitch > 89.0f)
+        pitch = 89.0f;
+    if (pitch < -89.0f)
+        pitch = -89.0f;
+}
+
+glm::vec3 cameraDirection(float yaw, float pitch)
+{
+    glm::vec3 front;
+    front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
+    front.y = sin(glm::radians(pitch));
+    front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
+    return glm::normalize(front);
+}
 
-int main()
+void tickCamera(CameraState& state, const CameraInput& input, double step)
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-    if (window == NULL)
+    state.Time += step;
+    // events pushed after this update was started wait for the next one, so a threaded simulation sees the same ones
+    for (const InputEvent* event = inputEvents.Front(); event && event->Frame <= input.Frame; event = inputEvents.Front())
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        if (event->Type == InputEvent::EVENT_CURSOR)
+        {
+            if (state.CursorSeen)
+                turnCamera(state.Yaw, state.Pitch, event->X - state.CursorX, event->Y - state.CursorY);
+            state.CursorX = event->X;
+            state.CursorY = event->Y;
+            state.CursorSeen = true;
+        }
+        else
+            state.Fov = glm::clamp(state.Fov - (float)event->Y, 1.0f, 45.0f);
+        inputEvents.Pop();
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
 
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (input.Orbit)
+    {
+        // fly-through: orbit the boxes, looking at the origin
+        const float radius = 10.0f;
+        float t = (float)state.Time * 0.5f;
+        glm::vec3 offset = glm::vec3(sin(t) * radius, 1.0f, cos(t) * radius);
+        state.Position = sceneOrigin + glm::dvec3(offset);
+        state.Front = glm::normalize(-offset);
+        return;
+    }
+    // the trig runs once per tick rather than once per mouse event
+    state.Front = cameraDirection(state.Yaw, state.Pitch);
+    float cameraSpeed = (float)(2.5 * step);
+    glm::vec3 right = glm::normalize(glm::cross(state.Front, cameraUp));
+    if (input.Forward)
+        state.Position += glm::dvec3(cameraSpeed * state.Front);
+    if (input.Backward)
+        state.Position -= glm::dvec3(cameraSpeed * state.Front);
+    if (input.Left)
+        state.Position -= glm::dvec3(right * cameraSpeed);
+    if (input.Right)
+        state.Position += glm::dvec3(right * cameraSpeed);
+}
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+CameraState blendCamera(const CameraState& previous, const CameraState& current, double alpha)
+{
+    CameraState state = current;
+    state.Position = glm::mix(previous.Position, current.Position, alpha);
+    state.Front = glm::normalize(glm::mix(previous.Front, current.Front, (float)alpha));
+    return state;
+}
+
+// input recording/replay: --record=<file>, --replay=<file> [--timestep=<seconds>]
+InputLog input;
+
+int main(int argc, char* argv[])
+{
+    if (!input.Open(argc, argv))
+        return -1;
+
+    // --stream=<file> (or - for stdout) writes every frame as y4m (--stream-format=y4m|raw) at --fps frames per second;
+    // when the frames go to stdout everything else is printed to stderr
+    std::string streamPath = GLContext::StringArg(argc, argv, "stream", "");
+    FrameStream::Format streamFormat = GLContext::StringArg(argc, argv, "stream-format", "y4m") == "raw" ? FrameStream::FORMAT_RAW : FrameStream::FORMAT_Y4M;
+    int streamFps = GLContext::IntArg(argc, argv, "fps", 60);
+    std::ostream& report = streamPath == "-" ? std::cerr : std::cout;
+
+    // context: a window by default, or headless (--context=egl|osmesa) drawing into an offscreen framebuffer
+    // -------------------------------------------------------------------------------------------------------
+    GLContext context;
+    if (!context.Create(GLContext::FromArgs(argc, argv), SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
     {
-        std::cout << "Failed to initialize GLAD" << std::endl;
+        context.Destroy();
         return -1;
     }
+    GLFWwindow* window = context.Window;
+    if (window)
+    {
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        // the callbacks go through the input log, which records them or, on replay, feeds them the logged events instead
+        glfwSetCursorPosCallback(window, [](GLFWwindow* w, double x, double y) { input.Cursor(w, x, y); });
+        glfwSetScrollCallback(window, [](GLFWwindow* w, double x, double y) { input.Scroll(w, x, y); });
+
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
+    input.SetCallbacks(mouse_callback, scroll_callback);
+    // --vsync=on|off|adaptive and --frame-rate=N; headless frames are only paced with an explicit --frame-rate
+    FramePacer pacer = FramePacer::FromArgs(argc, argv);
+    pacer.Start(window);
+    // without a window the camera flies a fixed orbit for --frames frames, one 1/fps step per frame
+    int headlessFrames = GLContext::IntArg(argc, argv, "frames", 600);
+    // camera movement runs at --tick-rate ticks per second, on its own thread with --sim-thread=1
+    int tickRate = GLContext::IntArg(argc, argv, "tick-rate", 120);
+    // --world-offset=<units> moves the whole scene that far out along x and z, e.g. 1000000 to check that nothing jitters
+    double worldOffset = GLContext::IntArg(argc, argv, "world-offset", 0);
+    sceneOrigin = glm::dvec3(worldOffset, 0.0, worldOffset);
+    cameraPos += sceneOrigin;
+    // yaw is initialized to -90.0 degrees since a yaw of 0.0 results in a direction vector pointing to the right so we initially rotate a bit to the left.
+    CameraState initialCamera = { 0.0, cameraPos, cameraFront, -90.0f, 0.0f, 45.0f, 0.0, 0.0, false };
+    // the camera the frames are drawn with
+    Camera viewCamera(cameraPos);
+    viewCamera.SetPerspective((float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    // culling and picking work in the scene graph's space, so the camera's view and frustum are taken relative to it
+    viewCamera.SetOrigin(sceneOrigin);
+    // --depth=reversed draws with reversed-z, an infinite far plane and a float depth buffer when the driver allows it
+    if (GLContext::StringArg(argc, argv, "depth", "standard") == "reversed" && context.EnableReversedZ())
+        viewCamera.SetDepth(DEPTH_REVERSED_Z);
+    Simulation<CameraState, CameraInput> simulation(initialCamera, tickCamera, blendCamera, tickRate > 0 ? tickRate : 120,
+                                                    GLContext::IntArg(argc, argv, "sim-thread", 0) != 0);
 
     // configure global opengl state
     // -----------------------------
@@ -263,6 +420,32 @@ int main()
         glm::vec3(1.5f,  0.2f, -1.5f),
         glm::vec3(-1.3f,  1.0f, -1.5f)
     };
+    // the cubes hang off a single root node of the scene graph, their world matrices are only rebuilt when they move
+    SceneGraph scene;
+    unsigned int sceneRoot = scene.AddNode(-1);
+    unsigned int cubeNodes[10];
+    for (unsigned int i = 0; i < 10; i++)
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, cubePositions[i]);
+        float angle = 20.0f * i;
+        model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+        cubeNodes[i] = scene.AddNode(sceneRoot, model);
+    }
+    // world space bounds of every cube, refreshed whenever the scene graph moves something
+    AABB cubeBounds(glm::vec3(-0.5f), glm::vec3(0.5f));
+    FrustumCuller culler;
+    for (unsigned int i = 0; i < 10; i++)
+        culler.Add(cubeBounds);
+    std::vector<AABB> cubeWorldBounds(10);
+    std::vector<unsigned int> visibleCubes;
+    // the frustum survivors are rasterized as occluders into a small CPU depth buffer and tested against it
+    OcclusionCuller occlusion;
+    JobSystem jobs;
+    // bounding volume hierarchy over the same bounds, used to pick the cube under the crosshair
+    BVH pickTree;
+    bool pickWasPressed = false;
+    double lastCullReport = 0.0;
     unsigned int VBO, VAO;
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
@@ -304,7 +487,7 @@ int main()
     }
     else
     {
-        std::cout << "Failed to load texture" << std::endl;
+        report << "Failed to load texture" << std::endl;
     }
     stbi_image_free(data);
     // texture 2
@@ -327,7 +510,7 @@ int main()
     }
     else
     {
-        std::cout << "Failed to load texture" << std::endl;
+        report << "Failed to load texture" << std::endl;
     }
     stbi_image_free(data);
 
@@ -338,19 +521,56 @@ int main()
     ourShader.setInt("texture2", 1);
 
 
+    // frames are read back through a PBO ring and converted/written on the capture worker; the queue between them is
+    // bounded and never drops, so a slow reader slows the render loop down instead of growing memory
+    std::unique_ptr<FrameStream> stream;
+    std::unique_ptr<FrameCapture> capture;
+    if (!streamPath.empty())
+    {
+        int streamWidth, streamHeight;
+        context.FramebufferSize(streamWidth, streamHeight);
+        stream.reset(new FrameStream(streamPath, streamWidth, streamHeight, streamFps, streamFormat));
+        if (!stream->IsOpen())
+        {
+            report << "Failed to open stream " << streamPath << std::endl;
+            context.Destroy();
+            return -1;
+        }
+        FrameStream* output = stream.get();
+        capture.reset(new FrameCapture(streamWidth, streamHeight, [output](unsigned int, unsigned char* bgra) { output->Write(bgra); }, 3, 4, false));
+    }
+
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    int frame = 0;
+    double loopStart = context.Time();
+    LatestCursor latestCursor;
+    for (; !context.ShouldClose() && (!context.Headless() || frame < headlessFrames) && !input.Finished(); frame++)
     {
+        // hold the frame back until just enough time is left to draw it, so the input it samples is fresh
+        pacer.BeginFrame();
+
         // per-frame time logic
         // --------------------
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
+        double currentFrame = context.Headless() ? (double)frame / streamFps : context.Time();
+        deltaTime = input.BeginFrame(currentFrame - lastFrame);
         lastFrame = currentFrame;
 
         // input
         // -----
-        processInput(window);
+        // a replay drives the camera even without a window
+        CameraInput cameraInput = CameraInput();
+        if (window || input.GetMode() == InputLog::MODE_REPLAY)
+            cameraInput = processInput(window);
+        else
+            cameraInput.Orbit = true;
+
+        // simulation: whole ticks for the elapsed time, drawn interpolated between the last two
+        forwardInput(latestCursor);
+        cameraInput.Frame = simulationFrame;
+        CameraState drawn = simulation.Update(deltaTime, cameraInput);
+        simulationFrame++;
+        cameraPos = drawn.Position;
 
         // render
         // ------
@@ -366,32 +586,127 @@ int main()
         // activate shader
         ourShader.use();
 
-        // pass projection matrix to shader (note that in this case it could change every frame)
-        glm::mat4 projection = glm::perspective(glm::radians(fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        // late latch: take the mouse movement that arrived while the frame was being prepared, right before the view is built
+        if (window)
+            glfwPollEvents();
+        input.Latch(window);
+        forwardInput(latestCursor);
+        pacer.MarkInput();
+
+        // camera/view transformation: the camera's cached matrices and frustum are only rebuilt when it moved or turned
+        viewCamera.Position = cameraPos;
+        viewCamera.Zoom = drawn.Fov;
+        if (cameraInput.Orbit)
+            viewCamera.SetFront(drawn.Front);
+        else
+        {
+            // turn by the cursor movement the ticks have not consumed yet
+            float yaw = drawn.Yaw, pitch = drawn.Pitch;
+            if (drawn.CursorSeen && latestCursor.Seen)
+                turnCamera(yaw, pitch, latestCursor.X - drawn.CursorX, latestCursor.Y - drawn.CursorY);
+            viewCamera.Yaw = yaw;
+            viewCamera.Pitch = pitch;
+        }
+        glm::mat4 projection = viewCamera.GetProjectionMatrix();
+        glm::mat4 view = viewCamera.GetViewMatrix();
+        cameraFront = viewCamera.Front;
+
+        // pass the matrices to the shader (note that in this case they could change every frame); drawing is camera
+        // relative: the view has no translation and the scene's offset from the camera is taken in double, so only
+        // small floats reach the GPU however far from the world origin the scene is
         ourShader.setMat4("projection", projection);
+        ourShader.setMat4("view", viewCamera.GetRelativeViewMatrix());
+        glm::mat4 sceneToCamera = glm::translate(glm::mat4(1.0f), viewCamera.Relative(sceneOrigin));
 
-        // camera/view transformation
-        glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-        ourShader.setMat4("view", view);
+        // refresh the world matrices of whatever moved since last frame (nothing, for static boxes)
+        if (scene.Update() > 0)
+        {
+            for (unsigned int i = 0; i < 10; i++)
+            {
+                cubeWorldBounds[i] = cubeBounds.Transform(scene.GetWorld(cubeNodes[i]));
+                culler.Set(i, cubeWorldBounds[i]);
+            }
+            // build the tree once, afterwards moving cubes only refit it
+            if (pickTree.Nodes.empty())
+                pickTree.Build(cubeWorldBounds);
+            else
+            {
+                for (unsigned int i = 0; i < 10; i++)
+                    pickTree.SetBounds(i, cubeWorldBounds[i]);
+                pickTree.Refit();
+            }
+        }
+
+        // left click picks the cube under the crosshair (the cursor is captured, so that's the screen center)
+        bool pickPressed = input.GetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        if (pickPressed && !pickWasPressed)
+        {
+            RayHit hit = pickTree.Raycast(Ray::FromScreen(SCR_WIDTH / 2.0f, SCR_HEIGHT / 2.0f, (float)SCR_WIDTH, (float)SCR_HEIGHT, view, projection,
+                                                             viewCamera.GetDepth()));
+            if (hit.Object >= 0)
+                report << "picked cube " << hit.Object << " at distance " << hit.Distance << std::endl;
+        }
+        pickWasPressed = pickPressed;
+
+        // only draw the boxes inside the view frustum
+        CullStats cullStats = culler.Cull(viewCamera.GetFrustum(), visibleCubes);
+
+        // then drop the ones hidden behind other boxes
+        occlusion.BeginFrame(viewCamera.GetViewProjectionMatrix(), viewCamera.GetDepth());
+        for (unsigned int i : visibleCubes)
+            occlusion.AddOccluder(vertices, 5, 36, scene.GetWorld(cubeNodes[i]));
+        occlusion.Rasterize(&jobs);
+        unsigned int occluded = occlusion.Filter(cubeWorldBounds, visibleCubes, &jobs);
+        if (currentFrame - lastCullReport >= 1.0f)
+        {
+            report << "visible: " << visibleCubes.size() << " culled: " << cullStats.Culled << " occluded: " << occluded << " (" << cullStats.NanosecondsPerObject << " ns/object)" << std::endl;
+            lastCullReport = currentFrame;
+        }
 
         // render boxes
         glBindVertexArray(VAO);
-        for (unsigned int i = 0; i < 10; i++)
+        for (unsigned int i : visibleCubes)
         {
-            // calculate the model matrix for each object and pass it to shader before drawing
-            glm::mat4 model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-            ourShader.setMat4("model", model);
+            ourShader.setMat4("model", sceneToCamera * scene.GetWorld(cubeNodes[i]));
 
             glDrawArrays(GL_TRIANGLES, 0, 36);
         }
 
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (capture)
+        {
+            capture->Capture();
+            if (!stream->Good())
+            {
+                report << "Stream closed, stopping" << std::endl;
+                break;
+            }
+        }
+
+        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.), or just submit the offscreen frame
+        // -----------------------------------------------------------------------------------------------------------------
+        pacer.BeginPresent();
+        context.Present();
+        pacer.EndPresent();
+        input.EndFrame(window);
+    }
+    glFinish();
+    double loopTime = context.Time() - loopStart;
+    report << GLContext::Name(context.Type) << ": " << frame << " frames in " << loopTime << " s, " << (loopTime > 0.0 ? frame / loopTime : 0.0) << " frames/second" << std::endl;
+    PacerStats pacing = pacer.Stats();
+    report << "pacing: " << pacer.Rate() << " Hz target, " << pacing.FrameMs << " ms/frame (jitter " << pacing.JitterMs << " ms, "
+           << pacing.Missed << " missed), input to present " << pacing.LatencyMs << " ms (max " << pacing.MaxLatencyMs << " ms), waited " << pacing.WaitMs << " ms/frame" << std::endl;
+    simulation.Sync();
+    report << "simulation: " << simulation.Clock().Ticks << " ticks of " << simulation.Clock().Step() * 1000.0 << " ms" << (simulation.Threaded() ? " on a worker thread" : "")
+           << ", " << simulation.Clock().Skipped * 1e-9 << " s skipped, " << callbackEvents.Dropped() + inputEvents.Dropped() << " input events dropped" << std::endl;
+    report << "camera: view rebuilt " << viewCamera.ViewUpdates << " times, projection " << viewCamera.ProjectionUpdates << " times in " << frame << " frames" << std::endl;
+    if (capture)
+    {
+        capture->Flush();
+        CaptureStats stats = capture->Stats();
+        report << "stream: " << stream->Frames << " frames, " << stream->BytesWritten / (1024.0 * 1024.0) << " MB, " << stats.Stalls << " stalls, convert + write "
+               << stats.EncodeMs << " ms/frame, " << stats.FramesPerSecond << " frames/second (" << stats.MegabytesPerSecond << " MB/s read back)" << std::endl;
+        capture.reset();
+        stream.reset();
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
@@ -399,28 +714,26 @@ int main()
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
 
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    // ------------------------------------------------------------------
-    glfwTerminate();
+    // glfw: terminate, clearing all previously allocated GLFW resources (or the headless context and its framebuffer).
+    // ------------------------------------------------------------------------------------------------------------------
+    context.Destroy();
     return 0;
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow* window)
+CameraInput processInput(GLFWwindow* window)
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (window && input.GetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    float cameraSpeed = 2.5 * deltaTime;
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        cameraPos += cameraSpeed * cameraFront;
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        cameraPos -= cameraSpeed * cameraFront;
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+    // the movement itself happens in tickCamera, once per simulation tick
+    CameraInput sampled = CameraInput();
+    sampled.Forward = input.GetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+    sampled.Backward = input.GetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+    sampled.Left = input.GetKey(window, GLFW_KEY_A) == GLFW_PRESS;
+    sampled.Right = input.GetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+    return sampled;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -429,52 +742,24 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     // make sure the viewport matches the new window dimensions; note that width and 
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    // with reversed-z the frame is drawn into a fixed size offscreen target instead, which Present() scales
+    GLint drawFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+    if (drawFramebuffer == 0)
+        glViewport(0, 0, width, height);
 }
 
 // glfw: whenever the mouse moves, this callback is called
 // -------------------------------------------------------
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 {
-    if (firstMouse)
-    {
-        lastX = xpos;
-        lastY = ypos;
-        firstMouse = false;
-    }
-
-    float xoffset = xpos - lastX;
-    float yoffset = lastY - ypos; // reversed since y-coordinates go from bottom to top
-    lastX = xpos;
-    lastY = ypos;
-
-    float sensitivity = 0.1f; // change this value to your liking
-    xoffset *= sensitivity;
-    yoffset *= sensitivity;
-
-    yaw += xoffset;
-    pitch += yoffset;
-
-    // make sure that when pitch is out of bounds, screen doesn't get flipped
-    if (pitch > 89.0f)
-        pitch = 89.0f;
-    if (pitch < -89.0f)
-        pitch = -89.0f;
-
-    glm::vec3 front;
-    front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
-    front.y = sin(glm::radians(pitch));
-    front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
-    cameraFront = glm::normalize(front);
+    // only queue the event, the simulation turns it into yaw and pitch
+    callbackEvents.TryPush({ InputEvent::EVENT_CURSOR, simulationFrame, xpos, ypos });
 }
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    fov -= (float)yoffset;
-    if (fov < 1.0f)
-        fov = 1.0f;
-    if (fov > 45.0f)
-        fov = 45.0f;
+    callbackEvents.TryPush({ InputEvent::EVENT_SCROLL, simulationFrame, xoffset, yoffset });
 }
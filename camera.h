@@ -0,0 +1,356 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <frustum.h>
+
+#include <cmath>
+
+// Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
+enum Camera_Movement {
+    FORWARD,
+    BACKWARD,
+    LEFT,
+    RIGHT
+};
+
+// Default camera values
+const float YAW = -90.0f;
+const float PITCH = 0.0f;
+const float SPEED = 2.5f;
+const float SENSITIVITY = 0.1f;
+const float ZOOM = 45.0f;
+
+
+// An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL.
+//
+// The orientation is a quaternion, built from Yaw and Pitch (yaw about WorldUp, then pitch about the camera's right axis,
+// cross(front, WorldUp), so any up axis works) or set directly with SetOrientation(). View, projection, their product, its inverse and the frustum planes are cached
+// and only recomputed when something they depend on changed: ProcessMouseMovement() and friends just update the angles,
+// and the trig runs once, the next time a matrix is asked for. Writing Position, Yaw, Pitch, Zoom or WorldUp directly
+// is noticed as well. Front, Right and Up follow the orientation lazily, they are current after any Get*() call.
+//
+// Position is in double precision so the camera can travel far from the origin. The view, view-projection and frustum
+// are expressed relative to an origin (SetOrigin(), the world origin by default), which should be near whatever they
+// are used with. For drawing, the relative matrices leave the camera's translation out altogether: models are placed
+// with Relative(worldPosition), the offset from the camera computed in double and only then rounded to float, so
+// geometry far from the origin does not jitter and the GPU still only sees floats.
+//
+// With SetDepth(DEPTH_REVERSED_Z) the projection is a reversed-z one with an infinite far plane: depth is 1 at the near
+// plane and falls towards 0 at infinity, which together with a floating point depth buffer spreads precision evenly
+// over the whole view distance. It needs glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE) and glDepthFunc(GL_GREATER),
+// see GLContext::EnableReversedZ(); the frustum follows the convention by itself.
+class Camera
+{
+public:
+    // camera Attributes
+    glm::dvec3 Position;
+    glm::vec3 Front;
+    glm::vec3 Up;
+    glm::vec3 Right;
+    glm::vec3 WorldUp;
+    // euler Angles
+    float Yaw;
+    float Pitch;
+    // camera options
+    float MovementSpeed;
+    float MouseSensitivity;
+    float Zoom;
+    // how often the cached matrices were rebuilt, to check that an idle camera costs nothing
+    unsigned int ViewUpdates = 0;
+    unsigned int ProjectionUpdates = 0;
+
+    // constructor with vectors
+    Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f), float yaw = YAW, float pitch = PITCH)
+        : Camera(glm::dvec3(position), up, yaw, pitch)
+    {
+    }
+    explicit Camera(const glm::dvec3& position, glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f), float yaw = YAW, float pitch = PITCH)
+        : Position(position), Front(glm::vec3(0.0f, 0.0f, -1.0f)), Up(up), Right(glm::vec3(1.0f, 0.0f, 0.0f)), WorldUp(up), Yaw(yaw), Pitch(pitch),
+          MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM)
+    {
+        updateOrientation();
+    }
+    // constructor with scalar values
+    Camera(float posX, float posY, float posZ, float upX, float upY, float upZ, float yaw, float pitch)
+        : Camera(glm::vec3(posX, posY, posZ), glm::vec3(upX, upY, upZ), yaw, pitch)
+    {
+    }
+
+    // aspect ratio and clip planes of the projection; the field of view is Zoom
+    void SetPerspective(float aspect, float nearPlane, float farPlane)
+    {
+        if (aspect == projectionAspect && nearPlane == projectionNear && farPlane == projectionFar)
+            return;
+        projectionAspect = aspect;
+        projectionNear = nearPlane;
+        projectionFar = farPlane;
+        dirty |= DIRTY_PROJECTION;
+    }
+
+    // standard -1..1 depth or reversed-z with an infinite far plane, where the far plane of SetPerspective() is ignored
+    void SetDepth(DepthConvention convention)
+    {
+        if (convention == depth)
+            return;
+        depth = convention;
+        dirty |= DIRTY_PROJECTION;
+    }
+
+    DepthConvention GetDepth() const
+    {
+        return depth;
+    }
+
+    // the point the view, view-projection and frustum are relative to
+    void SetOrigin(const glm::dvec3& origin)
+    {
+        if (origin == viewOrigin)
+            return;
+        viewOrigin = origin;
+        dirty |= DIRTY_VIEW;
+    }
+
+    // offset of a world position from the camera, for model matrices used with the relative view
+    glm::vec3 Relative(const glm::dvec3& world) const
+    {
+        return glm::vec3(world - Position);
+    }
+
+    // replaces the orientation, e.g. one with roll or one interpolated with slerp; Yaw and Pitch follow it
+    void SetOrientation(const glm::quat& rotation)
+    {
+        orientation = glm::normalize(rotation);
+        glm::vec3 front = glm::conjugate(upFrame()) * (orientation * glm::vec3(0.0f, 0.0f, -1.0f));
+        Pitch = glm::degrees(std::asin(glm::clamp(front.y, -1.0f, 1.0f)));
+        Yaw = glm::degrees(std::atan2(front.z, front.x));
+        viewWorldUp = WorldUp;
+        orientedYaw = Yaw;
+        orientedPitch = Pitch;
+        updateVectors();
+        dirty |= DIRTY_ROTATION;
+    }
+
+    // points the camera along direction; only does work when the direction differs from the last one set
+    void SetFront(const glm::vec3& direction)
+    {
+        if (direction == lastFront)
+            return;
+        lastFront = direction;
+        glm::vec3 front = glm::conjugate(upFrame()) * glm::normalize(direction);
+        Pitch = glm::degrees(std::asin(glm::clamp(front.y, -1.0f, 1.0f)));
+        Yaw = glm::degrees(std::atan2(front.z, front.x));
+    }
+
+    const glm::quat& GetOrientation()
+    {
+        refresh();
+        return orientation;
+    }
+
+    // returns the view matrix, rebuilt only when the camera moved or turned since the last call
+    const glm::mat4& GetViewMatrix()
+    {
+        refresh();
+        return view;
+    }
+
+    const glm::mat4& GetProjectionMatrix()
+    {
+        refresh();
+        return projection;
+    }
+
+    // the view of a camera sitting at the origin, i.e. rotation only, for camera-relative drawing
+    const glm::mat4& GetRelativeViewMatrix()
+    {
+        refresh();
+        return relativeView;
+    }
+
+    const glm::mat4& GetRelativeViewProjectionMatrix()
+    {
+        refresh();
+        return relativeViewProjection;
+    }
+
+    const glm::mat4& GetViewProjectionMatrix()
+    {
+        refresh();
+        return viewProjection;
+    }
+
+    const glm::mat4& GetInverseViewProjectionMatrix()
+    {
+        refresh();
+        return inverseViewProjection;
+    }
+
+    const Frustum& GetFrustum()
+    {
+        refresh();
+        return frustum;
+    }
+
+    // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
+    void ProcessKeyboard(Camera_Movement direction, float deltaTime)
+    {
+        refresh();
+        float velocity = MovementSpeed * deltaTime;
+        if (direction == FORWARD)
+            Position += glm::dvec3(Front * velocity);
+        if (direction == BACKWARD)
+            Position -= glm::dvec3(Front * velocity);
+        if (direction == LEFT)
+            Position -= glm::dvec3(Right * velocity);
+        if (direction == RIGHT)
+            Position += glm::dvec3(Right * velocity);
+    }
+
+    // processes input received from a mouse input system. Expects the offset value in both the x and y direction.
+    void ProcessMouseMovement(float xoffset, float yoffset, GLboolean constrainPitch = true)
+    {
+        xoffset *= MouseSensitivity;
+        yoffset *= MouseSensitivity;
+
+        Yaw += xoffset;
+        Pitch += yoffset;
+
+        // make sure that when pitch is out of bounds, screen doesn't get flipped
+        if (constrainPitch)
+        {
+            if (Pitch > 89.0f)
+                Pitch = 89.0f;
+            if (Pitch < -89.0f)
+                Pitch = -89.0f;
+        }
+        // the orientation is rebuilt once, when it is next needed
+    }
+
+    // processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
+    void ProcessMouseScroll(float yoffset)
+    {
+        Zoom -= (float)yoffset;
+        if (Zoom < 1.0f)
+            Zoom = 1.0f;
+        if (Zoom > 45.0f)
+            Zoom = 45.0f;
+    }
+
+private:
+    enum { DIRTY_ROTATION = 1, DIRTY_VIEW = 2, DIRTY_PROJECTION = 4 };
+
+    glm::quat orientation;
+    unsigned int dirty = DIRTY_ROTATION | DIRTY_VIEW | DIRTY_PROJECTION;
+    // the values the caches were built from
+    float orientedYaw = 0.0f, orientedPitch = 0.0f;
+    glm::dvec3 viewPosition = glm::dvec3(0.0), viewOrigin = glm::dvec3(0.0);
+    glm::vec3 viewWorldUp = glm::vec3(0.0f), lastFront = glm::vec3(0.0f);
+    float projectionZoom = 0.0f, projectionAspect = 4.0f / 3.0f, projectionNear = 0.1f, projectionFar = 100.0f;
+    DepthConvention depth = DEPTH_STANDARD;
+
+    glm::mat4 view = glm::mat4(1.0f), projection = glm::mat4(1.0f), inverseView = glm::mat4(1.0f), inverseProjection = glm::mat4(1.0f);
+    glm::mat4 viewProjection = glm::mat4(1.0f), inverseViewProjection = glm::mat4(1.0f);
+    glm::mat4 relativeView = glm::mat4(1.0f), relativeViewProjection = glm::mat4(1.0f);
+    Frustum frustum;
+
+    // compares what the caches were built from with the public fields and rebuilds what is stale
+    void refresh()
+    {
+        if (Yaw != orientedYaw || Pitch != orientedPitch || WorldUp != viewWorldUp)
+            updateOrientation();
+        if (Position != viewPosition)
+            dirty |= DIRTY_VIEW;
+        if (Zoom != projectionZoom)
+            dirty |= DIRTY_PROJECTION;
+        if (!dirty)
+            return;
+
+        if (dirty & DIRTY_ROTATION)
+        {
+            // the rotation part of the view is the inverse (transpose) of the orientation, no lookAt needed
+            relativeView = glm::mat4_cast(glm::conjugate(orientation));
+        }
+        if (dirty & (DIRTY_ROTATION | DIRTY_VIEW))
+        {
+            // the translation is taken in double and only the (small) offset from the origin is rounded
+            glm::vec3 position = glm::vec3(Position - viewOrigin);
+            inverseView = glm::mat4_cast(orientation);
+            inverseView[3] = glm::vec4(position, 1.0f);
+            view = relativeView;
+            view[3] = glm::vec4(-(glm::mat3(relativeView) * position), 1.0f);
+            viewPosition = Position;
+            ViewUpdates++;
+        }
+        if (dirty & DIRTY_PROJECTION)
+        {
+            if (depth == DEPTH_REVERSED_Z)
+            {
+                // clip z = near and clip w = -z_view, so depth = near / distance: 1 at the near plane, 0 at infinity
+                float f = 1.0f / std::tan(glm::radians(Zoom) * 0.5f);
+                projection = glm::mat4(0.0f);
+                projection[0][0] = f / projectionAspect;
+                projection[1][1] = f;
+                projection[2][3] = -1.0f;
+                projection[3][2] = projectionNear;
+                inverseProjection = glm::mat4(0.0f);
+                inverseProjection[0][0] = projectionAspect / f;
+                inverseProjection[1][1] = 1.0f / f;
+                inverseProjection[3][2] = -1.0f;
+                inverseProjection[2][3] = 1.0f / projectionNear;
+            }
+            else
+            {
+                projection = glm::perspective(glm::radians(Zoom), projectionAspect, projectionNear, projectionFar);
+                inverseProjection = glm::inverse(projection);
+            }
+            projectionZoom = Zoom;
+            ProjectionUpdates++;
+        }
+        if (dirty & (DIRTY_ROTATION | DIRTY_PROJECTION))
+            relativeViewProjection = projection * relativeView;
+        viewProjection = projection * view;
+        inverseViewProjection = inverseView * inverseProjection;
+        frustum = Frustum(viewProjection, depth);
+        dirty = 0;
+    }
+
+    // builds the orientation from the euler angles: yaw about the world up axis, then pitch about the camera's right
+    void updateOrientation()
+    {
+        glm::vec3 worldUp = glm::normalize(WorldUp);
+        // a yaw of -90 degrees looks down -z, the quaternion's rest direction, turned so that +y is the world up
+        glm::quat yaw = glm::angleAxis(glm::radians(-(Yaw + 90.0f)), worldUp) * upFrame();
+        // pitch about the right axis of the yawed camera, which is horizontal whatever the world up is
+        glm::vec3 right = glm::normalize(glm::cross(yaw * glm::vec3(0.0f, 0.0f, -1.0f), worldUp));
+        glm::quat pitch = glm::angleAxis(glm::radians(Pitch), right);
+        orientation = glm::normalize(pitch * yaw);
+        orientedYaw = Yaw;
+        orientedPitch = Pitch;
+        viewWorldUp = WorldUp;
+        updateVectors();
+        dirty |= DIRTY_ROTATION;
+    }
+
+    // the rotation taking +y to WorldUp along the shortest arc; the angles are measured in this frame
+    glm::quat upFrame() const
+    {
+        glm::vec3 worldUp = glm::normalize(WorldUp);
+        if (worldUp.y < -0.9999f)
+            return glm::quat(0.0f, 1.0f, 0.0f, 0.0f);
+        glm::vec3 axis = glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), worldUp);
+        return glm::normalize(glm::quat(1.0f + worldUp.y, axis.x, axis.y, axis.z));
+    }
+
+    void updateVectors()
+    {
+        Front = orientation * glm::vec3(0.0f, 0.0f, -1.0f);
+        Right = orientation * glm::vec3(1.0f, 0.0f, 0.0f);
+        Up = orientation * glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+};
+#endif
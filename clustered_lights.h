@@ -0,0 +1,518 @@
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <job_system.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CLUSTER_SSE2
+#endif
+
+// a point light with a finite range: it adds nothing beyond Radius, which is what allows binning it
+struct PointLight
+{
+    glm::vec3 Position = glm::vec3(0.0f);
+    float Radius = 1.0f;
+    glm::vec3 Color = glm::vec3(1.0f);
+    float Intensity = 1.0f;
+};
+
+struct ClusterStats
+{
+    unsigned int Lights = 0;        // lights inside the clustered depth range
+    unsigned int Occupied = 0;      // clusters with at least one light
+    unsigned int References = 0;    // entries in the light index list
+    unsigned int MaxPerCluster = 0;
+    double AssignMs = 0.0;          // CPU time of the last Assign()
+};
+
+// Clustered light assignment. The view volume is cut into GridX x GridY screen tiles and GridZ depth slices, spaced
+// exponentially so that clusters stay roughly cubic, and every light is binned into the clusters its sphere touches;
+// a fragment then only loops over the lights of its own cluster.
+//
+// Assign() moves the lights to view space four at a time, spreads them over the depth slices they cover, and fills
+// the slices in parallel on the job system, testing a light's sphere against four cluster boxes at once with SSE2.
+// The result is an (offset, count) range per cluster into one light index list, lights in ascending order within a
+// cluster. AssignReference() is the brute force version, every light against every cluster, to check it against.
+class LightClusters
+{
+public:
+    unsigned int GridX, GridY, GridZ;
+    std::vector<std::uint32_t> Ranges;   // offset and count per cluster, cluster = (z * GridY + y) * GridX + x
+    std::vector<std::uint32_t> Indices;  // light indices, cluster after cluster
+
+    LightClusters(unsigned int gridX = 16, unsigned int gridY = 9, unsigned int gridZ = 24)
+        : GridX(gridX), GridY(gridY), GridZ(gridZ)
+    {
+        unsigned int count = gridX * gridY * gridZ;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            boxMin[axis].resize(count);
+            boxMax[axis].resize(count);
+        }
+        rowMin.resize(gridY * gridZ);
+        rowMax.resize(gridY * gridZ);
+        Ranges.assign(count * 2, 0);
+        slices.resize(gridZ);
+    }
+
+    unsigned int ClusterCount() const
+    {
+        return GridX * GridY * GridZ;
+    }
+
+    // builds the view space cluster boxes; fovY in radians. Only depths between nearPlane and farPlane are clustered
+    // and fragments beyond farPlane use the last slice, so with an infinite projection farPlane should still cover
+    // the lit part of the scene
+    void SetProjection(float fovY, float aspect, float nearPlane, float farPlane)
+    {
+        if (fovY == projectionFov && aspect == projectionAspect && nearPlane == sliceNear && farPlane == sliceFar)
+            return;
+        projectionFov = fovY;
+        projectionAspect = aspect;
+        sliceNear = nearPlane;
+        sliceFar = farPlane;
+        sliceScale = GridZ / std::log(farPlane / nearPlane);
+        sliceBias = -std::log(nearPlane) * sliceScale;
+
+        float tanY = std::tan(fovY * 0.5f), tanX = tanY * aspect;
+        for (unsigned int z = 0; z < GridZ; z++)
+        {
+            float d0 = sliceDepth(z), d1 = sliceDepth(z + 1);
+            for (unsigned int y = 0; y < GridY; y++)
+            {
+                float y0 = (-1.0f + 2.0f * y / GridY) * tanY, y1 = (-1.0f + 2.0f * (y + 1) / GridY) * tanY;
+                glm::vec3& lowRow = rowMin[z * GridY + y];
+                glm::vec3& highRow = rowMax[z * GridY + y];
+                lowRow = glm::vec3(1e30f);
+                highRow = glm::vec3(-1e30f);
+                for (unsigned int x = 0; x < GridX; x++)
+                {
+                    float x0 = (-1.0f + 2.0f * x / GridX) * tanX, x1 = (-1.0f + 2.0f * (x + 1) / GridX) * tanX;
+                    // the tile's edges at both ends of the slice; the view looks down -z
+                    glm::vec3 low(std::min(std::min(x0 * d0, x0 * d1), std::min(x1 * d0, x1 * d1)),
+                                  std::min(std::min(y0 * d0, y0 * d1), std::min(y1 * d0, y1 * d1)), -d1);
+                    glm::vec3 high(std::max(std::max(x0 * d0, x0 * d1), std::max(x1 * d0, x1 * d1)),
+                                   std::max(std::max(y0 * d0, y0 * d1), std::max(y1 * d0, y1 * d1)), -d0);
+                    unsigned int cluster = (z * GridY + y) * GridX + x;
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        boxMin[axis][cluster] = low[axis];
+                        boxMax[axis][cluster] = high[axis];
+                    }
+                    lowRow = glm::min(lowRow, low);
+                    highRow = glm::max(highRow, high);
+                }
+            }
+        }
+    }
+
+    // slice = log(view depth) * x + y, for the shader
+    glm::vec2 Slicing() const
+    {
+        return glm::vec2(sliceScale, sliceBias);
+    }
+
+    void Assign(const std::vector<PointLight>& lights, const glm::mat4& view, JobSystem* jobs = nullptr)
+    {
+        auto start = std::chrono::steady_clock::now();
+        transformLights(lights, view);
+
+        // spread the lights over the depth slices their spheres reach, one slice of slack on either side so that
+        // rounding in the log never drops a light the boxes would accept
+        for (Slice& slice : slices)
+            slice.Lights.clear();
+        unsigned int inRange = 0;
+        for (unsigned int i = 0; i < (unsigned int)lights.size(); i++)
+        {
+            float depth = -viewZ[i], radius = viewRadius[i];
+            if (depth + radius < sliceNear || depth - radius > sliceFar)
+                continue;
+            int first = sliceOf(std::max(depth - radius, sliceNear)) - 1;
+            int last = sliceOf(std::min(depth + radius, sliceFar)) + 1;
+            for (int z = std::max(first, 0); z <= std::min(last, (int)GridZ - 1); z++)
+                slices[z].Lights.push_back(i);
+            inRange++;
+        }
+
+        // every slice owns its clusters, so slices fill in parallel without sharing anything
+        auto fill = [this](unsigned int begin, unsigned int end)
+        {
+            for (unsigned int z = begin; z < end; z++)
+                fillSlice(z);
+        };
+        if (jobs)
+            jobs->ParallelFor(GridZ, 1, fill);
+        else
+            fill(0, GridZ);
+
+        // then the slices' lists are concatenated
+        unsigned int total = 0;
+        for (Slice& slice : slices)
+        {
+            slice.Base = total;
+            total += (unsigned int)slice.Indices.size();
+        }
+        Indices.resize(total);
+        auto merge = [this](unsigned int begin, unsigned int end)
+        {
+            for (unsigned int z = begin; z < end; z++)
+            {
+                const Slice& slice = slices[z];
+                std::copy(slice.Indices.begin(), slice.Indices.end(), Indices.begin() + slice.Base);
+                unsigned int first = z * GridX * GridY;
+                for (unsigned int c = 0; c < GridX * GridY; c++)
+                {
+                    Ranges[(first + c) * 2] = slice.Base + slice.Starts[c];
+                    Ranges[(first + c) * 2 + 1] = slice.Counts[c];
+                }
+            }
+        };
+        if (jobs)
+            jobs->ParallelFor(GridZ, 4, merge);
+        else
+            merge(0, GridZ);
+
+        stats = ClusterStats();
+        stats.Lights = inRange;
+        stats.References = total;
+        for (unsigned int c = 0; c < ClusterCount(); c++)
+        {
+            unsigned int count = Ranges[c * 2 + 1];
+            stats.Occupied += count > 0 ? 1 : 0;
+            stats.MaxPerCluster = std::max(stats.MaxPerCluster, count);
+        }
+        stats.AssignMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // brute force: every light against every cluster box, in scalar code, producing the same layout as Assign()
+    void AssignReference(const std::vector<PointLight>& lights, const glm::mat4& view,
+                         std::vector<std::uint32_t>& ranges, std::vector<std::uint32_t>& indices) const
+    {
+        ranges.assign(ClusterCount() * 2, 0);
+        indices.clear();
+        for (unsigned int c = 0; c < ClusterCount(); c++)
+        {
+            ranges[c * 2] = (unsigned int)indices.size();
+            for (unsigned int i = 0; i < (unsigned int)lights.size(); i++)
+            {
+                const glm::vec3& p = lights[i].Position;
+                float x = view[0][0] * p.x + view[1][0] * p.y + view[2][0] * p.z + view[3][0];
+                float y = view[0][1] * p.x + view[1][1] * p.y + view[2][1] * p.z + view[3][1];
+                float z = view[0][2] * p.x + view[1][2] * p.y + view[2][2] * p.z + view[3][2];
+                if (touches(c, x, y, z, lights[i].Radius * lights[i].Radius))
+                    indices.push_back(i);
+            }
+            ranges[c * 2 + 1] = (unsigned int)indices.size() - ranges[c * 2];
+        }
+    }
+
+    // number of clusters whose light list differs from AssignReference() for the same lights and view
+    unsigned int Validate(const std::vector<PointLight>& lights, const glm::mat4& view) const
+    {
+        std::vector<std::uint32_t> ranges, indices;
+        AssignReference(lights, view, ranges, indices);
+        unsigned int mismatches = 0;
+        for (unsigned int c = 0; c < ClusterCount(); c++)
+        {
+            unsigned int count = Ranges[c * 2 + 1];
+            bool same = count == ranges[c * 2 + 1] &&
+                        std::equal(Indices.begin() + Ranges[c * 2], Indices.begin() + Ranges[c * 2] + count, indices.begin() + ranges[c * 2]);
+            mismatches += same ? 0 : 1;
+        }
+        return mismatches;
+    }
+
+    ClusterStats Stats() const
+    {
+        return stats;
+    }
+
+private:
+    // one depth slice: the lights that may touch it and, after fillSlice(), its clusters' light lists
+    struct Slice
+    {
+        std::vector<std::uint32_t> Lights;
+        std::vector<std::uint32_t> HitCluster, HitLight;
+        std::vector<std::uint32_t> Counts, Starts, Next, Indices;
+        unsigned int Base = 0;
+    };
+
+    std::vector<float> boxMin[3], boxMax[3];      // cluster boxes in view space, structure of arrays
+    std::vector<glm::vec3> rowMin, rowMax;        // bounds of every row of tiles in a slice
+    std::vector<float> viewX, viewY, viewZ, viewRadius;
+    std::vector<Slice> slices;
+    float projectionFov = 0.0f, projectionAspect = 0.0f;
+    float sliceNear = 0.1f, sliceFar = 100.0f, sliceScale = 1.0f, sliceBias = 0.0f;
+    ClusterStats stats;
+
+    float sliceDepth(unsigned int z) const
+    {
+        return sliceNear * std::pow(sliceFar / sliceNear, (float)z / GridZ);
+    }
+
+    int sliceOf(float depth) const
+    {
+        return (int)std::floor(std::log(depth) * sliceScale + sliceBias);
+    }
+
+    // sphere against box: the squared distance from the center to the box, per axis max(min - c, c - max, 0)
+    bool touches(unsigned int cluster, float x, float y, float z, float radiusSquared) const
+    {
+        float dx = std::max(std::max(boxMin[0][cluster] - x, x - boxMax[0][cluster]), 0.0f);
+        float dy = std::max(std::max(boxMin[1][cluster] - y, y - boxMax[1][cluster]), 0.0f);
+        float dz = std::max(std::max(boxMin[2][cluster] - z, z - boxMax[2][cluster]), 0.0f);
+        return dx * dx + dy * dy + dz * dz <= radiusSquared;
+    }
+
+    static bool touchesBox(const glm::vec3& low, const glm::vec3& high, const glm::vec3& center, float radiusSquared)
+    {
+        glm::vec3 d = glm::max(glm::max(low - center, center - high), glm::vec3(0.0f));
+        return glm::dot(d, d) <= radiusSquared;
+    }
+
+    void transformLights(const std::vector<PointLight>& lights, const glm::mat4& view)
+    {
+        unsigned int count = (unsigned int)lights.size();
+        viewX.resize(count);
+        viewY.resize(count);
+        viewZ.resize(count);
+        viewRadius.resize(count);
+        unsigned int i = 0;
+#ifdef CLUSTER_SSE2
+        __m128 m[4][3];
+        for (int column = 0; column < 4; column++)
+            for (int row = 0; row < 3; row++)
+                m[column][row] = _mm_set1_ps(view[column][row]);
+        for (; i + 4 <= count; i += 4)
+        {
+            const PointLight* l = &lights[i];
+            __m128 px = _mm_set_ps(l[3].Position.x, l[2].Position.x, l[1].Position.x, l[0].Position.x);
+            __m128 py = _mm_set_ps(l[3].Position.y, l[2].Position.y, l[1].Position.y, l[0].Position.y);
+            __m128 pz = _mm_set_ps(l[3].Position.z, l[2].Position.z, l[1].Position.z, l[0].Position.z);
+            float* out[3] = { &viewX[i], &viewY[i], &viewZ[i] };
+            for (int row = 0; row < 3; row++)
+            {
+                __m128 v = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][row], px), _mm_mul_ps(m[1][row], py)), _mm_mul_ps(m[2][row], pz)), m[3][row]);
+                _mm_storeu_ps(out[row], v);
+            }
+            _mm_storeu_ps(&viewRadius[i], _mm_set_ps(l[3].Radius, l[2].Radius, l[1].Radius, l[0].Radius));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            const glm::vec3& p = lights[i].Position;
+            viewX[i] = view[0][0] * p.x + view[1][0] * p.y + view[2][0] * p.z + view[3][0];
+            viewY[i] = view[0][1] * p.x + view[1][1] * p.y + view[2][1] * p.z + view[3][1];
+            viewZ[i] = view[0][2] * p.x + view[1][2] * p.y + view[2][2] * p.z + view[3][2];
+            viewRadius[i] = lights[i].Radius;
+        }
+    }
+
+    void fillSlice(unsigned int z)
+    {
+        Slice& slice = slices[z];
+        slice.HitCluster.clear();
+        slice.HitLight.clear();
+        unsigned int tiles = GridX * GridY, first = z * tiles;
+        for (std::uint32_t light : slice.Lights)
+        {
+            glm::vec3 center(viewX[light], viewY[light], viewZ[light]);
+            float radiusSquared = viewRadius[light] * viewRadius[light];
+            for (unsigned int y = 0; y < GridY; y++)
+            {
+                if (!touchesBox(rowMin[z * GridY + y], rowMax[z * GridY + y], center, radiusSquared))
+                    continue;
+                unsigned int row = first + y * GridX, x = 0;
+#ifdef CLUSTER_SSE2
+                __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+                __m128 r2 = _mm_set1_ps(radiusSquared), zero = _mm_setzero_ps();
+                for (; x + 4 <= GridX; x += 4)
+                {
+                    unsigned int c = row + x;
+                    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMin[0][c]), cx), _mm_sub_ps(cx, _mm_loadu_ps(&boxMax[0][c]))), zero);
+                    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMin[1][c]), cy), _mm_sub_ps(cy, _mm_loadu_ps(&boxMax[1][c]))), zero);
+                    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMin[2][c]), cz), _mm_sub_ps(cz, _mm_loadu_ps(&boxMax[2][c]))), zero);
+                    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    int mask = _mm_movemask_ps(_mm_cmple_ps(distance, r2));
+                    for (int k = 0; k < 4; k++)
+                        if (mask & (1 << k))
+                        {
+                            slice.HitCluster.push_back(c + k - first);
+                            slice.HitLight.push_back(light);
+                        }
+                }
+#endif
+                for (; x < GridX; x++)
+                    if (touches(row + x, center.x, center.y, center.z, radiusSquared))
+                    {
+                        slice.HitCluster.push_back(row + x - first);
+                        slice.HitLight.push_back(light);
+                    }
+            }
+        }
+
+        // counting sort by cluster; stable, so every cluster keeps its lights in ascending order
+        slice.Counts.assign(tiles, 0);
+        slice.Starts.resize(tiles);
+        for (std::uint32_t cluster : slice.HitCluster)
+            slice.Counts[cluster]++;
+        unsigned int offset = 0;
+        for (unsigned int c = 0; c < tiles; c++)
+        {
+            slice.Starts[c] = offset;
+            offset += slice.Counts[c];
+        }
+        slice.Indices.resize(offset);
+        slice.Next.assign(slice.Starts.begin(), slice.Starts.end());
+        for (std::size_t h = 0; h < slice.HitCluster.size(); h++)
+            slice.Indices[slice.Next[slice.HitCluster[h]]++] = slice.HitLight[h];
+    }
+};
+
+// The GL side: lights, cluster ranges and light indices as buffer textures, which GL 3.3 has (storage buffers need
+// 4.3). Lights take two RGBA32F texels, (position, radius) and (color * intensity, 0).
+class ClusterBuffers
+{
+public:
+    // GLSL for a fragment shader, after its #version line: the cluster lookup and a loop over the cluster's lights
+    // with Blinn-Phong and a windowed falloff that reaches zero at the light's radius
+    static const char* ShaderSource()
+    {
+        return R"(
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterIndices;
+uniform vec3 clusterGrid;
+uniform vec2 clusterTileSize;
+uniform vec2 clusterSlicing;
+
+// offset and count of the fragment's cluster; when drawing the geometry itself the view depth is 1.0 / gl_FragCoord.w
+uvec2 clusterRange(float viewDepth)
+{
+    vec2 tile = min(floor(gl_FragCoord.xy / clusterTileSize), clusterGrid.xy - 1.0);
+    float slice = clamp(floor(log(viewDepth) * clusterSlicing.x + clusterSlicing.y), 0.0, clusterGrid.z - 1.0);
+    int cluster = int((slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x);
+    return texelFetch(clusterRanges, cluster).xy;
+}
+
+vec3 pointLight(int light, vec3 position, vec3 normal, vec3 viewDir, float shininess)
+{
+    vec4 positionRadius = texelFetch(clusterLights, light * 2);
+    vec3 color = texelFetch(clusterLights, light * 2 + 1).rgb;
+    vec3 toLight = positionRadius.xyz - position;
+    float distance = length(toLight);
+    vec3 lightDir = toLight / max(distance, 1e-4);
+    float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+    float attenuation = window * window / (distance * distance + 1.0);
+    float diffuse = max(dot(normal, lightDir), 0.0);
+    float specular = pow(max(dot(normal, normalize(lightDir + viewDir)), 0.0), shininess) * 0.5;
+    return color * (diffuse + specular) * attenuation;
+}
+
+vec3 clusteredLighting(vec3 position, vec3 normal, vec3 viewDir, float shininess, float viewDepth)
+{
+    uvec2 range = clusterRange(viewDepth);
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; i++)
+        result += pointLight(int(texelFetch(clusterIndices, int(range.x + i)).r), position, normal, viewDir, shininess);
+    return result;
+}
+)";
+    }
+
+    ~ClusterBuffers()
+    {
+        for (int b = 0; b < BUFFER_COUNT; b++)
+        {
+            if (textures[b])
+                glDeleteTextures(1, &textures[b]);
+            if (buffers[b])
+                glDeleteBuffers(1, &buffers[b]);
+        }
+    }
+
+    void Upload(const std::vector<PointLight>& lights, const LightClusters& clusters)
+    {
+        if (!buffers[0])
+            create();
+        packed.resize(lights.size() * 8);
+        for (std::size_t i = 0; i < lights.size(); i++)
+        {
+            const PointLight& light = lights[i];
+            float* texels = &packed[i * 8];
+            texels[0] = light.Position.x;
+            texels[1] = light.Position.y;
+            texels[2] = light.Position.z;
+            texels[3] = light.Radius;
+            texels[4] = light.Color.x * light.Intensity;
+            texels[5] = light.Color.y * light.Intensity;
+            texels[6] = light.Color.z * light.Intensity;
+            texels[7] = 0.0f;
+        }
+        // orphaning: a fresh store every frame, so the driver never waits for the previous frame to finish reading
+        upload(BUFFER_LIGHTS, packed.data(), packed.size() * sizeof(float));
+        upload(BUFFER_RANGES, clusters.Ranges.data(), clusters.Ranges.size() * sizeof(std::uint32_t));
+        upload(BUFFER_INDICES, clusters.Indices.data(), clusters.Indices.size() * sizeof(std::uint32_t));
+    }
+
+    // binds the three buffer textures to firstUnit.. firstUnit + 2 and sets the uniforms of ShaderSource();
+    // width and height are the viewport's
+    template <typename ShaderType>
+    void Bind(const ShaderType& shader, const LightClusters& clusters, int width, int height, int firstUnit = 0) const
+    {
+        const char* names[BUFFER_COUNT] = { "clusterLights", "clusterRanges", "clusterIndices" };
+        for (int b = 0; b < BUFFER_COUNT; b++)
+        {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + b);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[b]);
+            shader.setInt(names[b], firstUnit + b);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        shader.setVec3("clusterGrid", glm::vec3((float)clusters.GridX, (float)clusters.GridY, (float)clusters.GridZ));
+        shader.setVec2("clusterTileSize", glm::vec2((float)width / clusters.GridX, (float)height / clusters.GridY));
+        shader.setVec2("clusterSlicing", clusters.Slicing());
+    }
+
+private:
+    enum { BUFFER_LIGHTS, BUFFER_RANGES, BUFFER_INDICES, BUFFER_COUNT };
+
+    unsigned int buffers[BUFFER_COUNT] = {}, textures[BUFFER_COUNT] = {};
+    std::vector<float> packed;
+
+    void create()
+    {
+        const GLenum formats[BUFFER_COUNT] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+        glGenBuffers(BUFFER_COUNT, buffers);
+        glGenTextures(BUFFER_COUNT, textures);
+        for (int b = 0; b < BUFFER_COUNT; b++)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[b]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[b]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[b], buffers[b]);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void upload(int b, const void* data, std::size_t size)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[b]);
+        // never empty, a zero sized store would leave the texture without a valid buffer
+        glBufferData(GL_TEXTURE_BUFFER, size > 0 ? size : 16, nullptr, GL_STREAM_DRAW);
+        if (size > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+#endif
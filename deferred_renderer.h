@@ -0,0 +1,440 @@
+#ifndef DEFERRED_RENDERER_H
+#define DEFERRED_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <clustered_lights.h>
+#include <material_library.h>
+#include <mesh_lod.h>
+#include <shader_program.h>
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Deferred shading. The geometry pass writes every visible surface's albedo and shininess (from the MaterialLibrary),
+// its normal (octahedral, two 16 bit channels) and depth into a G-buffer; lighting then runs once per lit pixel instead of once per rasterized fragment,
+// which pays off with many overlapping lights or lots of overdraw. Positions are reconstructed from depth.
+//
+// Two lighting passes share the G-buffer and the light data of ClusterBuffers:
+//   LIGHTING_VOLUMES    an ambient pass, then one instanced box per light drawn additively. Only back faces are drawn,
+//                       with a depth test against the scene, so pixels in front of the light's far side are shaded
+//                       and lights buried behind walls cost nothing
+//   LIGHTING_CLUSTERED  one full-screen pass that loops over the lights of every pixel's cluster
+// Both finish by copying the G-buffer depth into the target framebuffer, so forward drawn objects (lamps, transparent
+// things) can follow.
+//
+// Lights that don't fit ClusterBuffers (a shadowed sun, say) come in as GLSL through Create(): it defines
+// vec3 extraLighting(position, normal, viewDir, shininess, viewDepth), added in the ambient and clustered passes, and
+// SetupLighting sets its uniforms.
+class DeferredRenderer
+{
+public:
+    enum Lighting { LIGHTING_VOLUMES, LIGHTING_CLUSTERED };
+
+    int Width = 0, Height = 0;
+    float Ambient = 0.05f;
+    std::function<void(const ShaderProgram&)> SetupLighting;
+
+    ~DeferredRenderer()
+    {
+        destroyTargets();
+        if (boxVAO)
+        {
+            glDeleteVertexArrays(1, &boxVAO);
+            glDeleteBuffers(1, &boxVBO);
+            glDeleteVertexArrays(1, &screenVAO);
+        }
+    }
+
+    bool Create(int width, int height, const char* extraLightingSource = nullptr)
+    {
+        geometry.Build(geometryVertexSource(), std::string("#version 330 core\n") + normalCodingSource() + MaterialLibrary::ShaderSource() + LodSelector::ShaderSource()
+                       + geometryFragmentSource());
+        MaterialLibrary::Attach(geometry.ID);
+        std::string lightingHeader = std::string("#version 330 core\n") + normalCodingSource() + ClusterBuffers::ShaderSource()
+            + (extraLightingSource ? extraLightingSource : NoExtraLightingSource()) + gbufferSource();
+        ambient.Build(screenVertexSource(), lightingHeader + ambientFragmentSource());
+        clustered.Build(screenVertexSource(), lightingHeader + clusteredFragmentSource());
+        volumes.Build(volumeVertexSource(), lightingHeader + volumeFragmentSource());
+
+        // a light's box: the cube from -1 to 1, wound counter-clockwise from outside, scaled by the radius in the shader
+        const int faces[6][4] = { { 5, 1, 3, 7 }, { 0, 4, 6, 2 }, { 6, 7, 3, 2 }, { 0, 1, 5, 4 }, { 4, 5, 7, 6 }, { 1, 0, 2, 3 } };
+        std::vector<float> box;
+        for (const int* face : faces)
+            for (int corner : { face[0], face[1], face[2], face[0], face[2], face[3] })
+            {
+                box.push_back(corner & 1 ? 1.0f : -1.0f);
+                box.push_back(corner & 2 ? 1.0f : -1.0f);
+                box.push_back(corner & 4 ? 1.0f : -1.0f);
+            }
+        glGenVertexArrays(1, &boxVAO);
+        glGenBuffers(1, &boxVBO);
+        glBindVertexArray(boxVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+        glBufferData(GL_ARRAY_BUFFER, box.size() * sizeof(float), box.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        // the full-screen triangle comes from gl_VertexID, core profile still wants a vertex array bound
+        glGenVertexArrays(1, &screenVAO);
+        glBindVertexArray(0);
+        return createTargets(width, height);
+    }
+
+    // resizes the G-buffer, binds it and returns the geometry program with view and projection set; draw the deferred
+    // meshes with it, setting "model", "materialIndex" and "lodFade"
+    const ShaderProgram& BeginGeometry(int width, int height, const glm::mat4& view, const glm::mat4& projection)
+    {
+        if (width != Width || height != Height)
+        {
+            destroyTargets();
+            createTargets(width, height);
+        }
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        glGetIntegerv(GL_VIEWPORT, targetViewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, gbuffer);
+        glViewport(0, 0, Width, Height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        geometry.use();
+        geometry.setMat4("view", view);
+        geometry.setMat4("projection", projection);
+        this->view = view;
+        this->projection = projection;
+        return geometry;
+    }
+
+    // lights the G-buffer into the framebuffer that was bound at BeginGeometry(); lights, buffers and clusters must
+    // hold this frame's lights (the clusters are only read by LIGHTING_CLUSTERED)
+    void Light(Lighting mode, unsigned int lightCount, const ClusterBuffers& buffers, const LightClusters& clusters, const glm::vec3& viewPosition)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glViewport(targetViewport[0], targetViewport[1], targetViewport[2], targetViewport[3]);
+        // the scene's depth first: the light volumes test against it and forward drawing continues on it
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gbuffer);
+        glBlitFramebuffer(0, 0, Width, Height, 0, 0, Width, Height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND), cull = glIsEnabled(GL_CULL_FACE);
+        GLint depthFunc;
+        glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+        glDepthMask(GL_FALSE);
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(screenVAO);
+        if (mode == LIGHTING_CLUSTERED)
+        {
+            use(clustered, buffers, clusters, viewPosition);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        else
+        {
+            use(ambient, buffers, clusters, viewPosition);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            use(volumes, buffers, clusters, viewPosition);
+            volumes.setMat4("viewProjection", projection * view);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+            glEnable(GL_DEPTH_TEST);
+            glDepthFunc(GL_GEQUAL);
+            glBindVertexArray(boxVAO);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 36, lightCount);
+            glCullFace(GL_BACK);
+        }
+        glBindVertexArray(0);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(depthFunc);
+        depthTest ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
+        blend ? glEnable(GL_BLEND) : glDisable(GL_BLEND);
+        cull ? glEnable(GL_CULL_FACE) : glDisable(GL_CULL_FACE);
+        for (int t = 0; t < 3; t++)
+        {
+            glActiveTexture(GL_TEXTURE0 + GBUFFER_UNIT + t);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // extraLighting() adding nothing, for shaders that include it without extra lights
+    static const char* NoExtraLightingSource()
+    {
+        return R"(
+vec3 extraLighting(vec3 position, vec3 normal, vec3 viewDir, float shininess, float viewDepth)
+{
+    return vec3(0.0);
+}
+)";
+    }
+
+private:
+    // the G-buffer textures sit after the three units ClusterBuffers binds
+    static const int GBUFFER_UNIT = 3;
+
+    unsigned int gbuffer = 0, albedoTexture = 0, normalTexture = 0, depthTexture = 0;
+    unsigned int boxVAO = 0, boxVBO = 0, screenVAO = 0;
+    GLint target = 0, targetViewport[4] = {};
+    glm::mat4 view = glm::mat4(1.0f), projection = glm::mat4(1.0f);
+    ShaderProgram geometry, ambient, clustered, volumes;
+
+    bool createTargets(int width, int height)
+    {
+        Width = width;
+        Height = height;
+        GLint previous;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+        glGenFramebuffers(1, &gbuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, gbuffer);
+        albedoTexture = createTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        normalTexture = createTexture(GL_RG16, GL_RG, GL_UNSIGNED_SHORT);
+        // the same format as a default framebuffer's depth, so it can be blitted into one
+        depthTexture = createTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        const GLenum attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, attachments);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete)
+            std::cout << "ERROR::FRAMEBUFFER:: G-buffer is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, previous);
+        return complete;
+    }
+
+    unsigned int createTexture(GLenum internalFormat, GLenum format, GLenum type)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, Width, Height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    void destroyTargets()
+    {
+        if (!gbuffer)
+            return;
+        unsigned int textures[3] = { albedoTexture, normalTexture, depthTexture };
+        glDeleteTextures(3, textures);
+        glDeleteFramebuffers(1, &gbuffer);
+        gbuffer = albedoTexture = normalTexture = depthTexture = 0;
+    }
+
+    void use(const ShaderProgram& program, const ClusterBuffers& buffers, const LightClusters& clusters, const glm::vec3& viewPosition)
+    {
+        program.use();
+        buffers.Bind(program, clusters, Width, Height);
+        glActiveTexture(GL_TEXTURE0 + GBUFFER_UNIT);
+        glBindTexture(GL_TEXTURE_2D, albedoTexture);
+        glActiveTexture(GL_TEXTURE0 + GBUFFER_UNIT + 1);
+        glBindTexture(GL_TEXTURE_2D, normalTexture);
+        glActiveTexture(GL_TEXTURE0 + GBUFFER_UNIT + 2);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glActiveTexture(GL_TEXTURE0);
+        program.setInt("gAlbedo", GBUFFER_UNIT);
+        program.setInt("gNormal", GBUFFER_UNIT + 1);
+        program.setInt("gDepth", GBUFFER_UNIT + 2);
+        program.setMat4("view", view);
+        program.setMat4("inverseViewProjection", glm::inverse(projection * view));
+        program.setVec2("screenSize", glm::vec2((float)Width, (float)Height));
+        program.setVec3("viewPos", viewPosition);
+        program.setFloat("ambient", Ambient);
+        if (SetupLighting)
+            SetupLighting(program);
+    }
+
+    // octahedral normal coding: the unit sphere folded onto a square, two channels with no wasted precision
+    static const char* normalCodingSource()
+    {
+        return R"(
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 folded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    return folded * 0.5 + 0.5;
+}
+
+vec3 decodeNormal(vec2 encoded)
+{
+    vec2 f = encoded * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    return normalize(n);
+}
+)";
+    }
+
+    static const char* geometryVertexSource()
+    {
+        return R"(#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+
+out vec3 Normal;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    Normal = mat3(transpose(inverse(model))) * aNormal;
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
+)";
+    }
+
+    static const char* geometryFragmentSource()
+    {
+        return R"(
+in vec3 Normal;
+
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec2 gNormal;
+
+void main()
+{
+    lodDither();
+    // alpha holds the shininess, 1 to 255, and being above zero marks covered pixels for the lighting passes
+    gAlbedo = vec4(materialColor(), clamp(materialShininess(), 1.0, 255.0) / 255.0);
+    gNormal = encodeNormal(normalize(Normal));
+}
+)";
+    }
+
+    // what every lighting pass reads back: the surface at a pixel, in world space
+    static const char* gbufferSource()
+    {
+        return R"(
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 view;
+uniform mat4 inverseViewProjection;
+uniform vec2 screenSize;
+uniform vec3 viewPos;
+uniform float ambient;
+
+out vec4 FragColor;
+
+struct Surface
+{
+    vec3 Albedo;
+    vec3 Position;
+    vec3 Normal;
+    float Shininess;
+    float ViewDepth;
+};
+
+// false for background pixels
+bool readSurface(out Surface surface)
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 albedo = texelFetch(gAlbedo, pixel, 0);
+    if (albedo.a == 0.0)
+        return false;
+    vec3 ndc = vec3(gl_FragCoord.xy / screenSize, texelFetch(gDepth, pixel, 0).r) * 2.0 - 1.0;
+    vec4 world = inverseViewProjection * vec4(ndc, 1.0);
+    surface.Albedo = albedo.rgb;
+    surface.Position = world.xyz / world.w;
+    surface.Normal = decodeNormal(texelFetch(gNormal, pixel, 0).rg);
+    surface.Shininess = albedo.a * 255.0;
+    surface.ViewDepth = -(view * vec4(surface.Position, 1.0)).z;
+    return true;
+}
+)";
+    }
+
+    static const char* screenVertexSource()
+    {
+        return R"(#version 330 core
+void main()
+{
+    // one triangle covering the screen: (-1, -1), (3, -1), (-1, 3)
+    vec2 position = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID >> 1) * 4 - 1);
+    gl_Position = vec4(position, 0.0, 1.0);
+}
+)";
+    }
+
+    static const char* ambientFragmentSource()
+    {
+        return R"(
+void main()
+{
+    Surface surface;
+    if (!readSurface(surface))
+        discard;
+    vec3 viewDir = normalize(viewPos - surface.Position);
+    vec3 light = vec3(ambient) + extraLighting(surface.Position, surface.Normal, viewDir, surface.Shininess, surface.ViewDepth);
+    FragColor = vec4(light * surface.Albedo, 1.0);
+}
+)";
+    }
+
+    static const char* clusteredFragmentSource()
+    {
+        return R"(
+void main()
+{
+    Surface surface;
+    if (!readSurface(surface))
+        discard;
+    vec3 viewDir = normalize(viewPos - surface.Position);
+    vec3 light = vec3(ambient) + clusteredLighting(surface.Position, surface.Normal, viewDir, surface.Shininess, surface.ViewDepth)
+        + extraLighting(surface.Position, surface.Normal, viewDir, surface.Shininess, surface.ViewDepth);
+    FragColor = vec4(light * surface.Albedo, 1.0);
+}
+)";
+    }
+
+    static const char* volumeVertexSource()
+    {
+        return R"(#version 330 core
+layout (location = 0) in vec3 aPos;
+
+flat out int light;
+
+uniform samplerBuffer clusterLights;
+uniform mat4 viewProjection;
+
+void main()
+{
+    vec4 positionRadius = texelFetch(clusterLights, gl_InstanceID * 2);
+    light = gl_InstanceID;
+    gl_Position = viewProjection * vec4(positionRadius.xyz + aPos * positionRadius.w, 1.0);
+}
+)";
+    }
+
+    static const char* volumeFragmentSource()
+    {
+        return R"(
+flat in int light;
+
+void main()
+{
+    Surface surface;
+    if (!readSurface(surface))
+        discard;
+    vec3 viewDir = normalize(viewPos - surface.Position);
+    FragColor = vec4(pointLight(light, surface.Position, surface.Normal, viewDir, surface.Shininess) * surface.Albedo, 1.0);
+}
+)";
+    }
+};
+#endif
@@ -0,0 +1,482 @@
+#ifndef DEPTH_PYRAMID_H
+#define DEPTH_PYRAMID_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <frustum.h>
+#include <shader_program.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// a min/max depth pyramid of an earlier frame to test occlusion against. Level 0 has the depth buffer's size and every
+// level halves the one before, rounding down (at least 1); a texel holds the smallest and the largest window depth
+// (0..1) under it, the extra row and column of an odd sized level included, so texel min(p >> L, size - 1) of level L
+// always covers pixel p of level 0
+struct HiZPyramid
+{
+    unsigned int Texture = 0;   // GL_RG32F with every level, r the smallest depth and g the largest; 0 for none
+    std::vector<unsigned int> Widths, Heights;
+    glm::mat4 ViewProjection = glm::mat4(1.0f); // what the depth was rendered with
+    DepthConvention Depth = DEPTH_STANDARD;
+    // the CPU copy: min, max pairs with row 0 at the bottom, for levels CpuFirstLevel and up
+    unsigned int CpuFirstLevel = 0;
+    std::vector<std::vector<float>> CpuLevels;
+
+    unsigned int Levels() const
+    {
+        return (unsigned int)Widths.size();
+    }
+};
+
+struct DepthPyramidStats
+{
+    unsigned long long Builds = 0;
+    unsigned long long Readbacks = 0;   // CPU copies taken
+    unsigned long long Late = 0;        // frames whose readback had not finished a frame later; the older copy stayed
+};
+
+// Builds a HiZPyramid from the depth of every frame. Build() copies the depth of the framebuffer being drawn to into a
+// texture of its own, turns that into level 0 and reduces each level into the next with a fragment pass, so it only
+// needs GL 3.3: the pass reading level L - 1 restricts the texture to that level with GL_TEXTURE_BASE_LEVEL and
+// GL_TEXTURE_MAX_LEVEL, which keeps level L, the one being written, out of what can be sampled.
+//
+// Current() is the pyramid of the last Build(), on the GPU only; the next frame's culling tests against it. Readback()
+// is a CPU copy of the levels from the first that fits readbackSize x readbackSize up, read into pixel buffers with a
+// fence and collected at the following Build(), so it lags one frame behind Current() and never stalls: when the copy
+// is not done by then the older one stays.
+class DepthPyramid
+{
+public:
+    ~DepthPyramid()
+    {
+        destroyTargets();
+        if (vao)
+            glDeleteVertexArrays(1, &vao);
+    }
+
+    // depthFormat has to be the one of the framebuffers Build() copies from (GL_DEPTH_COMPONENT32F with reversed-z,
+    // see OffscreenTarget)
+    bool Create(int width, int height, GLenum depthFormat = GL_DEPTH24_STENCIL8, unsigned int readbackSize = 64)
+    {
+        this->depthFormat = depthFormat;
+        this->readbackSize = readbackSize;
+        if (!copyProgram.Build(screenVertexSource(), copyFragmentSource()) || !reduceProgram.Build(screenVertexSource(), reduceFragmentSource()))
+            return false;
+        glGenVertexArrays(1, &vao);
+        return createTargets(width, height);
+    }
+
+    // Copies the depth of the framebuffer bound for drawing, width x height (the targets follow when that changes),
+    // and reduces it into the pyramid; viewProjection and depth are what the frame was rendered with. Also takes last
+    // frame's readback and starts this one's. The framebuffer, viewport, depth test, blending and face culling are
+    // left as they were
+    void Build(int width, int height, const glm::mat4& viewProjection, DepthConvention depth = DEPTH_STANDARD)
+    {
+        if (width != (int)current.Widths[0] || height != (int)current.Heights[0])
+        {
+            destroyTargets();
+            createTargets(width, height);
+        }
+        collectReadback();
+
+        GLint target = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND), cullFace = glIsEnabled(GL_CULL_FACE);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, target);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFBO);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glDisable(GL_CULL_FACE);
+        glBindVertexArray(vao);
+        glBindFramebuffer(GL_FRAMEBUFFER, levelFBO);
+        glActiveTexture(GL_TEXTURE0);
+
+        // level 0 is the depth itself, as (min, max) = (depth, depth)
+        copyProgram.use();
+        copyProgram.setInt("source", 0);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        drawLevel(0);
+
+        reduceProgram.use();
+        reduceProgram.setInt("source", 0);
+        glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+        unsigned int levels = current.Levels();
+        for (unsigned int level = 1; level < levels; level++)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+            drawLevel(level);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+
+        startReadback(viewProjection, depth);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+        if (blend)
+            glEnable(GL_BLEND);
+        if (cullFace)
+            glEnable(GL_CULL_FACE);
+
+        current.Texture = pyramidTexture;
+        current.ViewProjection = viewProjection;
+        current.Depth = depth;
+        stats.Builds++;
+    }
+
+    // the pyramid of the last Build(); Texture stays 0 until there is one
+    const HiZPyramid& Current() const
+    {
+        return current;
+    }
+
+    // the CPU copy of an earlier Build(), Texture 0; CpuLevels stays empty until the first copy arrives
+    const HiZPyramid& Readback() const
+    {
+        return readback;
+    }
+
+    DepthPyramidStats Stats() const
+    {
+        return stats;
+    }
+
+    // Reads the last Build()'s depth and pyramid back (a stall, for checking only) and returns how many texels of the
+    // pyramid differ from Reduce(). Level 0 is compared with the depth up to one step of a 24 bit depth, which the
+    // sampler and glReadPixels() may round to a float differently; the levels above it with Reduce() of level 0, exactly
+    unsigned int Validate() const
+    {
+        if (!current.Texture)
+            return 0;
+        unsigned int width = current.Widths[0], height = current.Heights[0];
+        std::vector<float> depth((std::size_t)width * height);
+        GLint readFramebuffer = 0;
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, depthFBO);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, depth.data());
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+
+        HiZPyramid gpu = current, reference;
+        ReadTexture(gpu);
+        float tolerance = depthFormat == GL_DEPTH24_STENCIL8 || depthFormat == GL_DEPTH_COMPONENT24 ? 1.0f / 16777215.0f : 0.0f;
+        unsigned int mismatches = 0;
+        std::vector<float> levelZero(depth.size());
+        for (std::size_t i = 0; i < depth.size(); i++)
+        {
+            levelZero[i] = gpu.CpuLevels[0][i * 2];
+            if (std::fabs(levelZero[i] - depth[i]) > tolerance || gpu.CpuLevels[0][i * 2 + 1] != levelZero[i])
+                mismatches++;
+        }
+        Reduce(levelZero, width, height, reference);
+        for (unsigned int level = 1; level < reference.Levels(); level++)
+            for (std::size_t i = 0; i < reference.CpuLevels[level].size(); i += 2)
+                if (reference.CpuLevels[level][i] != gpu.CpuLevels[level][i] || reference.CpuLevels[level][i + 1] != gpu.CpuLevels[level][i + 1])
+                    mismatches++;
+        return mismatches;
+    }
+
+    // the sizes of the levels of a width x height pyramid
+    static void LevelSizes(unsigned int width, unsigned int height, std::vector<unsigned int>& outWidths, std::vector<unsigned int>& outHeights)
+    {
+        outWidths.assign(1, std::max(width, 1u));
+        outHeights.assign(1, std::max(height, 1u));
+        while (outWidths.back() > 1 || outHeights.back() > 1)
+        {
+            outWidths.push_back(std::max(outWidths.back() / 2, 1u));
+            outHeights.push_back(std::max(outHeights.back() / 2, 1u));
+        }
+    }
+
+    // What Build() computes, on the CPU: every level of the pyramid of a width x height depth buffer (row 0 at the
+    // bottom) into pyramid's sizes and CpuLevels, from level 0. Texture, ViewProjection and Depth are left alone
+    static void Reduce(const std::vector<float>& depth, unsigned int width, unsigned int height, HiZPyramid& pyramid)
+    {
+        LevelSizes(width, height, pyramid.Widths, pyramid.Heights);
+        pyramid.CpuFirstLevel = 0;
+        pyramid.CpuLevels.assign(pyramid.Levels(), std::vector<float>());
+        std::vector<float>& first = pyramid.CpuLevels[0];
+        first.resize((std::size_t)width * height * 2);
+        for (std::size_t i = 0; i < (std::size_t)width * height; i++)
+            first[i * 2] = first[i * 2 + 1] = depth[i];
+        for (unsigned int level = 1; level < pyramid.Levels(); level++)
+        {
+            const std::vector<float>& source = pyramid.CpuLevels[level - 1];
+            int sourceWidth = (int)pyramid.Widths[level - 1], sourceHeight = (int)pyramid.Heights[level - 1];
+            int levelWidth = (int)pyramid.Widths[level], levelHeight = (int)pyramid.Heights[level];
+            std::vector<float>& texels = pyramid.CpuLevels[level];
+            texels.resize((std::size_t)levelWidth * levelHeight * 2);
+            for (int y = 0; y < levelHeight; y++)
+                for (int x = 0; x < levelWidth; x++)
+                {
+                    // the same footprint as reduceFragmentSource()
+                    int x1 = x == levelWidth - 1 ? sourceWidth - 1 : std::min(x * 2 + 1, sourceWidth - 1);
+                    int y1 = y == levelHeight - 1 ? sourceHeight - 1 : std::min(y * 2 + 1, sourceHeight - 1);
+                    float nearest = 1.0f, farthest = 0.0f;
+                    for (int sy = y * 2; sy <= y1; sy++)
+                        for (int sx = x * 2; sx <= x1; sx++)
+                        {
+                            nearest = std::min(nearest, source[((std::size_t)sy * sourceWidth + sx) * 2]);
+                            farthest = std::max(farthest, source[((std::size_t)sy * sourceWidth + sx) * 2 + 1]);
+                        }
+                    texels[((std::size_t)y * levelWidth + x) * 2] = nearest;
+                    texels[((std::size_t)y * levelWidth + x) * 2 + 1] = farthest;
+                }
+        }
+    }
+
+    // fills pyramid's CpuLevels with every level of its Texture (a stall)
+    static void ReadTexture(HiZPyramid& pyramid)
+    {
+        pyramid.CpuFirstLevel = 0;
+        pyramid.CpuLevels.assign(pyramid.Levels(), std::vector<float>());
+        glBindTexture(GL_TEXTURE_2D, pyramid.Texture);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        for (unsigned int level = 0; level < pyramid.Levels(); level++)
+        {
+            pyramid.CpuLevels[level].resize((std::size_t)pyramid.Widths[level] * pyramid.Heights[level] * 2);
+            glGetTexImage(GL_TEXTURE_2D, level, GL_RG, GL_FLOAT, pyramid.CpuLevels[level].data());
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+private:
+    struct Slot
+    {
+        unsigned int PBO = 0;
+        GLsync Fence = 0;
+        glm::mat4 ViewProjection = glm::mat4(1.0f);
+        DepthConvention Depth = DEPTH_STANDARD;
+    };
+
+    ShaderProgram copyProgram, reduceProgram;
+    GLenum depthFormat = GL_DEPTH24_STENCIL8;
+    unsigned int readbackSize = 64;
+    unsigned int vao = 0;
+    unsigned int depthTexture = 0, pyramidTexture = 0;
+    unsigned int depthFBO = 0, levelFBO = 0;
+    HiZPyramid current, readback;
+    // two copies in flight at most: the one started this frame and the one collected at the next Build()
+    Slot slots[2];
+    unsigned int nextSlot = 0;
+    std::size_t readbackBytes = 0;
+    DepthPyramidStats stats;
+
+    bool createTargets(int width, int height)
+    {
+        current = HiZPyramid();
+        LevelSizes((unsigned int)width, (unsigned int)height, current.Widths, current.Heights);
+        unsigned int levels = current.Levels();
+
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        GLenum format = depthFormat == GL_DEPTH24_STENCIL8 || depthFormat == GL_DEPTH32F_STENCIL8 ? GL_DEPTH_STENCIL : GL_DEPTH_COMPONENT;
+        GLenum type = format == GL_DEPTH_STENCIL ? GL_UNSIGNED_INT_24_8 : GL_FLOAT;
+        if (depthFormat == GL_DEPTH32F_STENCIL8)
+            type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
+        glTexImage2D(GL_TEXTURE_2D, 0, depthFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenTextures(1, &pyramidTexture);
+        glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+        for (unsigned int level = 0; level < levels; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RG32F, current.Widths[level], current.Heights[level], 0, GL_RG, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        GLint previous = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+        glGenFramebuffers(1, &depthFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, format == GL_DEPTH_STENCIL ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glGenFramebuffers(1, &levelFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, levelFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramidTexture, 0);
+        complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+        // the CPU copy starts at the first level that fits, or the last one
+        readback = HiZPyramid();
+        readback.Widths = current.Widths;
+        readback.Heights = current.Heights;
+        unsigned int first = 0;
+        while (first + 1 < levels && (current.Widths[first] > readbackSize || current.Heights[first] > readbackSize))
+            first++;
+        readback.CpuFirstLevel = first;
+        readbackBytes = 0;
+        for (unsigned int level = first; level < levels; level++)
+            readbackBytes += (std::size_t)current.Widths[level] * current.Heights[level] * 2 * sizeof(float);
+        for (Slot& slot : slots)
+        {
+            glGenBuffers(1, &slot.PBO);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+            glBufferData(GL_PIXEL_PACK_BUFFER, readbackBytes, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return complete;
+    }
+
+    void destroyTargets()
+    {
+        if (!depthTexture)
+            return;
+        glDeleteTextures(1, &depthTexture);
+        glDeleteTextures(1, &pyramidTexture);
+        glDeleteFramebuffers(1, &depthFBO);
+        glDeleteFramebuffers(1, &levelFBO);
+        for (Slot& slot : slots)
+        {
+            if (slot.Fence)
+                glDeleteSync(slot.Fence);
+            glDeleteBuffers(1, &slot.PBO);
+            slot = Slot();
+        }
+        depthTexture = pyramidTexture = depthFBO = levelFBO = 0;
+    }
+
+    // renders into level of the pyramid with whatever program and source are bound; levelFBO is bound
+    void drawLevel(unsigned int level)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramidTexture, level);
+        glViewport(0, 0, current.Widths[level], current.Heights[level]);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    // reads the CPU levels of this Build() into the next slot; levelFBO is bound
+    void startReadback(const glm::mat4& viewProjection, DepthConvention depth)
+    {
+        Slot& slot = slots[nextSlot];
+        // still pending from two builds ago: the newer copy replaces it
+        if (slot.Fence)
+            glDeleteSync(slot.Fence);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        std::size_t offset = 0;
+        for (unsigned int level = readback.CpuFirstLevel; level < current.Levels(); level++)
+        {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramidTexture, level);
+            glReadPixels(0, 0, current.Widths[level], current.Heights[level], GL_RG, GL_FLOAT, (void*)offset);
+            offset += (std::size_t)current.Widths[level] * current.Heights[level] * 2 * sizeof(float);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.ViewProjection = viewProjection;
+        slot.Depth = depth;
+        nextSlot ^= 1;
+    }
+
+    // takes the copy started by the last Build() if it has finished
+    void collectReadback()
+    {
+        Slot& slot = slots[nextSlot ^ 1];
+        if (!slot.Fence)
+            return;
+        GLenum status = glClientWaitSync(slot.Fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            stats.Late++;
+            return;
+        }
+        glDeleteSync(slot.Fence);
+        slot.Fence = 0;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+        const char* data = (const char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readbackBytes, GL_MAP_READ_BIT);
+        if (data)
+        {
+            readback.CpuLevels.resize(readback.Levels() - readback.CpuFirstLevel);
+            std::size_t offset = 0;
+            for (unsigned int level = readback.CpuFirstLevel; level < readback.Levels(); level++)
+            {
+                std::vector<float>& texels = readback.CpuLevels[level - readback.CpuFirstLevel];
+                texels.resize((std::size_t)readback.Widths[level] * readback.Heights[level] * 2);
+                std::memcpy(texels.data(), data + offset, texels.size() * sizeof(float));
+                offset += texels.size() * sizeof(float);
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            readback.ViewProjection = slot.ViewProjection;
+            readback.Depth = slot.Depth;
+            stats.Readbacks++;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    static const char* screenVertexSource()
+    {
+        return R"(#version 330 core
+void main()
+{
+    // one triangle covering the level: (-1, -1), (3, -1), (-1, 3)
+    vec2 position = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID >> 1) * 4 - 1);
+    gl_Position = vec4(position, 0.0, 1.0);
+}
+)";
+    }
+
+    static const char* copyFragmentSource()
+    {
+        return R"(#version 330 core
+uniform sampler2D source;
+out vec2 MinMax;
+
+void main()
+{
+    MinMax = vec2(texelFetch(source, ivec2(gl_FragCoord.xy), 0).r);
+}
+)";
+    }
+
+    static const char* reduceFragmentSource()
+    {
+        return R"(#version 330 core
+uniform sampler2D source;   // restricted to the level below the one being written
+out vec2 MinMax;
+
+void main()
+{
+    ivec2 sourceSize = textureSize(source, 0);
+    ivec2 size = max(sourceSize / 2, ivec2(1));
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    ivec2 first = p * 2;
+    // the last texel of a row or column also takes the extra one of an odd sized source
+    ivec2 last = min(first + 1, sourceSize - 1);
+    if (p.x == size.x - 1)
+        last.x = sourceSize.x - 1;
+    if (p.y == size.y - 1)
+        last.y = sourceSize.y - 1;
+    vec2 result = vec2(1.0, 0.0);
+    for (int y = first.y; y <= last.y; y++)
+        for (int x = first.x; x <= last.x; x++)
+        {
+            vec2 texel = texelFetch(source, ivec2(x, y), 0).rg;
+            result = vec2(min(result.x, texel.x), max(result.y, texel.y));
+        }
+    MinMax = result;
+}
+)";
+    }
+};
+
+#endif
@@ -0,0 +1,433 @@
+#ifndef ECS_H
+#define ECS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Archetype based entity-component system. Every distinct set of component types is an archetype, and an
+// archetype stores its entities in fixed size chunks where each component type is a tightly packed array.
+// Iterating a query walks the matching chunks array by array, so systems touch only the bytes they use.
+namespace ecs
+{
+    typedef std::uint32_t Entity;
+    typedef std::uint64_t Signature;
+
+    const Entity NULL_ENTITY = 0xFFFFFFFFu;
+    const unsigned int MAX_COMPONENTS = 64;
+    const unsigned int CHUNK_SIZE = 16 * 1024;
+
+    // default components
+    // ------------------
+    struct Transform
+    {
+        glm::vec3 Position = glm::vec3(0.0f);
+        float Angle = 0.0f; // degrees around RotationAxis
+        glm::vec3 RotationAxis = glm::vec3(1.0f, 0.3f, 0.5f);
+        float Scale = 1.0f;
+
+        glm::mat4 GetModelMatrix() const
+        {
+            glm::mat4 model = glm::mat4(1.0f);
+            model = glm::translate(model, Position);
+            if (Angle != 0.0f)
+                model = glm::rotate(model, glm::radians(Angle), RotationAxis);
+            if (Scale != 1.0f)
+                model = glm::scale(model, glm::vec3(Scale));
+            return model;
+        }
+    };
+
+    struct MeshRenderer
+    {
+        unsigned int VAO = 0;
+        unsigned int First = 0;
+        unsigned int Count = 0;
+        unsigned int Material = 0; // ID in the render system's MaterialLibrary, which also names the shader variant
+        bool Indexed = false;      // First and Count are in the element buffer of VAO rather than its vertices
+        float Fade = 0.0f;         // LOD cross-fade, see LodSelector::FadeIn()
+    };
+
+    struct Light
+    {
+        glm::vec3 Color = glm::vec3(1.0f);
+        float Intensity = 1.0f;
+        float Radius = 10.0f; // range of the light, used by clustered shading
+    };
+
+    struct Camera
+    {
+        float Yaw = -90.0f;
+        float Pitch = 0.0f;
+        float Zoom = 45.0f;
+        float Near = 0.1f;
+        float Far = 100.0f;
+    };
+
+    // component type ids
+    // ------------------
+    inline unsigned int nextComponentId()
+    {
+        static unsigned int counter = 0;
+        return counter++;
+    }
+
+    template<typename T>
+    unsigned int ComponentId()
+    {
+        static const unsigned int id = nextComponentId();
+        // a Signature has one bit per component type
+        assert(id < MAX_COMPONENTS && "more component types than MAX_COMPONENTS");
+        return id;
+    }
+
+    template<typename... Ts>
+    Signature SignatureOf()
+    {
+        Signature signature = 0;
+        const unsigned int ids[] = { ComponentId<Ts>()... };
+        for (unsigned int id : ids)
+            signature |= Signature(1) << id;
+        return signature;
+    }
+
+    // storage
+    // -------
+    struct Chunk
+    {
+        std::unique_ptr<unsigned char[]> Data;
+        unsigned int Count = 0;
+    };
+
+    struct Archetype
+    {
+        Signature Sig = 0;
+        std::vector<unsigned int> Types;   // component ids in ascending order
+        std::vector<unsigned int> Sizes;   // sizeof each component
+        std::vector<unsigned int> Offsets; // byte offset of each component array inside a chunk
+        unsigned int EntityOffset = 0;
+        unsigned int Capacity = 0;         // entities per chunk
+        std::vector<Chunk> Chunks;
+
+        int Column(unsigned int type) const
+        {
+            for (unsigned int c = 0; c < Types.size(); c++)
+                if (Types[c] == type)
+                    return (int)c;
+            return -1;
+        }
+
+        unsigned char* Get(unsigned int chunk, unsigned int column, unsigned int row) const
+        {
+            return Chunks[chunk].Data.get() + Offsets[column] + row * Sizes[column];
+        }
+
+        Entity* Entities(unsigned int chunk) const
+        {
+            return reinterpret_cast<Entity*>(Chunks[chunk].Data.get() + EntityOffset);
+        }
+    };
+
+    class World
+    {
+    public:
+        World() {}
+        World(const World&) = delete;
+        World& operator=(const World&) = delete;
+
+        // creates an entity holding the given component values
+        template<typename... Ts>
+        Entity Create(const Ts&... components)
+        {
+            registerTypes<Ts...>();
+            unsigned int archetype = findArchetype(SignatureOf<Ts...>());
+            Entity entity = allocateEntity();
+            insertRow(entity, archetype);
+            (Set<Ts>(entity, components), ...);
+            return entity;
+        }
+
+        void Destroy(Entity entity)
+        {
+            if (!IsAlive(entity))
+                return;
+            Record& record = records[index(entity)];
+            removeRow(record.Archetype, record.Chunk, record.Row);
+            record.Alive = false;
+            record.Generation++;
+            freeList.push_back(index(entity));
+            aliveCount--;
+        }
+
+        bool IsAlive(Entity entity) const
+        {
+            unsigned int i = index(entity);
+            return i < records.size() && records[i].Alive && (records[i].Generation & 0xFFu) == generation(entity);
+        }
+
+        template<typename T>
+        bool Has(Entity entity) const
+        {
+            return IsAlive(entity) && (archetypes[records[index(entity)].Archetype].Sig & SignatureOf<T>()) != 0;
+        }
+
+        template<typename T>
+        T& Get(Entity entity)
+        {
+            assert(Has<T>(entity) && "Get<T>() on an entity without T");
+            const Record& record = records[index(entity)];
+            const Archetype& archetype = archetypes[record.Archetype];
+            return *reinterpret_cast<T*>(archetype.Get(record.Chunk, archetype.Column(ComponentId<T>()), record.Row));
+        }
+
+        template<typename T>
+        void Set(Entity entity, const T& value)
+        {
+            Get<T>(entity) = value;
+        }
+
+        // adds a component, moving the entity into the archetype that also holds T
+        template<typename T>
+        void Add(Entity entity, const T& value)
+        {
+            registerTypes<T>();
+            if (Has<T>(entity))
+            {
+                Set<T>(entity, value);
+                return;
+            }
+            migrate(entity, archetypes[records[index(entity)].Archetype].Sig | SignatureOf<T>());
+            Set<T>(entity, value);
+        }
+
+        template<typename T>
+        void Remove(Entity entity)
+        {
+            if (!Has<T>(entity))
+                return;
+            migrate(entity, archetypes[records[index(entity)].Archetype].Sig & ~SignatureOf<T>());
+        }
+
+        // calls fn(count, entities, Ts*...) once per chunk whose archetype holds every T
+        template<typename... Ts, typename Fn>
+        void ForEachChunk(Fn fn)
+        {
+            Signature query = SignatureOf<Ts...>();
+            for (Archetype& archetype : archetypes)
+            {
+                if ((archetype.Sig & query) != query)
+                    continue;
+                const unsigned int columns[] = { (unsigned int)archetype.Column(ComponentId<Ts>())... };
+                for (unsigned int c = 0; c < archetype.Chunks.size(); c++)
+                    callChunk<Ts...>(fn, archetype, c, columns, std::index_sequence_for<Ts...>());
+            }
+        }
+
+        // calls fn(entity, Ts&...) for every entity holding every T
+        template<typename... Ts, typename Fn>
+        void ForEach(Fn fn)
+        {
+            ForEachChunk<Ts...>([&fn](unsigned int count, const Entity* entities, Ts*... arrays)
+            {
+                for (unsigned int i = 0; i < count; i++)
+                    fn(entities[i], arrays[i]...);
+            });
+        }
+
+        unsigned int Size() const
+        {
+            return aliveCount;
+        }
+
+        const std::vector<Archetype>& Archetypes() const
+        {
+            return archetypes;
+        }
+
+    private:
+        struct Record
+        {
+            unsigned int Archetype = 0;
+            unsigned int Chunk = 0;
+            unsigned int Row = 0;
+            unsigned int Generation = 0;
+            bool Alive = false;
+        };
+
+        std::vector<Archetype> archetypes;
+        std::vector<Record> records;
+        std::vector<unsigned int> freeList;
+        unsigned int componentSizes[MAX_COMPONENTS] = {};
+        unsigned int aliveCount = 0;
+
+        // entity handles keep the record index in the low 24 bits and a generation in the high 8
+        static unsigned int index(Entity entity) { return entity & 0x00FFFFFFu; }
+        static unsigned int generation(Entity entity) { return entity >> 24; }
+
+        template<typename... Ts>
+        void registerTypes()
+        {
+            const unsigned int ids[] = { ComponentId<Ts>()... };
+            const unsigned int sizes[] = { (unsigned int)sizeof(Ts)... };
+            static_assert(sizeof...(Ts) > 0, "an entity needs at least one component");
+            static_assert((std::is_trivially_copyable<Ts>::value && ...), "components are moved with memcpy");
+            for (unsigned int i = 0; i < sizeof...(Ts); i++)
+                componentSizes[ids[i]] = sizes[i];
+        }
+
+        Entity allocateEntity()
+        {
+            unsigned int i;
+            if (!freeList.empty())
+            {
+                i = freeList.back();
+                freeList.pop_back();
+            }
+            else
+            {
+                i = (unsigned int)records.size();
+                // index 0x00FFFFFF at generation 255 would encode as NULL_ENTITY
+                assert(i < 0x00FFFFFFu && "entity indices are 24 bits, the last one is reserved");
+                records.push_back(Record());
+            }
+            records[i].Alive = true;
+            aliveCount++;
+            return i | ((records[i].Generation & 0xFFu) << 24);
+        }
+
+        unsigned int findArchetype(Signature signature)
+        {
+            for (unsigned int a = 0; a < archetypes.size(); a++)
+                if (archetypes[a].Sig == signature)
+                    return a;
+
+            Archetype archetype;
+            archetype.Sig = signature;
+            unsigned int rowSize = sizeof(Entity);
+            for (unsigned int id = 0; id < MAX_COMPONENTS; id++)
+            {
+                if ((signature & (Signature(1) << id)) == 0)
+                    continue;
+                archetype.Types.push_back(id);
+                archetype.Sizes.push_back(componentSizes[id]);
+                rowSize += componentSizes[id];
+            }
+            // every array starts on a 16 byte boundary, reserve the padding before sizing the chunk
+            unsigned int padding = 16 * ((unsigned int)archetype.Types.size() + 1);
+            archetype.Capacity = (CHUNK_SIZE - padding) / rowSize;
+            assert(archetype.Capacity > 0 && "one row of the archetype is larger than a chunk");
+            unsigned int offset = 0;
+            archetype.EntityOffset = offset;
+            offset += (archetype.Capacity * sizeof(Entity) + 15) & ~15u;
+            for (unsigned int c = 0; c < archetype.Types.size(); c++)
+            {
+                archetype.Offsets.push_back(offset);
+                offset += (archetype.Capacity * archetype.Sizes[c] + 15) & ~15u;
+            }
+            archetypes.push_back(std::move(archetype));
+            return (unsigned int)archetypes.size() - 1;
+        }
+
+        // appends a zeroed row for entity to the last chunk of the archetype
+        void insertRow(Entity entity, unsigned int a)
+        {
+            Archetype& archetype = archetypes[a];
+            if (archetype.Chunks.empty() || archetype.Chunks.back().Count == archetype.Capacity)
+            {
+                Chunk chunk;
+                chunk.Data.reset(new unsigned char[CHUNK_SIZE]);
+                archetype.Chunks.push_back(std::move(chunk));
+            }
+            unsigned int c = (unsigned int)archetype.Chunks.size() - 1;
+            unsigned int row = archetype.Chunks[c].Count++;
+            archetype.Entities(c)[row] = entity;
+            for (unsigned int col = 0; col < archetype.Types.size(); col++)
+                std::memset(archetype.Get(c, col, row), 0, archetype.Sizes[col]);
+
+            Record& record = records[index(entity)];
+            record.Archetype = a;
+            record.Chunk = c;
+            record.Row = row;
+        }
+
+        // removes a row by moving the archetype's last row into it, keeping every chunk but the last full
+        void removeRow(unsigned int a, unsigned int c, unsigned int row)
+        {
+            Archetype& archetype = archetypes[a];
+            unsigned int lastChunk = (unsigned int)archetype.Chunks.size() - 1;
+            unsigned int lastRow = archetype.Chunks[lastChunk].Count - 1;
+            if (c != lastChunk || row != lastRow)
+            {
+                Entity moved = archetype.Entities(lastChunk)[lastRow];
+                archetype.Entities(c)[row] = moved;
+                for (unsigned int col = 0; col < archetype.Types.size(); col++)
+                    std::memcpy(archetype.Get(c, col, row), archetype.Get(lastChunk, col, lastRow), archetype.Sizes[col]);
+                records[index(moved)].Chunk = c;
+                records[index(moved)].Row = row;
+            }
+            if (--archetype.Chunks[lastChunk].Count == 0)
+                archetype.Chunks.pop_back();
+        }
+
+        void migrate(Entity entity, Signature signature)
+        {
+            Record old = records[index(entity)];
+            unsigned int target = findArchetype(signature);
+            insertRow(entity, target);
+            const Record& record = records[index(entity)];
+            const Archetype& from = archetypes[old.Archetype];
+            const Archetype& to = archetypes[target];
+            for (unsigned int col = 0; col < from.Types.size(); col++)
+            {
+                int dst = to.Column(from.Types[col]);
+                if (dst >= 0)
+                    std::memcpy(to.Get(record.Chunk, dst, record.Row), from.Get(old.Chunk, col, old.Row), from.Sizes[col]);
+            }
+            removeRow(old.Archetype, old.Chunk, old.Row);
+        }
+
+        template<typename... Ts, typename Fn, std::size_t... I>
+        static void callChunk(Fn& fn, Archetype& archetype, unsigned int c, const unsigned int* columns, std::index_sequence<I...>)
+        {
+            fn(archetype.Chunks[c].Count, archetype.Entities(c), reinterpret_cast<Ts*>(archetype.Get(c, columns[I], 0))...);
+        }
+    };
+
+    // runs systems in the order they were added, once per frame
+    class Scheduler
+    {
+    public:
+        typedef std::function<void(World&, float)> System;
+
+        void Add(const std::string& name, System system)
+        {
+            names.push_back(name);
+            systems.push_back(system);
+        }
+
+        void Run(World& world, float deltaTime)
+        {
+            for (unsigned int i = 0; i < systems.size(); i++)
+                systems[i](world, deltaTime);
+        }
+
+        const std::vector<std::string>& Names() const
+        {
+            return names;
+        }
+
+    private:
+        std::vector<std::string> names;
+        std::vector<System> systems;
+    };
+}
+#endif
@@ -0,0 +1,196 @@
+#ifndef FIXED_TIMESTEP_H
+#define FIXED_TIMESTEP_H
+
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Splits elapsed frame time into fixed simulation steps. Time is accumulated in integer nanoseconds, so it neither
+// drifts nor loses resolution the way a float seconds counter does after a few hours, and the same sequence of frame
+// times always produces the same sequence of ticks.
+class FixedTimestep
+{
+public:
+    typedef std::int64_t Nanoseconds;
+
+    std::uint64_t Ticks = 0;      // simulation steps run so far
+    Nanoseconds Skipped = 0;      // time thrown away because a frame would have needed more than maxTicksPerFrame steps
+
+    // maxTicksPerFrame keeps a long hitch (a breakpoint, a window drag) from turning into a burst of catch-up ticks
+    explicit FixedTimestep(double ticksPerSecond = 120.0, unsigned int maxTicksPerFrame = 8)
+        : step(std::llround(1e9 / ticksPerSecond)), maxTicks(maxTicksPerFrame)
+    {
+        if (step < 1)
+            step = 1;
+    }
+
+    // steady clock reading in nanoseconds, for loops that measure frame time themselves
+    static Nanoseconds Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // adds a frame's elapsed time and returns how many steps are due
+    unsigned int Advance(double seconds)
+    {
+        return AdvanceNanoseconds(std::llround(seconds * 1e9));
+    }
+
+    unsigned int AdvanceNanoseconds(Nanoseconds elapsed)
+    {
+        accumulator += elapsed > 0 ? elapsed : 0;
+        Nanoseconds due = accumulator / step;
+        if (due > (Nanoseconds)maxTicks)
+        {
+            Skipped += (due - maxTicks) * step;
+            due = maxTicks;
+        }
+        accumulator -= due * step;
+        Ticks += (std::uint64_t)due;
+        return (unsigned int)due;
+    }
+
+    // seconds per step
+    double Step() const
+    {
+        return step * 1e-9;
+    }
+
+    // how far the frame is between the last two steps, in [0, 1)
+    double Alpha() const
+    {
+        return (double)accumulator / step;
+    }
+
+    // simulated time at the last step
+    double Time() const
+    {
+        return (double)Ticks * step * 1e-9;
+    }
+
+private:
+    Nanoseconds step;
+    Nanoseconds accumulator = 0;
+    unsigned int maxTicks;
+};
+
+// Runs a simulation at a fixed rate and hands the renderer the state interpolated between the last two ticks.
+// State is copied once per tick, so it should be a small value type (transforms, a camera), and Input is whatever the
+// render thread sampled for the frame (keys, the view direction).
+//
+// With threaded set the ticks run on a worker thread: Update() gives the worker the frame's time and input and returns
+// the state the worker finished for the previous frame, so simulation and rendering overlap at the cost of one frame of
+// latency. Both modes run the exact same ticks for the same frame times and input.
+template <typename State, typename Input>
+class Simulation
+{
+public:
+    typedef std::function<void(State& state, const Input& input, double step)> TickFunction;
+    typedef std::function<State(const State& previous, const State& current, double alpha)> BlendFunction;
+
+    Simulation(const State& initial, TickFunction tick, BlendFunction blend, double ticksPerSecond = 120.0, bool threaded = false)
+        : clock(ticksPerSecond), tick(tick), blend(blend), previous(initial), current(initial), threaded(threaded)
+    {
+        if (threaded)
+            worker = std::thread([this]() { run(); });
+    }
+
+    ~Simulation()
+    {
+        if (!threaded)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    // call once per rendered frame; returns the state to draw
+    State Update(double frameSeconds, const Input& input)
+    {
+        if (!threaded)
+        {
+            advance(frameSeconds, input);
+            return blend(previous, current, clock.Alpha());
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return !pending; });
+        State shown = blend(previous, current, clock.Alpha());
+        pendingSeconds = frameSeconds;
+        pendingInput = input;
+        pending = true;
+        lock.unlock();
+        wake.notify_one();
+        return shown;
+    }
+
+    // waits until the worker has run the ticks of the last Update(); does nothing when not threaded
+    void Sync()
+    {
+        if (!threaded)
+            return;
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return !pending; });
+    }
+
+    // the tick clock, for reporting; call Sync() first when threaded
+    const FixedTimestep& Clock() const
+    {
+        return clock;
+    }
+
+    bool Threaded() const
+    {
+        return threaded;
+    }
+
+private:
+    FixedTimestep clock;
+    TickFunction tick;
+    BlendFunction blend;
+    State previous, current;
+    bool threaded;
+
+    // worker hand-off: pending is set by Update() and cleared by the worker once the ticks are done
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    bool pending = false, quit = false;
+    double pendingSeconds = 0.0;
+    Input pendingInput = Input();
+    std::thread worker;
+
+    void advance(double seconds, const Input& input)
+    {
+        for (unsigned int i = clock.Advance(seconds); i > 0; i--)
+        {
+            previous = current;
+            tick(current, input, clock.Step());
+        }
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            wake.wait(lock, [this]() { return quit || pending; });
+            if (quit)
+                return;
+            // Update() does not touch the states again until pending is cleared
+            double seconds = pendingSeconds;
+            Input input = pendingInput;
+            lock.unlock();
+            advance(seconds, input);
+            lock.lock();
+            pending = false;
+            done.notify_one();
+        }
+    }
+};
+#endif
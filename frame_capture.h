@@ -0,0 +1,293 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include <png_writer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct CaptureStats
+{
+    unsigned int Issued = 0;     // glReadPixels calls
+    unsigned int Written = 0;    // frames the worker passed to the sink
+    unsigned int Dropped = 0;    // frames skipped because the worker queue was full
+    unsigned int Stalls = 0;     // times the render thread had to wait for a fence
+    double LatencyMs = 0.0;      // average time from glReadPixels to the mapped copy
+    double LatencyFrames = 0.0;  // the same in captured frames
+    double RenderThreadMs = 0.0; // average render thread cost of Capture()
+    double EncodeMs = 0.0;       // average sink time per frame (conversion, encoding, writing)
+    double FramesPerSecond = 0.0;
+    double MegabytesPerSecond = 0.0;
+};
+
+// Asynchronous framebuffer readback. Capture() starts a glReadPixels into one pixel-pack buffer of a small ring and
+// puts a fence behind it; the copy is only mapped a few frames later, once its fence has signaled, so the render thread
+// never waits on the GPU unless the whole ring is still in flight. Mapped frames go to a worker thread that hands them
+// to a sink; the default one converts BGRA to RGBA and writes numbered PNG or raw RGBA files.
+class FrameCapture
+{
+public:
+    enum Format { FORMAT_PNG, FORMAT_RAW };
+
+    // called on the worker thread with the frame index and its BGRA pixels, bottom row first; the pixels may be modified
+    typedef std::function<void(unsigned int frame, unsigned char* bgra)> Sink;
+
+    // frames are written to <directory>/frame_00000.png (or .rgba)
+    FrameCapture(int width, int height, const std::string& directory, Format format = FORMAT_PNG, unsigned int ringSize = 3, unsigned int maxQueued = 8)
+        : FrameCapture(width, height, fileSink(width, height, directory, format), ringSize, maxQueued)
+    {
+    }
+
+    // with dropWhenBehind unset a full queue makes Capture() wait for the worker instead of skipping the frame, so every
+    // frame reaches the sink and memory stays bounded by ringSize + maxQueued frames
+    FrameCapture(int width, int height, Sink sink, unsigned int ringSize = 3, unsigned int maxQueued = 8, bool dropWhenBehind = true)
+        : width(width), height(height), sink(sink), maxQueued(maxQueued), dropWhenBehind(dropWhenBehind)
+    {
+        slots.resize(ringSize < 2 ? 2 : ringSize);
+        std::size_t size = (std::size_t)width * height * 4;
+        for (Slot& slot : slots)
+        {
+            glGenBuffers(1, &slot.PBO);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        worker = std::thread([this]() { run(); });
+    }
+
+    ~FrameCapture()
+    {
+        Flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        worker.join();
+        for (Slot& slot : slots)
+        {
+            if (slot.Fence)
+                glDeleteSync(slot.Fence);
+            glDeleteBuffers(1, &slot.PBO);
+        }
+    }
+
+    // reads the currently bound read framebuffer; call it after the frame is drawn, before swapping buffers
+    void Capture()
+    {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        // retire whatever finished, oldest first, then make sure the slot we are about to reuse is free
+        while (slots[tail].Busy && signaled(slots[tail]))
+            retire(slots[tail], false, dropWhenBehind);
+        // head only catches up with tail when the whole ring is in flight
+        if (slots[head].Busy)
+            retire(slots[tail], true, dropWhenBehind);
+
+        Slot& slot = slots[head];
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        // BGRA is what most drivers keep the framebuffer in, so the copy needs no conversion on the GPU side
+        glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.Frame = issued++;
+        slot.Issued = begin;
+        slot.Busy = true;
+        head = (head + 1) % slots.size();
+
+        renderThreadSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    // waits for every outstanding readback and for the worker to write everything it was given
+    void Flush()
+    {
+        while (slots[tail].Busy)
+            retire(slots[tail], true, false);
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this]() { return queue.empty() && !encoding; });
+    }
+
+    CaptureStats Stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CaptureStats stats;
+        stats.Issued = issued;
+        stats.Written = written;
+        stats.Dropped = dropped;
+        stats.Stalls = stalls;
+        unsigned int retired = written + dropped + (unsigned int)queue.size() + (encoding ? 1 : 0);
+        stats.LatencyMs = retired > 0 ? latencySeconds * 1000.0 / retired : 0.0;
+        stats.LatencyFrames = retired > 0 ? latencyFrames / retired : 0.0;
+        stats.RenderThreadMs = issued > 0 ? renderThreadSeconds * 1000.0 / issued : 0.0;
+        stats.EncodeMs = written > 0 ? encodeSeconds * 1000.0 / written : 0.0;
+        if (written > 0)
+        {
+            double elapsed = std::chrono::duration<double>(lastWrite - firstRetire).count();
+            stats.FramesPerSecond = elapsed > 0.0 ? written / elapsed : 0.0;
+            stats.MegabytesPerSecond = stats.FramesPerSecond * width * height * 4 / (1024.0 * 1024.0);
+        }
+        return stats;
+    }
+
+private:
+    struct Slot
+    {
+        unsigned int PBO = 0;
+        GLsync Fence = 0;
+        unsigned int Frame = 0;
+        std::chrono::steady_clock::time_point Issued;
+        bool Busy = false;
+    };
+    struct Frame
+    {
+        unsigned int Index;
+        std::vector<unsigned char> Pixels;
+    };
+
+    int width, height;
+    Sink sink;
+    unsigned int maxQueued;
+    bool dropWhenBehind;
+    std::vector<Slot> slots;
+    std::size_t head = 0, tail = 0;
+    unsigned int issued = 0;
+    double renderThreadSeconds = 0.0;
+
+    // shared with the worker
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    std::deque<Frame> queue;
+    std::vector<std::vector<unsigned char>> freeBuffers;
+    bool quit = false, encoding = false;
+    unsigned int written = 0, dropped = 0, stalls = 0;
+    double latencySeconds = 0.0, latencyFrames = 0.0, encodeSeconds = 0.0;
+    std::chrono::steady_clock::time_point firstRetire, lastWrite;
+    std::thread worker;
+
+    static bool signaled(const Slot& slot)
+    {
+        GLenum status = glClientWaitSync(slot.Fence, 0, 0);
+        return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+    }
+
+    // maps a finished readback, copies it out and hands it to the worker; when the worker is behind the frame is
+    // dropped, or, if it may not be, the call waits for room in the queue
+    void retire(Slot& slot, bool wait, bool mayDrop)
+    {
+        if (wait && !signaled(slot))
+        {
+            // the ring is full or we are flushing: this is the only place the render thread blocks
+            glClientWaitSync(slot.Fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            std::lock_guard<std::mutex> lock(mutex);
+            stalls++;
+        }
+        glDeleteSync(slot.Fence);
+        slot.Fence = 0;
+        slot.Busy = false;
+        tail = (tail + 1) % slots.size();
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mutex);
+        if (written + dropped + queue.size() + (encoding ? 1 : 0) == 0)
+            firstRetire = now;
+        latencySeconds += std::chrono::duration<double>(now - slot.Issued).count();
+        latencyFrames += issued - slot.Frame;
+        if (queue.size() >= maxQueued)
+        {
+            // dropping keeps the render thread from waiting on a slow disk
+            if (mayDrop)
+            {
+                dropped++;
+                return;
+            }
+            idle.wait(lock, [this]() { return queue.size() < maxQueued; });
+        }
+        std::vector<unsigned char> pixels;
+        if (!freeBuffers.empty())
+        {
+            pixels.swap(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+        lock.unlock();
+
+        std::size_t size = (std::size_t)width * height * 4;
+        pixels.resize(size);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+        const unsigned char* mapped = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (mapped)
+        {
+            std::copy(mapped, mapped + size, pixels.begin());
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        lock.lock();
+        queue.push_back({ slot.Frame, std::move(pixels) });
+        lock.unlock();
+        wake.notify_one();
+    }
+
+    static Sink fileSink(int width, int height, const std::string& directory, Format format)
+    {
+        return [width, height, directory, format](unsigned int index, unsigned char* pixels)
+        {
+            // BGRA -> RGBA in place
+            std::size_t size = (std::size_t)width * height * 4;
+            for (std::size_t i = 0; i < size; i += 4)
+                std::swap(pixels[i], pixels[i + 2]);
+            char name[32];
+            std::snprintf(name, sizeof(name), "/frame_%05u.%s", index, format == FORMAT_PNG ? "png" : "rgba");
+            std::string path = directory + name;
+            if (format == FORMAT_PNG)
+                PNGWriter::Write(path.c_str(), width, height, 4, pixels, true);
+            else
+            {
+                // raw frames keep OpenGL's bottom-up row order, as glReadPixels returned them
+                FILE* file = std::fopen(path.c_str(), "wb");
+                if (file)
+                {
+                    std::fwrite(pixels, 1, size, file);
+                    std::fclose(file);
+                }
+            }
+        };
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            wake.wait(lock, [this]() { return quit || !queue.empty(); });
+            if (queue.empty())
+                return;
+            Frame frame = std::move(queue.front());
+            queue.pop_front();
+            encoding = true;
+            lock.unlock();
+
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            sink(frame.Index, frame.Pixels.data());
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+            lock.lock();
+            encodeSeconds += std::chrono::duration<double>(end - begin).count();
+            lastWrite = end;
+            written++;
+            encoding = false;
+            freeBuffers.push_back(std::move(frame.Pixels));
+            idle.notify_all();
+        }
+    }
+};
+#endif
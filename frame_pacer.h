@@ -0,0 +1,229 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+struct PacerStats
+{
+    unsigned int Frames = 0;
+    unsigned int Missed = 0;      // frames that presented later than their deadline plus half a period
+    double FrameMs = 0.0;         // average present to present time
+    double JitterMs = 0.0;        // standard deviation of it
+    double LatencyMs = 0.0;       // average input sample to present time
+    double MaxLatencyMs = 0.0;
+    double WaitMs = 0.0;          // average time BeginFrame() held the frame back
+};
+
+// Paces the render loop to a target rate with as little input latency as the rate allows. Instead of rendering as
+// early as possible and then blocking in the swap (or in a sleep after it), BeginFrame() delays the start of the frame
+// until just enough time is left to build it before its deadline, so input sampled afterwards is as fresh as possible.
+// The frame's cost is predicted from a slowly decaying peak of the last frames' CPU time.
+//
+// Waiting sleeps while the remaining time is comfortably above the observed oversleep of the OS timer and spins for the
+// rest, so the deadline is hit to within microseconds without burning a core for the whole wait.
+//
+// Latency is measured on the CPU, from MarkInput() to the return of the swap, so it leaves out the compositor and the
+// display; it is still what the pacing changes.
+class FramePacer
+{
+public:
+    enum Sync { SYNC_OFF, SYNC_ON, SYNC_ADAPTIVE };
+
+    typedef std::int64_t Nanoseconds;
+
+    // targetRate 0 means the monitor's refresh rate with vsync on, no cap with it off
+    FramePacer(double targetRate = 0.0, Sync sync = SYNC_ON)
+        : targetRate(targetRate), sync(sync)
+    {
+    }
+
+    // --vsync=on|off|adaptive, --frame-rate=<frames per second>
+    static FramePacer FromArgs(int argc, char* argv[], Sync defaultSync = SYNC_ON)
+    {
+        Sync sync = defaultSync;
+        double rate = 0.0;
+        const std::string vsync = "--vsync=", frameRate = "--frame-rate=";
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg.compare(0, vsync.size(), vsync) == 0)
+            {
+                std::string value = arg.substr(vsync.size());
+                sync = value == "off" ? SYNC_OFF : value == "adaptive" ? SYNC_ADAPTIVE : SYNC_ON;
+            }
+            else if (arg.compare(0, frameRate.size(), frameRate) == 0)
+                rate = std::atof(arg.c_str() + frameRate.size());
+        }
+        return FramePacer(rate, sync);
+    }
+
+    // sets the swap interval on the window's (current) context and settles the frame period; without a window there
+    // is no vsync and only an explicit target rate paces the loop
+    void Start(GLFWwindow* window)
+    {
+        Sync applied = window ? sync : SYNC_OFF;
+        if (applied == SYNC_ADAPTIVE && !glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+            applied = SYNC_ON;
+        if (window)
+            glfwSwapInterval(applied == SYNC_OFF ? 0 : applied == SYNC_ON ? 1 : -1);
+        sync = applied;
+
+        double rate = targetRate;
+        if (rate <= 0.0 && sync != SYNC_OFF)
+        {
+            GLFWmonitor* monitor = glfwGetWindowMonitor(window);
+            const GLFWvidmode* mode = glfwGetVideoMode(monitor ? monitor : glfwGetPrimaryMonitor());
+            rate = mode && mode->refreshRate > 0 ? mode->refreshRate : 60.0;
+        }
+        period = rate > 0.0 ? std::llround(1e9 / rate) : 0;
+        deadline = now() + period;
+    }
+
+    Sync GetSync() const
+    {
+        return sync;
+    }
+
+    // frames per second the loop is paced to, 0 when it runs uncapped
+    double Rate() const
+    {
+        return period > 0 ? 1e9 / period : 0.0;
+    }
+
+    // call at the top of the loop, before sampling input
+    void BeginFrame()
+    {
+        Nanoseconds begin = now();
+        if (period > 0)
+        {
+            Nanoseconds start = deadline - predictedWork - margin;
+            if (start > begin)
+                waitUntil(start);
+        }
+        frameStart = now();
+        waitTotal += frameStart - begin;
+        inputTime = frameStart;
+    }
+
+    // call when the input the frame shows was sampled (the late latch), for the latency measurement
+    void MarkInput()
+    {
+        inputTime = now();
+    }
+
+    // call right before swapping buffers and right after the swap returned
+    void BeginPresent()
+    {
+        Nanoseconds work = now() - frameStart;
+        // the prediction jumps up to a slow frame at once and forgets it over a few dozen frames
+        predictedWork = work > predictedWork ? work : predictedWork - (predictedWork - work) / 16;
+    }
+
+    void EndPresent()
+    {
+        Nanoseconds presented = now();
+        if (period > 0 && presented > deadline + period / 2)
+            missed++;
+
+        if (lastPresent > 0)
+        {
+            double frameTime = (double)(presented - lastPresent);
+            frameSum += frameTime;
+            frameSquares += frameTime * frameTime;
+        }
+        lastPresent = presented;
+        double latency = (double)(presented - inputTime);
+        latencySum += latency;
+        latencyMax = latency > latencyMax ? latency : latencyMax;
+        frames++;
+
+        if (period > 0)
+        {
+            // with vsync the swap returning marks the refresh, so the next deadline follows it; a plain cap keeps its
+            // own schedule and only resynchronizes after falling a whole period behind
+            if (sync != SYNC_OFF)
+                deadline = presented + period;
+            else
+            {
+                deadline += period;
+                if (deadline < presented)
+                    deadline = presented + period;
+            }
+        }
+    }
+
+    PacerStats Stats() const
+    {
+        PacerStats stats;
+        stats.Frames = frames;
+        stats.Missed = missed;
+        if (frames > 1)
+        {
+            double mean = frameSum / (frames - 1);
+            double variance = frameSquares / (frames - 1) - mean * mean;
+            stats.FrameMs = mean * 1e-6;
+            stats.JitterMs = std::sqrt(variance > 0.0 ? variance : 0.0) * 1e-6;
+        }
+        if (frames > 0)
+        {
+            stats.LatencyMs = latencySum / frames * 1e-6;
+            stats.WaitMs = (double)waitTotal / frames * 1e-6;
+        }
+        stats.MaxLatencyMs = latencyMax * 1e-6;
+        return stats;
+    }
+
+private:
+    double targetRate;
+    Sync sync;
+    Nanoseconds period = 0, deadline = 0;
+    Nanoseconds frameStart = 0, inputTime = 0, lastPresent = 0;
+    Nanoseconds predictedWork = 0;
+    // slack for the driver's part of the swap
+    Nanoseconds margin = 500000;
+    // how long a 1 ms sleep really takes, refined as sleeps are measured
+    double sleepMean = 1e6, sleepSquares = 1e12;
+    unsigned int sleeps = 0;
+
+    unsigned int frames = 0, missed = 0;
+    double frameSum = 0.0, frameSquares = 0.0, latencySum = 0.0, latencyMax = 0.0;
+    Nanoseconds waitTotal = 0;
+
+    static Nanoseconds now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void waitUntil(Nanoseconds target)
+    {
+        for (;;)
+        {
+            Nanoseconds current = now();
+            Nanoseconds remaining = target - current;
+            if (remaining <= 0)
+                return;
+            // sleep only while a sleep that overshoots by two deviations still ends in time
+            double variance = sleepSquares - sleepMean * sleepMean;
+            double estimate = sleepMean + 2.0 * std::sqrt(variance > 0.0 ? variance : 0.0);
+            if (remaining > estimate)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                double slept = (double)(now() - current);
+                // running averages over the last ~64 sleeps, so a timer resolution change is picked up
+                double weight = sleeps < 64 ? 1.0 / ++sleeps : 1.0 / 64;
+                sleepMean += (slept - sleepMean) * weight;
+                sleepSquares += (slept * slept - sleepSquares) * weight;
+            }
+            else
+                std::this_thread::yield();
+        }
+    }
+};
+#endif
@@ -0,0 +1,233 @@
+#ifndef FRAME_STREAM_H
+#define FRAME_STREAM_H
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRAME_STREAM_SSE2
+#endif
+
+// Writes a sequence of frames to a file or to stdout ("-") as a YUV4MPEG2 (.y4m) stream, which ffmpeg and most
+// encoders read directly, or as headerless RGBA. Frames come in as captured by FrameCapture (BGRA, bottom row first)
+// and are converted to I420 (BT.601, limited range) with SSE2, 8 pixels at a time.
+class FrameStream
+{
+public:
+    enum Format { FORMAT_Y4M, FORMAT_RAW };
+
+    std::uint64_t Frames = 0;
+    std::uint64_t BytesWritten = 0;
+
+    FrameStream(const std::string& path, int width, int height, int fps, Format format = FORMAT_Y4M)
+        : width(width), height(height), format(format)
+    {
+        if (path == "-")
+        {
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            file = stdout;
+        }
+        else
+            file = std::fopen(path.c_str(), "wb");
+        if (!file)
+            return;
+#ifndef _WIN32
+        // a reader that goes away would kill the process on the next write; with SIGPIPE ignored the write fails
+        // with EPIPE instead and Good() lets the caller stop
+        struct stat info;
+        if (file == stdout || (fstat(fileno(file), &info) == 0 && S_ISFIFO(info.st_mode)))
+            std::signal(SIGPIPE, SIG_IGN);
+#endif
+        // frames are large, a big buffer keeps the writes few when the reader is a pipe
+        std::setvbuf(file, NULL, _IOFBF, 1 << 20);
+        if (format == FORMAT_Y4M)
+        {
+            char header[96];
+            int size = std::snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+            put(header, size);
+            int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+            planes.resize((std::size_t)width * height + 2 * (std::size_t)chromaWidth * chromaHeight);
+        }
+        else
+            planes.resize((std::size_t)width * 4);
+    }
+
+    ~FrameStream()
+    {
+        if (!file)
+            return;
+        if (file == stdout)
+            std::fflush(file);
+        else
+            std::fclose(file);
+    }
+
+    bool IsOpen() const
+    {
+        return file != nullptr;
+    }
+
+    // false once a write failed, e.g. because the reading end of the pipe went away
+    bool Good() const
+    {
+        return file != nullptr && !failed;
+    }
+
+    // bgra holds width * height pixels, bottom row first
+    void Write(const unsigned char* bgra)
+    {
+        if (!Good())
+            return;
+        if (format == FORMAT_Y4M)
+        {
+            int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+            unsigned char* y = planes.data();
+            unsigned char* u = y + (std::size_t)width * height;
+            unsigned char* v = u + (std::size_t)chromaWidth * chromaHeight;
+            ConvertI420(bgra, width, height, true, y, u, v);
+            put("FRAME\n", 6);
+            put(planes.data(), planes.size());
+        }
+        else
+        {
+            // RGBA, top row first
+            for (int row = height - 1; row >= 0; row--)
+            {
+                const unsigned char* src = bgra + (std::size_t)row * width * 4;
+                for (int x = 0; x < width * 4; x += 4)
+                {
+                    planes[x] = src[x + 2];
+                    planes[x + 1] = src[x + 1];
+                    planes[x + 2] = src[x];
+                    planes[x + 3] = src[x + 3];
+                }
+                put(planes.data(), planes.size());
+            }
+        }
+        Frames++;
+    }
+
+    // BGRA to planar Y, U, V (chroma averaged over 2x2 blocks); flipY reads the source bottom row first
+    static void ConvertI420(const unsigned char* bgra, int width, int height, bool flipY, unsigned char* y, unsigned char* u, unsigned char* v)
+    {
+        int chromaWidth = (width + 1) / 2;
+        for (int row = 0; row < height; row += 2)
+        {
+            // an odd last row pairs with itself for chroma
+            int nextRow = row + 1 < height ? row + 1 : row;
+            const unsigned char* a = bgra + (std::size_t)(flipY ? height - 1 - row : row) * width * 4;
+            const unsigned char* b = bgra + (std::size_t)(flipY ? height - 1 - nextRow : nextRow) * width * 4;
+            unsigned char* yA = y + (std::size_t)row * width;
+            unsigned char* yB = y + (std::size_t)nextRow * width;
+            unsigned char* uRow = u + (std::size_t)(row / 2) * chromaWidth;
+            unsigned char* vRow = v + (std::size_t)(row / 2) * chromaWidth;
+            int x = 0;
+#ifdef FRAME_STREAM_SSE2
+            for (; x + 8 <= width; x += 8)
+            {
+                __m128i bA, gA, rA, bB, gB, rB;
+                load8(a + x * 4, bA, gA, rA);
+                load8(b + x * 4, bB, gB, rB);
+                _mm_storel_epi64((__m128i*)(yA + x), _mm_packus_epi16(luma8(bA, gA, rA), _mm_setzero_si128()));
+                _mm_storel_epi64((__m128i*)(yB + x), _mm_packus_epi16(luma8(bB, gB, rB), _mm_setzero_si128()));
+
+                // 2x2 averages: add the rows, then pairs of neighbours with madd
+                __m128i ones = _mm_set1_epi16(1), two = _mm_set1_epi32(2);
+                __m128i avgB = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_add_epi16(bA, bB), ones), two), 2);
+                __m128i avgG = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_add_epi16(gA, gB), ones), two), 2);
+                __m128i avgR = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_add_epi16(rA, rB), ones), two), 2);
+                avgB = _mm_packs_epi32(avgB, avgB);
+                avgG = _mm_packs_epi32(avgG, avgG);
+                avgR = _mm_packs_epi32(avgR, avgR);
+                // every product fits a signed 16 bit lane: |-38 * 255 - 74 * 255| < 32768
+                __m128i round = _mm_set1_epi16(128);
+                __m128i cu = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(avgR, _mm_set1_epi16(-38)), _mm_mullo_epi16(avgG, _mm_set1_epi16(-74))),
+                                           _mm_add_epi16(_mm_mullo_epi16(avgB, _mm_set1_epi16(112)), round));
+                __m128i cv = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(avgR, _mm_set1_epi16(112)), _mm_mullo_epi16(avgG, _mm_set1_epi16(-94))),
+                                           _mm_add_epi16(_mm_mullo_epi16(avgB, _mm_set1_epi16(-18)), round));
+                cu = _mm_add_epi16(_mm_srai_epi16(cu, 8), round);
+                cv = _mm_add_epi16(_mm_srai_epi16(cv, 8), round);
+                int packedU = _mm_cvtsi128_si32(_mm_packus_epi16(cu, cu));
+                int packedV = _mm_cvtsi128_si32(_mm_packus_epi16(cv, cv));
+                for (int i = 0; i < 4; i++)
+                {
+                    uRow[x / 2 + i] = (unsigned char)(packedU >> (8 * i));
+                    vRow[x / 2 + i] = (unsigned char)(packedV >> (8 * i));
+                }
+            }
+#endif
+            for (; x < width; x += 2)
+            {
+                int nextX = x + 1 < width ? x + 1 : x;
+                yA[x] = luma(a + x * 4);
+                yB[x] = luma(b + x * 4);
+                if (nextX != x)
+                {
+                    yA[nextX] = luma(a + nextX * 4);
+                    yB[nextX] = luma(b + nextX * 4);
+                }
+                int sum[3];
+                for (int c = 0; c < 3; c++)
+                    sum[c] = (a[x * 4 + c] + a[nextX * 4 + c] + b[x * 4 + c] + b[nextX * 4 + c] + 2) >> 2;
+                int blue = sum[0], green = sum[1], red = sum[2];
+                uRow[x / 2] = (unsigned char)(((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128);
+                vRow[x / 2] = (unsigned char)(((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128);
+            }
+        }
+    }
+
+private:
+    int width, height;
+    Format format;
+    FILE* file = nullptr;
+    std::atomic<bool> failed{ false }; // set on the writing thread, polled by the render loop
+    std::vector<unsigned char> planes;
+
+    void put(const void* data, std::size_t size)
+    {
+        if (std::fwrite(data, 1, size, file) != size)
+            failed = true;
+        BytesWritten += size;
+    }
+
+    static unsigned char luma(const unsigned char* bgra)
+    {
+        return (unsigned char)(((66 * bgra[2] + 129 * bgra[1] + 25 * bgra[0] + 128) >> 8) + 16);
+    }
+
+#ifdef FRAME_STREAM_SSE2
+    // 8 BGRA pixels to three vectors of 8 16 bit channels
+    static void load8(const unsigned char* p, __m128i& b, __m128i& g, __m128i& r)
+    {
+        __m128i p0 = _mm_loadu_si128((const __m128i*)p);
+        __m128i p1 = _mm_loadu_si128((const __m128i*)(p + 16));
+        __m128i mask = _mm_set1_epi32(0xFF);
+        b = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+        g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+        r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+    }
+
+    // the weighted sum stays below 65536, so it is computed in wrapping 16 bit lanes and shifted as unsigned
+    static __m128i luma8(__m128i b, __m128i g, __m128i r)
+    {
+        __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129))),
+                                    _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), _mm_set1_epi16(128)));
+        return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+    }
+#endif
+};
+#endif
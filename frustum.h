@@ -0,0 +1,251 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_SSE2
+#endif
+
+// bounding volumes
+// ----------------
+struct AABB
+{
+    glm::vec3 Min = glm::vec3(0.0f);
+    glm::vec3 Max = glm::vec3(0.0f);
+
+    AABB() {}
+    AABB(const glm::vec3& min, const glm::vec3& max) : Min(min), Max(max) {}
+
+    glm::vec3 Center() const { return (Min + Max) * 0.5f; }
+    glm::vec3 Extent() const { return (Max - Min) * 0.5f; }
+
+    // bounds of this box after an affine transformation (Arvo's method: the new extent is |M| * extent)
+    AABB Transform(const glm::mat4& m) const
+    {
+        glm::vec3 center = glm::vec3(m * glm::vec4(Center(), 1.0f));
+        glm::vec3 extent = Extent();
+        glm::vec3 newExtent;
+        for (int i = 0; i < 3; i++)
+            newExtent[i] = std::abs(m[0][i]) * extent.x + std::abs(m[1][i]) * extent.y + std::abs(m[2][i]) * extent.z;
+        return AABB(center - newExtent, center + newExtent);
+    }
+};
+
+struct BoundingSphere
+{
+    glm::vec3 Center = glm::vec3(0.0f);
+    float Radius = 0.0f;
+};
+
+// how clip space z maps to depth. DEPTH_STANDARD is OpenGL's default -w..w volume with the near plane at -w;
+// DEPTH_REVERSED_Z is the 0..w volume of glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE) with the near plane at w and
+// the far plane at 0, which an infinite projection never reaches
+enum DepthConvention { DEPTH_STANDARD, DEPTH_REVERSED_Z };
+
+// six clip planes (a, b, c, d) with normals pointing inside: a point p is inside when dot(n, p) + d >= 0
+struct Frustum
+{
+    enum { PLANE_LEFT, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR };
+    glm::vec4 Planes[6];
+
+    Frustum() {}
+
+    // Gribb/Hartmann extraction from projection * view, for the clip volume of the given depth convention
+    explicit Frustum(const glm::mat4& viewProjection, DepthConvention depth = DEPTH_STANDARD)
+    {
+        glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+        glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+        glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+        glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        Planes[PLANE_LEFT] = row3 + row0;
+        Planes[PLANE_RIGHT] = row3 - row0;
+        Planes[PLANE_BOTTOM] = row3 + row1;
+        Planes[PLANE_TOP] = row3 - row1;
+        Planes[PLANE_NEAR] = depth == DEPTH_REVERSED_Z ? row3 - row2 : row3 + row2;
+        Planes[PLANE_FAR] = depth == DEPTH_REVERSED_Z ? row2 : row3 - row2;
+        for (int i = 0; i < 6; i++)
+        {
+            // an infinite far plane comes out as (0, 0, 0, w): everything is in front of it
+            float length = glm::length(glm::vec3(Planes[i].x, Planes[i].y, Planes[i].z));
+            Planes[i] = length > 0.0f ? Planes[i] / length : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+    }
+
+    bool Intersects(const AABB& box) const
+    {
+        glm::vec3 center = box.Center();
+        glm::vec3 extent = box.Extent();
+        for (int i = 0; i < 6; i++)
+        {
+            const glm::vec4& p = Planes[i];
+            float distance = p.x * center.x + p.y * center.y + p.z * center.z + p.w;
+            float radius = std::abs(p.x) * extent.x + std::abs(p.y) * extent.y + std::abs(p.z) * extent.z;
+            if (distance + radius < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    bool Intersects(const BoundingSphere& sphere) const
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            const glm::vec4& p = Planes[i];
+            if (p.x * sphere.Center.x + p.y * sphere.Center.y + p.z * sphere.Center.z + p.w < -sphere.Radius)
+                return false;
+        }
+        return true;
+    }
+};
+
+struct CullStats
+{
+    unsigned int Tested = 0;
+    unsigned int Visible = 0;
+    unsigned int Culled = 0;
+    double NanosecondsPerObject = 0.0;
+};
+
+// Culls many boxes at once. Bounds are kept as structure-of-arrays (centers and extents) padded to a
+// multiple of 8, and the kernel tests 8 boxes per iteration with AVX, 4 with SSE2, or one at a time
+// otherwise. Indices of the boxes that survive are written to a compact visible list.
+class FrustumCuller
+{
+public:
+    unsigned int Add(const AABB& box)
+    {
+        unsigned int index = count++;
+        if (count > CenterX.size())
+        {
+            unsigned int padded = (count + 7) & ~7u;
+            // padding boxes sit at the origin with a negative extent so they never pass a plane test
+            for (std::vector<float>* v : { &CenterX, &CenterY, &CenterZ })
+                v->resize(padded, 0.0f);
+            for (std::vector<float>* v : { &ExtentX, &ExtentY, &ExtentZ })
+                v->resize(padded, -1e30f);
+        }
+        Set(index, box);
+        return index;
+    }
+
+    void Set(unsigned int index, const AABB& box)
+    {
+        glm::vec3 center = box.Center();
+        glm::vec3 extent = box.Extent();
+        CenterX[index] = center.x; CenterY[index] = center.y; CenterZ[index] = center.z;
+        ExtentX[index] = extent.x; ExtentY[index] = extent.y; ExtentZ[index] = extent.z;
+    }
+
+    void Clear()
+    {
+        count = 0;
+        CenterX.clear(); CenterY.clear(); CenterZ.clear();
+        ExtentX.clear(); ExtentY.clear(); ExtentZ.clear();
+    }
+
+    unsigned int Size() const
+    {
+        return count;
+    }
+
+    // fills visible with the indices of the boxes that intersect the frustum
+    CullStats Cull(const Frustum& frustum, std::vector<unsigned int>& visible) const
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        visible.resize(CenterX.size());
+        unsigned int written = CullRange(frustum, 0, (unsigned int)CenterX.size(), visible.data());
+        visible.resize(written);
+
+        CullStats stats;
+        stats.Tested = count;
+        stats.Visible = written;
+        stats.Culled = count - written;
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+        stats.NanosecondsPerObject = count > 0 ? elapsed / count : 0.0;
+        return stats;
+    }
+
+    // tests boxes [begin, end) (begin a multiple of 8) and writes the survivors to out, returns how many
+    unsigned int CullRange(const Frustum& frustum, unsigned int begin, unsigned int end, unsigned int* out) const
+    {
+        unsigned int written = 0;
+#if defined(__AVX__)
+        for (unsigned int i = begin; i < end; i += 8)
+        {
+            __m256 cx = _mm256_loadu_ps(&CenterX[i]), cy = _mm256_loadu_ps(&CenterY[i]), cz = _mm256_loadu_ps(&CenterZ[i]);
+            __m256 ex = _mm256_loadu_ps(&ExtentX[i]), ey = _mm256_loadu_ps(&ExtentY[i]), ez = _mm256_loadu_ps(&ExtentZ[i]);
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                const glm::vec4& plane = frustum.Planes[p];
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), cx), _mm256_mul_ps(_mm256_set1_ps(plane.y), cy)),
+                                                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), cz), _mm256_set1_ps(plane.w)));
+                __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::abs(plane.x)), ex), _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.y)), ey)),
+                                              _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.z)), ez));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+            }
+            written += compact((unsigned int)_mm256_movemask_ps(inside), i, out + written);
+        }
+#elif defined(FRUSTUM_SSE2)
+        for (unsigned int i = begin; i < end; i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(&CenterX[i]), cy = _mm_loadu_ps(&CenterY[i]), cz = _mm_loadu_ps(&CenterZ[i]);
+            __m128 ex = _mm_loadu_ps(&ExtentX[i]), ey = _mm_loadu_ps(&ExtentY[i]), ez = _mm_loadu_ps(&ExtentZ[i]);
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                const glm::vec4& plane = frustum.Planes[p];
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+                                             _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w)));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), ex), _mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), ey)),
+                                           _mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), ez));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+            }
+            written += compact((unsigned int)_mm_movemask_ps(inside), i, out + written);
+        }
+#else
+        for (unsigned int i = begin; i < end; i++)
+        {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; p++)
+            {
+                const glm::vec4& plane = frustum.Planes[p];
+                float distance = plane.x * CenterX[i] + plane.y * CenterY[i] + plane.z * CenterZ[i] + plane.w;
+                float radius = std::abs(plane.x) * ExtentX[i] + std::abs(plane.y) * ExtentY[i] + std::abs(plane.z) * ExtentZ[i];
+                inside = distance + radius >= 0.0f;
+            }
+            if (inside)
+                out[written++] = i;
+        }
+#endif
+        return written;
+    }
+
+    // bounds as structure of arrays, padded to a multiple of 8
+    std::vector<float> CenterX, CenterY, CenterZ;
+    std::vector<float> ExtentX, ExtentY, ExtentZ;
+
+private:
+    unsigned int count = 0;
+
+    // appends the index of every set bit of mask; every candidate is stored and only set bits advance the output
+    static unsigned int compact(unsigned int mask, unsigned int base, unsigned int* out)
+    {
+        unsigned int written = 0;
+        for (unsigned int bit = 0; mask != 0; bit++, mask >>= 1)
+        {
+            out[written] = base + bit;
+            written += mask & 1u;
+        }
+        return written;
+    }
+};
+#endif
@@ -0,0 +1,468 @@
+#ifndef GL_CONTEXT_H
+#define GL_CONTEXT_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+// headless backends are opt-in because they need extra libraries at link time:
+// HEADLESS_EGL links against libEGL (Mesa's surfaceless platform), HEADLESS_OSMESA against libOSMesa
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#ifdef HEADLESS_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// GL_ARB_clip_control, core in 4.5 and so missing from the 3.3 headers
+#ifndef GL_ZERO_TO_ONE
+#define GL_ZERO_TO_ONE 0x935F
+#endif
+
+// color + depth renderbuffers the headless backends draw into, so that the render code is the same with or without a window
+class OffscreenTarget
+{
+public:
+    unsigned int FBO = 0, Color = 0, Depth = 0;
+    int Width = 0, Height = 0;
+
+    // depthFormat GL_DEPTH_COMPONENT32F gives a floating point depth buffer (without stencil), e.g. for reversed-z
+    bool Create(int width, int height, GLenum depthFormat = GL_DEPTH24_STENCIL8)
+    {
+        Width = width;
+        Height = height;
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glGenRenderbuffers(1, &Color);
+        glBindRenderbuffer(GL_RENDERBUFFER, Color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, Color);
+        glGenRenderbuffers(1, &Depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, Depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, depthFormat, width, height);
+        GLenum attachment = depthFormat == GL_DEPTH24_STENCIL8 || depthFormat == GL_DEPTH32F_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, Depth);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete)
+            std::cout << "ERROR::FRAMEBUFFER:: Offscreen framebuffer is not complete" << std::endl;
+        return complete;
+    }
+
+    void Bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, Width, Height);
+    }
+
+    void Destroy()
+    {
+        glDeleteRenderbuffers(1, &Color);
+        glDeleteRenderbuffers(1, &Depth);
+        glDeleteFramebuffers(1, &FBO);
+        FBO = Color = Depth = 0;
+    }
+};
+
+// GPU time of a part of the frame, from GL_TIME_ELAPSED queries. Results are collected a few frames later, when the
+// GPU has long finished them, so timing never stalls the pipeline; only one timer may be running at a time
+class GpuTimer
+{
+public:
+    unsigned int Samples = 0;
+    double TotalMs = 0.0;
+
+    ~GpuTimer()
+    {
+        if (queries[0])
+            glDeleteQueries(QUERY_COUNT, queries);
+    }
+
+    void Begin()
+    {
+        if (!queries[0])
+            glGenQueries(QUERY_COUNT, queries);
+        // the slot about to be reused holds a query from QUERY_COUNT frames ago
+        if (issued[current])
+            collect(current);
+        glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+    }
+
+    void End()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        issued[current] = true;
+        current = (current + 1) % QUERY_COUNT;
+    }
+
+    double AverageMs() const
+    {
+        return Samples > 0 ? TotalMs / Samples : 0.0;
+    }
+
+private:
+    static const int QUERY_COUNT = 4;
+    unsigned int queries[QUERY_COUNT] = {};
+    bool issued[QUERY_COUNT] = {};
+    int current = 0;
+
+    void collect(int slot)
+    {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+        TotalMs += elapsed * 1e-6;
+        Samples++;
+        issued[slot] = false;
+    }
+};
+
+// Creates the OpenGL 3.3 core context a sample renders with and loads glad for it. BACKEND_GLFW opens the usual window;
+// BACKEND_EGL (EGL_MESA_platform_surfaceless) and BACKEND_OSMESA need no display at all and render into an
+// OffscreenTarget, which makes batch rendering and benchmarking possible on CPU-only Mesa (llvmpipe) servers.
+class GLContext
+{
+public:
+    enum Backend { BACKEND_GLFW, BACKEND_EGL, BACKEND_OSMESA };
+
+    Backend Type = BACKEND_GLFW;
+    int Width = 0, Height = 0;
+    GLFWwindow* Window = nullptr;
+    OffscreenTarget Target;
+
+    // "--context=glfw|egl|osmesa" on the command line, else the GL_CONTEXT environment variable, else a window
+    static Backend FromArgs(int argc, char* argv[])
+    {
+        std::string name;
+        const char* env = std::getenv("GL_CONTEXT");
+        if (env)
+            name = env;
+        for (int i = 1; i < argc; i++)
+            if (std::strncmp(argv[i], "--context=", 10) == 0)
+                name = argv[i] + 10;
+        if (name == "egl")
+            return BACKEND_EGL;
+        if (name == "osmesa")
+            return BACKEND_OSMESA;
+        return BACKEND_GLFW;
+    }
+
+    // "--<name>=<value>" on the command line, fallback when missing
+    static std::string StringArg(int argc, char* argv[], const char* name, const std::string& fallback)
+    {
+        std::string prefix = std::string("--") + name + "=";
+        for (int i = 1; i < argc; i++)
+            if (std::strncmp(argv[i], prefix.c_str(), prefix.size()) == 0)
+                return argv[i] + prefix.size();
+        return fallback;
+    }
+
+    static int IntArg(int argc, char* argv[], const char* name, int fallback)
+    {
+        std::string value = StringArg(argc, argv, name, "");
+        return value.empty() ? fallback : std::atoi(value.c_str());
+    }
+
+    static const char* Name(Backend backend)
+    {
+        return backend == BACKEND_EGL ? "EGL (surfaceless)" : backend == BACKEND_OSMESA ? "OSMesa" : "GLFW";
+    }
+
+    bool Create(Backend backend, int width, int height, const char* title)
+    {
+        Type = backend;
+        Width = width;
+        Height = height;
+        current() = backend;
+        bool created = backend == BACKEND_EGL ? createEGL() : backend == BACKEND_OSMESA ? createOSMesa() : createGLFW(title);
+        if (!created)
+            return false;
+
+        // glad: load all OpenGL function pointers
+        // ---------------------------------------
+        if (!gladLoadGLLoader((GLADloadproc)GetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return false;
+        }
+        if (Headless())
+        {
+            if (!Target.Create(width, height))
+                return false;
+            Target.Bind();
+        }
+        return true;
+    }
+
+    bool Headless() const
+    {
+        return Type != BACKEND_GLFW;
+    }
+
+    // the size of what a frame is drawn into and read back from: the offscreen target when there is one, otherwise
+    // the window's framebuffer, which is larger than Width x Height on high dpi screens
+    void FramebufferSize(int& width, int& height) const
+    {
+        width = Width;
+        height = Height;
+        if (Target.FBO)
+        {
+            width = Target.Width;
+            height = Target.Height;
+        }
+        else if (Window)
+            glfwGetFramebufferSize(Window, &width, &height);
+    }
+
+    // switches depth to reversed-z: 0..1 clip depth through glClipControl, GL_GREATER tests, depth cleared to 0 and
+    // a 32 bit float depth buffer. The default framebuffer's depth format can't be chosen, so with a window the frame
+    // is drawn into a window sized OffscreenTarget that Present() blits to the window. Returns false, changing
+    // nothing, when the driver has no GL_ARB_clip_control
+    bool EnableReversedZ()
+    {
+        typedef void (APIENTRY* ClipControlFunction)(GLenum origin, GLenum depth);
+        ClipControlFunction clipControl = (ClipControlFunction)GetProcAddress("glClipControl");
+        if (!clipControl || !HasExtension("GL_ARB_clip_control"))
+        {
+            std::cout << "Reversed-z needs GL_ARB_clip_control, keeping standard depth" << std::endl;
+            return false;
+        }
+        if (Target.FBO)
+            Target.Destroy();
+        // as large as the window's framebuffer, so a capture of it reads as many pixels as the window has
+        int width = Width, height = Height;
+        if (Window)
+            glfwGetFramebufferSize(Window, &width, &height);
+        if (!Target.Create(width, height, GL_DEPTH_COMPONENT32F))
+            return false;
+        Target.Bind();
+        clipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+        glDepthFunc(GL_GREATER);
+        glClearDepth(0.0);
+        return true;
+    }
+
+    // seconds since the context was created, glfwGetTime() when there is a window
+    double Time() const
+    {
+        if (!Headless())
+            return glfwGetTime();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // a headless context never closes by itself, the caller decides how many frames to render
+    bool ShouldClose() const
+    {
+        return !Headless() && glfwWindowShouldClose(Window);
+    }
+
+    // swaps buffers and polls events when there is a window; offscreen frames only need to be submitted
+    void Present()
+    {
+        if (!Headless())
+        {
+            if (Target.FBO)
+            {
+                // the frame was drawn offscreen (see EnableReversedZ()), scale it onto the window
+                int width, height;
+                glfwGetFramebufferSize(Window, &width, &height);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, Target.FBO);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+                glBlitFramebuffer(0, 0, Target.Width, Target.Height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+            }
+            glfwSwapBuffers(Window);
+            glfwPollEvents();
+            // after polling, so a resize callback's glViewport doesn't stick to the fixed size target
+            if (Target.FBO)
+                Target.Bind();
+        }
+        else
+            glFlush();
+    }
+
+    void Destroy()
+    {
+        if (Target.FBO)
+            Target.Destroy();
+#ifdef HEADLESS_EGL
+        if (eglContext != EGL_NO_CONTEXT)
+        {
+            eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(eglDisplay, eglContext);
+            eglTerminate(eglDisplay);
+            eglContext = EGL_NO_CONTEXT;
+        }
+#endif
+#ifdef HEADLESS_OSMESA
+        if (osmesaContext)
+        {
+            OSMesaDestroyContext(osmesaContext);
+            osmesaContext = nullptr;
+        }
+#endif
+        if (Window)
+        {
+            glfwTerminate();
+            Window = nullptr;
+        }
+    }
+
+    // loader handed to glad, resolves through whichever backend created the current context
+    static void* GetProcAddress(const char* name)
+    {
+#ifdef HEADLESS_EGL
+        if (current() == BACKEND_EGL)
+            return (void*)eglGetProcAddress(name);
+#endif
+#ifdef HEADLESS_OSMESA
+        if (current() == BACKEND_OSMESA)
+            return (void*)OSMesaGetProcAddress(name);
+#endif
+        return (void*)glfwGetProcAddress(name);
+    }
+
+    // whether the current context exposes an extension
+    static bool HasExtension(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (extension && std::strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+
+private:
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#ifdef HEADLESS_EGL
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    EGLContext eglContext = EGL_NO_CONTEXT;
+#endif
+#ifdef HEADLESS_OSMESA
+    OSMesaContext osmesaContext = nullptr;
+    std::vector<unsigned char> osmesaBuffer;
+#endif
+
+    static Backend& current()
+    {
+        static Backend backend = BACKEND_GLFW;
+        return backend;
+    }
+
+    bool createGLFW(const char* title)
+    {
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+        // glfw window creation
+        // --------------------
+        Window = glfwCreateWindow(Width, Height, title, NULL, NULL);
+        if (Window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return false;
+        }
+        glfwMakeContextCurrent(Window);
+        return true;
+    }
+
+    bool createEGL()
+    {
+#ifdef HEADLESS_EGL
+        // the surfaceless platform needs no window system; the context is made current without any surface and draws into the FBO
+        const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (!extensions || !std::strstr(extensions, "EGL_MESA_platform_surfaceless"))
+        {
+            std::cout << "Failed to create EGL context: EGL_MESA_platform_surfaceless is not supported" << std::endl;
+            return false;
+        }
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        EGLint major, minor;
+        if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+        {
+            std::cout << "Failed to initialize the surfaceless EGL display" << std::endl;
+            return false;
+        }
+        // EGL_SURFACE_TYPE defaults to EGL_WINDOW_BIT, which the surfaceless platform never offers
+        const EGLint configAttributes[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configs = 0;
+        if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configs) || configs == 0)
+        {
+            std::cout << "Failed to find an EGL config for desktop OpenGL" << std::endl;
+            return false;
+        }
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+        if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext))
+        {
+            std::cout << "Failed to create EGL context (error 0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+            return false;
+        }
+        return true;
+#else
+        std::cout << "Failed to create EGL context: built without HEADLESS_EGL" << std::endl;
+        return false;
+#endif
+    }
+
+    bool createOSMesa()
+    {
+#ifdef HEADLESS_OSMESA
+        // OSMesa renders on the CPU into memory we own; it is only the default framebuffer, drawing still goes to the FBO
+        const int attributes[] = {
+            OSMESA_FORMAT, OSMESA_RGBA,
+            OSMESA_DEPTH_BITS, 24,
+            OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+            OSMESA_CONTEXT_MAJOR_VERSION, 3,
+            OSMESA_CONTEXT_MINOR_VERSION, 3,
+            0
+        };
+        osmesaContext = OSMesaCreateContextAttribs(attributes, NULL);
+        if (!osmesaContext)
+        {
+            std::cout << "Failed to create OSMesa context" << std::endl;
+            return false;
+        }
+        osmesaBuffer.resize((std::size_t)Width * Height * 4);
+        if (!OSMesaMakeCurrent(osmesaContext, osmesaBuffer.data(), GL_UNSIGNED_BYTE, Width, Height))
+        {
+            std::cout << "Failed to make the OSMesa context current" << std::endl;
+            return false;
+        }
+        return true;
+#else
+        std::cout << "Failed to create OSMesa context: built without HEADLESS_OSMESA" << std::endl;
+        return false;
+#endif
+    }
+};
+#endif
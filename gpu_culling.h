@@ -0,0 +1,771 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <depth_pyramid.h>
+#include <frustum.h>
+#include <gl_context.h>
+#include <mesh_lod.h>
+#include <shader_program.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// GL 4.3 and GL_ARB_indirect_parameters names the 3.3 core headers don't have
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_PARAMETER_BUFFER_ARB
+#define GL_PARAMETER_BUFFER_ARB 0x80EE
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+
+// the layout glMultiDrawElementsIndirect reads
+struct DrawElementsIndirectCommand
+{
+    unsigned int Count;
+    unsigned int InstanceCount;
+    unsigned int FirstIndex;
+    int BaseVertex;
+    unsigned int BaseInstance;
+};
+
+struct GpuCullStats
+{
+    unsigned long long Frames = 0;
+    unsigned long long GpuFrames = 0;   // culled by the compute passes, whose results stay on the GPU
+    unsigned long long Tested = 0;      // the counts below are the CPU reference's
+    unsigned long long FrustumCulled = 0;
+    unsigned long long Occluded = 0;
+    unsigned long long Visible = 0;
+    unsigned long long Draws = 0;
+    double CullMs = 0.0;                // CPU time spent in Cull()
+};
+
+// Culls instances of a few meshes that share one vertex and one element buffer, and turns what is left into indirect
+// draw commands. Each instance is a bounding sphere and a model matrix; it is tested against the view frustum and the
+// Hi-Z pyramid of an earlier frame, picks a level of its mesh's LOD chain the same way LodSelector does (without the
+// cross-fades, the GPU keeps no state per instance), and its index is appended to the list of its (mesh, level) draw.
+//
+// With a GL 4.3 context the whole thing runs in two compute passes: the first tests every instance and appends it to
+// its draw's list with an atomic counter, the second compacts the non-empty draws into DrawElementsIndirectCommands
+// and a draw count that glMultiDrawElementsIndirectCount (GL_ARB_indirect_parameters) consumes, so the CPU cost of a
+// frame is a few uniforms and three calls whatever the number of instances. Without compute shaders the same culling
+// runs on the CPU (CullReference()), its lists are uploaded and every command is drawn with
+// glDrawElementsInstancedBaseVertex. Either way the vertex shader finds its instance through the INSTANCE_ATTRIBUTE
+// attribute, a per-instance index into the model matrices, see ShaderSource().
+class GpuCuller
+{
+public:
+    static const unsigned int INSTANCE_ATTRIBUTE = 3;
+    // after the cluster, G-buffer and shadow units
+    static const int MODEL_UNIT = 8;
+    static const int HIZ_UNIT = 9;
+
+    float LodThreshold = 1.0f;  // pixels, as LodSelector::Threshold
+
+    ~GpuCuller()
+    {
+        if (buffers[0])
+        {
+            glDeleteBuffers(BUFFER_COUNT, buffers);
+            glDeleteTextures(1, &modelTexture);
+        }
+    }
+
+    // gpu = false keeps to the CPU path even when the context could cull on the GPU
+    void Create(bool gpu = true)
+    {
+        gpuPath = gpu && loadFunctions();
+        glGenBuffers(BUFFER_COUNT, buffers);
+        glGenTextures(1, &modelTexture);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[BUFFER_MODELS]);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, modelTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffers[BUFFER_MODELS]);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        if (gpuPath)
+        {
+            std::string common = std::string("#version 430 core\n") + bufferSource();
+            gpuPath = cullProgram.BuildCompute(common + cullSource()) && commandProgram.BuildCompute(common + commandSource());
+        }
+    }
+
+    // whether culling runs in the compute passes
+    bool Gpu() const
+    {
+        return gpuPath;
+    }
+
+    // a mesh in the shared buffers: its LOD chain, whose indices start at firstIndex of the element buffer and have
+    // baseVertex added, and the radius of its bounding sphere around the origin. Returns the mesh's ID
+    unsigned int AddMesh(const std::vector<LodLevel>& levels, unsigned int firstIndex, int baseVertex, float radius)
+    {
+        MeshInfo mesh = { (unsigned int)draws.size(), (unsigned int)levels.size(), 0, 0 };
+        for (const LodLevel& level : levels)
+        {
+            DrawInfo draw = { level.Count, firstIndex + level.First, baseVertex, 0, level.Error, (unsigned int)meshes.size(), 0, 0 };
+            draws.push_back(draw);
+        }
+        meshes.push_back(mesh);
+        radii.push_back(radius);
+        layoutDirty = true;
+        return (unsigned int)meshes.size() - 1;
+    }
+
+    // model must scale uniformly; returns the instance's index
+    unsigned int Add(unsigned int mesh, const glm::mat4& model)
+    {
+        instances.push_back(InstanceInfo());
+        models.push_back(model);
+        instances.back().Mesh = mesh;
+        Set((unsigned int)instances.size() - 1, model);
+        layoutDirty = true;
+        return (unsigned int)instances.size() - 1;
+    }
+
+    void Set(unsigned int instance, const glm::mat4& model)
+    {
+        InstanceInfo& info = instances[instance];
+        float scale = glm::length(glm::vec3(model[0]));
+        info.Sphere[0] = model[3][0];
+        info.Sphere[1] = model[3][1];
+        info.Sphere[2] = model[3][2];
+        info.Sphere[3] = radii[info.Mesh] * scale;
+        info.Scale = scale;
+        models[instance] = model;
+        dirtyBegin = std::min(dirtyBegin, instance);
+        dirtyEnd = std::max(dirtyEnd, instance + 1);
+    }
+
+    unsigned int Size() const
+    {
+        return (unsigned int)instances.size();
+    }
+
+    // points INSTANCE_ATTRIBUTE of a VAO that draws from the shared buffers at the visible instance lists
+    void Attach(unsigned int vao) const
+    {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[BUFFER_VISIBLE]);
+        glVertexAttribIPointer(INSTANCE_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void*)0);
+        glVertexAttribDivisor(INSTANCE_ATTRIBUTE, 1);
+        glEnableVertexAttribArray(INSTANCE_ATTRIBUTE);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // culls every instance against the view and, when given, an earlier frame's depth pyramid, and builds the draws.
+    // fovY (radians) and viewportHeight (pixels) are the projection's, for the LOD pick
+    void Cull(const glm::mat4& viewProjection, const glm::vec3& eye, float fovY, float viewportHeight, const HiZPyramid* hiZ = nullptr,
+              DepthConvention depth = DEPTH_STANDARD)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        upload();
+        last = { viewProjection, eye, viewportHeight / (2.0f * std::tan(fovY * 0.5f)), depth, hiZ };
+        if (gpuPath)
+        {
+            cullGpu();
+            stats.GpuFrames++;
+        }
+        else
+        {
+            CullReference(viewProjection, eye, fovY, viewportHeight, commands, visible, hiZ, depth, &stats);
+            if (!visible.empty())
+            {
+                glBindBuffer(GL_ARRAY_BUFFER, buffers[BUFFER_VISIBLE]);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, visible.size() * sizeof(unsigned int), visible.data());
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+            }
+        }
+        stats.Frames++;
+        stats.CullMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // the model matrices for instanceModel()
+    template <typename ShaderType>
+    void Bind(const ShaderType& shader) const
+    {
+        glActiveTexture(GL_TEXTURE0 + MODEL_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, modelTexture);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("instanceModels", MODEL_UNIT);
+    }
+
+    // draws what the last Cull() left with the VAO given to Attach()
+    void Draw(unsigned int vao) const
+    {
+        glBindVertexArray(vao);
+        if (gpuPath)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffers[BUFFER_COMMANDS]);
+            if (multiDrawCount)
+            {
+                glBindBuffer(GL_PARAMETER_BUFFER_ARB, buffers[BUFFER_DRAW_COUNT]);
+                multiDrawCount(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, 0, (GLsizei)draws.size(), 0);
+                glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+            }
+            else
+                multiDraw(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, (GLsizei)draws.size(), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        else
+        {
+            // GL 3.3 has no base instance, the instance attribute is pointed at each command's list instead
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[BUFFER_VISIBLE]);
+            for (const DrawElementsIndirectCommand& command : commands)
+            {
+                glVertexAttribIPointer(INSTANCE_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void*)(command.BaseInstance * sizeof(unsigned int)));
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.Count, GL_UNSIGNED_INT, (void*)(command.FirstIndex * sizeof(unsigned int)),
+                                                  command.InstanceCount, command.BaseVertex);
+            }
+            glVertexAttribIPointer(INSTANCE_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void*)0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        glBindVertexArray(0);
+    }
+
+    // The CPU reference of the compute passes, also the path without them: the same tests and LOD pick, the non-empty
+    // draws' commands in draw order and their instances in index order, packed one list after the other. hiZ is used
+    // through its CPU copy
+    void CullReference(const glm::mat4& viewProjection, const glm::vec3& eye, float fovY, float viewportHeight, std::vector<DrawElementsIndirectCommand>& outCommands,
+                       std::vector<unsigned int>& outVisible, const HiZPyramid* hiZ = nullptr, DepthConvention depth = DEPTH_STANDARD,
+                       GpuCullStats* outStats = nullptr) const
+    {
+        cullReference(viewProjection, eye, viewportHeight / (2.0f * std::tan(fovY * 0.5f)), outCommands, outVisible, hiZ, depth, outStats);
+    }
+
+    // Reads the compute passes' results of the last Cull() back (a stall, for checking only) and returns how many
+    // instances they drew, or left out, differently from CullReference(). Exact when the pyramid's CPU copy has every level;
+    // with a coarser copy the reference culls less, and a pyramid without one is read back whole
+    unsigned int Validate() const
+    {
+        if (!gpuPath)
+            return 0;
+        HiZPyramid readHiZ;
+        const HiZPyramid* hiZ = last.HiZ;
+        if (hiZ && hiZ->Texture && hiZ->CpuLevels.empty())
+        {
+            readHiZ = *hiZ;
+            DepthPyramid::ReadTexture(readHiZ);
+            hiZ = &readHiZ;
+        }
+        std::vector<DrawElementsIndirectCommand> reference;
+        std::vector<unsigned int> referenceVisible;
+        cullReference(last.ViewProjection, last.Eye, last.PixelsPerUnit, reference, referenceVisible, hiZ, last.Depth, nullptr);
+
+        std::vector<DrawElementsIndirectCommand> gpuCommands(draws.size());
+        std::vector<unsigned int> gpuVisible(visibleCapacity);
+        unsigned int drawCount = (unsigned int)draws.size();
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[BUFFER_COMMANDS]);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, gpuCommands.size() * sizeof(DrawElementsIndirectCommand), gpuCommands.data());
+        if (multiDrawCount)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[BUFFER_DRAW_COUNT]);
+            glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(unsigned int), &drawCount);
+        }
+        if (!gpuVisible.empty())
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[BUFFER_VISIBLE]);
+            glGetBufferSubData(GL_ARRAY_BUFFER, 0, gpuVisible.size() * sizeof(unsigned int), gpuVisible.data());
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // the instances of every draw, keyed by where the draw's indices start; the GPU's come in any order
+        std::map<unsigned long long, std::vector<unsigned int>> expected, found;
+        for (const DrawElementsIndirectCommand& command : reference)
+            expected[key(command)].assign(referenceVisible.begin() + command.BaseInstance, referenceVisible.begin() + command.BaseInstance + command.InstanceCount);
+        for (unsigned int c = 0; c < drawCount && c < gpuCommands.size(); c++)
+        {
+            const DrawElementsIndirectCommand& command = gpuCommands[c];
+            if (command.InstanceCount == 0)
+                continue;
+            std::vector<unsigned int>& list = found[key(command)];
+            list.assign(gpuVisible.begin() + command.BaseInstance, gpuVisible.begin() + command.BaseInstance + command.InstanceCount);
+            std::sort(list.begin(), list.end());
+        }
+        unsigned int differences = 0;
+        for (unsigned int pass = 0; pass < 2; pass++)
+        {
+            const std::map<unsigned long long, std::vector<unsigned int>>& from = pass == 0 ? expected : found;
+            const std::map<unsigned long long, std::vector<unsigned int>>& to = pass == 0 ? found : expected;
+            for (const auto& draw : from)
+            {
+                auto other = to.find(draw.first);
+                for (unsigned int instance : draw.second)
+                    if (other == to.end() || !std::binary_search(other->second.begin(), other->second.end(), instance))
+                        differences++;
+            }
+        }
+        return differences;
+    }
+
+    GpuCullStats Stats() const
+    {
+        return stats;
+    }
+
+    // GLSL after the #version line of a vertex shader drawn through Draw(): instanceModel() is the model matrix of the
+    // instance being drawn
+    static const char* ShaderSource()
+    {
+        return R"(
+layout (location = 3) in uint aInstance;
+
+uniform samplerBuffer instanceModels;
+
+mat4 instanceModel()
+{
+    int base = int(aInstance) * 4;
+    return mat4(texelFetch(instanceModels, base), texelFetch(instanceModels, base + 1), texelFetch(instanceModels, base + 2),
+                texelFetch(instanceModels, base + 3));
+}
+)";
+    }
+
+private:
+    enum { BUFFER_INSTANCES, BUFFER_MODELS, BUFFER_MESHES, BUFFER_DRAWS, BUFFER_COUNTS, BUFFER_VISIBLE, BUFFER_COMMANDS, BUFFER_DRAW_COUNT, BUFFER_COUNT };
+
+    // the std430 layouts of bufferSource()
+    struct InstanceInfo
+    {
+        float Sphere[4];    // world space center and radius
+        unsigned int Mesh;
+        float Scale;
+        unsigned int Pad[2];
+    };
+    struct MeshInfo
+    {
+        unsigned int FirstDraw;
+        unsigned int Levels;
+        unsigned int Pad[2];
+    };
+    struct DrawInfo
+    {
+        unsigned int Count;
+        unsigned int FirstIndex;
+        int BaseVertex;
+        unsigned int BaseInstance;  // where the draw's list starts in the visible instances; room for every instance of the mesh
+        float Error;
+        unsigned int Mesh;
+        unsigned int Pad[2];
+    };
+    // what the last Cull() was given, for Validate()
+    struct CullInput
+    {
+        glm::mat4 ViewProjection;
+        glm::vec3 Eye;
+        float PixelsPerUnit;
+        DepthConvention Depth;
+        const HiZPyramid* HiZ;
+    };
+
+    typedef void (APIENTRY* DispatchComputeFunction)(GLuint x, GLuint y, GLuint z);
+    typedef void (APIENTRY* MemoryBarrierFunction)(GLbitfield barriers);
+    typedef void (APIENTRY* MultiDrawFunction)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+    typedef void (APIENTRY* MultiDrawCountFunction)(GLenum mode, GLenum type, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride);
+
+    static const unsigned int GROUP_SIZE = 64;
+
+    bool gpuPath = false;
+    DispatchComputeFunction dispatchCompute = nullptr;
+    MemoryBarrierFunction memoryBarrier = nullptr;
+    MultiDrawFunction multiDraw = nullptr;
+    MultiDrawCountFunction multiDrawCount = nullptr;
+    ShaderProgram cullProgram, commandProgram;
+
+    unsigned int buffers[BUFFER_COUNT] = {};
+    unsigned int modelTexture = 0;
+    std::vector<MeshInfo> meshes;
+    std::vector<float> radii;
+    std::vector<DrawInfo> draws;
+    std::vector<InstanceInfo> instances;
+    std::vector<glm::mat4> models;
+    bool layoutDirty = false;
+    unsigned int dirtyBegin = ~0u, dirtyEnd = 0;
+    unsigned int visibleCapacity = 0;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<unsigned int> visible;
+    CullInput last = {};
+    GpuCullStats stats;
+
+    // CullReference() with the projection's pixels per unit at distance 1
+    void cullReference(const glm::mat4& viewProjection, const glm::vec3& eye, float pixelsPerUnit, std::vector<DrawElementsIndirectCommand>& outCommands,
+                       std::vector<unsigned int>& outVisible, const HiZPyramid* hiZ, DepthConvention depth, GpuCullStats* outStats) const
+    {
+        Frustum frustum(viewProjection, depth);
+        bool occlusion = hiZ && !hiZ->CpuLevels.empty();
+        std::vector<std::vector<unsigned int>> lists(draws.size());
+        for (unsigned int i = 0; i < instances.size(); i++)
+        {
+            const InstanceInfo& instance = instances[i];
+            BoundingSphere sphere;
+            sphere.Center = glm::vec3(instance.Sphere[0], instance.Sphere[1], instance.Sphere[2]);
+            sphere.Radius = instance.Sphere[3];
+            if (!frustum.Intersects(sphere))
+            {
+                if (outStats)
+                    outStats->FrustumCulled++;
+                continue;
+            }
+            if (occlusion && occluded(sphere, *hiZ))
+            {
+                if (outStats)
+                    outStats->Occluded++;
+                continue;
+            }
+            lists[drawFor(instance, sphere, eye, pixelsPerUnit)].push_back(i);
+        }
+
+        outCommands.clear();
+        outVisible.clear();
+        for (unsigned int d = 0; d < draws.size(); d++)
+        {
+            if (lists[d].empty())
+                continue;
+            DrawElementsIndirectCommand command = { draws[d].Count, (unsigned int)lists[d].size(), draws[d].FirstIndex, draws[d].BaseVertex,
+                                                    (unsigned int)outVisible.size() };
+            outCommands.push_back(command);
+            outVisible.insert(outVisible.end(), lists[d].begin(), lists[d].end());
+        }
+        if (outStats)
+        {
+            outStats->Tested += instances.size();
+            outStats->Visible += outVisible.size();
+            outStats->Draws += outCommands.size();
+        }
+    }
+
+    bool loadFunctions()
+    {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        int version = major * 10 + minor;
+        if (version < 43)
+        {
+            std::cout << "GPU culling needs GL 4.3 compute shaders, culling on the CPU" << std::endl;
+            return false;
+        }
+        dispatchCompute = (DispatchComputeFunction)GLContext::GetProcAddress("glDispatchCompute");
+        memoryBarrier = (MemoryBarrierFunction)GLContext::GetProcAddress("glMemoryBarrier");
+        multiDraw = (MultiDrawFunction)GLContext::GetProcAddress("glMultiDrawElementsIndirect");
+        // without a draw count read by the GPU, every draw is submitted and the empty ones have no instances
+        if (version >= 46)
+            multiDrawCount = (MultiDrawCountFunction)GLContext::GetProcAddress("glMultiDrawElementsIndirectCount");
+        else if (GLContext::HasExtension("GL_ARB_indirect_parameters"))
+            multiDrawCount = (MultiDrawCountFunction)GLContext::GetProcAddress("glMultiDrawElementsIndirectCountARB");
+        return dispatchCompute && memoryBarrier && multiDraw;
+    }
+
+    // sends what changed since the last frame: the draw layout after meshes or instances were added, and the moved instances
+    void upload()
+    {
+        if (layoutDirty)
+        {
+            // every draw gets room for all the instances of its mesh, any of them may pick its level
+            std::vector<unsigned int> perMesh(meshes.size(), 0);
+            for (const InstanceInfo& instance : instances)
+                perMesh[instance.Mesh]++;
+            visibleCapacity = 0;
+            for (DrawInfo& draw : draws)
+            {
+                draw.BaseInstance = visibleCapacity;
+                visibleCapacity += perMesh[draw.Mesh];
+            }
+            std::vector<unsigned int> zeros(std::max<size_t>(draws.size() * 5, 1), 0);
+            bufferData(BUFFER_VISIBLE, std::max(visibleCapacity, 1u) * sizeof(unsigned int), NULL);
+            bufferData(BUFFER_INSTANCES, instances.size() * sizeof(InstanceInfo), instances.data());
+            bufferData(BUFFER_MODELS, models.size() * sizeof(glm::mat4), models.data());
+            if (gpuPath)
+            {
+                bufferData(BUFFER_MESHES, meshes.size() * sizeof(MeshInfo), meshes.data());
+                bufferData(BUFFER_DRAWS, draws.size() * sizeof(DrawInfo), draws.data());
+                bufferData(BUFFER_COUNTS, draws.size() * sizeof(unsigned int), zeros.data());
+                bufferData(BUFFER_COMMANDS, draws.size() * sizeof(DrawElementsIndirectCommand), zeros.data());
+                bufferData(BUFFER_DRAW_COUNT, sizeof(unsigned int), zeros.data());
+            }
+            layoutDirty = false;
+        }
+        else if (dirtyBegin < dirtyEnd)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[BUFFER_INSTANCES]);
+            glBufferSubData(GL_ARRAY_BUFFER, dirtyBegin * sizeof(InstanceInfo), (dirtyEnd - dirtyBegin) * sizeof(InstanceInfo), &instances[dirtyBegin]);
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[BUFFER_MODELS]);
+            glBufferSubData(GL_ARRAY_BUFFER, dirtyBegin * sizeof(glm::mat4), (dirtyEnd - dirtyBegin) * sizeof(glm::mat4), &models[dirtyBegin]);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        dirtyBegin = ~0u;
+        dirtyEnd = 0;
+    }
+
+    void bufferData(int buffer, size_t size, const void* data)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[buffer]);
+        glBufferData(GL_ARRAY_BUFFER, std::max<size_t>(size, 4), data, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void cullGpu()
+    {
+        const int bindings[] = { BUFFER_INSTANCES, BUFFER_MESHES, BUFFER_DRAWS, BUFFER_COUNTS, BUFFER_VISIBLE, BUFFER_DRAW_COUNT, BUFFER_COMMANDS };
+        for (unsigned int b = 0; b < sizeof(bindings) / sizeof(bindings[0]); b++)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, b, buffers[bindings[b]]);
+
+        Frustum frustum(last.ViewProjection, last.Depth);
+        const HiZPyramid* hiZ = last.HiZ && last.HiZ->Texture ? last.HiZ : nullptr;
+        cullProgram.use();
+        cullProgram.setInt("instanceCount", (int)instances.size());
+        glUniform4fv(glGetUniformLocation(cullProgram.ID, "planes"), 6, &frustum.Planes[0][0]);
+        cullProgram.setVec3("eye", last.Eye);
+        cullProgram.setFloat("pixelsPerUnit", last.PixelsPerUnit);
+        cullProgram.setFloat("lodThreshold", LodThreshold);
+        cullProgram.setInt("occlusion", hiZ != nullptr);
+        if (hiZ)
+        {
+            glActiveTexture(GL_TEXTURE0 + HIZ_UNIT);
+            glBindTexture(GL_TEXTURE_2D, hiZ->Texture);
+            glActiveTexture(GL_TEXTURE0);
+            cullProgram.setInt("hiZ", HIZ_UNIT);
+            cullProgram.setInt("hiZLevels", (int)hiZ->Levels());
+            cullProgram.setMat4("hiZViewProjection", hiZ->ViewProjection);
+            cullProgram.setInt("reversedZ", hiZ->Depth == DEPTH_REVERSED_Z);
+        }
+        // cleared from the CPU: with no instances the dispatch has no invocation that could do it
+        const unsigned int zero = 0;
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[BUFFER_DRAW_COUNT]);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(unsigned int), &zero);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        dispatchCompute(((unsigned int)instances.size() + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+        memoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        commandProgram.use();
+        commandProgram.setInt("drawTotal", (int)draws.size());
+        commandProgram.setInt("compact", multiDrawCount != nullptr);
+        dispatchCompute(((unsigned int)draws.size() + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+        // the draws read the commands and lists, Validate() reads them back with glGetBufferSubData
+        memoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        glUseProgram(0);
+    }
+
+    unsigned int drawFor(const InstanceInfo& instance, const BoundingSphere& sphere, const glm::vec3& eye, float pixelsPerUnit) const
+    {
+        const MeshInfo& mesh = meshes[instance.Mesh];
+        float nearest = std::max(glm::length(sphere.Center - eye) - sphere.Radius, 0.01f);
+        float pixels = pixelsPerUnit * instance.Scale / nearest;
+        unsigned int level = 0;
+        while (level + 1 < mesh.Levels && draws[mesh.FirstDraw + level + 1].Error * pixels <= LodThreshold)
+            level++;
+        return mesh.FirstDraw + level;
+    }
+
+    // whether the sphere is behind the pyramid's depth: the box around it is projected with the pyramid's view and its
+    // nearest depth compared with the farthest depth of the (at most 2x2) texels of the first level its rectangle fits
+    static bool occluded(const BoundingSphere& sphere, const HiZPyramid& hiZ)
+    {
+        bool reversed = hiZ.Depth == DEPTH_REVERSED_Z;
+        glm::vec2 low(1e30f), high(-1e30f);
+        float nearest = reversed ? 0.0f : 1.0f;
+        for (int c = 0; c < 8; c++)
+        {
+            glm::vec3 corner = sphere.Center + sphere.Radius * glm::vec3(c & 1 ? 1.0f : -1.0f, c & 2 ? 1.0f : -1.0f, c & 4 ? 1.0f : -1.0f);
+            glm::vec4 clip = hiZ.ViewProjection * glm::vec4(corner, 1.0f);
+            if (clip.w <= 1e-5f)
+                return false;   // reaches behind the camera
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            low = glm::min(low, glm::vec2(ndc.x, ndc.y));
+            high = glm::max(high, glm::vec2(ndc.x, ndc.y));
+            float depth = reversed ? ndc.z : ndc.z * 0.5f + 0.5f;
+            nearest = reversed ? std::max(nearest, depth) : std::min(nearest, depth);
+        }
+        // only what the pyramid saw all of can be occluded
+        if (low.x < -1.0f || low.y < -1.0f || high.x > 1.0f || high.y > 1.0f || (reversed ? nearest > 1.0f : nearest < 0.0f))
+            return false;
+
+        int width = (int)hiZ.Widths[0], height = (int)hiZ.Heights[0];
+        int x0 = std::min((int)((low.x * 0.5f + 0.5f) * width), width - 1), y0 = std::min((int)((low.y * 0.5f + 0.5f) * height), height - 1);
+        int x1 = std::min((int)((high.x * 0.5f + 0.5f) * width), width - 1), y1 = std::min((int)((high.y * 0.5f + 0.5f) * height), height - 1);
+        int level = (int)hiZ.CpuFirstLevel;
+        while (level + 1 < (int)hiZ.Levels() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+            level++;
+        int levelWidth = (int)hiZ.Widths[level], levelHeight = (int)hiZ.Heights[level];
+        const std::vector<float>& texels = hiZ.CpuLevels[level - hiZ.CpuFirstLevel];
+        float farthest = reversed ? 1.0f : 0.0f;
+        for (int y = std::min(y0 >> level, levelHeight - 1); y <= std::min(y1 >> level, levelHeight - 1); y++)
+            for (int x = std::min(x0 >> level, levelWidth - 1); x <= std::min(x1 >> level, levelWidth - 1); x++)
+            {
+                const float* minMax = &texels[(y * levelWidth + x) * 2];
+                farthest = reversed ? std::min(farthest, minMax[0]) : std::max(farthest, minMax[1]);
+            }
+        return reversed ? nearest < farthest : nearest > farthest;
+    }
+
+    static unsigned long long key(const DrawElementsIndirectCommand& command)
+    {
+        return (unsigned long long)command.FirstIndex << 32 | (unsigned int)command.BaseVertex;
+    }
+
+    // buffers of both passes, matching InstanceInfo, MeshInfo and DrawInfo
+    static const char* bufferSource()
+    {
+        return R"(
+layout (local_size_x = 64) in;
+
+struct Instance
+{
+    vec4 Sphere;
+    uint Mesh;
+    float Scale;
+    uint Pad0, Pad1;
+};
+
+struct Draw
+{
+    uint Count;
+    uint FirstIndex;
+    int BaseVertex;
+    uint BaseInstance;
+    float Error;
+    uint Mesh;
+    uint Pad0, Pad1;
+};
+
+layout (std430, binding = 0) readonly buffer Instances { Instance instances[]; };
+layout (std430, binding = 1) readonly buffer Meshes { uvec4 meshes[]; };   // first draw, levels
+layout (std430, binding = 2) readonly buffer Draws { Draw draws[]; };
+layout (std430, binding = 3) buffer Counts { uint counts[]; };
+layout (std430, binding = 4) buffer Visible { uint visible[]; };
+layout (std430, binding = 5) buffer DrawCount { uint drawCount; };
+layout (std430, binding = 6) writeonly buffer Commands { uint commands[]; };
+)";
+    }
+
+    // one invocation per instance: the tests of CullReference(), then an atomic slot in the list of the picked draw
+    static const char* cullSource()
+    {
+        return R"(
+uniform int instanceCount;
+uniform vec4 planes[6];
+uniform vec3 eye;
+uniform float pixelsPerUnit;
+uniform float lodThreshold;
+uniform bool occlusion;
+uniform sampler2D hiZ;
+uniform int hiZLevels;
+uniform mat4 hiZViewProjection;
+uniform bool reversedZ;
+
+bool occluded(vec4 sphere)
+{
+    vec2 low = vec2(1e30), high = vec2(-1e30);
+    float nearest = reversedZ ? 0.0 : 1.0;
+    for (int c = 0; c < 8; c++)
+    {
+        vec3 corner = sphere.xyz + sphere.w * vec3((c & 1) != 0 ? 1.0 : -1.0, (c & 2) != 0 ? 1.0 : -1.0, (c & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = hiZViewProjection * vec4(corner, 1.0);
+        if (clip.w <= 1e-5)
+            return false;
+        vec3 ndc = clip.xyz / clip.w;
+        low = min(low, ndc.xy);
+        high = max(high, ndc.xy);
+        float depth = reversedZ ? ndc.z : ndc.z * 0.5 + 0.5;
+        nearest = reversedZ ? max(nearest, depth) : min(nearest, depth);
+    }
+    if (low.x < -1.0 || low.y < -1.0 || high.x > 1.0 || high.y > 1.0 || (reversedZ ? nearest > 1.0 : nearest < 0.0))
+        return false;
+
+    ivec2 size = textureSize(hiZ, 0);
+    ivec2 p0 = min(ivec2((low * 0.5 + 0.5) * vec2(size)), size - 1);
+    ivec2 p1 = min(ivec2((high * 0.5 + 0.5) * vec2(size)), size - 1);
+    int level = 0;
+    while (level + 1 < hiZLevels && any(greaterThan((p1 >> level) - (p0 >> level), ivec2(1))))
+        level++;
+    // the size of a level is worked out rather than queried, textureSize() with a level that differs between invocations
+    // only looks at the first one on some drivers (llvmpipe)
+    ivec2 levelSize = max(size >> level, ivec2(1));
+    ivec2 t0 = min(p0 >> level, levelSize - 1), t1 = min(p1 >> level, levelSize - 1);
+    float farthest = reversedZ ? 1.0 : 0.0;
+    for (int y = t0.y; y <= t1.y; y++)
+        for (int x = t0.x; x <= t1.x; x++)
+        {
+            vec2 minMax = texelFetch(hiZ, ivec2(x, y), level).rg;
+            farthest = reversedZ ? min(farthest, minMax.r) : max(farthest, minMax.g);
+        }
+    return reversedZ ? nearest < farthest : nearest > farthest;
+}
+
+void main()
+{
+    int i = int(gl_GlobalInvocationID.x);
+    if (i >= instanceCount)
+        return;
+    Instance instance = instances[i];
+    for (int p = 0; p < 6; p++)
+        if (dot(planes[p].xyz, instance.Sphere.xyz) + planes[p].w < -instance.Sphere.w)
+            return;
+    if (occlusion && occluded(instance.Sphere))
+        return;
+
+    uvec4 mesh = meshes[instance.Mesh];
+    float nearest = max(length(instance.Sphere.xyz - eye) - instance.Sphere.w, 0.01);
+    float pixels = pixelsPerUnit * instance.Scale / nearest;
+    uint level = 0u;
+    while (level + 1u < mesh.y && draws[mesh.x + level + 1u].Error * pixels <= lodThreshold)
+        level++;
+    uint draw = mesh.x + level;
+    uint slot = atomicAdd(counts[draw], 1u);
+    visible[draws[draw].BaseInstance + slot] = uint(i);
+}
+)";
+    }
+
+    // one invocation per draw: non-empty draws get a command, packed with an atomic counter when the draw count is read
+    // by the GPU, in place otherwise; the counters are cleared for the next frame
+    static const char* commandSource()
+    {
+        return R"(
+uniform int drawTotal;
+uniform bool compact;
+
+void main()
+{
+    int d = int(gl_GlobalInvocationID.x);
+    if (d >= drawTotal)
+        return;
+    uint count = counts[d];
+    counts[d] = 0u;
+    if (compact && count == 0u)
+        return;
+    uint c = compact ? atomicAdd(drawCount, 1u) : uint(d);
+    commands[c * 5u] = draws[d].Count;
+    commands[c * 5u + 1u] = count;
+    commands[c * 5u + 2u] = draws[d].FirstIndex;
+    commands[c * 5u + 3u] = uint(draws[d].BaseVertex);
+    commands[c * 5u + 4u] = draws[d].BaseInstance;
+}
+)";
+    }
+};
+#endif
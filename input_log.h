@@ -0,0 +1,253 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Records the input a sample consumes (polled keys and mouse buttons, cursor and scroll callbacks) together with every
+// frame's deltaTime, and plays it back so that a camera path can be rerun exactly, e.g. for benchmarks.
+//
+// The log is a text file, one event per line, in the order the sample saw them:
+//   F <frame> <time> <deltaTime>    a frame starts
+//   K <frame> <time> <key> <action> a polled key changed state
+//   B <frame> <time> <button> <action> a polled mouse button changed state
+//   M <frame> <time> <x> <y>        cursor position callback
+//   S <frame> <time> <x> <y>        scroll callback
+//   L <frame> <time>                the frame latched its input (see Latch())
+// Times are seconds since recording started; numbers are written with enough digits to read back bit for bit.
+//
+// Usage: route GLFW callbacks through Cursor()/Scroll(), replace glfwGetKey/glfwGetMouseButton with GetKey/GetMouseButton,
+// take deltaTime from BeginFrame() and call EndFrame() right after glfwPollEvents().
+class InputLog
+{
+public:
+    enum Mode { MODE_LIVE, MODE_RECORD, MODE_REPLAY };
+
+    struct Event
+    {
+        char Type;
+        unsigned int Frame;
+        double Time;
+        int Code, Action;   // key or button events
+        double X, Y;        // cursor and scroll events
+        double DeltaTime;   // frame events
+    };
+
+    ~InputLog()
+    {
+        if (file)
+            std::fclose(file);
+    }
+
+    // --record=<file> or --replay=<file> [--timestep=<seconds>, a fixed deltaTime instead of the recorded one]
+    bool Open(int argc, char* argv[])
+    {
+        std::string record, replay;
+        for (int i = 1; i < argc; i++)
+        {
+            if (std::strncmp(argv[i], "--record=", 9) == 0)
+                record = argv[i] + 9;
+            else if (std::strncmp(argv[i], "--replay=", 9) == 0)
+                replay = argv[i] + 9;
+            else if (std::strncmp(argv[i], "--timestep=", 11) == 0)
+                timestep = std::atof(argv[i] + 11);
+        }
+        if (!replay.empty())
+            return Replay(replay);
+        if (!record.empty())
+            return Record(record);
+        return true;
+    }
+
+    bool Record(const std::string& path)
+    {
+        file = std::fopen(path.c_str(), "w");
+        if (!file)
+        {
+            std::cout << "Failed to open input log " << path << std::endl;
+            return false;
+        }
+        std::fprintf(file, "# input log\n");
+        mode = MODE_RECORD;
+        return true;
+    }
+
+    bool Replay(const std::string& path)
+    {
+        FILE* in = std::fopen(path.c_str(), "r");
+        if (!in)
+        {
+            std::cout << "Failed to open input log " << path << std::endl;
+            return false;
+        }
+        char line[256];
+        while (std::fgets(line, sizeof(line), in))
+        {
+            Event e = Event();
+            e.Type = line[0];
+            bool parsed = false;
+            if (e.Type == 'L')
+                parsed = std::sscanf(line + 1, "%u %lf", &e.Frame, &e.Time) == 2;
+            else if (e.Type == 'F')
+                parsed = std::sscanf(line + 1, "%u %lf %lf", &e.Frame, &e.Time, &e.DeltaTime) == 3;
+            else if (e.Type == 'K' || e.Type == 'B')
+                parsed = std::sscanf(line + 1, "%u %lf %d %d", &e.Frame, &e.Time, &e.Code, &e.Action) == 4;
+            else if (e.Type == 'M' || e.Type == 'S')
+                parsed = std::sscanf(line + 1, "%u %lf %lf %lf", &e.Frame, &e.Time, &e.X, &e.Y) == 4;
+            if (parsed)
+                events.push_back(e);
+        }
+        std::fclose(in);
+        mode = MODE_REPLAY;
+        return true;
+    }
+
+    Mode GetMode() const
+    {
+        return mode;
+    }
+
+    // the callbacks Cursor() and Scroll() forward to, live or replayed
+    void SetCallbacks(GLFWcursorposfun cursor, GLFWscrollfun scroll)
+    {
+        cursorCallback = cursor;
+        scrollCallback = scroll;
+    }
+
+    // starts a frame and returns the deltaTime to simulate it with: the live one, or the recorded (or fixed) one on replay
+    double BeginFrame(double liveDeltaTime)
+    {
+        if (mode == MODE_REPLAY)
+        {
+            // keys and buttons polled this frame take the state they had when it was recorded
+            if (next < events.size() && events[next].Type == 'F')
+                frameDeltaTime = events[next++].DeltaTime;
+            for (std::size_t i = next; i < events.size() && events[i].Type != 'F'; i++)
+            {
+                if (events[i].Type != 'K' && events[i].Type != 'B')
+                    continue;
+                std::vector<int>& state = events[i].Type == 'K' ? keys : buttons;
+                if (events[i].Code >= 0 && events[i].Code < (int)state.size())
+                    state[events[i].Code] = events[i].Action;
+            }
+            return timestep > 0.0 ? timestep : frameDeltaTime;
+        }
+        if (mode == MODE_RECORD)
+            std::fprintf(file, "F %u %.17g %.17g\n", frame, now(), liveDeltaTime);
+        return liveDeltaTime;
+    }
+
+    // late latch: call after polling events a second time mid-frame, right before the input is used (the view matrix
+    // is built); on replay the callbacks recorded up to this point of the frame fire here
+    void Latch(GLFWwindow* window)
+    {
+        if (mode == MODE_REPLAY)
+            fire(window, true);
+        else if (mode == MODE_RECORD)
+            std::fprintf(file, "L %u %.17g\n", frame, now());
+    }
+
+    // call right after glfwPollEvents(): on replay this is when the recorded callbacks of the frame fire
+    void EndFrame(GLFWwindow* window)
+    {
+        if (mode == MODE_REPLAY)
+            fire(window, false);
+        frame++;
+    }
+
+    // true once a replay has used up its log
+    bool Finished() const
+    {
+        return mode == MODE_REPLAY && next >= events.size();
+    }
+
+    unsigned int Frame() const
+    {
+        return frame;
+    }
+
+    int GetKey(GLFWwindow* window, int key)
+    {
+        return poll(window, key, 'K', keys);
+    }
+
+    int GetMouseButton(GLFWwindow* window, int button)
+    {
+        return poll(window, button, 'B', buttons);
+    }
+
+    // GLFW callback entry points, live events are ignored during a replay
+    void Cursor(GLFWwindow* window, double x, double y)
+    {
+        if (mode == MODE_REPLAY)
+            return;
+        if (mode == MODE_RECORD)
+            std::fprintf(file, "M %u %.17g %.17g %.17g\n", frame, now(), x, y);
+        if (cursorCallback)
+            cursorCallback(window, x, y);
+    }
+
+    void Scroll(GLFWwindow* window, double x, double y)
+    {
+        if (mode == MODE_REPLAY)
+            return;
+        if (mode == MODE_RECORD)
+            std::fprintf(file, "S %u %.17g %.17g %.17g\n", frame, now(), x, y);
+        if (scrollCallback)
+            scrollCallback(window, x, y);
+    }
+
+private:
+    Mode mode = MODE_LIVE;
+    FILE* file = nullptr;
+    std::vector<Event> events;
+    std::size_t next = 0;
+    unsigned int frame = 0;
+    double timestep = 0.0, frameDeltaTime = 0.0;
+    std::vector<int> keys = std::vector<int>(GLFW_KEY_LAST + 1, GLFW_RELEASE);
+    std::vector<int> buttons = std::vector<int>(GLFW_MOUSE_BUTTON_LAST + 1, GLFW_RELEASE);
+    GLFWcursorposfun cursorCallback = nullptr;
+    GLFWscrollfun scrollCallback = nullptr;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    double now() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // replays the frame's callbacks up to the next latch (or to the end of the frame)
+    void fire(GLFWwindow* window, bool toLatch)
+    {
+        while (next < events.size() && events[next].Type != 'F')
+        {
+            const Event& e = events[next++];
+            if (e.Type == 'L' && toLatch)
+                return;
+            if (e.Type == 'M' && cursorCallback)
+                cursorCallback(window, e.X, e.Y);
+            else if (e.Type == 'S' && scrollCallback)
+                scrollCallback(window, e.X, e.Y);
+        }
+    }
+
+    int poll(GLFWwindow* window, int code, char type, std::vector<int>& state)
+    {
+        if (code < 0 || code >= (int)state.size())
+            return GLFW_RELEASE;
+        if (mode == MODE_REPLAY || !window)
+            return state[code];
+        int action = type == 'K' ? glfwGetKey(window, code) : glfwGetMouseButton(window, code);
+        if (mode == MODE_RECORD && action != state[code])
+            std::fprintf(file, "%c %u %.17g %d %d\n", type, frame, now(), code, action);
+        state[code] = action;
+        return action;
+    }
+};
+#endif
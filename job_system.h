@@ -0,0 +1,246 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing job system for CPU side frame work (culling, transform updates, command recording).
+// Every worker owns a deque: it pushes and pops its own jobs at the back and steals from the front of the
+// others when it runs dry. Threads that are not workers (the GL context thread) share queue 0 and help out
+// while they Wait() on a counter, so OpenGL calls can stay on the context thread while the rest fans out.
+class JobSystem
+{
+public:
+    typedef std::function<void()> Work;
+
+    // counts the unfinished jobs signalling it; jobs started with RunAfter are held until it reaches zero
+    struct Counter
+    {
+        std::atomic<int> Pending{ 0 };
+        std::mutex Lock;
+        std::vector<std::pair<Work, Counter*>> Waiting;
+
+        bool Done() const
+        {
+            return Pending.load(std::memory_order_acquire) == 0;
+        }
+    };
+
+    // workers defaults to one less than the core count, the calling thread being the last core
+    explicit JobSystem(int workers = -1)
+    {
+        if (workers < 0)
+        {
+            unsigned int cores = std::thread::hardware_concurrency();
+            workers = cores > 1 ? (int)cores - 1 : 0;
+        }
+        queues = std::vector<Queue>(workers + 1);
+        for (int i = 0; i < workers; i++)
+            threads.emplace_back(&JobSystem::workerLoop, this, i + 1);
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // number of threads executing jobs, including the one calling Wait()
+    unsigned int ThreadCount() const
+    {
+        return (unsigned int)queues.size();
+    }
+
+    void Run(Work work, Counter* signal = nullptr)
+    {
+        if (signal)
+            signal->Pending.fetch_add(1, std::memory_order_relaxed);
+        push(std::move(work), signal);
+    }
+
+    // runs work once every job signalling dependency has finished
+    void RunAfter(Counter& dependency, Work work, Counter* signal = nullptr)
+    {
+        if (signal)
+            signal->Pending.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(dependency.Lock);
+            if (!dependency.Done())
+            {
+                dependency.Waiting.emplace_back(std::move(work), signal);
+                return;
+            }
+        }
+        push(std::move(work), signal);
+    }
+
+    // executes queued jobs on the calling thread until counter reaches zero
+    void Wait(Counter& counter)
+    {
+        while (!counter.Done())
+        {
+            if (!runOne(threadIndex()))
+                std::this_thread::yield();
+        }
+        // the job that finished last may still hold the lock, do not hand the counter back before it lets go
+        std::lock_guard<std::mutex> lock(counter.Lock);
+    }
+
+    // splits [0, count) in ranges of at most grain elements and calls fn(begin, end) for each of them in parallel
+    void ParallelFor(unsigned int count, unsigned int grain, const std::function<void(unsigned int, unsigned int)>& fn)
+    {
+        if (count == 0)
+            return;
+        if (grain == 0)
+            grain = 1;
+        if (count <= grain || queues.size() == 1)
+        {
+            fn(0, count);
+            return;
+        }
+        Counter counter;
+        for (unsigned int begin = 0; begin < count; begin += grain)
+        {
+            unsigned int end = begin + grain < count ? begin + grain : count;
+            Run([&fn, begin, end]() { fn(begin, end); }, &counter);
+        }
+        Wait(counter);
+    }
+
+private:
+    struct Job
+    {
+        Work Fn;
+        Counter* Signal = nullptr;
+    };
+
+    struct Queue
+    {
+        std::mutex Lock;
+        std::deque<Job> Jobs;
+    };
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> threads;
+    std::atomic<int> queued{ 0 };
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    // the job system a worker thread belongs to and its queue; a thread can only be a worker of one
+    struct Worker
+    {
+        const JobSystem* Owner = nullptr;
+        unsigned int Index = 0;
+    };
+
+    static Worker& currentWorker()
+    {
+        thread_local Worker worker;
+        return worker;
+    }
+
+    // the queue of the calling thread: its own for our workers, 0 for every other thread, workers of another job
+    // system waiting on one of our counters included
+    unsigned int threadIndex() const
+    {
+        const Worker& worker = currentWorker();
+        return worker.Owner == this ? worker.Index : 0;
+    }
+
+    void push(Work work, Counter* signal)
+    {
+        Queue& queue = queues[threadIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.Lock);
+            queue.Jobs.push_back(Job{ std::move(work), signal });
+        }
+        queued.fetch_add(1, std::memory_order_release);
+        {
+            // taking the lock orders this notify after a worker's predicate check, so the wake-up is not lost
+            std::lock_guard<std::mutex> lock(sleepLock);
+        }
+        wake.notify_one();
+    }
+
+    // pops from the back of our own deque, otherwise steals from the front of another one
+    bool pop(unsigned int self, Job& job)
+    {
+        {
+            Queue& own = queues[self];
+            std::lock_guard<std::mutex> lock(own.Lock);
+            if (!own.Jobs.empty())
+            {
+                job = std::move(own.Jobs.back());
+                own.Jobs.pop_back();
+                return true;
+            }
+        }
+        for (unsigned int k = 1; k < queues.size(); k++)
+        {
+            Queue& victim = queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.Lock);
+            if (!victim.Jobs.empty())
+            {
+                job = std::move(victim.Jobs.front());
+                victim.Jobs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool runOne(unsigned int self)
+    {
+        Job job;
+        if (!pop(self, job))
+            return false;
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        job.Fn();
+        if (job.Signal)
+            finish(*job.Signal);
+        return true;
+    }
+
+    // the last job of a counter releases everything waiting on it
+    void finish(Counter& counter)
+    {
+        std::vector<std::pair<Work, Counter*>> released;
+        {
+            std::lock_guard<std::mutex> lock(counter.Lock);
+            if (counter.Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                released.swap(counter.Waiting);
+        }
+        for (std::pair<Work, Counter*>& entry : released)
+            push(std::move(entry.first), entry.second);
+    }
+
+    void workerLoop(unsigned int index)
+    {
+        currentWorker().Owner = this;
+        currentWorker().Index = index;
+        while (true)
+        {
+            if (runOne(index))
+                continue;
+            std::unique_lock<std::mutex> lock(sleepLock);
+            wake.wait(lock, [this]() { return stopping || queued.load(std::memory_order_acquire) > 0; });
+            if (stopping)
+                return;
+        }
+    }
+};
+#endif
@@ -0,0 +1,202 @@
+#ifndef MATERIAL_LIBRARY_H
+#define MATERIAL_LIBRARY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// what a material looks like; the shader variant that draws it is kept next to it in the library
+struct MaterialParams
+{
+    glm::vec3 Color = glm::vec3(1.0f);
+    float Shininess = 32.0f;
+    int DiffuseLayer = -1;     // layer of a texture array, -1 for none
+    int SpecularLayer = -1;
+};
+
+struct MaterialStats
+{
+    unsigned int Materials = 0;
+    unsigned int Edits = 0;       // Edit() calls since Create()
+    unsigned int Uploads = 0;     // glBufferSubData calls
+    unsigned int BytesUploaded = 0;
+};
+
+// Material parameters for every material in one uniform buffer, indexed by material ID, so a draw only has to set
+// "materialIndex" and materials sharing a shader variant draw back to back without any other uniform changes.
+//
+// Add() and Edit() only change the CPU copy and mark the slot dirty; Upload() then writes each run of dirty slots
+// with one glBufferSubData, so editing one material sends its 32 bytes and nothing else. Shaders declare the buffer
+// with ShaderSource() and are connected to it once with Attach().
+class MaterialLibrary
+{
+public:
+    // a material is two vec4s, 32 bytes in std140; 16 KB, the smallest uniform block GL allows, would hold 512
+    static const unsigned int MAX_MATERIALS = 256;
+    static const unsigned int BINDING = 0;
+
+    ~MaterialLibrary()
+    {
+        if (buffer)
+            glDeleteBuffers(1, &buffer);
+    }
+
+    void Create()
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(Packed), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, buffer);
+    }
+
+    // returns the new material's ID, or MAX_MATERIALS when the library is full
+    unsigned int Add(const std::string& name, unsigned int variant, const MaterialParams& params)
+    {
+        if (materials.size() == MAX_MATERIALS)
+            return MAX_MATERIALS;
+        names.push_back(name);
+        variants.push_back(variant);
+        materials.push_back(params);
+        packed.push_back(pack(params));
+        dirty.push_back(true);
+        return (unsigned int)materials.size() - 1;
+    }
+
+    void Edit(unsigned int material, const MaterialParams& params)
+    {
+        materials[material] = params;
+        packed[material] = pack(params);
+        dirty[material] = true;
+        stats.Edits++;
+    }
+
+    // writes the slots changed since the last Upload()
+    void Upload()
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        for (unsigned int first = 0; first < dirty.size();)
+        {
+            if (!dirty[first])
+            {
+                first++;
+                continue;
+            }
+            unsigned int end = first;
+            while (end < dirty.size() && dirty[end])
+                dirty[end++] = false;
+            glBufferSubData(GL_UNIFORM_BUFFER, first * sizeof(Packed), (end - first) * sizeof(Packed), &packed[first]);
+            stats.Uploads++;
+            stats.BytesUploaded += (end - first) * sizeof(Packed);
+            first = end;
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // binds the buffer again, in case something else took the binding point
+    void Bind() const
+    {
+        glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, buffer);
+    }
+
+    // points a program's Materials block at the library's binding point
+    static void Attach(unsigned int program)
+    {
+        unsigned int block = glGetUniformBlockIndex(program, "Materials");
+        if (block != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, block, BINDING);
+    }
+
+    // MAX_MATERIALS if there is no material of that name
+    unsigned int Find(const std::string& name) const
+    {
+        for (unsigned int i = 0; i < names.size(); i++)
+            if (names[i] == name)
+                return i;
+        return MAX_MATERIALS;
+    }
+
+    const MaterialParams& Params(unsigned int material) const
+    {
+        return materials[material];
+    }
+
+    unsigned int Variant(unsigned int material) const
+    {
+        return variants[material];
+    }
+
+    unsigned int Count() const
+    {
+        return (unsigned int)materials.size();
+    }
+
+    // orders draws so that each shader variant is bound once and its materials follow each other
+    unsigned int SortKey(unsigned int material) const
+    {
+        return variants[material] << 16 | material;
+    }
+
+    MaterialStats Stats() const
+    {
+        MaterialStats result = stats;
+        result.Materials = Count();
+        return result;
+    }
+
+    // GLSL after the #version line: the Materials block and materialColor()/materialShininess() for the material of
+    // the draw, "materialIndex"
+    static const char* ShaderSource()
+    {
+        return R"(
+struct Material
+{
+    vec4 ColorShininess;
+    ivec4 Layers;   // diffuse and specular texture array layers, -1 for none
+};
+
+layout (std140) uniform Materials
+{
+    Material materials[256];
+};
+
+uniform int materialIndex;
+
+vec3 materialColor()
+{
+    return materials[materialIndex].ColorShininess.rgb;
+}
+
+float materialShininess()
+{
+    return materials[materialIndex].ColorShininess.a;
+}
+)";
+    }
+
+private:
+    // the std140 layout of Material in ShaderSource()
+    struct Packed
+    {
+        float ColorShininess[4];
+        int Layers[4];
+    };
+
+    unsigned int buffer = 0;
+    std::vector<std::string> names;
+    std::vector<unsigned int> variants;
+    std::vector<MaterialParams> materials;
+    std::vector<Packed> packed;
+    std::vector<bool> dirty;
+    MaterialStats stats;
+
+    static Packed pack(const MaterialParams& params)
+    {
+        Packed result = { { params.Color.x, params.Color.y, params.Color.z, params.Shininess },
+                          { params.DiffuseLayer, params.SpecularLayer, -1, -1 } };
+        return result;
+    }
+};
+#endif
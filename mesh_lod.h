@@ -0,0 +1,386 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// one detail level: a range of LodMesh::Indices and how far (object space, RMS) its surface is from the full mesh
+struct LodLevel
+{
+    unsigned int First = 0;
+    unsigned int Count = 0;
+    float Error = 0.0f;
+};
+
+// a triangle mesh and its LOD chain. Every level indexes the same vertices, the levels' indices follow each other
+// in Indices, level 0 being the full mesh, so one vertex and one element buffer hold the whole chain
+struct LodMesh
+{
+    std::vector<float> Vertices;          // position and normal per vertex
+    std::vector<unsigned int> Indices;
+    std::vector<LodLevel> Levels;
+    float Radius = 0.0f;                  // bounding sphere around the origin
+
+    static const unsigned int STRIDE = 6;
+
+    unsigned int VertexCount() const
+    {
+        return (unsigned int)(Vertices.size() / STRIDE);
+    }
+
+    glm::vec3 Position(unsigned int vertex) const
+    {
+        return glm::vec3(Vertices[vertex * STRIDE], Vertices[vertex * STRIDE + 1], Vertices[vertex * STRIDE + 2]);
+    }
+};
+
+// Quadric error metric simplification (Garland and Heckbert) by half-edge collapses: a vertex is merged into one of
+// its neighbours, so no new vertices are made and every level can share the original vertex buffer.
+//
+// Every vertex starts with the area weighted quadric of its triangles' planes; a collapse costs the two quadrics'
+// sum evaluated at the surviving vertex, and the survivor keeps that sum, so costs measure the distance to the
+// original surface however many collapses came before. Each pass sorts the edges by cost and makes the cheapest
+// collapses that don't touch each other's triangles or flip one, until the target is reached. Border vertices are
+// never moved.
+class MeshSimplifier
+{
+public:
+    double Error = 0.0;  // of the most expensive collapse so far, as an RMS distance
+
+    explicit MeshSimplifier(const LodMesh& mesh)
+        : mesh(mesh), quadrics(mesh.VertexCount()), locked(mesh.VertexCount(), false)
+    {
+        const std::vector<unsigned int>& indices = mesh.Indices;
+        std::vector<std::pair<unsigned int, unsigned int>> edges;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        {
+            glm::vec3 p0 = mesh.Position(indices[t]), p1 = mesh.Position(indices[t + 1]), p2 = mesh.Position(indices[t + 2]);
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal) * 0.5f;
+            if (area <= 0.0f)
+                continue;
+            normal = normal / (area * 2.0f);
+            Quadric plane = Quadric::FromPlane(normal, -glm::dot(normal, p0), area);
+            for (int k = 0; k < 3; k++)
+            {
+                quadrics[indices[t + k]].Add(plane);
+                unsigned int a = indices[t + k], b = indices[t + (k + 1) % 3];
+                edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+            }
+        }
+        // an edge used by one triangle only is on the border
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size();)
+        {
+            size_t j = i + 1;
+            while (j < edges.size() && edges[j] == edges[i])
+                j++;
+            if (j - i == 1)
+                locked[edges[i].first] = locked[edges[i].second] = true;
+            i = j;
+        }
+    }
+
+    // simplifies indices (the mesh's or a previous Simplify() result) towards targetCount indices; error grows to
+    // the largest error of a collapse made so far
+    std::vector<unsigned int> Simplify(const std::vector<unsigned int>& indices, size_t targetCount)
+    {
+        std::vector<unsigned int> result = indices;
+        std::vector<unsigned int> remap(mesh.VertexCount());
+        std::vector<char> touched(mesh.VertexCount());
+        while (result.size() > targetCount)
+        {
+            buildAdjacency(result);
+            std::vector<Collapse> collapses = collectCollapses(result);
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.Cost < b.Cost; });
+
+            for (unsigned int v = 0; v < remap.size(); v++)
+                remap[v] = v;
+            std::fill(touched.begin(), touched.end(), 0);
+            // a collapse removes about two triangles
+            size_t triangles = result.size() / 3, target = targetCount / 3;
+            size_t made = 0;
+            for (const Collapse& collapse : collapses)
+            {
+                if (triangles - 2 * made <= target)
+                    break;
+                if (touched[collapse.From] || touched[collapse.To] || flips(result, collapse.From, collapse.To))
+                    continue;
+                remap[collapse.From] = collapse.To;
+                quadrics[collapse.To].Add(quadrics[collapse.From]);
+                Error = std::max(Error, std::sqrt(std::max(collapse.Cost, 0.0)));
+                // the triangles around From change, nothing else may change them this pass
+                for (unsigned int a = adjacencyOffsets[collapse.From]; a < adjacencyOffsets[collapse.From + 1]; a++)
+                    for (int k = 0; k < 3; k++)
+                        touched[result[adjacency[a] * 3 + k]] = 1;
+                made++;
+            }
+            if (made == 0)
+                break;
+
+            size_t kept = 0;
+            for (size_t t = 0; t < result.size(); t += 3)
+            {
+                unsigned int a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+                if (a == b || b == c || a == c)
+                    continue;
+                result[kept++] = a;
+                result[kept++] = b;
+                result[kept++] = c;
+            }
+            result.resize(kept);
+        }
+        return result;
+    }
+
+    // appends levels to a mesh holding only its full detail indices: each one aims for ratio of the previous one's
+    // triangles, and the chain stops at maxLevels or when a pass can't remove a tenth of them
+    static void BuildChain(LodMesh& mesh, unsigned int maxLevels = 8, float ratio = 0.5f)
+    {
+        mesh.Levels.clear();
+        LodLevel full;
+        full.Count = (unsigned int)mesh.Indices.size();
+        mesh.Levels.push_back(full);
+        mesh.Radius = 0.0f;
+        for (unsigned int v = 0; v < mesh.VertexCount(); v++)
+            mesh.Radius = std::max(mesh.Radius, glm::length(mesh.Position(v)));
+
+        MeshSimplifier simplifier(mesh);
+        std::vector<unsigned int> previous = mesh.Indices;
+        while (mesh.Levels.size() < maxLevels && previous.size() > 3 * 16)
+        {
+            size_t target = (size_t)(previous.size() / 3 * ratio) * 3;
+            std::vector<unsigned int> level = simplifier.Simplify(previous, target);
+            if (level.size() > previous.size() * 9 / 10)
+                break;
+            LodLevel lod;
+            lod.First = (unsigned int)mesh.Indices.size();
+            lod.Count = (unsigned int)level.size();
+            lod.Error = (float)simplifier.Error;
+            mesh.Indices.insert(mesh.Indices.end(), level.begin(), level.end());
+            mesh.Levels.push_back(lod);
+            previous.swap(level);
+        }
+    }
+
+private:
+    // symmetric 4x4 matrix of the squared distance to a set of planes, and the area they stand for
+    struct Quadric
+    {
+        double A00 = 0, A01 = 0, A02 = 0, A11 = 0, A12 = 0, A22 = 0;
+        double B0 = 0, B1 = 0, B2 = 0, C = 0;
+        double Weight = 0;
+
+        static Quadric FromPlane(const glm::vec3& n, float d, float weight)
+        {
+            Quadric q;
+            q.A00 = weight * n.x * n.x; q.A01 = weight * n.x * n.y; q.A02 = weight * n.x * n.z;
+            q.A11 = weight * n.y * n.y; q.A12 = weight * n.y * n.z; q.A22 = weight * n.z * n.z;
+            q.B0 = weight * n.x * d; q.B1 = weight * n.y * d; q.B2 = weight * n.z * d;
+            q.C = weight * d * d;
+            q.Weight = weight;
+            return q;
+        }
+
+        void Add(const Quadric& o)
+        {
+            A00 += o.A00; A01 += o.A01; A02 += o.A02; A11 += o.A11; A12 += o.A12; A22 += o.A22;
+            B0 += o.B0; B1 += o.B1; B2 += o.B2; C += o.C;
+            Weight += o.Weight;
+        }
+
+        // weighted mean squared distance of p to the planes
+        double Evaluate(const glm::vec3& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double sum = A00 * x * x + 2 * A01 * x * y + 2 * A02 * x * z + A11 * y * y + 2 * A12 * y * z + A22 * z * z
+                       + 2 * (B0 * x + B1 * y + B2 * z) + C;
+            return Weight > 0 ? sum / Weight : 0.0;
+        }
+    };
+
+    struct Collapse
+    {
+        unsigned int From, To;
+        double Cost;
+    };
+
+    const LodMesh& mesh;
+    std::vector<Quadric> quadrics;
+    std::vector<bool> locked;
+    // triangles around each vertex, as offsets into adjacency
+    std::vector<unsigned int> adjacencyOffsets, adjacency;
+
+    void buildAdjacency(const std::vector<unsigned int>& indices)
+    {
+        adjacencyOffsets.assign(mesh.VertexCount() + 1, 0);
+        for (unsigned int index : indices)
+            adjacencyOffsets[index + 1]++;
+        for (size_t v = 0; v < mesh.VertexCount(); v++)
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        adjacency.resize(indices.size());
+        std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    // the cheaper direction of every edge that has one
+    std::vector<Collapse> collectCollapses(const std::vector<unsigned int>& indices) const
+    {
+        std::vector<Collapse> collapses;
+        collapses.reserve(indices.size());
+        for (size_t t = 0; t < indices.size(); t += 3)
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int a = indices[t + k], b = indices[t + (k + 1) % 3];
+                // every interior edge is seen from both of its triangles, keep it once
+                if (a > b)
+                    continue;
+                Quadric sum = quadrics[a];
+                sum.Add(quadrics[b]);
+                double intoB = locked[a] ? -1.0 : sum.Evaluate(mesh.Position(b));
+                double intoA = locked[b] ? -1.0 : sum.Evaluate(mesh.Position(a));
+                if (intoB < 0.0 && intoA < 0.0)
+                    continue;
+                if (intoA < 0.0 || (intoB >= 0.0 && intoB <= intoA))
+                    collapses.push_back({ a, b, intoB });
+                else
+                    collapses.push_back({ b, a, intoA });
+            }
+        return collapses;
+    }
+
+    // would moving from onto to turn one of from's other triangles over?
+    bool flips(const std::vector<unsigned int>& indices, unsigned int from, unsigned int to) const
+    {
+        for (unsigned int a = adjacencyOffsets[from]; a < adjacencyOffsets[from + 1]; a++)
+        {
+            const unsigned int* triangle = &indices[adjacency[a] * 3];
+            if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+                continue;
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++)
+            {
+                p[k] = mesh.Position(triangle[k]);
+                q[k] = triangle[k] == from ? mesh.Position(to) : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if (glm::dot(before, after) <= 0.0f)
+                return true;
+        }
+        return false;
+    }
+};
+
+// which level of a LodMesh an object draws, and the level it is fading out of
+struct LodState
+{
+    unsigned int Mesh = 0;      // index into the caller's meshes
+    int Level = 0;
+    int Previous = -1;          // -1 when not fading
+    float Fade = 1.0f;          // 0 to 1 while fading from Previous to Level
+};
+
+struct LodStats
+{
+    unsigned long long Triangles = 0;          // submitted, both levels of a cross-fade counted
+    unsigned long long FullTriangles = 0;      // what full detail would have submitted
+    unsigned int Switches = 0;
+};
+
+// Picks a level per object from its projected error: a level's object space error scaled by the pixels per unit at
+// the object's distance must stay under Threshold pixels. Going coarser needs the error to be under Threshold by the
+// Hysteresis fraction, so an object sitting at a switching distance doesn't flip back and forth. A switch cross-fades
+// the two levels over FadeSeconds with complementary dither patterns (ShaderSource()), so the object never pops and
+// every pixel is still drawn exactly once.
+class LodSelector
+{
+public:
+    float Threshold = 1.0f;
+    float Hysteresis = 0.25f;
+    float FadeSeconds = 0.3f;
+
+    // the projection of the frame, fovY in radians and the viewport height in pixels
+    void BeginFrame(float fovY, float viewportHeight, float dt)
+    {
+        pixelsPerUnit = viewportHeight / (2.0f * std::tan(fovY * 0.5f));
+        deltaTime = dt;
+    }
+
+    // distance from the camera to the object's center; scale is the object's uniform scale
+    void Select(LodState& state, const LodMesh& mesh, float distance, float scale)
+    {
+        float nearest = std::max(distance - mesh.Radius * scale, 0.01f);
+        float pixels = pixelsPerUnit * scale / nearest;
+        int level = std::min(state.Level, (int)mesh.Levels.size() - 1);
+        while (level > 0 && mesh.Levels[level].Error * pixels > Threshold)
+            level--;
+        while (level + 1 < (int)mesh.Levels.size() && mesh.Levels[level + 1].Error * pixels < Threshold * (1.0f - Hysteresis))
+            level++;
+
+        if (state.Previous >= 0)
+        {
+            state.Fade += deltaTime / FadeSeconds;
+            if (state.Fade >= 1.0f)
+            {
+                state.Fade = 1.0f;
+                state.Previous = -1;
+            }
+        }
+        if (level != state.Level)
+        {
+            // a switch during a fade starts over from the level that is fully visible by now
+            state.Previous = state.Level;
+            state.Level = level;
+            state.Fade = 0.0f;
+            stats.Switches++;
+        }
+        stats.Triangles += mesh.Levels[state.Level].Count / 3 + (state.Previous >= 0 ? mesh.Levels[state.Previous].Count / 3 : 0);
+        stats.FullTriangles += mesh.Levels[0].Count / 3;
+    }
+
+    // "lodFade" of ShaderSource() for the level being faded in, and for the one being faded out; 0 outside a fade
+    static float FadeIn(const LodState& state)
+    {
+        return state.Previous < 0 ? 0.0f : std::max(state.Fade, 1.0f / 16.0f);
+    }
+
+    static float FadeOut(const LodState& state)
+    {
+        return -FadeIn(state);
+    }
+
+    LodStats Stats() const
+    {
+        return stats;
+    }
+
+    // GLSL after the #version line: lodDither() discards the fragments the other level of a cross-fade draws. A level
+    // fading in with lodFade f keeps the pixels whose 4x4 Bayer threshold is under f, the one fading out (-f) the rest
+    static const char* ShaderSource()
+    {
+        return R"(
+uniform float lodFade;
+
+void lodDither()
+{
+    if (lodFade == 0.0)
+        return;
+    ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    float threshold = (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+    if (lodFade > 0.0 ? threshold >= lodFade : threshold < -lodFade)
+        discard;
+}
+)";
+    }
+
+private:
+    float pixelsPerUnit = 1.0f, deltaTime = 0.0f;
+    LodStats stats;
+};
+#endif
@@ -0,0 +1,330 @@
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <glm/glm.hpp>
+
+#include <frustum.h>
+#include <mesh_lod.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESHLET_SSE2
+#endif
+
+// a small cluster of a mesh's triangles: up to MAX_VERTICES vertices and MAX_TRIANGLES triangles
+struct Meshlet
+{
+    unsigned int VertexOffset = 0;     // into MeshletMesh::Vertices
+    unsigned int TriangleOffset = 0;   // into MeshletMesh::Triangles (three local indices per triangle) and Indices
+    unsigned int VertexCount = 0;
+    unsigned int TriangleCount = 0;
+};
+
+// a mesh cut into meshlets. Each meshlet lists the mesh vertices it uses and its triangles as indices into that list,
+// the layout mesh shaders want; Indices holds the same triangles expanded to mesh vertex indices, meshlet after
+// meshlet, which is what gets copied into a compacted index buffer. The bounds are kept as structure of arrays,
+// padded to a multiple of 4: a bounding sphere and a normal cone (axis and the cutoff of the cone test, 1 when the
+// triangles face too many ways for the cone to ever cull)
+struct MeshletMesh
+{
+    static const unsigned int MAX_VERTICES = 64;
+    static const unsigned int MAX_TRIANGLES = 124;
+
+    std::vector<Meshlet> Meshlets;
+    std::vector<unsigned int> Vertices;
+    std::vector<unsigned char> Triangles;
+    std::vector<unsigned int> Indices;
+    std::vector<float> CenterX, CenterY, CenterZ, Radius;
+    std::vector<float> AxisX, AxisY, AxisZ, Cutoff;
+
+    unsigned int TriangleCount() const
+    {
+        return (unsigned int)(Indices.size() / 3);
+    }
+};
+
+struct MeshletStats
+{
+    unsigned long long Tested = 0;
+    unsigned long long FrustumCulled = 0;
+    unsigned long long ConeCulled = 0;       // inside the frustum but facing away from the camera
+    unsigned long long Visible = 0;
+    unsigned long long Triangles = 0;        // emitted into compacted index buffers
+    unsigned long long TrianglesTested = 0;  // in every meshlet tested
+};
+
+// Builds meshlets from a range of a LodMesh's indices (a LOD level). Meshlets grow greedily from a seed triangle,
+// always taking the neighbouring triangle that adds the fewest new vertices (the closest to the meshlet's center on
+// a tie), so they come out compact and reuse their vertices; a meshlet ends when the next triangle would break a
+// limit or none of its neighbours is left.
+class MeshletBuilder
+{
+public:
+    static MeshletMesh Build(const LodMesh& mesh, unsigned int first, unsigned int count)
+    {
+        MeshletMesh result;
+        const unsigned int* indices = &mesh.Indices[first];
+        unsigned int triangleCount = count / 3;
+
+        // triangles around every vertex
+        std::vector<unsigned int> offsets(mesh.VertexCount() + 1, 0), adjacency(count);
+        for (unsigned int i = 0; i < count; i++)
+            offsets[indices[i] + 1]++;
+        for (unsigned int v = 0; v < mesh.VertexCount(); v++)
+            offsets[v + 1] += offsets[v];
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (unsigned int i = 0; i < count; i++)
+            adjacency[fill[indices[i]]++] = i / 3;
+
+        std::vector<bool> used(triangleCount, false);
+        // local index of each mesh vertex in the meshlet being built, -1 when it isn't in it
+        std::vector<int> local(mesh.VertexCount(), -1);
+        std::vector<unsigned int> candidates;
+        unsigned int seed = 0;
+        while (true)
+        {
+            while (seed < triangleCount && used[seed])
+                seed++;
+            if (seed == triangleCount)
+                break;
+
+            Meshlet meshlet;
+            meshlet.VertexOffset = (unsigned int)result.Vertices.size();
+            meshlet.TriangleOffset = (unsigned int)(result.Triangles.size() / 3);
+            glm::vec3 centerSum(0.0f);
+            unsigned int next = seed;
+            candidates.clear();
+            while (true)
+            {
+                // take the triangle
+                used[next] = true;
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int vertex = indices[next * 3 + k];
+                    if (local[vertex] < 0)
+                    {
+                        local[vertex] = (int)meshlet.VertexCount++;
+                        result.Vertices.push_back(vertex);
+                        centerSum += mesh.Position(vertex);
+                        for (unsigned int a = offsets[vertex]; a < offsets[vertex + 1]; a++)
+                            if (!used[adjacency[a]])
+                                candidates.push_back(adjacency[a]);
+                    }
+                    result.Triangles.push_back((unsigned char)local[vertex]);
+                    result.Indices.push_back(vertex);
+                }
+                meshlet.TriangleCount++;
+                if (meshlet.TriangleCount == MeshletMesh::MAX_TRIANGLES)
+                    break;
+
+                // the neighbour adding the fewest vertices, then the closest
+                glm::vec3 center = centerSum / (float)meshlet.VertexCount;
+                int best = -1;
+                unsigned int bestNew = 4;
+                float bestDistance = FLT_MAX;
+                for (unsigned int c = 0; c < candidates.size();)
+                {
+                    unsigned int triangle = candidates[c];
+                    if (used[triangle])
+                    {
+                        candidates[c] = candidates.back();
+                        candidates.pop_back();
+                        continue;
+                    }
+                    unsigned int added = 0;
+                    glm::vec3 centroid(0.0f);
+                    for (int k = 0; k < 3; k++)
+                    {
+                        added += local[indices[triangle * 3 + k]] < 0 ? 1 : 0;
+                        centroid += mesh.Position(indices[triangle * 3 + k]) / 3.0f;
+                    }
+                    float distance = glm::length(centroid - center);
+                    if (meshlet.VertexCount + added <= MeshletMesh::MAX_VERTICES && (added < bestNew || (added == bestNew && distance < bestDistance)))
+                    {
+                        best = (int)triangle;
+                        bestNew = added;
+                        bestDistance = distance;
+                    }
+                    c++;
+                }
+                if (best < 0)
+                    break;
+                next = (unsigned int)best;
+            }
+            for (unsigned int v = 0; v < meshlet.VertexCount; v++)
+                local[result.Vertices[meshlet.VertexOffset + v]] = -1;
+            result.Meshlets.push_back(meshlet);
+        }
+        computeBounds(mesh, result);
+        return result;
+    }
+
+private:
+    static void computeBounds(const LodMesh& mesh, MeshletMesh& result)
+    {
+        unsigned int padded = ((unsigned int)result.Meshlets.size() + 3) & ~3u;
+        for (std::vector<float>* array : { &result.CenterX, &result.CenterY, &result.CenterZ, &result.Radius, &result.AxisX, &result.AxisY, &result.AxisZ, &result.Cutoff })
+            array->assign(padded, 0.0f);
+        for (unsigned int m = 0; m < result.Meshlets.size(); m++)
+        {
+            const Meshlet& meshlet = result.Meshlets[m];
+            // sphere around the box's center
+            glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+            for (unsigned int v = 0; v < meshlet.VertexCount; v++)
+            {
+                glm::vec3 position = mesh.Position(result.Vertices[meshlet.VertexOffset + v]);
+                low = glm::min(low, position);
+                high = glm::max(high, position);
+            }
+            glm::vec3 center = (low + high) * 0.5f;
+            float radius = 0.0f;
+            for (unsigned int v = 0; v < meshlet.VertexCount; v++)
+                radius = std::max(radius, glm::length(mesh.Position(result.Vertices[meshlet.VertexOffset + v]) - center));
+
+            // the cone around the average face normal that holds every face normal
+            std::vector<glm::vec3> normals;
+            glm::vec3 axis(0.0f);
+            for (unsigned int t = 0; t < meshlet.TriangleCount; t++)
+            {
+                const unsigned int* triangle = &result.Indices[(meshlet.TriangleOffset + t) * 3];
+                glm::vec3 p0 = mesh.Position(triangle[0]);
+                glm::vec3 normal = glm::cross(mesh.Position(triangle[1]) - p0, mesh.Position(triangle[2]) - p0);
+                float length = glm::length(normal);
+                if (length <= 0.0f)
+                    continue;
+                normals.push_back(normal / length);
+                axis += normal / length;
+            }
+            float cutoff = 1.0f;
+            if (glm::length(axis) > 0.0f)
+            {
+                axis = glm::normalize(axis);
+                float minimum = 1.0f;
+                for (const glm::vec3& normal : normals)
+                    minimum = std::min(minimum, glm::dot(normal, axis));
+                // sine of the cone's half angle; a cone of 90 degrees or more never faces away as a whole
+                cutoff = minimum <= 0.1f ? 1.0f : std::sqrt(1.0f - minimum * minimum);
+            }
+            result.CenterX[m] = center.x;
+            result.CenterY[m] = center.y;
+            result.CenterZ[m] = center.z;
+            result.Radius[m] = radius;
+            result.AxisX[m] = axis.x;
+            result.AxisY[m] = axis.y;
+            result.AxisZ[m] = axis.z;
+            result.Cutoff[m] = cutoff;
+        }
+    }
+};
+
+// Culls an instance's meshlets and appends the indices of the ones left to a compacted index buffer.
+//
+// Everything is done in the mesh's own space: the camera position and the frustum planes are moved into it once per
+// instance (a world plane p becomes transpose(model) * p, which still measures world distances), so the meshlet
+// bounds are used as built. A meshlet is rejected when its sphere is outside a plane, or when its normal cone faces
+// away from the camera from every point of the sphere:
+//     dot(center - camera, axis) >= cutoff * |center - camera| + radius
+// Four meshlets are tested at once with SSE2.
+class MeshletCuller
+{
+public:
+    // model must scale uniformly; returns the number of indices appended to indices
+    unsigned int Cull(const MeshletMesh& meshlets, const glm::mat4& model, const glm::vec3& cameraPosition, const Frustum& frustum, std::vector<unsigned int>& indices)
+    {
+        glm::vec4 planes[6];
+        for (int p = 0; p < 6; p++)
+            planes[p] = glm::transpose(model) * frustum.Planes[p];
+        glm::vec3 camera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+        float scale = glm::length(glm::vec3(model[0]));
+
+        size_t start = indices.size();
+        unsigned int count = (unsigned int)meshlets.Meshlets.size();
+        for (unsigned int i = 0; i < count; i += 4)
+        {
+            unsigned int valid = count - i >= 4 ? 0xF : (1u << (count - i)) - 1;
+            unsigned int outside, backfacing;
+            test(meshlets, i, planes, camera, scale, outside, backfacing);
+            outside &= valid;
+            backfacing &= valid & ~outside;
+            unsigned int visible = valid & ~outside & ~backfacing;
+            stats.Tested += popcount(valid);
+            stats.FrustumCulled += popcount(outside);
+            stats.ConeCulled += popcount(backfacing);
+            stats.Visible += popcount(visible);
+            for (unsigned int k = 0; k < 4 && i + k < count; k++)
+            {
+                const Meshlet& meshlet = meshlets.Meshlets[i + k];
+                stats.TrianglesTested += meshlet.TriangleCount;
+                if ((visible & (1u << k)) == 0)
+                    continue;
+                size_t at = indices.size();
+                indices.resize(at + meshlet.TriangleCount * 3);
+                std::memcpy(&indices[at], &meshlets.Indices[meshlet.TriangleOffset * 3], meshlet.TriangleCount * 3 * sizeof(unsigned int));
+                stats.Triangles += meshlet.TriangleCount;
+            }
+        }
+        return (unsigned int)(indices.size() - start);
+    }
+
+    MeshletStats Stats() const
+    {
+        return stats;
+    }
+
+private:
+    MeshletStats stats;
+
+    static unsigned int popcount(unsigned int bits)
+    {
+        unsigned int count = 0;
+        for (; bits; bits &= bits - 1)
+            count++;
+        return count;
+    }
+
+    // bit k of outside and backfacing for meshlet first + k
+    static void test(const MeshletMesh& m, unsigned int first, const glm::vec4* planes, const glm::vec3& camera, float scale,
+                     unsigned int& outside, unsigned int& backfacing)
+    {
+#if defined(MESHLET_SSE2)
+        __m128 cx = _mm_loadu_ps(&m.CenterX[first]), cy = _mm_loadu_ps(&m.CenterY[first]), cz = _mm_loadu_ps(&m.CenterZ[first]);
+        __m128 radius = _mm_loadu_ps(&m.Radius[first]);
+        __m128 out = _mm_setzero_ps();
+        __m128 worldRadius = _mm_mul_ps(radius, _mm_set1_ps(-scale));
+        for (int p = 0; p < 6; p++)
+        {
+            const glm::vec4& plane = planes[p];
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+                                         _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w)));
+            out = _mm_or_ps(out, _mm_cmplt_ps(distance, worldRadius));
+        }
+        __m128 dx = _mm_sub_ps(cx, _mm_set1_ps(camera.x)), dy = _mm_sub_ps(cy, _mm_set1_ps(camera.y)), dz = _mm_sub_ps(cz, _mm_set1_ps(camera.z));
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&m.AxisX[first])), _mm_mul_ps(dy, _mm_loadu_ps(&m.AxisY[first]))),
+                                  _mm_mul_ps(dz, _mm_loadu_ps(&m.AxisZ[first])));
+        __m128 limit = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&m.Cutoff[first]), length), radius);
+        outside = (unsigned int)_mm_movemask_ps(out);
+        backfacing = (unsigned int)_mm_movemask_ps(_mm_cmpge_ps(along, limit));
+#else
+        outside = backfacing = 0;
+        for (unsigned int k = 0; k < 4; k++)
+        {
+            unsigned int i = first + k;
+            glm::vec3 center(m.CenterX[i], m.CenterY[i], m.CenterZ[i]);
+            for (int p = 0; p < 6; p++)
+                if (glm::dot(glm::vec3(planes[p]), center) + planes[p].w < -m.Radius[i] * scale)
+                    outside |= 1u << k;
+            glm::vec3 d = center - camera;
+            if (glm::dot(d, glm::vec3(m.AxisX[i], m.AxisY[i], m.AxisZ[i])) >= m.Cutoff[i] * glm::length(d) + m.Radius[i])
+                backfacing |= 1u << k;
+        }
+#endif
+    }
+};
+#endif
@@ -0,0 +1,314 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include <frustum.h>
+#include <job_system.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE2
+#endif
+
+// Software occlusion culling on a small CPU depth buffer. Selected occluders are rasterized every frame:
+// triangles are clipped against the near plane, binned into 8x8 pixel tiles, and every tile is then
+// rasterized by one job with 4-wide SSE edge functions, so no two threads ever touch the same pixel. Each tile
+// also stores its farthest depth, which lets box tests reject whole tiles before looking at pixels.
+// Depth is NDC z remapped to [0, 1] (0 near), cleared to 1. Nothing here touches OpenGL.
+class OcclusionCuller
+{
+public:
+    static const unsigned int TILE_SIZE = 8;
+
+    unsigned int Width, Height;
+    unsigned int TilesX, TilesY;
+    std::vector<float> Depth;   // Width * Height, row 0 is the bottom of the screen
+    std::vector<float> TileMax; // farthest depth stored in each tile
+
+    // the resolution is rounded up to whole tiles
+    OcclusionCuller(unsigned int width = 256, unsigned int height = 128)
+    {
+        TilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+        TilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+        Width = TilesX * TILE_SIZE;
+        Height = TilesY * TILE_SIZE;
+        Depth.assign(Width * Height, 1.0f);
+        TileMax.assign(TilesX * TilesY, 1.0f);
+        bins.resize(TilesX * TilesY);
+    }
+
+    // starts a frame: clears the depth buffer and the occluder list. The buffer always keeps 0 at the near plane and
+    // 1 at the far plane, whichever depth convention viewProjection was built for
+    void BeginFrame(const glm::mat4& viewProjection, DepthConvention depth = DEPTH_STANDARD)
+    {
+        this->viewProjection = viewProjection;
+        this->depth = depth;
+        triangles.clear();
+        for (std::vector<unsigned int>& bin : bins)
+            bin.clear();
+        std::fill(Depth.begin(), Depth.end(), 1.0f);
+        std::fill(TileMax.begin(), TileMax.end(), 1.0f);
+    }
+
+    // adds a triangle list occluder; vertices holds positions as the first 3 floats of every stride floats
+    void AddOccluder(const float* vertices, unsigned int stride, unsigned int vertexCount, const glm::mat4& model)
+    {
+        glm::mat4 mvp = viewProjection * model;
+        for (unsigned int v = 0; v + 2 < vertexCount; v += 3)
+        {
+            glm::vec4 clip[3];
+            for (int k = 0; k < 3; k++)
+            {
+                const float* p = vertices + (v + k) * stride;
+                clip[k] = mvp * glm::vec4(p[0], p[1], p[2], 1.0f);
+            }
+            addClipTriangle(clip);
+        }
+    }
+
+    // rasterizes every occluder added since BeginFrame, tiles are spread over the job system when given one
+    void Rasterize(JobSystem* jobs = nullptr)
+    {
+        if (jobs)
+            jobs->ParallelFor(TilesX * TilesY, 4, [this](unsigned int begin, unsigned int end)
+            {
+                for (unsigned int t = begin; t < end; t++)
+                    rasterizeTile(t);
+            });
+        else
+        {
+            for (unsigned int t = 0; t < TilesX * TilesY; t++)
+                rasterizeTile(t);
+        }
+    }
+
+    // false when every pixel covered by the box is behind the occluders
+    bool IsVisible(const AABB& box) const
+    {
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 1.0f;
+        for (int c = 0; c < 8; c++)
+        {
+            glm::vec4 corner((c & 1) ? box.Max.x : box.Min.x, (c & 2) ? box.Max.y : box.Min.y, (c & 4) ? box.Max.z : box.Min.z, 1.0f);
+            glm::vec4 clip = viewProjection * corner;
+            // a corner closer than the near plane means the camera is inside or touching the box
+            if (nearDistance(clip) < 0.0f || clip.w <= NEAR_EPSILON)
+                return true;
+            float x = (clip.x / clip.w * 0.5f + 0.5f) * Width;
+            float y = (clip.y / clip.w * 0.5f + 0.5f) * Height;
+            float z = bufferDepth(clip);
+            minX = std::min(minX, x); maxX = std::max(maxX, x);
+            minY = std::min(minY, y); maxY = std::max(maxY, y);
+            nearest = std::min(nearest, z);
+        }
+        if (maxX <= 0.0f || maxY <= 0.0f || minX >= (float)Width || minY >= (float)Height)
+            return false; // off screen
+        int x0 = (int)std::max(minX, 0.0f);
+        int y0 = (int)std::max(minY, 0.0f);
+        int x1 = std::min((int)Width - 1, (int)std::ceil(std::min(maxX, (float)Width)) - 1);
+        int y1 = std::min((int)Height - 1, (int)std::ceil(std::min(maxY, (float)Height)) - 1);
+        if (x0 > x1 || y0 > y1)
+            return false;
+
+        for (int ty = y0 / (int)TILE_SIZE; ty <= y1 / (int)TILE_SIZE; ty++)
+        {
+            for (int tx = x0 / (int)TILE_SIZE; tx <= x1 / (int)TILE_SIZE; tx++)
+            {
+                // the whole tile is closer than the box, skip it without reading pixels
+                if (nearest > TileMax[ty * TilesX + tx])
+                    continue;
+                int px0 = std::max(x0, tx * (int)TILE_SIZE), px1 = std::min(x1, tx * (int)TILE_SIZE + (int)TILE_SIZE - 1);
+                int py0 = std::max(y0, ty * (int)TILE_SIZE), py1 = std::min(y1, ty * (int)TILE_SIZE + (int)TILE_SIZE - 1);
+                for (int y = py0; y <= py1; y++)
+                    for (int x = px0; x <= px1; x++)
+                        if (nearest <= Depth[y * Width + x])
+                            return true;
+            }
+        }
+        return false;
+    }
+
+    // removes the occluded entries of a visible list (indices into bounds), returns how many were removed
+    unsigned int Filter(const std::vector<AABB>& bounds, std::vector<unsigned int>& visible, JobSystem* jobs = nullptr) const
+    {
+        std::vector<unsigned char> keep(visible.size());
+        std::function<void(unsigned int, unsigned int)> test = [&](unsigned int begin, unsigned int end)
+        {
+            for (unsigned int i = begin; i < end; i++)
+                keep[i] = IsVisible(bounds[visible[i]]) ? 1 : 0;
+        };
+        if (jobs)
+            jobs->ParallelFor((unsigned int)visible.size(), 64, test);
+        else
+            test(0, (unsigned int)visible.size());
+
+        unsigned int written = 0;
+        for (unsigned int i = 0; i < visible.size(); i++)
+            if (keep[i])
+                visible[written++] = visible[i];
+        unsigned int removed = (unsigned int)visible.size() - written;
+        visible.resize(written);
+        return removed;
+    }
+
+    unsigned int OccluderTriangles() const
+    {
+        return (unsigned int)triangles.size();
+    }
+
+private:
+    static constexpr float NEAR_EPSILON = 1e-5f;
+
+    // screen space triangle with its edge and depth plane equations, value(x, y) = a * x + b * y + c
+    struct Triangle
+    {
+        float EdgeA[3], EdgeB[3], EdgeC[3];
+        float DepthA, DepthB, DepthC;
+    };
+
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    DepthConvention depth = DEPTH_STANDARD;
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<unsigned int>> bins;
+
+    // signed distance to the near plane in clip space, z + w or, reversed, w - z; negative behind it
+    float nearDistance(const glm::vec4& clip) const
+    {
+        return depth == DEPTH_REVERSED_Z ? clip.w - clip.z : clip.z + clip.w;
+    }
+
+    // the buffer's 0 (near) to 1 (far) depth of a clip space point in front of the near plane
+    float bufferDepth(const glm::vec4& clip) const
+    {
+        return depth == DEPTH_REVERSED_Z ? 1.0f - clip.z / clip.w : clip.z / clip.w * 0.5f + 0.5f;
+    }
+
+    // clips against the near plane and sends the resulting one or two triangles to setup
+    void addClipTriangle(const glm::vec4* clip)
+    {
+        glm::vec4 polygon[4];
+        int count = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            const glm::vec4& a = clip[k];
+            const glm::vec4& b = clip[(k + 1) % 3];
+            float da = nearDistance(a);
+            float db = nearDistance(b);
+            if (da >= 0.0f)
+                polygon[count++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f))
+                polygon[count++] = a + (b - a) * (da / (da - db));
+        }
+        for (int k = 1; k + 1 < count; k++)
+        {
+            glm::vec4 triangle[3] = { polygon[0], polygon[k], polygon[k + 1] };
+            setupTriangle(triangle);
+        }
+    }
+
+    void setupTriangle(const glm::vec4* clip)
+    {
+        glm::vec3 v[3];
+        for (int k = 0; k < 3; k++)
+        {
+            if (clip[k].w <= NEAR_EPSILON)
+                return;
+            v[k] = glm::vec3((clip[k].x / clip[k].w * 0.5f + 0.5f) * Width,
+                             (clip[k].y / clip[k].w * 0.5f + 0.5f) * Height,
+                             bufferDepth(clip[k]));
+        }
+        // occluders are two sided, wind everything counter-clockwise
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+        if (area == 0.0f)
+            return;
+        if (area < 0.0f)
+        {
+            std::swap(v[1], v[2]);
+            area = -area;
+        }
+
+        float minX = std::min(v[0].x, std::min(v[1].x, v[2].x)), maxX = std::max(v[0].x, std::max(v[1].x, v[2].x));
+        float minY = std::min(v[0].y, std::min(v[1].y, v[2].y)), maxY = std::max(v[0].y, std::max(v[1].y, v[2].y));
+        if (maxX < 0.0f || maxY < 0.0f || minX >= (float)Width || minY >= (float)Height)
+            return;
+        // clamp before converting so that huge projected coordinates cannot overflow the tile indices
+        int tx0 = (int)std::max(minX, 0.0f) / (int)TILE_SIZE, tx1 = (int)std::min(maxX, (float)Width - 1.0f) / (int)TILE_SIZE;
+        int ty0 = (int)std::max(minY, 0.0f) / (int)TILE_SIZE, ty1 = (int)std::min(maxY, (float)Height - 1.0f) / (int)TILE_SIZE;
+
+        Triangle triangle;
+        for (int k = 0; k < 3; k++)
+        {
+            const glm::vec3& a = v[k];
+            const glm::vec3& b = v[(k + 1) % 3];
+            triangle.EdgeA[k] = -(b.y - a.y);
+            triangle.EdgeB[k] = b.x - a.x;
+            triangle.EdgeC[k] = -(triangle.EdgeA[k] * a.x + triangle.EdgeB[k] * a.y);
+        }
+        glm::vec3 d1 = v[1] - v[0], d2 = v[2] - v[0];
+        triangle.DepthA = (d1.z * d2.y - d2.z * d1.y) / area;
+        triangle.DepthB = (d2.z * d1.x - d1.z * d2.x) / area;
+        triangle.DepthC = v[0].z - triangle.DepthA * v[0].x - triangle.DepthB * v[0].y;
+
+        unsigned int index = (unsigned int)triangles.size();
+        triangles.push_back(triangle);
+        for (int ty = ty0; ty <= ty1; ty++)
+            for (int tx = tx0; tx <= tx1; tx++)
+                bins[ty * TilesX + tx].push_back(index);
+    }
+
+    void rasterizeTile(unsigned int tile)
+    {
+        unsigned int tx = tile % TilesX, ty = tile / TilesX;
+        unsigned int x0 = tx * TILE_SIZE, y0 = ty * TILE_SIZE;
+        for (unsigned int index : bins[tile])
+        {
+            const Triangle& t = triangles[index];
+            for (unsigned int y = y0; y < y0 + TILE_SIZE; y++)
+            {
+                float py = y + 0.5f;
+                float* row = &Depth[y * Width];
+#ifdef OCCLUSION_SSE2
+                __m128 e0Row = _mm_set1_ps(t.EdgeB[0] * py + t.EdgeC[0]);
+                __m128 e1Row = _mm_set1_ps(t.EdgeB[1] * py + t.EdgeC[1]);
+                __m128 e2Row = _mm_set1_ps(t.EdgeB[2] * py + t.EdgeC[2]);
+                __m128 zRow = _mm_set1_ps(t.DepthB * py + t.DepthC);
+                for (unsigned int x = x0; x < x0 + TILE_SIZE; x += 4)
+                {
+                    __m128 px = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+                    __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.EdgeA[0]), px), e0Row);
+                    __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.EdgeA[1]), px), e1Row);
+                    __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.EdgeA[2]), px), e2Row);
+                    __m128 inside = _mm_and_ps(_mm_cmpgt_ps(e0, _mm_setzero_ps()), _mm_and_ps(_mm_cmpgt_ps(e1, _mm_setzero_ps()), _mm_cmpgt_ps(e2, _mm_setzero_ps())));
+                    if (_mm_movemask_ps(inside) == 0)
+                        continue;
+                    __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.DepthA), px), zRow);
+                    __m128 current = _mm_loadu_ps(row + x);
+                    __m128 closer = _mm_min_ps(current, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, current)));
+                }
+#else
+                for (unsigned int x = x0; x < x0 + TILE_SIZE; x++)
+                {
+                    float px = x + 0.5f;
+                    if (t.EdgeA[0] * px + t.EdgeB[0] * py + t.EdgeC[0] > 0.0f &&
+                        t.EdgeA[1] * px + t.EdgeB[1] * py + t.EdgeC[1] > 0.0f &&
+                        t.EdgeA[2] * px + t.EdgeB[2] * py + t.EdgeC[2] > 0.0f)
+                        row[x] = std::min(row[x], t.DepthA * px + t.DepthB * py + t.DepthC);
+                }
+#endif
+            }
+        }
+
+        float farthest = 0.0f;
+        for (unsigned int y = y0; y < y0 + TILE_SIZE; y++)
+            for (unsigned int x = x0; x < x0 + TILE_SIZE; x++)
+                farthest = std::max(farthest, Depth[y * Width + x]);
+        TileMax[tile] = farthest;
+    }
+};
+#endif
@@ -0,0 +1,228 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// Minimal PNG encoder for frame dumps and reference images. Pixel data goes into uncompressed (stored)
+// deflate blocks: files are larger than a real encoder would make them, but encoding is a plain copy plus
+// two checksums, which keeps capture cheap and needs no zlib. Decode() reads back only what Encode() writes,
+// so reference images compared against have to be saved by this class.
+class PNGWriter
+{
+public:
+    // encodes 8 bit RGB (channels = 3) or RGBA (channels = 4) pixels; rows are read bottom-up when flipY is
+    // set, which is the order glReadPixels returns them in
+    static std::vector<unsigned char> Encode(int width, int height, int channels, const unsigned char* pixels, bool flipY = false)
+    {
+        std::vector<unsigned char> png;
+        static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        png.insert(png.end(), signature, signature + 8);
+
+        unsigned char header[13];
+        put32(header, (std::uint32_t)width);
+        put32(header + 4, (std::uint32_t)height);
+        header[8] = 8;                          // bit depth
+        header[9] = channels == 4 ? 6 : 2;      // color type: RGBA or RGB
+        header[10] = header[11] = header[12] = 0;
+        chunk(png, "IHDR", header, 13);
+
+        // zlib stream: every row is prefixed with filter type 0 and the rows are split in stored blocks
+        std::size_t rowBytes = (std::size_t)width * channels;
+        std::vector<unsigned char> raw;
+        raw.reserve((rowBytes + 1) * height);
+        for (int y = 0; y < height; y++)
+        {
+            const unsigned char* row = pixels + (std::size_t)(flipY ? height - 1 - y : y) * rowBytes;
+            raw.push_back(0);
+            raw.insert(raw.end(), row, row + rowBytes);
+        }
+        std::vector<unsigned char> zlib;
+        zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+        zlib.push_back(0x78);
+        zlib.push_back(0x01);
+        std::size_t offset = 0;
+        do
+        {
+            std::size_t size = raw.size() - offset < 65535 ? raw.size() - offset : 65535;
+            zlib.push_back(offset + size == raw.size() ? 1 : 0);
+            zlib.push_back((unsigned char)(size & 0xFF));
+            zlib.push_back((unsigned char)(size >> 8));
+            zlib.push_back((unsigned char)(~size & 0xFF));
+            zlib.push_back((unsigned char)((~size >> 8) & 0xFF));
+            zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+            offset += size;
+        } while (offset < raw.size());
+        unsigned char adler[4];
+        put32(adler, adler32(raw.data(), raw.size()));
+        zlib.insert(zlib.end(), adler, adler + 4);
+        chunk(png, "IDAT", zlib.data(), zlib.size());
+
+        chunk(png, "IEND", nullptr, 0);
+        return png;
+    }
+
+    static bool Write(const char* path, int width, int height, int channels, const unsigned char* pixels, bool flipY = false)
+    {
+        std::vector<unsigned char> png = Encode(width, height, channels, pixels, flipY);
+        FILE* file = std::fopen(path, "wb");
+        if (!file)
+            return false;
+        bool written = std::fwrite(png.data(), 1, png.size(), file) == png.size();
+        return std::fclose(file) == 0 && written;
+    }
+
+    // 8 bit RGB or RGBA, unfiltered rows in stored deflate blocks; anything else (a compressed or filtered
+    // file from a real encoder) is rejected rather than decoded. Rows come out top first, as Encode() takes them
+    static bool Decode(const std::vector<unsigned char>& png, int& width, int& height, int& channels, std::vector<unsigned char>& pixels)
+    {
+        static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        if (png.size() < 8 || std::memcmp(png.data(), signature, 8) != 0)
+            return false;
+        width = height = channels = 0;
+        std::vector<unsigned char> zlib;
+        std::size_t offset = 8;
+        while (offset + 12 <= png.size())
+        {
+            std::size_t length = get32(&png[offset]);
+            if (length > png.size() - offset - 12)
+                return false;
+            const unsigned char* type = &png[offset + 4];
+            const unsigned char* data = &png[offset + 8];
+            if (std::memcmp(type, "IHDR", 4) == 0 && length == 13)
+            {
+                // bit depth 8, RGB or RGBA, no interlacing
+                if (data[8] != 8 || (data[9] != 2 && data[9] != 6) || data[12] != 0)
+                    return false;
+                width = (int)get32(data);
+                height = (int)get32(data + 4);
+                channels = data[9] == 6 ? 4 : 3;
+            }
+            else if (std::memcmp(type, "IDAT", 4) == 0)
+                zlib.insert(zlib.end(), data, data + length);
+            else if (std::memcmp(type, "IEND", 4) == 0)
+                break;
+            offset += length + 12;
+        }
+        if (width <= 0 || height <= 0 || zlib.size() < 2)
+            return false;
+
+        std::size_t rowBytes = (std::size_t)width * channels;
+        std::vector<unsigned char> raw;
+        raw.reserve((rowBytes + 1) * height);
+        std::size_t position = 2;
+        bool last = false;
+        while (!last)
+        {
+            // a stored block: BFINAL, BTYPE 00, then LEN and its complement
+            if (position + 5 > zlib.size() || (zlib[position] & 0x06) != 0)
+                return false;
+            last = (zlib[position] & 1) != 0;
+            std::size_t size = zlib[position + 1] | (std::size_t)zlib[position + 2] << 8;
+            position += 5;
+            if (size > zlib.size() - position)
+                return false;
+            raw.insert(raw.end(), zlib.begin() + position, zlib.begin() + position + size);
+            position += size;
+        }
+        if (position + 4 > zlib.size() || get32(&zlib[position]) != adler32(raw.data(), raw.size()) || raw.size() != (rowBytes + 1) * height)
+            return false;
+
+        pixels.resize(rowBytes * height);
+        for (int y = 0; y < height; y++)
+        {
+            const unsigned char* row = &raw[(std::size_t)y * (rowBytes + 1)];
+            if (row[0] != 0)
+                return false;
+            std::memcpy(&pixels[(std::size_t)y * rowBytes], row + 1, rowBytes);
+        }
+        return true;
+    }
+
+    static bool Read(const char* path, int& width, int& height, int& channels, std::vector<unsigned char>& pixels)
+    {
+        FILE* file = std::fopen(path, "rb");
+        if (!file)
+            return false;
+        std::vector<unsigned char> png;
+        unsigned char buffer[65536];
+        std::size_t read;
+        while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+            png.insert(png.end(), buffer, buffer + read);
+        std::fclose(file);
+        return Decode(png, width, height, channels, pixels);
+    }
+
+private:
+    static std::uint32_t get32(const unsigned char* in)
+    {
+        return (std::uint32_t)in[0] << 24 | (std::uint32_t)in[1] << 16 | (std::uint32_t)in[2] << 8 | in[3];
+    }
+
+    static void put32(unsigned char* out, std::uint32_t value)
+    {
+        out[0] = (unsigned char)(value >> 24);
+        out[1] = (unsigned char)(value >> 16);
+        out[2] = (unsigned char)(value >> 8);
+        out[3] = (unsigned char)value;
+    }
+
+    static std::uint32_t crc32(std::uint32_t crc, const unsigned char* data, std::size_t size)
+    {
+        // built on first use; function statics are initialized thread safely
+        struct Table
+        {
+            std::uint32_t Values[256];
+            Table()
+            {
+                for (std::uint32_t n = 0; n < 256; n++)
+                {
+                    std::uint32_t c = n;
+                    for (int k = 0; k < 8; k++)
+                        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    Values[n] = c;
+                }
+            }
+        };
+        static const Table table;
+        for (std::size_t i = 0; i < size; i++)
+            crc = table.Values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return crc;
+    }
+
+    static std::uint32_t adler32(const unsigned char* data, std::size_t size)
+    {
+        // 5552 bytes is the longest run that cannot overflow the sums before the modulo
+        std::uint32_t a = 1, b = 0;
+        while (size > 0)
+        {
+            std::size_t run = size < 5552 ? size : 5552;
+            size -= run;
+            for (std::size_t i = 0; i < run; i++)
+            {
+                a += *data++;
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    static void chunk(std::vector<unsigned char>& png, const char* type, const unsigned char* data, std::size_t size)
+    {
+        unsigned char length[4];
+        put32(length, (std::uint32_t)size);
+        png.insert(png.end(), length, length + 4);
+        std::size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        if (size > 0)
+            png.insert(png.end(), data, data + size);
+        unsigned char crc[4];
+        put32(crc, crc32(0xFFFFFFFFu, &png[start], png.size() - start) ^ 0xFFFFFFFFu);
+        png.insert(png.end(), crc, crc + 4);
+    }
+};
+#endif
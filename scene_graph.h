@@ -0,0 +1,193 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+
+// Hierarchical scene graph. Nodes are addressed by a stable handle (the value returned by AddNode) but their
+// transforms live in flat arrays laid out breadth-first: nodes are sorted by depth and the children of a node
+// are contiguous. Changing a local transform only marks the node dirty; Update() then recomputes the world
+// matrices of the dirty subtrees and nothing else, so static geometry costs nothing per frame. The arrays are
+// private so that every change to a local transform goes through SetLocal() and is seen by Update().
+class SceneGraph
+{
+public:
+    // adds a node under parent (-1 for a root) and returns its handle
+    unsigned int AddNode(int parent, const glm::mat4& local = glm::mat4(1.0f))
+    {
+        unsigned int handle = (unsigned int)nodeParent.size();
+        nodeParent.push_back(parent);
+        nodeDepth.push_back(parent < 0 ? 0 : nodeDepth[parent] + 1);
+        indices.push_back((unsigned int)locals.size());
+        handles.push_back(handle);
+        locals.push_back(local);
+        worlds.push_back(glm::mat4(1.0f));
+        parents.push_back(-1);
+        depths.push_back(nodeDepth[handle]);
+        firstChildren.push_back(0);
+        childCounts.push_back(0);
+        stamp.push_back(0);
+        layoutDirty = true;
+        markDirty(handle);
+        return handle;
+    }
+
+    void SetLocal(unsigned int handle, const glm::mat4& local)
+    {
+        locals[indices[handle]] = local;
+        markDirty(handle);
+    }
+
+    const glm::mat4& GetLocal(unsigned int handle) const
+    {
+        return locals[indices[handle]];
+    }
+
+    const glm::mat4& GetWorld(unsigned int handle) const
+    {
+        return worlds[indices[handle]];
+    }
+
+    // the parent's handle, -1 for a root
+    int GetParent(unsigned int handle) const
+    {
+        return nodeParent[handle];
+    }
+
+    unsigned int Size() const
+    {
+        return (unsigned int)locals.size();
+    }
+
+    // recomputes world matrices of every dirty subtree and returns how many matrices were rebuilt
+    unsigned int Update()
+    {
+        if (layoutDirty)
+            rebuildLayout();
+        if (dirtyCount == 0)
+            return 0;
+
+        // a node is processed at most once per update, the frame stamp filters children of dirty nodes
+        // that were also marked dirty themselves
+        frame++;
+        unsigned int updated = 0;
+        for (unsigned int d = 0; d < levels.size(); d++)
+        {
+            std::vector<unsigned int>& level = levels[d];
+            for (unsigned int k = 0; k < level.size(); k++)
+            {
+                unsigned int i = level[k];
+                if (stamp[i] == frame)
+                    continue;
+                stamp[i] = frame;
+                worlds[i] = parents[i] < 0 ? locals[i] : worlds[parents[i]] * locals[i];
+                updated++;
+
+                if (childCounts[i] > 0)
+                {
+                    std::vector<unsigned int>& next = levels[d + 1];
+                    for (unsigned int c = firstChildren[i]; c < firstChildren[i] + childCounts[i]; c++)
+                        next.push_back(c);
+                }
+            }
+            level.clear();
+        }
+        dirtyCount = 0;
+        return updated;
+    }
+
+private:
+    // node data in breadth-first (depth-sorted) order, index with indices[handle]
+    std::vector<glm::mat4> locals;
+    std::vector<glm::mat4> worlds;
+    std::vector<int> parents;
+    std::vector<unsigned int> depths;
+    std::vector<unsigned int> firstChildren;
+    std::vector<unsigned int> childCounts;
+    // handle <-> array index
+    std::vector<unsigned int> indices;
+    std::vector<unsigned int> handles;
+    // creation order data, used to rebuild the breadth-first layout when nodes are added
+    std::vector<int> nodeParent;
+    std::vector<unsigned int> nodeDepth;
+    // per depth lists of array indices waiting for a world matrix update
+    std::vector<std::vector<unsigned int>> levels;
+    std::vector<unsigned int> stamp;
+    unsigned int frame = 0;
+    unsigned int dirtyCount = 0;
+    bool layoutDirty = false;
+
+    void markDirty(unsigned int handle)
+    {
+        if (layoutDirty)
+        {
+            // the whole graph is re-queued once the layout is rebuilt
+            dirtyCount++;
+            return;
+        }
+        unsigned int i = indices[handle];
+        if (levels.size() <= depths[i] + 1)
+            levels.resize(depths[i] + 2);
+        levels[depths[i]].push_back(i);
+        dirtyCount++;
+    }
+
+    // sorts the node arrays breadth-first so that depths are ascending and siblings are contiguous
+    void rebuildLayout()
+    {
+        unsigned int count = (unsigned int)nodeParent.size();
+        std::vector<std::vector<unsigned int>> children(count);
+        std::vector<unsigned int> order;
+        order.reserve(count);
+        for (unsigned int h = 0; h < count; h++)
+        {
+            if (nodeParent[h] < 0)
+                order.push_back(h);
+            else
+                children[nodeParent[h]].push_back(h);
+        }
+        std::vector<unsigned int> firstChild(count, 0);
+        for (unsigned int k = 0; k < order.size(); k++)
+        {
+            unsigned int h = order[k];
+            firstChild[h] = (unsigned int)order.size();
+            order.insert(order.end(), children[h].begin(), children[h].end());
+        }
+
+        std::vector<glm::mat4> local(count);
+        std::vector<glm::mat4> world(count);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            local[i] = locals[indices[order[i]]];
+            world[i] = worlds[indices[order[i]]];
+        }
+        for (unsigned int i = 0; i < count; i++)
+        {
+            indices[order[i]] = i;
+            handles[i] = order[i];
+        }
+        unsigned int maxDepth = 0;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            unsigned int h = order[i];
+            parents[i] = nodeParent[h] < 0 ? -1 : (int)indices[nodeParent[h]];
+            depths[i] = nodeDepth[h];
+            firstChildren[i] = firstChild[h];
+            childCounts[i] = (unsigned int)children[h].size();
+            if (depths[i] > maxDepth)
+                maxDepth = depths[i];
+        }
+        locals.swap(local);
+        worlds.swap(world);
+        layoutDirty = false;
+
+        // re-queue everything, roots first, the children follow through propagation
+        levels.assign(maxDepth + 2, std::vector<unsigned int>());
+        for (unsigned int i = 0; i < count && depths[i] == 0; i++)
+            levels[0].push_back(i);
+        dirtyCount = count;
+    }
+};
+#endif
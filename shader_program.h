@@ -0,0 +1,129 @@
+#ifndef SHADER_PROGRAM_H
+#define SHADER_PROGRAM_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <string>
+
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+
+// Shader built from source strings instead of files, for shaders that belong to a header (their GLSL depends on the
+// buffer layouts the C++ side writes). Same use()/set*() interface as learnopengl's Shader.
+class ShaderProgram
+{
+public:
+    unsigned int ID = 0;
+
+    ShaderProgram() {}
+
+    ShaderProgram(const std::string& vertexSource, const std::string& fragmentSource)
+    {
+        Build(vertexSource, fragmentSource);
+    }
+
+    ~ShaderProgram()
+    {
+        if (ID)
+            glDeleteProgram(ID);
+    }
+
+    ShaderProgram(const ShaderProgram&) = delete;
+    ShaderProgram& operator=(const ShaderProgram&) = delete;
+
+    bool Build(const std::string& vertexSource, const std::string& fragmentSource)
+    {
+        if (ID)
+            glDeleteProgram(ID);
+        unsigned int vertex = compile(GL_VERTEX_SHADER, vertexSource, "VERTEX");
+        unsigned int fragment = compile(GL_FRAGMENT_SHADER, fragmentSource, "FRAGMENT");
+        ID = glCreateProgram();
+        glAttachShader(ID, vertex);
+        glAttachShader(ID, fragment);
+        glLinkProgram(ID);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        return linked();
+    }
+
+    // a compute program; needs a GL 4.3 (or GL_ARB_compute_shader) context, which the caller checks
+    bool BuildCompute(const std::string& computeSource)
+    {
+        if (ID)
+            glDeleteProgram(ID);
+        unsigned int compute = compile(GL_COMPUTE_SHADER, computeSource, "COMPUTE");
+        ID = glCreateProgram();
+        glAttachShader(ID, compute);
+        glLinkProgram(ID);
+        glDeleteShader(compute);
+        return linked();
+    }
+
+    void use() const
+    {
+        glUseProgram(ID);
+    }
+    void setInt(const std::string& name, int value) const
+    {
+        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    }
+    void setFloat(const std::string& name, float value) const
+    {
+        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    }
+    void setVec2(const std::string& name, const glm::vec2& value) const
+    {
+        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    }
+    void setVec3(const std::string& name, const glm::vec3& value) const
+    {
+        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    }
+    void setVec4(const std::string& name, const glm::vec4& value) const
+    {
+        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    }
+    void setMat3(const std::string& name, const glm::mat3& value) const
+    {
+        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &value[0][0]);
+    }
+    void setMat4(const std::string& name, const glm::mat4& value) const
+    {
+        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &value[0][0]);
+    }
+
+private:
+    bool linked() const
+    {
+        int success;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            char infoLog[1024];
+            glGetProgramInfoLog(ID, 1024, NULL, infoLog);
+            std::cout << "ERROR::PROGRAM_LINKING_ERROR\n" << infoLog << std::endl;
+        }
+        return success != 0;
+    }
+
+    static unsigned int compile(GLenum type, const std::string& source, const char* name)
+    {
+        unsigned int shader = glCreateShader(type);
+        const char* text = source.c_str();
+        glShaderSource(shader, 1, &text, NULL);
+        glCompileShader(shader);
+        int success;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            char infoLog[1024];
+            glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+            std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << name << "\n" << infoLog << std::endl;
+        }
+        return shader;
+    }
+};
+#endif
@@ -0,0 +1,419 @@
+#ifndef SHADOW_MAPS_H
+#define SHADOW_MAPS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <frustum.h>
+#include <shader_program.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <string>
+
+struct ShadowStats
+{
+    static const int CASCADES = 4;
+    unsigned int Frames = 0;
+    unsigned int CascadeDraws[CASCADES] = {};          // caster draws per cascade, static and dynamic, over all frames
+    unsigned int CascadeStaticRenders[CASCADES] = {};  // frames whose cached static depth had to be rendered again
+    unsigned int CubeDraws = 0;
+    unsigned int CubeStaticRenders = 0;
+};
+
+// Shadows for a directional light (the sun, cascaded shadow maps) and one point light (the lamp, a depth cube map).
+//
+// Casters are split into static and dynamic ones. Every shadow map keeps a cached depth of the static casters that
+// is only rendered again when what it depends on changed: the light, the static geometry (InvalidateStatic()) or, for
+// a cascade, its placement. Each frame the cached depth is copied into the map and only the dynamic casters are drawn
+// on top of it.
+//
+// The cascades split the camera frustum between its near plane and ShadowDistance, blending logarithmic and uniform
+// splits. Each cascade covers the bounding sphere of its slice, whose size does not change as the camera turns, and
+// its center is snapped to whole shadow texels in light space, so edges don't shimmer and a far cascade keeps its
+// cached depth until the camera has moved a full texel.
+class ShadowMaps
+{
+public:
+    static const int CASCADES = ShadowStats::CASCADES;
+
+    int Resolution = 1024, CubeResolution = 512;
+    float ShadowDistance = 40.0f;
+    float SplitLambda = 0.75f;    // 1 is logarithmic splits, 0 uniform ones
+
+    // draws the static or the dynamic casters that intersect frustum with the given depth program, which only needs
+    // "model" set; returns the number of draws
+    typedef std::function<unsigned int(const ShaderProgram& program, bool staticCasters, const Frustum& frustum)> DrawCasters;
+
+    ~ShadowMaps()
+    {
+        if (!framebuffers[0])
+            return;
+        glDeleteFramebuffers(2, framebuffers);
+        unsigned int textures[4] = { cascades, cascadeCache, cube, cubeCache };
+        glDeleteTextures(4, textures);
+    }
+
+    bool Create(int resolution = 1024, int cubeResolution = 512)
+    {
+        Resolution = resolution;
+        CubeResolution = cubeResolution;
+        directional.Build(R"(#version 330 core
+layout (location = 0) in vec3 aPos;
+uniform mat4 lightSpace;
+uniform mat4 model;
+void main()
+{
+    gl_Position = lightSpace * model * vec4(aPos, 1.0);
+}
+)", R"(#version 330 core
+void main()
+{
+}
+)");
+        // the cube stores distance to the lamp over its range, the same in every face
+        point.Build(R"(#version 330 core
+layout (location = 0) in vec3 aPos;
+out vec3 FragPos;
+uniform mat4 lightSpace;
+uniform mat4 model;
+void main()
+{
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    gl_Position = lightSpace * vec4(FragPos, 1.0);
+}
+)", R"(#version 330 core
+in vec3 FragPos;
+uniform vec3 lampPosition;
+uniform float lampRange;
+void main()
+{
+    gl_FragDepth = length(FragPos - lampPosition) / lampRange;
+}
+)");
+
+        cascades = createArray(true);
+        cascadeCache = createArray(false);
+        cube = createCube(true);
+        cubeCache = createCube(false);
+        glGenFramebuffers(2, framebuffers);
+        GLint previous;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+        for (unsigned int framebuffer : framebuffers)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, previous);
+        return true;
+    }
+
+    // direction the sunlight travels in
+    void SetSun(const glm::vec3& direction, const glm::vec3& color)
+    {
+        glm::vec3 normalized = glm::normalize(direction);
+        if (normalized != sunDirection)
+            staticVersion++;
+        sunDirection = normalized;
+        sunColor = color;
+    }
+
+    void SetLamp(const glm::vec3& position, const glm::vec3& color, float range)
+    {
+        if (position != lampPosition || range != lampRange)
+            cubeStale = true;
+        lampPosition = position;
+        lampColor = color;
+        lampRange = range;
+    }
+
+    // the static casters moved, every cached depth is stale
+    void InvalidateStatic()
+    {
+        staticVersion++;
+        cubeStale = true;
+    }
+
+    // renders the cascades for the camera's view (fovY in radians) and the lamp's cube; restores the framebuffer
+    // and viewport it found
+    void Render(const glm::mat4& view, float fovY, float aspect, float nearPlane, const DrawCasters& draw)
+    {
+        GLint target, viewport[4];
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glEnable(GL_DEPTH_TEST);
+        stats.Frames++;
+
+        placeCascades(view, fovY, aspect, nearPlane);
+        // casters between the sun and a cascade are flattened onto its near plane instead of being clipped
+        glEnable(GL_DEPTH_CLAMP);
+        directional.use();
+        glViewport(0, 0, Resolution, Resolution);
+        for (int c = 0; c < CASCADES; c++)
+        {
+            // pancaking keeps everything towards the sun, so the near plane must not cull casters either
+            Frustum frustum(cascadeMatrices[c]);
+            frustum.Planes[Frustum::PLANE_NEAR] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            directional.setMat4("lightSpace", cascadeMatrices[c]);
+            if (cachedMatrices[c] != cascadeMatrices[c] || cachedVersions[c] != staticVersion)
+            {
+                attachLayer(framebuffers[1], cascadeCache, c);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                stats.CascadeDraws[c] += draw(directional, true, frustum);
+                cachedMatrices[c] = cascadeMatrices[c];
+                cachedVersions[c] = staticVersion;
+                stats.CascadeStaticRenders[c]++;
+            }
+            attachLayer(framebuffers[1], cascadeCache, c);
+            attachLayer(framebuffers[0], cascades, c);
+            copyDepth(Resolution);
+            stats.CascadeDraws[c] += draw(directional, false, frustum);
+        }
+        glDisable(GL_DEPTH_CLAMP);
+
+        point.use();
+        point.setVec3("lampPosition", lampPosition);
+        point.setFloat("lampRange", lampRange);
+        glViewport(0, 0, CubeResolution, CubeResolution);
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.05f, lampRange);
+        const glm::vec3 directions[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+        const glm::vec3 ups[6] = { glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0) };
+        for (int face = 0; face < 6; face++)
+        {
+            glm::mat4 lightSpace = projection * glm::lookAt(lampPosition, lampPosition + directions[face], ups[face]);
+            Frustum frustum(lightSpace);
+            point.setMat4("lightSpace", lightSpace);
+            if (cubeStale)
+            {
+                attachFace(framebuffers[1], cubeCache, face);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                stats.CubeDraws += draw(point, true, frustum);
+            }
+            attachFace(framebuffers[1], cubeCache, face);
+            attachFace(framebuffers[0], cube, face);
+            copyDepth(CubeResolution);
+            stats.CubeDraws += draw(point, false, frustum);
+        }
+        if (cubeStale)
+            stats.CubeStaticRenders++;
+        cubeStale = false;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    // binds the maps to firstUnit and firstUnit + 1 and sets the uniforms of ShaderSource()
+    template <typename ShaderType>
+    void Bind(const ShaderType& shader, int firstUnit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + firstUnit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, cascades);
+        glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cube);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("shadowCascades", firstUnit);
+        shader.setInt("lampShadow", firstUnit + 1);
+        for (int c = 0; c < CASCADES; c++)
+        {
+            std::string index = "[" + std::to_string(c) + "]";
+            shader.setMat4("cascadeMatrices" + index, cascadeMatrices[c]);
+            shader.setFloat("cascadeFar" + index, cascadeFar[c]);
+            shader.setFloat("cascadeTexel" + index, cascadeTexel[c]);
+        }
+        shader.setVec3("sunDirection", sunDirection);
+        shader.setVec3("sunColor", sunColor);
+        shader.setVec3("lampPosition", lampPosition);
+        shader.setVec3("lampColor", lampColor);
+        shader.setFloat("lampRange", lampRange);
+    }
+
+    // GLSL after the #version line: vec3 extraLighting(position, normal, viewDir, shininess, viewDepth), the sun and
+    // the lamp with their shadows, 3x3 PCF on the cascades and a hardware compare on the cube
+    static const char* ShaderSource()
+    {
+        return R"(
+uniform sampler2DArrayShadow shadowCascades;
+uniform samplerCubeShadow lampShadow;
+uniform mat4 cascadeMatrices[4];
+uniform float cascadeFar[4];
+uniform float cascadeTexel[4];
+uniform vec3 sunDirection;
+uniform vec3 sunColor;
+uniform vec3 lampPosition;
+uniform vec3 lampColor;
+uniform float lampRange;
+
+float sunShadow(vec3 position, vec3 normal, float viewDepth)
+{
+    int cascade = 0;
+    while (cascade < 3 && viewDepth > cascadeFar[cascade])
+        cascade++;
+    if (viewDepth > cascadeFar[3])
+        return 1.0;
+    // pushing the lookup out along the normal by about a texel removes acne without a large depth bias
+    vec4 lightSpace = cascadeMatrices[cascade] * vec4(position + normal * cascadeTexel[cascade] * 1.5, 1.0);
+    vec3 coord = lightSpace.xyz / lightSpace.w * 0.5 + 0.5;
+    vec2 texel = 1.0 / vec2(textureSize(shadowCascades, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++)
+            lit += texture(shadowCascades, vec4(coord.xy + vec2(x, y) * texel, float(cascade), coord.z - 0.0005));
+    return lit / 9.0;
+}
+
+float lampVisibility(vec3 position, vec3 normal)
+{
+    vec3 fromLamp = position + normal * 0.02 - lampPosition;
+    return texture(lampShadow, vec4(fromLamp, length(fromLamp) / lampRange - 0.002));
+}
+
+vec3 extraLighting(vec3 position, vec3 normal, vec3 viewDir, float shininess, float viewDepth)
+{
+    vec3 toSun = -sunDirection;
+    float diffuse = max(dot(normal, toSun), 0.0);
+    float specular = pow(max(dot(normal, normalize(toSun + viewDir)), 0.0), shininess) * 0.5;
+    vec3 sun = sunColor * (diffuse + specular) * sunShadow(position, normal, viewDepth);
+
+    vec3 toLamp = lampPosition - position;
+    float distance = length(toLamp);
+    vec3 lampDir = toLamp / max(distance, 1e-4);
+    float window = clamp(1.0 - pow(distance / lampRange, 4.0), 0.0, 1.0);
+    float lampDiffuse = max(dot(normal, lampDir), 0.0);
+    float lampSpecular = pow(max(dot(normal, normalize(lampDir + viewDir)), 0.0), shininess) * 0.5;
+    vec3 lamp = lampColor * (lampDiffuse + lampSpecular) * window * window / (distance * distance + 1.0) * lampVisibility(position, normal);
+    return sun + lamp;
+}
+)";
+    }
+
+    ShadowStats Stats() const
+    {
+        return stats;
+    }
+
+private:
+    ShaderProgram directional, point;
+    unsigned int cascades = 0, cascadeCache = 0, cube = 0, cubeCache = 0;
+    unsigned int framebuffers[2] = {};  // the map being drawn and the cache it is copied from
+    glm::vec3 sunDirection = glm::vec3(0.0f, -1.0f, 0.0f), sunColor = glm::vec3(0.0f);
+    glm::vec3 lampPosition = glm::vec3(0.0f), lampColor = glm::vec3(0.0f);
+    float lampRange = 10.0f;
+    glm::mat4 cascadeMatrices[CASCADES], cachedMatrices[CASCADES];
+    float cascadeFar[CASCADES] = {}, cascadeTexel[CASCADES] = {};
+    unsigned int staticVersion = 1, cachedVersions[CASCADES] = {};
+    bool cubeStale = true;
+    ShadowStats stats;
+
+    unsigned int createArray(bool compare)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, Resolution, Resolution, CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        setParameters(GL_TEXTURE_2D_ARRAY, compare);
+        // outside a cascade counts as lit
+        const float border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return texture;
+    }
+
+    unsigned int createCube(bool compare)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        for (int face = 0; face < 6; face++)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT32F, CubeResolution, CubeResolution, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        setParameters(GL_TEXTURE_CUBE_MAP, compare);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        return texture;
+    }
+
+    // the maps that are sampled compare in hardware with bilinear filtering, the caches are only copied from
+    static void setParameters(GLenum target, bool compare)
+    {
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+        if (compare)
+        {
+            glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+    }
+
+    void attachLayer(unsigned int framebuffer, unsigned int texture, int layer)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+    }
+
+    void attachFace(unsigned int framebuffer, unsigned int texture, int face)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, texture, 0);
+    }
+
+    // cache (framebuffers[1]) into the map (framebuffers[0]), leaving the map bound for the dynamic casters
+    void copyDepth(int size)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[1]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[0]);
+        glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[0]);
+    }
+
+    void placeCascades(const glm::mat4& view, float fovY, float aspect, float nearPlane)
+    {
+        glm::mat4 inverseView = glm::inverse(view);
+        float tanY = std::tan(fovY * 0.5f), tanX = tanY * aspect;
+        // a fixed rotation per sun direction, so snapping in its x and y is snapping to texels
+        glm::vec3 up = std::abs(sunDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), sunDirection, up);
+
+        float sliceNear = nearPlane;
+        for (int c = 0; c < CASCADES; c++)
+        {
+            float t = (float)(c + 1) / CASCADES;
+            float sliceFar = SplitLambda * nearPlane * std::pow(ShadowDistance / nearPlane, t) + (1.0f - SplitLambda) * (nearPlane + (ShadowDistance - nearPlane) * t);
+
+            // bounding sphere of the slice: its radius depends only on the slice, not on where the camera looks
+            glm::vec3 corners[8];
+            glm::vec3 center(0.0f);
+            for (int k = 0; k < 8; k++)
+            {
+                float depth = k & 4 ? sliceFar : sliceNear;
+                glm::vec4 corner(((k & 1) ? 1.0f : -1.0f) * tanX * depth, ((k & 2) ? 1.0f : -1.0f) * tanY * depth, -depth, 1.0f);
+                corners[k] = glm::vec3(inverseView * corner);
+                center += corners[k] / 8.0f;
+            }
+            float radius = 0.0f;
+            for (const glm::vec3& corner : corners)
+                radius = std::max(radius, glm::length(corner - center));
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+
+            float texel = 2.0f * radius / Resolution;
+            glm::vec3 snapped = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+            snapped.x = std::floor(snapped.x / texel) * texel;
+            snapped.y = std::floor(snapped.y / texel) * texel;
+            // depth moves in coarse steps as well, with enough room in front and behind to cover them
+            float depthStep = radius * 0.5f;
+            snapped.z = std::floor(snapped.z / depthStep) * depthStep;
+            glm::mat4 projection = glm::ortho(snapped.x - radius, snapped.x + radius, snapped.y - radius, snapped.y + radius,
+                                              -(snapped.z + 2.0f * radius + depthStep), -(snapped.z - radius - depthStep));
+            cascadeMatrices[c] = projection * lightRotation;
+            cascadeFar[c] = sliceFar;
+            cascadeTexel[c] = texel;
+            sliceNear = sliceFar;
+        }
+    }
+};
+#endif
@@ -0,0 +1,463 @@
+#ifndef SOFT_RASTERIZER_H
+#define SOFT_RASTERIZER_H
+
+#include <glm/glm.hpp>
+
+#include <job_system.h>
+#include <png_writer.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFT_RASTERIZER_SSE2
+#endif
+
+// RGBA8 texture with a box filtered mip chain, sampled like GL_REPEAT + GL_LINEAR_MIPMAP_LINEAR.
+// Row 0 is the bottom of the image, as after stbi_set_flip_vertically_on_load(true).
+class SoftTexture
+{
+public:
+    std::vector<std::vector<unsigned char>> Levels;
+    std::vector<int> Widths, Heights;
+
+    SoftTexture() {}
+
+    // channels is 3 or 4, missing alpha is filled with 255
+    SoftTexture(int width, int height, int channels, const unsigned char* pixels)
+    {
+        std::vector<unsigned char> level((std::size_t)width * height * 4);
+        for (int i = 0; i < width * height; i++)
+        {
+            for (int c = 0; c < 3; c++)
+                level[i * 4 + c] = pixels[i * channels + c];
+            level[i * 4 + 3] = channels == 4 ? pixels[i * 4 + 3] : 255;
+        }
+        Levels.push_back(level);
+        Widths.push_back(width);
+        Heights.push_back(height);
+        while (width > 1 || height > 1)
+        {
+            int w = std::max(1, width / 2), h = std::max(1, height / 2);
+            const std::vector<unsigned char>& src = Levels.back();
+            std::vector<unsigned char> dst((std::size_t)w * h * 4);
+            for (int y = 0; y < h; y++)
+                for (int x = 0; x < w; x++)
+                    for (int c = 0; c < 4; c++)
+                    {
+                        int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+                        int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+                        int sum = src[(y0 * width + x0) * 4 + c] + src[(y0 * width + x1) * 4 + c] + src[(y1 * width + x0) * 4 + c] + src[(y1 * width + x1) * 4 + c];
+                        dst[(y * w + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                    }
+            Levels.push_back(dst);
+            Widths.push_back(w);
+            Heights.push_back(h);
+            width = w;
+            height = h;
+        }
+    }
+
+    // trilinear sample, the mip level comes from the screen space derivatives of uv
+    glm::vec4 Sample(const glm::vec2& uv, const glm::vec2& dUVdx, const glm::vec2& dUVdy) const
+    {
+        glm::vec2 size((float)Widths[0], (float)Heights[0]);
+        float rho = std::max(glm::length(dUVdx * size), glm::length(dUVdy * size));
+        float lod = rho > 1.0f ? std::log2(rho) : 0.0f;
+        return SampleLevel(uv, lod);
+    }
+
+    glm::vec4 SampleLevel(const glm::vec2& uv, float lod) const
+    {
+        lod = std::min(std::max(lod, 0.0f), (float)(Levels.size() - 1));
+        int level = (int)lod;
+        float t = lod - level;
+        glm::vec4 color = bilinear(uv, level);
+        if (t > 0.0f && level + 1 < (int)Levels.size())
+            color = glm::mix(color, bilinear(uv, level + 1), t);
+        return color;
+    }
+
+private:
+    glm::vec4 texel(int level, int x, int y) const
+    {
+        int w = Widths[level], h = Heights[level];
+        x = ((x % w) + w) % w;
+        y = ((y % h) + h) % h;
+        const unsigned char* p = &Levels[level][((std::size_t)y * w + x) * 4];
+        return glm::vec4(p[0], p[1], p[2], p[3]) * (1.0f / 255.0f);
+    }
+
+    glm::vec4 bilinear(const glm::vec2& uv, int level) const
+    {
+        float x = uv.x * Widths[level] - 0.5f;
+        float y = uv.y * Heights[level] - 0.5f;
+        float fx = std::floor(x), fy = std::floor(y);
+        int ix = (int)fx, iy = (int)fy;
+        float tx = x - fx, ty = y - fy;
+        glm::vec4 bottom = glm::mix(texel(level, ix, iy), texel(level, ix + 1, iy), tx);
+        glm::vec4 top = glm::mix(texel(level, ix, iy + 1), texel(level, ix + 1, iy + 1), tx);
+        return glm::mix(bottom, top, ty);
+    }
+};
+
+// what a fragment callback gets, the software counterpart of the GLSL fragment stage inputs
+struct SoftFragment
+{
+    const float* Varyings; // perspective correct, in the order the vertex callback wrote them
+    const float* DDX;      // screen space derivatives of every varying, only when the program asks for them
+    const float* DDY;
+    glm::vec2 FragCoord;   // pixel center, origin at the top left
+    float Depth;
+};
+
+// the clipper keeps its polygon on the stack, so a program's varyings are bounded
+const unsigned int MAX_VARYINGS = 64;
+
+// C++ callbacks standing in for a GLSL program: Vertex returns gl_Position and writes Varyings floats,
+// Fragment returns FragColor
+struct SoftProgram
+{
+    unsigned int Varyings = 0; // at most MAX_VARYINGS floats
+    bool Derivatives = false;
+    std::function<glm::vec4(const float* vertex, float* varyings)> Vertex;
+    std::function<glm::vec4(const SoftFragment& fragment)> Fragment;
+};
+
+// Multithreaded software rasterizer implementing the subset of OpenGL the samples use: triangle lists (indexed
+// or not), near plane clipping, a GL_LESS depth test, perspective correct varyings and RGBA8 output.
+// Each draw runs the vertex callbacks in parallel, sets up and bins triangles into 32x32 pixel tiles in
+// submission order, then shades tiles in parallel, testing 4 pixels at a time with SSE edge functions.
+class SoftRasterizer
+{
+public:
+    static const int TILE_SIZE = 32;
+
+    int Width, Height;
+    std::vector<unsigned char> Color; // RGBA8, row 0 at the top (PNG order)
+    std::vector<float> Depth;         // window depth in [0, 1]
+
+    SoftRasterizer(int width, int height, JobSystem* jobs = nullptr) : Width(width), Height(height), jobs(jobs)
+    {
+        tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+        tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+        Color.assign((std::size_t)width * height * 4, 0);
+        Depth.assign((std::size_t)width * height, 1.0f);
+        bins.resize(tilesX * tilesY);
+    }
+
+    // glClearColor + glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT)
+    void Clear(const glm::vec4& color)
+    {
+        unsigned char rgba[4];
+        pack(color, rgba);
+        for (std::size_t i = 0; i < Color.size(); i += 4)
+            std::copy(rgba, rgba + 4, &Color[i]);
+        std::fill(Depth.begin(), Depth.end(), 1.0f);
+    }
+
+    // glDrawArrays(GL_TRIANGLES, first, count); vertices are stride floats apart
+    void Draw(const SoftProgram& program, const float* vertices, unsigned int stride, unsigned int first, unsigned int count)
+    {
+        std::vector<unsigned int> indices(count);
+        for (unsigned int i = 0; i < count; i++)
+            indices[i] = first + i;
+        DrawElements(program, vertices, stride, indices.data(), count);
+    }
+
+    // glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, indices)
+    void DrawElements(const SoftProgram& program, const float* vertices, unsigned int stride, const unsigned int* indices, unsigned int count)
+    {
+        // vertex stage, every referenced vertex once: clip position followed by its varyings
+        unsigned int vertexCount = 0;
+        for (unsigned int i = 0; i < count; i++)
+            vertexCount = std::max(vertexCount, indices[i] + 1);
+        assert(program.Varyings <= MAX_VARYINGS && "more varyings than the clipper has room for");
+        unsigned int outStride = 4 + program.Varyings;
+        std::vector<float> shaded((std::size_t)vertexCount * outStride);
+        parallelFor(vertexCount, 256, [&](unsigned int begin, unsigned int end)
+        {
+            for (unsigned int v = begin; v < end; v++)
+            {
+                float* out = &shaded[(std::size_t)v * outStride];
+                glm::vec4 position = program.Vertex(vertices + (std::size_t)v * stride, out + 4);
+                out[0] = position.x; out[1] = position.y; out[2] = position.z; out[3] = position.w;
+            }
+        });
+
+        // primitive assembly, clipping, setup and binning keep submission order
+        varyings = program.Varyings;
+        triangles.clear();
+        triangleVaryings.clear();
+        for (std::vector<unsigned int>& bin : bins)
+            bin.clear();
+        for (unsigned int i = 0; i + 2 < count; i += 3)
+        {
+            const float* v[3] = { &shaded[(std::size_t)indices[i] * outStride], &shaded[(std::size_t)indices[i + 1] * outStride], &shaded[(std::size_t)indices[i + 2] * outStride] };
+            clipAndSetup(v);
+        }
+
+        // fragment stage, one tile per job so that no two threads write the same pixel
+        parallelFor(tilesX * tilesY, 1, [&](unsigned int begin, unsigned int end)
+        {
+            std::vector<float> scratch(3 * varyings);
+            for (unsigned int t = begin; t < end; t++)
+                rasterizeTile(program, t, scratch.data());
+        });
+    }
+
+    bool WritePNG(const char* path) const
+    {
+        return PNGWriter::Write(path, Width, Height, 4, Color.data());
+    }
+
+private:
+    // screen space triangle: edge functions value(x, y) = A * x + B * y + C, positive inside
+    struct Triangle
+    {
+        float A[3], B[3], C[3];
+        bool TopLeft[3];
+        float InvArea;
+        float Z[3];    // window depth per vertex (linear in screen space)
+        float InvW[3]; // 1 / w per vertex
+        int MinX, MinY, MaxX, MaxY;
+        unsigned int Varyings; // offset in triangleVaryings of the 3 vertices' varyings, pre-divided by w
+    };
+
+    JobSystem* jobs;
+    int tilesX, tilesY;
+    unsigned int varyings = 0;
+    std::vector<Triangle> triangles;
+    std::vector<float> triangleVaryings;
+    std::vector<std::vector<unsigned int>> bins;
+
+    static void pack(const glm::vec4& color, unsigned char* out)
+    {
+        for (int c = 0; c < 4; c++)
+            out[c] = (unsigned char)(std::min(std::max(color[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+
+    void parallelFor(unsigned int count, unsigned int grain, const std::function<void(unsigned int, unsigned int)>& fn)
+    {
+        if (jobs)
+            jobs->ParallelFor(count, grain, fn);
+        else
+            fn(0, count);
+    }
+
+    // Sutherland-Hodgman against the near plane (z >= -w), the other planes are handled by the screen bounds
+    void clipAndSetup(const float* const* v)
+    {
+        unsigned int stride = 4 + varyings;
+        float polygon[4][4 + MAX_VARYINGS];
+        const float* in[4];
+        int count = 0;
+        bool clipped = false;
+        for (int k = 0; k < 3; k++)
+        {
+            const float* a = v[k];
+            const float* b = v[(k + 1) % 3];
+            float da = a[2] + a[3], db = b[2] + b[3];
+            if (da >= 0.0f)
+                in[count++] = a;
+            else
+                clipped = true;
+            if ((da >= 0.0f) != (db >= 0.0f))
+            {
+                float t = da / (da - db);
+                for (unsigned int c = 0; c < stride; c++)
+                    polygon[count][c] = a[c] + (b[c] - a[c]) * t;
+                in[count] = polygon[count];
+                count++;
+            }
+        }
+        if (!clipped)
+        {
+            setup(v[0], v[1], v[2]);
+            return;
+        }
+        for (int k = 1; k + 1 < count; k++)
+            setup(in[0], in[k], in[k + 1]);
+    }
+
+    void setup(const float* v0, const float* v1, const float* v2)
+    {
+        const float* v[3] = { v0, v1, v2 };
+        glm::vec3 screen[3];
+        float invW[3];
+        for (int k = 0; k < 3; k++)
+        {
+            if (v[k][3] <= 1e-6f)
+                return;
+            invW[k] = 1.0f / v[k][3];
+            screen[k] = glm::vec3((v[k][0] * invW[k] * 0.5f + 0.5f) * Width,
+                                  (0.5f - v[k][1] * invW[k] * 0.5f) * Height,
+                                  v[k][2] * invW[k] * 0.5f + 0.5f);
+        }
+        // no face culling, like the samples; flip clockwise triangles so the edge functions are positive inside
+        float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+        if (area == 0.0f || std::isnan(area))
+            return;
+        int order[3] = { 0, 1, 2 };
+        if (area < 0.0f)
+        {
+            std::swap(order[1], order[2]);
+            area = -area;
+        }
+
+        Triangle t;
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+        for (int k = 0; k < 3; k++)
+        {
+            const glm::vec3& a = screen[order[k]];
+            const glm::vec3& b = screen[order[(k + 1) % 3]];
+            t.A[k] = -(b.y - a.y);
+            t.B[k] = b.x - a.x;
+            t.C[k] = -(t.A[k] * a.x + t.B[k] * a.y);
+            // y grows downwards: top edges are horizontal going left, left edges go down
+            t.TopLeft[k] = (a.y == b.y && b.x < a.x) || (b.y > a.y);
+            t.Z[k] = screen[order[k]].z;
+            t.InvW[k] = invW[order[k]];
+            minX = std::min(minX, a.x); maxX = std::max(maxX, a.x);
+            minY = std::min(minY, a.y); maxY = std::max(maxY, a.y);
+        }
+        if (maxX < 0.0f || maxY < 0.0f || minX >= (float)Width || minY >= (float)Height)
+            return;
+        t.MinX = (int)std::max(minX, 0.0f);
+        t.MinY = (int)std::max(minY, 0.0f);
+        t.MaxX = (int)std::min(maxX, (float)Width - 1.0f);
+        t.MaxY = (int)std::min(maxY, (float)Height - 1.0f);
+        t.InvArea = 1.0f / area;
+        t.Varyings = (unsigned int)triangleVaryings.size();
+        for (int k = 0; k < 3; k++)
+            for (unsigned int c = 0; c < varyings; c++)
+                triangleVaryings.push_back(v[order[k]][4 + c] * invW[order[k]]);
+
+        unsigned int index = (unsigned int)triangles.size();
+        triangles.push_back(t);
+        for (int ty = t.MinY / TILE_SIZE; ty <= t.MaxY / TILE_SIZE; ty++)
+            for (int tx = t.MinX / TILE_SIZE; tx <= t.MaxX / TILE_SIZE; tx++)
+                bins[ty * tilesX + tx].push_back(index);
+    }
+
+    // perspective correct varyings at (px, py), weights come from the edge functions
+    void interpolate(const Triangle& t, float px, float py, float* out) const
+    {
+        // the edge opposite vertex k starts at vertex k + 1
+        float w0 = (t.A[1] * px + t.B[1] * py + t.C[1]) * t.InvArea;
+        float w1 = (t.A[2] * px + t.B[2] * py + t.C[2]) * t.InvArea;
+        float w2 = 1.0f - w0 - w1;
+        float invW = w0 * t.InvW[0] + w1 * t.InvW[1] + w2 * t.InvW[2];
+        float w = 1.0f / invW;
+        const float* a = triangleVaryings.data() + t.Varyings;
+        const float* b = a + varyings;
+        const float* c = b + varyings;
+        for (unsigned int i = 0; i < varyings; i++)
+            out[i] = (w0 * a[i] + w1 * b[i] + w2 * c[i]) * w;
+    }
+
+    void shade(const SoftProgram& program, const Triangle& t, int x, int y, float depth, float* scratch)
+    {
+        float px = x + 0.5f, py = y + 0.5f;
+        SoftFragment fragment;
+        fragment.FragCoord = glm::vec2(px, py);
+        fragment.Depth = depth;
+        interpolate(t, px, py, scratch);
+        fragment.Varyings = scratch;
+        fragment.DDX = fragment.DDY = nullptr;
+        if (program.Derivatives)
+        {
+            // forward differences, like the coarse derivatives of a 2x2 quad
+            float* dx = scratch + varyings;
+            float* dy = dx + varyings;
+            interpolate(t, px + 1.0f, py, dx);
+            interpolate(t, px, py + 1.0f, dy);
+            for (unsigned int i = 0; i < varyings; i++)
+            {
+                dx[i] -= scratch[i];
+                dy[i] -= scratch[i];
+            }
+            fragment.DDX = dx;
+            fragment.DDY = dy;
+        }
+        pack(program.Fragment(fragment), &Color[((std::size_t)y * Width + x) * 4]);
+    }
+
+    void rasterizeTile(const SoftProgram& program, unsigned int tile, float* scratch)
+    {
+        int tileX0 = (tile % tilesX) * TILE_SIZE, tileY0 = (tile / tilesX) * TILE_SIZE;
+        int tileX1 = std::min(tileX0 + TILE_SIZE, Width) - 1, tileY1 = std::min(tileY0 + TILE_SIZE, Height) - 1;
+        for (unsigned int index : bins[tile])
+        {
+            const Triangle& t = triangles[index];
+            int x0 = std::max(t.MinX, tileX0), x1 = std::min(t.MaxX, tileX1);
+            int y0 = std::max(t.MinY, tileY0), y1 = std::min(t.MaxY, tileY1);
+            // depth is affine in screen space: z = zA * x + zB * y + zC
+            float zA = (t.A[1] * t.Z[0] + t.A[2] * t.Z[1] + t.A[0] * t.Z[2]) * t.InvArea;
+            float zB = (t.B[1] * t.Z[0] + t.B[2] * t.Z[1] + t.B[0] * t.Z[2]) * t.InvArea;
+            float zC = (t.C[1] * t.Z[0] + t.C[2] * t.Z[1] + t.C[0] * t.Z[2]) * t.InvArea;
+            for (int y = y0; y <= y1; y++)
+            {
+                float py = y + 0.5f;
+                float* depthRow = &Depth[(std::size_t)y * Width];
+                int x = x0;
+#ifdef SOFT_RASTERIZER_SSE2
+                __m128 rowE[3], edgeA[3], bias[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    rowE[k] = _mm_set1_ps(t.B[k] * py + t.C[k]);
+                    edgeA[k] = _mm_set1_ps(t.A[k]);
+                    // top-left rule: pixels exactly on an edge belong to the triangle only on top and left edges
+                    bias[k] = t.TopLeft[k] ? _mm_setzero_ps() : _mm_set1_ps(-1.0f);
+                }
+                __m128 rowZ = _mm_set1_ps(zB * py + zC);
+                for (; x + 3 <= x1; x += 4)
+                {
+                    __m128 px = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+                    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                    for (int k = 0; k < 3; k++)
+                    {
+                        __m128 e = _mm_add_ps(_mm_mul_ps(edgeA[k], px), rowE[k]);
+                        __m128 on = _mm_and_ps(_mm_cmpeq_ps(e, _mm_setzero_ps()), _mm_cmpeq_ps(bias[k], _mm_setzero_ps()));
+                        inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(e, _mm_setzero_ps()), on));
+                    }
+                    __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px), rowZ);
+                    __m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, _mm_loadu_ps(depthRow + x)));
+                    int mask = _mm_movemask_ps(pass);
+                    if (mask == 0)
+                        continue;
+                    float zs[4];
+                    _mm_storeu_ps(zs, z);
+                    for (int lane = 0; lane < 4; lane++)
+                    {
+                        if ((mask & (1 << lane)) == 0)
+                            continue;
+                        depthRow[x + lane] = zs[lane];
+                        shade(program, t, x + lane, y, zs[lane], scratch);
+                    }
+                }
+#endif
+                for (; x <= x1; x++)
+                {
+                    float px = x + 0.5f;
+                    bool inside = true;
+                    for (int k = 0; k < 3 && inside; k++)
+                    {
+                        float e = t.A[k] * px + t.B[k] * py + t.C[k];
+                        inside = e > 0.0f || (e == 0.0f && t.TopLeft[k]);
+                    }
+                    float z = zA * px + zB * py + zC;
+                    if (!inside || z >= depthRow[x])
+                        continue;
+                    depthRow[x] = z;
+                    shade(program, t, x, y, z, scratch);
+                }
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,94 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free ring buffer for exactly one producer thread and one consumer thread, e.g. GLFW callbacks on the main
+// thread feeding a simulation that may run on a worker. Each side owns one index and only reads the other's; each also
+// keeps a cached copy of the other index, so the shared cache line is only touched when the ring looks full or empty.
+// Capacity is rounded up to a power of two; the ring holds one element less than that.
+template <typename T>
+class SPSCQueue
+{
+public:
+    explicit SPSCQueue(std::size_t capacity = 1024)
+    {
+        std::size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        items.resize(size);
+        mask = size - 1;
+    }
+
+    // producer side; returns false (and drops the item, counting it) when the ring is full
+    bool TryPush(const T& item)
+    {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        std::size_t next = (t + 1) & mask;
+        if (next == cachedHead)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (next == cachedHead)
+            {
+                dropped++;
+                return false;
+            }
+        }
+        items[t] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side: the oldest item, or nullptr when the ring is empty; it stays valid until Pop()
+    const T* Front()
+    {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == cachedTail)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h == cachedTail)
+                return nullptr;
+        }
+        return &items[h];
+    }
+
+    // consumer side; only after Front() returned an item
+    void Pop()
+    {
+        head.store((head.load(std::memory_order_relaxed) + 1) & mask, std::memory_order_release);
+    }
+
+    bool TryPop(T& item)
+    {
+        const T* front = Front();
+        if (!front)
+            return false;
+        item = *front;
+        Pop();
+        return true;
+    }
+
+    std::size_t Capacity() const
+    {
+        return mask;
+    }
+
+    // producer side: items TryPush() dropped so far
+    std::size_t Dropped() const
+    {
+        return dropped;
+    }
+
+private:
+    std::vector<T> items;
+    std::size_t mask = 0;
+    // the two sides on separate cache lines, each with its cached view of the other
+    alignas(64) std::atomic<std::size_t> head{ 0 };
+    std::size_t cachedTail = 0;
+    alignas(64) std::atomic<std::size_t> tail{ 0 };
+    std::size_t cachedHead = 0;
+    std::size_t dropped = 0;
+};
+#endif